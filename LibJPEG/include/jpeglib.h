@@ -883,6 +883,11 @@ EXTERN(int) jpeg_consume_input JPP((j_decompress_ptr cinfo));
 EXTERN(void) jpeg_core_output_dimensions JPP((j_decompress_ptr cinfo));
 EXTERN(void) jpeg_calc_output_dimensions JPP((j_decompress_ptr cinfo));
 
+#ifdef HUFF_FAST_SUPPORTED
+/* Combined lookahead Huffman decode, the default, or the classic one, from the next jpeg_start_decompress. */
+EXTERN(void) jpeg_huff_fast JPP((boolean enable));
+#endif
+
 /* Control saving of COM and APPn markers into marker_list. */
 EXTERN(void) jpeg_save_markers JPP((j_decompress_ptr cinfo, int marker_code, unsigned int length_limit));
 
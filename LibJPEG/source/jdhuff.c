@@ -14,6 +14,12 @@
  * up to the start of the current MCU.  To do this, we copy state variables
  * into local working storage, and update them back to the permanent
  * storage only upon successful completion of an MCU.
+ *
+ * HUFF_FAST_SUPPORTED adds a combined code and value lookahead of
+ * HUFF_FAST_BITS for sequential full size blocks, a small coefficient's
+ * magnitude bits come out of the same lookup as its code, and a 64 bit
+ * bit buffer refilled 8 bytes at a time.  jpeg_huff_fast(FALSE) selects
+ * the classic decode for comparison; the coefficients are the same.
  */
 
 #define JPEG_INTERNALS
@@ -25,6 +31,23 @@
 
 #define HUFF_LOOKAHEAD	8	/* # of bits of lookahead */
 
+#ifdef HUFF_FAST_SUPPORTED
+#define HUFF_FAST_BITS	9	/* # of bits of combined lookahead */
+/* 9 bits, 2K per table, keeps four tables inside the dtcm small pool */
+
+/* look_fast entry: # bits used in the low 5 bits, FAST_MORE if the
+ * coefficient's magnitude bits are still to be read, the symbol in
+ * bits 8..15, the extended coefficient value in bits 16..31.
+ * 0 if the code is too long.
+ */
+#define FAST_MORE	0x20
+#define FAST_NBITS(entry)	((entry) & 0x1F)
+#define FAST_SYM(entry)	(((entry) >> 8) & 0xFF)
+#define FAST_VALUE(entry)	((entry) >> 16)
+
+static boolean huff_fast = TRUE;	/* jpeg_huff_fast() */
+#endif
+
 typedef struct {
   /* Basic tables: (element [0] of each array is unused) */
   INT32 maxcode[18];		/* largest code of length k (-1 if none) */
@@ -45,6 +68,13 @@ typedef struct {
    */
   int look_nbits[1<<HUFF_LOOKAHEAD]; /* # bits, or 0 if too long */
   UINT8 look_sym[1<<HUFF_LOOKAHEAD]; /* symbol, or unused */
+
+#ifdef HUFF_FAST_SUPPORTED
+  /* Combined lookahead: indexed by the next HUFF_FAST_BITS bits, the
+   * code's symbol and, if they fit too, its magnitude bits extended.
+   */
+  int look_fast[1<<HUFF_FAST_BITS];
+#endif
 } d_derived_tbl;
 
 
@@ -66,8 +96,13 @@ typedef struct {
  * necessary.
  */
 
+#ifdef HUFF_FAST_SUPPORTED
+typedef unsigned long long bit_buf_type; /* 64 bits on 32 bit targets too */
+#define BIT_BUF_SIZE  64	/* size of buffer in bits */
+#else
 typedef INT32 bit_buf_type;	/* type of bit-extraction buffer */
 #define BIT_BUF_SIZE  32	/* size of buffer in bits */
+#endif
 
 /* If long is > 32 bits on your machine, and shifting/masking longs is
  * reasonably fast, making bit_buf_type be long and setting BIT_BUF_SIZE
@@ -187,6 +222,29 @@ slowlabel: \
   } \
 }
 
+#ifdef HUFF_FAST_SUPPORTED
+/*
+ * HUFF_DECODE_FAST leaves a look_fast style entry in result, its bits
+ * already dropped.  Codes longer than HUFF_FAST_BITS, and too few bits
+ * left before a marker, take HUFF_DECODE as before.
+ */
+
+#define HUFF_DECODE_FAST(result,state,htbl,failaction,slowlabel) \
+{ register int sym; \
+  if (bits_left < HUFF_FAST_BITS) { \
+    if (! jpeg_fill_bit_buffer(&state,get_buffer,bits_left, 0)) {failaction;} \
+    get_buffer = state.get_buffer; bits_left = state.bits_left; \
+  } \
+  if (bits_left >= HUFF_FAST_BITS && \
+      (result = htbl->look_fast[PEEK_BITS(HUFF_FAST_BITS)]) != 0) { \
+    DROP_BITS(FAST_NBITS(result)); \
+  } else { \
+    HUFF_DECODE(sym, state, htbl, failaction, slowlabel); \
+    result = (sym << 8) | ((sym & 15) ? FAST_MORE : 0); \
+  } \
+}
+#endif
+
 
 /*
  * Expanded entropy decoder object for Huffman decoding.
@@ -424,6 +482,35 @@ jpeg_make_d_derived_tbl (j_decompress_ptr cinfo, boolean isDC, int tblno,
     }
   }
 
+#ifdef HUFF_FAST_SUPPORTED
+  /* Same again HUFF_FAST_BITS wide, the bits after a code are its
+   * magnitude bits, extended here when they fit as well (Figure F.12).
+   */
+
+  if (huff_fast) {
+    MEMZERO(dtbl->look_fast, SIZEOF(dtbl->look_fast));
+
+    p = 0;
+    for (l = 1; l <= HUFF_FAST_BITS; l++) {
+      for (i = 1; i <= (int) htbl->bits[l]; i++, p++) {
+	int sym = htbl->huffval[p];
+	int s = sym & 15;
+	lookbits = huffcode[p] << (HUFF_FAST_BITS-l);
+	for (ctr = 0; ctr < (1 << (HUFF_FAST_BITS-l)); ctr++) {
+	  int entry = l;
+	  if (s && l + s <= HUFF_FAST_BITS) {
+	    int r = (ctr >> (HUFF_FAST_BITS-l-s)) & ((1 << s) - 1);
+	    int v = r < (1 << (s-1)) ? r - ((1 << s) - 1) : r;
+	    entry = (int) ((unsigned int) v << 16) | (l + s);
+	  } else if (s)
+	    entry |= FAST_MORE;
+	  dtbl->look_fast[lookbits + ctr] = entry | (sym << 8);
+	}
+      }
+    }
+  }
+#endif
+
   /* Validate symbols as being reasonable.
    * For AC tables, we make no check, but accept all byte values 0..255.
    * For DC tables, we require the symbols to be in range 0..15.
@@ -477,6 +564,25 @@ jpeg_fill_bit_buffer (bitread_working_state * state,
   /* We fail to do so only if we hit a marker or are forced to suspend. */
 
   if (cinfo->unread_marker == 0) {	/* cannot advance past a marker */
+#ifdef HUFF_FAST_SUPPORTED
+    /* 8 bytes without an FF, no stuffing or marker in them, fill from
+     * them in one go; anything else takes the byte loop below.
+     */
+    if (huff_fast && bytes_in_buffer >= 8 && bits_left < MIN_GET_BITS) {
+      bit_buf_type word = 0;
+      int i;
+      for (i = 0; i < 8; i++)
+	word = (word << 8) | GETJOCTET(next_input_byte[i]);
+      if (((~word - 0x0101010101010101ULL) & word & 0x8080808080808080ULL) == 0) {
+	int nbytes = (BIT_BUF_SIZE - bits_left) >> 3;
+	get_buffer = nbytes == 8 ? word :
+	  (get_buffer << (nbytes << 3)) | (word >> (BIT_BUF_SIZE - (nbytes << 3)));
+	bits_left += nbytes << 3;
+	next_input_byte += nbytes;
+	bytes_in_buffer -= nbytes;
+      }
+    }
+#endif
     while (bits_left < MIN_GET_BITS) {
       register int c;
 
@@ -1302,6 +1408,140 @@ decode_mcu (j_decompress_ptr cinfo, JBLOCKROW *MCU_data)
 }
 
 
+#ifdef HUFF_FAST_SUPPORTED
+
+/*
+ * decode_mcu with the combined lookahead, full-size blocks.
+ */
+
+METHODDEF(boolean)
+decode_mcu_fast (j_decompress_ptr cinfo, JBLOCKROW *MCU_data)
+{
+  huff_entropy_ptr entropy = (huff_entropy_ptr) cinfo->entropy;
+  int blkn;
+  BITREAD_STATE_VARS;
+  savable_state state;
+
+  /* Process restart marker if needed; may have to suspend */
+  if (cinfo->restart_interval) {
+    if (entropy->restarts_to_go == 0)
+      if (! process_restart(cinfo))
+	return FALSE;
+  }
+
+  /* If we've run out of data, just leave the MCU set to zeroes.
+   * This way, we return uniform gray for the remainder of the segment.
+   */
+  if (! entropy->insufficient_data) {
+
+    /* Load up working state */
+    BITREAD_LOAD_STATE(cinfo,entropy->bitstate);
+    ASSIGN_STATE(state, entropy->saved);
+
+    /* Outer loop handles each block in the MCU */
+
+    for (blkn = 0; blkn < cinfo->blocks_in_MCU; blkn++) {
+      JBLOCKROW block = MCU_data[blkn];
+      d_derived_tbl * htbl;
+      register int s, k, r, entry;
+      int coef_limit, ci;
+
+      /* Section F.2.2.1: decode the DC coefficient difference */
+      htbl = entropy->dc_cur_tbls[blkn];
+      HUFF_DECODE_FAST(entry, br_state, htbl, return FALSE, label1);
+      s = FAST_SYM(entry);
+
+      htbl = entropy->ac_cur_tbls[blkn];
+      k = 1;
+      coef_limit = entropy->coef_limit[blkn];
+      if (coef_limit) {
+	/* Convert DC difference to actual value, update last_dc_val */
+	if (entry & FAST_MORE) {
+	  CHECK_BIT_BUFFER(br_state, s, return FALSE);
+	  r = GET_BITS(s);
+	  s = HUFF_EXTEND(r, s);
+	} else
+	  s = FAST_VALUE(entry);
+	ci = cinfo->MCU_membership[blkn];
+	s += state.last_dc_val[ci];
+	state.last_dc_val[ci] = s;
+	/* Output the DC coefficient */
+	(*block)[0] = (JCOEF) s;
+
+	/* Section F.2.2.2: decode the AC coefficients */
+	/* Since zeroes are skipped, output area must be cleared beforehand */
+	for (; k < coef_limit; k++) {
+	  HUFF_DECODE_FAST(entry, br_state, htbl, return FALSE, label2);
+
+	  s = FAST_SYM(entry);
+	  r = s >> 4;
+	  s &= 15;
+
+	  if (s) {
+	    k += r;
+	    if (entry & FAST_MORE) {
+	      CHECK_BIT_BUFFER(br_state, s, return FALSE);
+	      r = GET_BITS(s);
+	      s = HUFF_EXTEND(r, s);
+	    } else
+	      s = FAST_VALUE(entry);
+	    /* Output coefficient in natural (dezigzagged) order.
+	     * Note: the extra entries in jpeg_natural_order[] will save us
+	     * if k >= DCTSIZE2, which could happen if the data is corrupted.
+	     */
+	    (*block)[jpeg_natural_order[k]] = (JCOEF) s;
+	  } else {
+	    if (r != 15)
+	      goto EndOfBlock;
+	    k += 15;
+	  }
+	}
+      } else {
+	if (entry & FAST_MORE) {
+	  CHECK_BIT_BUFFER(br_state, s, return FALSE);
+	  DROP_BITS(s);
+	}
+      }
+
+      /* Section F.2.2.2: decode the AC coefficients */
+      /* In this path we just discard the values */
+      for (; k < DCTSIZE2; k++) {
+	HUFF_DECODE_FAST(entry, br_state, htbl, return FALSE, label3);
+
+	s = FAST_SYM(entry);
+	r = s >> 4;
+	s &= 15;
+
+	if (s) {
+	  k += r;
+	  if (entry & FAST_MORE) {
+	    CHECK_BIT_BUFFER(br_state, s, return FALSE);
+	    DROP_BITS(s);
+	  }
+	} else {
+	  if (r != 15)
+	    break;
+	  k += 15;
+	}
+      }
+
+      EndOfBlock: ;
+    }
+
+    /* Completed MCU, so update state */
+    BITREAD_SAVE_STATE(cinfo,entropy->bitstate);
+    ASSIGN_STATE(entropy->saved, state);
+  }
+
+  /* Account for restart interval (no-op if not using restarts) */
+  entropy->restarts_to_go--;
+
+  return TRUE;
+}
+
+#endif /* HUFF_FAST_SUPPORTED */
+
+
 /*
  * Initialize for a Huffman-compressed scan.
  */
@@ -1415,6 +1655,10 @@ start_pass_huff_decoder (j_decompress_ptr cinfo)
      */
     if (cinfo->lim_Se != DCTSIZE2-1)
       entropy->pub.decode_mcu = decode_mcu_sub;
+#ifdef HUFF_FAST_SUPPORTED
+    else if (huff_fast)
+      entropy->pub.decode_mcu = decode_mcu_fast;
+#endif
     else
       entropy->pub.decode_mcu = decode_mcu;
 
@@ -1539,3 +1783,19 @@ jinit_huff_decoder (j_decompress_ptr cinfo)
     }
   }
 }
+
+
+#ifdef HUFF_FAST_SUPPORTED
+
+/*
+ * Select the combined lookahead decode, the default, or the classic one.
+ * Takes effect from the next jpeg_start_decompress.
+ */
+
+GLOBAL(void)
+jpeg_huff_fast (boolean enable)
+{
+  huff_fast = enable;
+}
+
+#endif
@@ -179,7 +179,7 @@ public:
   //{{{
   cRect()  {
     left = 0;
-    bottom = 0;
+    top = 0;
     right = 0;
     bottom = 0;
     }
@@ -237,6 +237,32 @@ public:
     }
   //}}}
 
+  bool isEmpty() const { return (right <= left) || (bottom <= top); }
+  //{{{
+  bool overlaps (const cRect& r) const {
+    return (left < r.right) && (r.left < right) && (top < r.bottom) && (r.top < bottom);
+    }
+  //}}}
+  //{{{
+  bool contains (const cRect& r) const {
+    return (r.left >= left) && (r.right <= right) && (r.top >= top) && (r.bottom <= bottom);
+    }
+  //}}}
+  //{{{
+  cRect intersect (const cRect& r) const {
+  // may be empty
+    return cRect (left > r.left ? left : r.left, top > r.top ? top : r.top,
+                  right < r.right ? right : r.right, bottom < r.bottom ? bottom : r.bottom);
+    }
+  //}}}
+  //{{{
+  cRect combine (const cRect& r) const {
+  // bounding rect
+    return cRect (left < r.left ? left : r.left, top < r.top ? top : r.top,
+                  right > r.right ? right : r.right, bottom > r.bottom ? bottom : r.bottom);
+    }
+  //}}}
+
   int16_t left;
   int16_t right;
   int16_t top;
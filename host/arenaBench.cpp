@@ -0,0 +1,106 @@
+// arenaBench.cpp - HOST_BUILD swJpegDecode with jmemArena pools against jmemnobs style heap pools
+// - the repo FatFs over the benchUtils sparse ram disk, 4G FAT32 32k clusters like an SDHC card
+// - corpus is the scaleBench test card 4:2:2 q90 at 720p, 1080p, 12MP and 24MP
+// - each image decoded to the 1004x556 main.cpp picture rect, the slideshow decode, and at 1:1
+// - heap is jpegArenaEnable false, every pool a pvPortMalloc or sdRamAlloc and its free, as jmemnobs did,
+//   arena is the same decode bumping the arenas, reset when the jpeg object is destroyed
+// - both tiles must be the same, heap free after each decode must be back where it started
+// - jpegArenaReport high water per image and output size is what kSmallArenaSize and kLargeArenaSize are sized from,
+//   fallbacks are pools that didn't fit and took the heap
+// - build from host/, FatFs and LibJPEG as C without jmemnobs.c, -I. picks up the jconfig.h stand in
+//     gcc -c -O2 -DHOST_BUILD -I. -I../nucleo -I../LibJPEG/include ../fatFs/*.c ../LibJPEG/source/*.c
+//     rm jmemnobs.o
+//     g++ -O2 -fpermissive -DHOST_BUILD -DFT2_BUILD_LIBRARY -I. -I../nucleo -I../LibJPEG/include -I../freetype/Inc
+//         arenaBench.cpp ../nucleo/swJpeg.cpp ../nucleo/jpegSimd.cpp ../nucleo/jpegThumb.cpp ../nucleo/jmemArena.cpp
+//         benchUtils.cpp host.cpp dma2d.cpp ../nucleo/cLcd.cpp ../common/utils.cpp <freetype> *.o -o arenaBench
+// - run
+//     arenaBench [iterations]
+//{{{  includes
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "../nucleo/cLcd.h"
+#include "../nucleo/jpeg.h"
+#include "../common/heap.h"
+#include "jpeglib.h"
+#include "benchUtils.h"
+
+using namespace std;
+//}}}
+
+const cPoint kPanelSize (1024 - 20, 600 - 44); // main.cpp picture rect
+
+//{{{
+double decodeMs (const string& fileName, const cPoint& size, bool arena, int iterations, cTile*& tile) {
+// ms per decode, tile of the last decode kept for the compare
+
+  jpegArenaEnable (arena);
+  auto startTime = chrono::steady_clock::now();
+  for (int i = 0; i < iterations; i++) {
+    delete tile;
+    tile = swJpegDecode (fileName, size, false);
+    }
+  return getMs (startTime) / iterations;
+  }
+//}}}
+
+//{{{
+void run (const char* name, int width, int height, int iterations) {
+
+  sImage image;
+  testCard (image, width, height);
+  string fileName = "arena.jpg";
+  if (!writeRamFile (fileName, encode (image)))
+    return;
+
+  for (auto& size : { kPanelSize, cPoint (width, height) }) {
+    size_t sramFree = getSramFreeSize();
+    size_t sdRamFree = getSdRamFreeSize();
+
+    cTile* heapTile = nullptr;
+    double heapMs = decodeMs (fileName, size, false, iterations, heapTile);
+    cTile* arenaTile = nullptr;
+    double arenaMs = decodeMs (fileName, size, true, iterations, arenaTile);
+
+    bool same = sameTile (heapTile, arenaTile);
+    int outWidth = arenaTile ? arenaTile->mWidth : 0;
+    int outHeight = arenaTile ? arenaTile->mHeight : 0;
+    delete heapTile;
+    delete arenaTile;
+
+    printf ("%s to %5dx%-5d heap %8.2fms arena %8.2fms %5.1f%% %s, heap %s\n",
+            name, outWidth, outHeight, heapMs, arenaMs, ((heapMs - arenaMs) * 100.0) / heapMs,
+            same ? "same" : "diff",
+            (getSramFreeSize() == sramFree) && (getSdRamFreeSize() == sdRamFree) ? "back" : "leak");
+    }
+  }
+//}}}
+
+//{{{
+int main (int argc, char** argv) {
+
+  int iterations = argc > 1 ? atoi (argv[1]) : 10;
+
+  if (!mountRamDisk())
+    return 1;
+
+  // arenas are allocated by the first jpeg object and kept, before any free sizes are taken
+  jpegArenaEnable (true);
+  jpeg_decompress_struct cinfo;
+  jpeg_error_mgr jerr;
+  cinfo.err = jpeg_std_error (&jerr);
+  jpeg_create_decompress (&cinfo);
+  jpeg_destroy_decompress (&cinfo);
+
+  run (" 1280x720 ", 1280, 720, iterations);
+  run (" 1920x1080", 1920, 1080, iterations);
+  run (" 4000x3000", 4000, 3000, iterations);
+  run (" 6000x4000", 6000, 4000, iterations);
+
+  jpegArenaReport();
+
+  unmountRamDisk();
+  return 0;
+  }
+//}}}
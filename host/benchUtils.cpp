@@ -0,0 +1,212 @@
+// benchUtils.cpp - HOST_BUILD fixture shared by the jpeg benches
+//{{{  includes
+#include "benchUtils.h"
+
+#include <random>
+#include <thread>
+#include <sys/mman.h>
+
+#include "../nucleo/cLcd.h"
+#include "../fatFs/ff_gen_drv.h"
+#include "jpeglib.h"
+
+using namespace std;
+//}}}
+
+const uint32_t kSectorSize = 512;
+const uint32_t kRamDiskSectors = 0x800000;
+
+//{{{  ram disk driver, counts
+uint8_t* mRamDisk = nullptr;
+char mRamDiskPath[4];
+
+uint32_t mDiskReads = 0;
+uint32_t mDiskSectors = 0;
+double mCardBytesPerUs = 0.0;
+void (*mRamReadHook)(const uint8_t* buff, uint32_t bytes) = nullptr;
+
+//{{{
+DSTATUS ramInit (BYTE lun) {
+  return 0;
+  }
+//}}}
+//{{{
+DSTATUS ramStatus (BYTE lun) {
+  return 0;
+  }
+//}}}
+//{{{
+DRESULT ramRead (BYTE lun, BYTE* buff, DWORD sector, UINT count) {
+
+  mDiskReads++;
+  mDiskSectors += count;
+  if (mRamReadHook)
+    mRamReadHook (buff, count * kSectorSize);
+
+  memcpy (buff, mRamDisk + (size_t(sector) * kSectorSize), count * kSectorSize);
+  if (mCardBytesPerUs > 0.0)
+    this_thread::sleep_for (chrono::microseconds (int64_t(count * kSectorSize / mCardBytesPerUs)));
+  return RES_OK;
+  }
+//}}}
+//{{{
+DRESULT ramWrite (BYTE lun, const BYTE* buff, DWORD sector, UINT count) {
+
+  memcpy (mRamDisk + (size_t(sector) * kSectorSize), buff, count * kSectorSize);
+  return RES_OK;
+  }
+//}}}
+//{{{
+DRESULT ramIoctl (BYTE lun, BYTE cmd, void* buff) {
+
+  switch (cmd) {
+    case CTRL_SYNC: return RES_OK;
+    case GET_SECTOR_COUNT: *(DWORD*)buff = kRamDiskSectors; return RES_OK;
+    case GET_SECTOR_SIZE: *(WORD*)buff = kSectorSize; return RES_OK;
+    case GET_BLOCK_SIZE: *(DWORD*)buff = 1; return RES_OK;
+    default: return RES_PARERR;
+    }
+  }
+//}}}
+
+const Diskio_drvTypeDef kRamDriver = { ramInit, ramStatus, ramRead, ramWrite, ramIoctl };
+//}}}
+
+//{{{
+bool mountRamDisk() {
+// format and mount, untouched pages stay unbacked
+
+  mRamDisk = (uint8_t*)mmap (nullptr, size_t(kRamDiskSectors) * kSectorSize, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+  FATFS_LinkDriver (&kRamDriver, mRamDiskPath);
+
+  vector<uint8_t> work (4096);
+  if (f_mkfs (mRamDiskPath, FM_FAT32, 32768, work.data(), work.size()) != FR_OK) {
+    printf ("f_mkfs fail\n");
+    return false;
+    }
+
+  static FATFS fatFs;
+  if (f_mount (&fatFs, mRamDiskPath, 1) != FR_OK) {
+    printf ("f_mount fail\n");
+    return false;
+    }
+
+  return true;
+  }
+//}}}
+//{{{
+void unmountRamDisk() {
+  f_mount (nullptr, mRamDiskPath, 0);
+  }
+//}}}
+//{{{
+bool writeRamFile (const string& fileName, const vector<uint8_t>& data) {
+
+  FIL file;
+  if (f_open (&file, fileName.c_str(), FA_WRITE | FA_CREATE_ALWAYS) != FR_OK) {
+    printf ("writeRamFile %s open fail\n", fileName.c_str());
+    return false;
+    }
+
+  UINT written = 0;
+  f_write (&file, data.data(), data.size(), &written);
+  f_close (&file);
+  return written == data.size();
+  }
+//}}}
+
+//{{{
+cTile* hwJpegDecode (const string& fileName, uint32_t offset, uint32_t length, bool yuv) {
+// no hw decoder on host, callers fall back to swJpegDecode
+  return nullptr;
+  }
+//}}}
+
+//{{{
+void testCard (sImage& image, int width, int height, int noise, int phase) {
+// scaleBench ramps and checkerboard
+// - noise gives the entropy decode a camera jpeg's longer codes and larger magnitudes
+// - phase shifts the checkerboard so every file of a set differs
+
+  mt19937 random (width);
+  image.mWidth = width;
+  image.mHeight = height;
+  image.mRgb.resize (image.mWidth * image.mHeight * 3);
+  for (int y = 0; y < image.mHeight; y++)
+    for (int x = 0; x < image.mWidth; x++) {
+      auto pix = &image.mRgb[(y * image.mWidth + x) * 3];
+      int value[3] = { (x * 255) / image.mWidth, (y * 255) / image.mHeight, (((x + phase) ^ y) & 0x20) ? 255 : 0 };
+      for (int i = 0; i < 3; i++) {
+        int v = value[i] + (noise ? (int)(random() % (2 * noise + 1)) - noise : 0);
+        pix[i] = v < 0 ? 0 : v > 255 ? 255 : v;
+        }
+      }
+  }
+//}}}
+//{{{
+vector<uint8_t> encode (const sImage& image, int hSamp, int vSamp, int restartRows, int restartMcus,
+                        int quality, bool progressive, const vector<uint8_t>& app1) {
+// luma sampling hSamp x vSamp, restart interval in mcu rows or in mcus, progressive the libjpeg default script,
+// optional APP1
+
+  jpeg_compress_struct cinfo;
+  jpeg_error_mgr jerr;
+  cinfo.err = jpeg_std_error (&jerr);
+  jpeg_create_compress (&cinfo);
+
+  unsigned char* buf = nullptr;
+  unsigned long size = 0;
+  jpeg_mem_dest (&cinfo, &buf, &size);
+
+  cinfo.image_width = image.mWidth;
+  cinfo.image_height = image.mHeight;
+  cinfo.input_components = 3;
+  cinfo.in_color_space = JCS_RGB;
+  jpeg_set_defaults (&cinfo);
+  jpeg_set_quality (&cinfo, quality, TRUE);
+  cinfo.comp_info[0].h_samp_factor = hSamp;
+  cinfo.comp_info[0].v_samp_factor = vSamp;
+  cinfo.restart_in_rows = restartRows;
+  cinfo.restart_interval = restartMcus;
+  if (progressive)
+    jpeg_simple_progression (&cinfo);
+
+  jpeg_start_compress (&cinfo, TRUE);
+  if (!app1.empty())
+    jpeg_write_marker (&cinfo, JPEG_APP0 + 1, app1.data(), app1.size());
+
+  vector<uint8_t> line (image.mWidth * 3);
+  while (cinfo.next_scanline < cinfo.image_height) {
+    // JCS_RGB is bgr for RGB_RED 2
+    auto src = &image.mRgb[cinfo.next_scanline * image.mWidth * 3];
+    for (int x = 0; x < image.mWidth; x++) {
+      line[x*3] = src[x*3 + 2];
+      line[x*3 + 1] = src[x*3 + 1];
+      line[x*3 + 2] = src[x*3];
+      }
+    JSAMPROW row = line.data();
+    jpeg_write_scanlines (&cinfo, &row, 1);
+    }
+  jpeg_finish_compress (&cinfo);
+  jpeg_destroy_compress (&cinfo);
+
+  vector<uint8_t> jpeg (buf, buf + size);
+  free (buf);
+  return jpeg;
+  }
+//}}}
+
+//{{{
+double getMs (chrono::steady_clock::time_point startTime) {
+  return chrono::duration<double, milli>(chrono::steady_clock::now() - startTime).count();
+  }
+//}}}
+//{{{
+bool sameTile (const cTile* a, const cTile* b) {
+
+  return a && b && (a->mWidth == b->mWidth) && (a->mHeight == b->mHeight) &&
+         !memcmp (a->mPiccy, b->mPiccy, a->mWidth * a->mHeight * 2);
+  }
+//}}}
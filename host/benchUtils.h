@@ -0,0 +1,39 @@
+// benchUtils.h - HOST_BUILD fixture shared by the jpeg benches
+// - the repo FatFs over a ram disk driver, 4G FAT32 32k clusters like an SDHC card, reads counted,
+//   optionally slowed to a card's speed
+// - the scaleBench test card, libjpeg encode of it into memory, timing, tile compare
+// - hwJpegDecode stub, no hw decoder on host, callers fall back to swJpegDecode
+#pragma once
+//{{{  includes
+#include <stdint.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+class cTile;
+//}}}
+
+// ram disk, reads since the bench last zeroed them
+extern uint32_t mDiskReads;
+extern uint32_t mDiskSectors;
+extern double mCardBytesPerUs;  // reads sleep to this rate, 0 is ram speed
+extern void (*mRamReadHook)(const uint8_t* buff, uint32_t bytes);
+
+bool mountRamDisk();
+void unmountRamDisk();
+bool writeRamFile (const std::string& fileName, const std::vector<uint8_t>& data);
+
+//{{{
+struct sImage {
+  int mWidth = 0;
+  int mHeight = 0;
+  std::vector<uint8_t> mRgb;
+  };
+//}}}
+void testCard (sImage& image, int width, int height, int noise = 0, int phase = 0);
+std::vector<uint8_t> encode (const sImage& image, int hSamp = 2, int vSamp = 1, int restartRows = 0, int restartMcus = 0,
+                             int quality = 90, bool progressive = false,
+                             const std::vector<uint8_t>& app1 = std::vector<uint8_t>());
+
+double getMs (std::chrono::steady_clock::time_point startTime);
+bool sameTile (const cTile* a, const cTile* b);
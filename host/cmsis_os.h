@@ -0,0 +1,3 @@
+// cmsis_os.h - HOST_BUILD stand in, freetype ftsystem.c allocates through pvPortMalloc
+#pragma once
+#include "host.h"
@@ -0,0 +1,74 @@
+// corpusBench.cpp - HOST_BUILD jpegBench, the decode benchmark the target runs over RTT with JPEG_BENCH
+// - the repo FatFs over the benchUtils ram disk, args copied onto it as the card files
+// - no hw decoder on host, hwJpegDecode lines say none
+// - build from host/, FatFs and LibJPEG as C, -I. picks up the jconfig.h stand in
+//     gcc -c -O2 -DHOST_BUILD -I. -I../nucleo -I../LibJPEG/include ../fatFs/*.c ../LibJPEG/source/*.c
+//     rm jmemnobs.o
+//     g++ -O2 -fpermissive -DHOST_BUILD -DFT2_BUILD_LIBRARY -I. -I../nucleo -I../LibJPEG/include -I../freetype/Inc
+//         corpusBench.cpp ../nucleo/jpegBench.cpp ../nucleo/swJpeg.cpp ../nucleo/jpegSimd.cpp ../nucleo/jpegThumb.cpp
+//         ../nucleo/jmemArena.cpp benchUtils.cpp host.cpp dma2d.cpp ../nucleo/cLcd.cpp ../common/utils.cpp <freetype> *.o -o corpusBench
+// - run
+//     corpusBench [photo.jpg ...]
+//{{{  includes
+#include <string>
+#include <vector>
+
+#include "../nucleo/cLcd.h"
+#include "../nucleo/jpeg.h"
+#include "benchUtils.h"
+
+using namespace std;
+//}}}
+
+//{{{
+bool copyToRamDisk (const char* pathName, string& fileName) {
+// host file onto the ram disk, by its name without the path
+
+  FILE* src = fopen (pathName, "rb");
+  if (!src) {
+    printf ("copyToRamDisk %s open fail\n", pathName);
+    return false;
+    }
+
+  const char* name = strrchr (pathName, '/');
+  fileName = name ? name + 1 : pathName;
+
+  FIL file;
+  if (f_open (&file, fileName.c_str(), FA_WRITE | FA_CREATE_ALWAYS) != FR_OK) {
+    fclose (src);
+    return false;
+    }
+
+  bool ok = true;
+  uint8_t buf[0x8000];
+  size_t got;
+  while (ok && (got = fread (buf, 1, sizeof (buf), src)) > 0) {
+    UINT written = 0;
+    ok = (f_write (&file, buf, UINT(got), &written) == FR_OK) && (written == got);
+    }
+
+  f_close (&file);
+  fclose (src);
+  return ok;
+  }
+//}}}
+
+//{{{
+int main (int argc, char** argv) {
+
+  if (!mountRamDisk())
+    return 1;
+
+  vector<string> fileNames;
+  for (int arg = 1; arg < argc; arg++) {
+    string fileName;
+    if (copyToRamDisk (argv[arg], fileName))
+      fileNames.push_back (fileName);
+    }
+
+  jpegBench (fileNames);
+
+  unmountRamDisk();
+  return 0;
+  }
+//}}}
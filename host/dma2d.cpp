@@ -0,0 +1,202 @@
+// dma2d.cpp - HOST_BUILD software DMA2D
+// - R2M, M2M, M2M_PFC, M2M_BLEND
+// - foreground A8, RGB565, RGB888, ARGB8888, YCbCr 4:4:4 4:2:2 4:2:0 jpeg mcu, background RGB565, output RGB565
+//{{{  includes
+#include "host.h"
+//}}}
+
+extern "C" { void DMA2D_IRQHandler(); }
+
+static bool mPending = false;
+static uint32_t mJobs = 0;
+static uint32_t mPixels = 0;
+
+//{{{
+static inline uint8_t clamp (int32_t value) {
+  return value < 0 ? 0 : value > 255 ? 255 : (uint8_t)value;
+  }
+//}}}
+//{{{
+static inline uint32_t rgb565toArgb (uint16_t rgb565) {
+
+  uint32_t r = (rgb565 >> 11) & 0x1F;
+  uint32_t g = (rgb565 >> 5) & 0x3F;
+  uint32_t b = rgb565 & 0x1F;
+  return 0xFF000000 | (((r << 3) | (r >> 2)) << 16) | (((g << 2) | (g >> 4)) << 8) | ((b << 3) | (b >> 2));
+  }
+//}}}
+//{{{
+static inline uint16_t argbToRgb565 (uint32_t argb) {
+  return ((argb >> 8) & 0xF800) | ((argb >> 5) & 0x07E0) | ((argb >> 3) & 0x001F);
+  }
+//}}}
+//{{{
+static inline uint32_t yuvToArgb (int32_t y, int32_t cb, int32_t cr) {
+
+  // jpeg full range BT.601, same arithmetic as cLcd cYuvMcu
+  cb -= 128;
+  cr -= 128;
+  return 0xFF000000 |
+         (clamp (y + ((91881 * cr + 32768) >> 16)) << 16) |
+         (clamp (y - ((22554 * cb + 46802 * cr - 32768) >> 16)) << 8) |
+          clamp (y + ((116130 * cb + 32768) >> 16));
+  }
+//}}}
+
+//{{{
+static uint32_t fetchFg (uint32_t x, uint32_t y, uint32_t pitch) {
+
+  uint32_t pfccr = DMA2D->FGPFCCR;
+  auto src = (const uint8_t*)(uintptr_t)DMA2D->FGMAR;
+
+  uint32_t argb = 0;
+  switch (pfccr & DMA2D_FGPFCCR_CM) {
+    case DMA2D_INPUT_ARGB8888:
+      argb = *((const uint32_t*)src + (y * pitch) + x);
+      break;
+
+    case DMA2D_INPUT_RGB888: {
+      // little endian, blue first
+      auto pix = src + ((y * pitch) + x) * 3;
+      argb = 0xFF000000 | (pix[2] << 16) | (pix[1] << 8) | pix[0];
+      break;
+      }
+
+    case DMA2D_INPUT_RGB565:
+      argb = rgb565toArgb (*((const uint16_t*)src + (y * pitch) + x));
+      break;
+
+    case DMA2D_INPUT_A8:
+      argb = (src[(y * pitch) + x] << 24) | (DMA2D->FGCOLR & 0x00FFFFFF);
+      break;
+
+    case DMA2D_INPUT_YCBCR: {
+      // jpeg mcus, Y blocks in raster order, Cb block, Cr block
+      // - no css 8x8, 4:2:2 16x8, 4:2:0 16x16
+      uint32_t css = (pfccr & DMA2D_FGPFCCR_CSS) >> POSITION_VAL(DMA2D_FGPFCCR_CSS);
+      uint32_t hShift = css != DMA2D_NO_CSS ? 1 : 0;
+      uint32_t vShift = css == DMA2D_CSS_420 ? 1 : 0;
+      uint32_t chroma = 64 << (hShift + vShift);
+      uint32_t mcu = ((y >> (3 + vShift)) * (pitch >> (3 + hShift))) + (x >> (3 + hShift));
+      auto mcuPtr = src + (mcu * (chroma + 128));
+      auto lum = mcuPtr[((((y >> 3) & vShift) << hShift) + ((x >> 3) & hShift)) * 64 + ((y & 7) * 8) + (x & 7)];
+      auto chr = mcuPtr + chroma + (((y >> vShift) & 7) * 8) + ((x >> hShift) & 7);
+      argb = yuvToArgb (lum, chr[0], chr[64]);
+      break;
+      }
+
+    default:
+      printf ("hostDma2d unsupported fg colour mode %d\n", pfccr & DMA2D_FGPFCCR_CM);
+      break;
+    }
+
+  // alpha mode
+  uint32_t alpha = pfccr >> 24;
+  switch ((pfccr & DMA2D_FGPFCCR_AM) >> 16) {
+    case 1:
+      argb = (alpha << 24) | (argb & 0x00FFFFFF);
+      break;
+
+    case 2:
+      argb = ((((argb >> 24) * alpha) / 255) << 24) | (argb & 0x00FFFFFF);
+      break;
+    }
+
+  return argb;
+  }
+//}}}
+//{{{
+static inline uint32_t blend (uint32_t fg, uint32_t bg) {
+
+  uint32_t fgA = fg >> 24;
+  uint32_t bgA = bg >> 24;
+  uint32_t multA = (fgA * bgA) / 255;
+  uint32_t outA = fgA + bgA - multA;
+  if (!outA)
+    return 0;
+
+  uint32_t argb = outA << 24;
+  for (int shift = 0; shift < 24; shift += 8) {
+    uint32_t fgC = (fg >> shift) & 0xFF;
+    uint32_t bgC = (bg >> shift) & 0xFF;
+    argb |= ((fgC * fgA + bgC * bgA - bgC * multA) / outA) << shift;
+    }
+
+  return argb;
+  }
+//}}}
+
+//{{{
+void hostDma2dStart() {
+
+  if (!(DMA2D->CR & DMA2D_CR_START))
+    return;
+  if (mPending)
+    printf ("hostDma2dStart - start while previous job running\n");
+
+  // flags acknowledged through IFCR, TC low while running
+  DMA2D->ISR &= ~(DMA2D->IFCR | DMA2D_FLAG_TC);
+  DMA2D->IFCR = 0;
+  mPending = true;
+  }
+//}}}
+//{{{
+bool hostDma2dPoll() {
+
+  if (!mPending)
+    return false;
+  mPending = false;
+
+  uint32_t cr = DMA2D->CR;
+
+  uint32_t width = DMA2D->NLR >> 16;
+  uint32_t height = DMA2D->NLR & 0xFFFF;
+  auto dst = (uint16_t*)(uintptr_t)DMA2D->OMAR;
+  uint32_t dstPitch = width + DMA2D->OOR;
+
+  switch (cr & DMA2D_CR_MODE) {
+    case DMA2D_R2M:
+      for (uint32_t y = 0; y < height; y++)
+        for (uint32_t x = 0; x < width; x++)
+          dst[(y * dstPitch) + x] = (uint16_t)DMA2D->OCOLR;
+      break;
+
+    case DMA2D_M2M:
+    case DMA2D_M2M_PFC: {
+      uint32_t fgPitch = width + DMA2D->FGOR;
+      for (uint32_t y = 0; y < height; y++)
+        for (uint32_t x = 0; x < width; x++)
+          dst[(y * dstPitch) + x] = argbToRgb565 (fetchFg (x, y, fgPitch));
+      break;
+      }
+
+    case DMA2D_M2M_BLEND: {
+      uint32_t fgPitch = width + DMA2D->FGOR;
+      auto bg = (const uint16_t*)(uintptr_t)DMA2D->BGMAR;
+      uint32_t bgPitch = width + DMA2D->BGOR;
+      for (uint32_t y = 0; y < height; y++)
+        for (uint32_t x = 0; x < width; x++)
+          dst[(y * dstPitch) + x] = argbToRgb565 (blend (fetchFg (x, y, fgPitch),
+                                                         rgb565toArgb (bg[(y * bgPitch) + x])));
+      break;
+      }
+    }
+
+  mJobs++;
+  mPixels += width * height;
+
+  // complete, raise flag, interrupt if enabled
+  DMA2D->CR = cr & ~DMA2D_CR_START;
+  DMA2D->ISR |= DMA2D_FLAG_TC;
+  if (cr & DMA2D_CR_TCIE) {
+    DMA2D_IRQHandler();
+    DMA2D->ISR &= ~DMA2D->IFCR;
+    DMA2D->IFCR = 0;
+    }
+
+  return true;
+  }
+//}}}
+
+uint32_t hostGetDma2dJobs() { return mJobs; }
+uint32_t hostGetDma2dPixels() { return mPixels; }
@@ -0,0 +1,265 @@
+// dma2dQueueTest.cpp - HOST_BUILD cDma2dQueue driven by a simulated completion source
+// - wrap      small ring, jobs added and completed through many wraps, started in add order, drained idle
+// - full      ring holds numJobs-1, a producer spins on isFull as cLcd::queueJob does, a completion thread
+//             stands in for DMA2D_IRQHandler, every job started once in order
+// - window    a job merges into one kMergeWindow back, not one further
+// - overlap   an overlapping job between stops the merge, a non overlapping one doesn't
+// - m2m       an M2M job between stops the merge, nothing moves ahead of a frame buffer read
+// - a8        A8 blend spans merge when their coverage follows on, not when it doesn't
+// - mutex stands in for taskENTER_CRITICAL, empty on host
+// - build from host/
+//     g++ -O2 -fpermissive -pthread -DHOST_BUILD -DFT2_BUILD_LIBRARY -I. -I../nucleo -I../freetype/Inc
+//         dma2dQueueTest.cpp host.cpp dma2d.cpp ../nucleo/cLcd.cpp ../common/utils.cpp <freetype> -o dma2dQueueTest
+// - run
+//     dma2dQueueTest, exit code is the number of failed checks
+//{{{  includes
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "../nucleo/cDma2dQueue.h"
+
+using namespace std;
+//}}}
+
+int mFails = 0;
+
+//{{{
+void check (const char* name, bool ok) {
+
+  printf ("%-8s %s\n", name, ok ? "ok" : "FAIL");
+  mFails += ok ? 0 : 1;
+  }
+//}}}
+//{{{
+sDma2dJob makeJob (uint32_t mode, uint32_t colour, int16_t x, int16_t y, uint16_t width, uint16_t height) {
+// fill or blend into a 1024 wide frame, mSrc is the A8 coverage of a blend
+
+  sDma2dJob job;
+  job.mMode = mode;
+  job.mFgpfccr = 0;
+  job.mColour = colour;
+  job.mSrc = 0;
+  job.mDst = (y * 1024) + x;
+  job.mSrcOffset = 0;
+  job.mDstOffset = 1024 - width;
+  job.mX = x;
+  job.mY = y;
+  job.mWidth = width;
+  job.mHeight = height;
+  return job;
+  }
+//}}}
+//{{{
+vector<sDma2dJob> drain (cDma2dQueue& queue, const sDma2dJob* running) {
+// complete until idle, the jobs started in order, the running one first
+
+  vector<sDma2dJob> started;
+  for (auto job = running; job; job = queue.complete())
+    started.push_back (*job);
+  return started;
+  }
+//}}}
+
+//{{{
+void testWrap() {
+
+  cDma2dQueue queue;
+  queue.init (8);
+
+  // colour is the add order, none merge, a few queued at a time so head and tail wrap many times
+  bool ok = true;
+  uint32_t added = 0;
+  uint32_t completed = 0;
+  const sDma2dJob* running = nullptr;
+  for (int round = 0; round < 100; round++) {
+    for (int i = 0; i < (round % 7) + 1; i++) {
+      auto job = queue.add (makeJob (DMA2D_R2M, added, int16_t((added % 64) * 16), 0, 8, 8));
+      added++;
+      if (job) {
+        ok &= !running;
+        running = job;
+        }
+      }
+
+    // complete all but one, the ring never idles mid round
+    while (running && (completed + 1 < added)) {
+      ok &= running->mColour == completed++;
+      running = queue.complete();
+      }
+    }
+
+  ok &= running && (running->mColour == completed++);
+  ok &= !queue.complete() && !queue.isBusy() && (completed == added);
+  check ("wrap", ok);
+  }
+//}}}
+//{{{
+void testFull() {
+
+  const int kJobs = 2000;
+
+  cDma2dQueue queue;
+  queue.init (16);
+
+  // capacity, busy with the first, numJobs-1 in the ring counting the running job
+  bool ok = true;
+  int capacity = 0;
+  while (!queue.isFull()) {
+    queue.add (makeJob (DMA2D_R2M, capacity, int16_t((capacity % 64) * 16), 0, 8, 8));
+    capacity++;
+    }
+  ok &= capacity == 15;
+
+  // one completion frees a slot
+  auto running = queue.complete();
+  ok &= running && !queue.isFull();
+  ok &= drain (queue, running).size() == size_t(capacity - 1);
+
+  // producer spins on isFull as cLcd::queueJob, the irq thread completes a job a while after it starts
+  mutex critical;
+  vector<uint32_t> started;
+  bool done = false;
+  int fullSpins = 0;
+
+  thread irq ([&]() {
+    while (true) {
+      this_thread::sleep_for (chrono::microseconds (20));
+      lock_guard<mutex> lock (critical);
+      if (queue.isBusy()) {
+        auto job = queue.complete();
+        if (job)
+          started.push_back (job->mColour);
+        }
+      else if (done)
+        break;
+      }
+    });
+
+  for (int i = 0; i < kJobs; i++) {
+    while (queue.isFull()) {
+      fullSpins++;
+      this_thread::yield();
+      }
+
+    lock_guard<mutex> lock (critical);
+    auto job = queue.add (makeJob (DMA2D_R2M, i, int16_t((i % 64) * 16), int16_t((i / 64) % 32), 8, 1));
+    if (job)
+      started.push_back (job->mColour);
+    }
+  {
+  lock_guard<mutex> lock (critical);
+  done = true;
+  }
+  irq.join();
+
+  ok &= (started.size() == kJobs) && (fullSpins > 0);
+  for (uint32_t i = 0; ok && (i < started.size()); i++)
+    ok &= started[i] == i;
+  printf ("- capacity %d, %d jobs, producer spun %d times on full\n", capacity, kJobs, fullSpins);
+  check ("full", ok);
+  }
+//}}}
+//{{{
+void testWindow() {
+// a job mergeable into the first queued one, with fillers between, merged only inside the window
+
+  bool ok = true;
+  for (int fillers : { cDma2dQueue::kMergeWindow - 1, cDma2dQueue::kMergeWindow }) {
+    cDma2dQueue queue;
+    queue.init (64);
+
+    auto running = queue.add (makeJob (DMA2D_R2M, 0xFF, 0, 500, 8, 8));
+    queue.add (makeJob (DMA2D_R2M, 1, 0, 0, 100, 10));
+    for (int i = 0; i < fillers; i++)
+      queue.add (makeJob (DMA2D_R2M, 2 + i, int16_t(200 + (i * 10)), 0, 8, 8));
+    queue.add (makeJob (DMA2D_R2M, 1, 0, 10, 100, 10));
+
+    auto started = drain (queue, running);
+    bool merged = fillers < cDma2dQueue::kMergeWindow;
+    ok &= started.size() == size_t(fillers + (merged ? 2 : 3));
+    ok &= started[1].mColour == 1;
+    ok &= started[1].mHeight == (merged ? 20 : 10);
+    }
+  check ("window", ok);
+  }
+//}}}
+//{{{
+void testOverlap() {
+
+  bool ok = true;
+  for (bool overlap : { false, true }) {
+    cDma2dQueue queue;
+    queue.init (64);
+
+    auto running = queue.add (makeJob (DMA2D_R2M, 0xFF, 0, 500, 8, 8));
+    queue.add (makeJob (DMA2D_R2M, 1, 0, 0, 100, 10));
+    // a different colour over where the merged job would reach, or clear of it
+    queue.add (makeJob (DMA2D_R2M, 2, 50, overlap ? 15 : 100, 10, 10));
+    queue.add (makeJob (DMA2D_R2M, 1, 0, 10, 100, 10));
+
+    auto started = drain (queue, running);
+    ok &= started.size() == size_t(overlap ? 4 : 3);
+    ok &= started[1].mHeight == (overlap ? 10 : 20);
+    if (overlap)
+      // the later fill still lands after the job it overlaps
+      ok &= (started[2].mColour == 2) && (started[3].mColour == 1) && (started[3].mY == 10);
+    }
+  check ("overlap", ok);
+  }
+//}}}
+//{{{
+void testM2m() {
+
+  cDma2dQueue queue;
+  queue.init (64);
+
+  auto running = queue.add (makeJob (DMA2D_R2M, 0xFF, 0, 500, 8, 8));
+  queue.add (makeJob (DMA2D_R2M, 1, 0, 0, 100, 10));
+  // copy reading the frame buffer, clear of both fills
+  queue.add (makeJob (DMA2D_M2M, 0, 500, 300, 10, 10));
+  queue.add (makeJob (DMA2D_R2M, 1, 0, 10, 100, 10));
+
+  auto started = drain (queue, running);
+  check ("m2m", (started.size() == 4) && (started[1].mHeight == 10) && (started[2].mMode == DMA2D_M2M));
+  }
+//}}}
+//{{{
+void testA8() {
+
+  bool ok = true;
+  for (bool follows : { true, false }) {
+    cDma2dQueue queue;
+    queue.init (64);
+
+    auto running = queue.add (makeJob (DMA2D_R2M, 0xFF, 0, 500, 8, 8));
+    auto first = makeJob (DMA2D_M2M_BLEND, 1, 0, 0, 100, 10);
+    first.mSrc = 0x10000;
+    auto second = makeJob (DMA2D_M2M_BLEND, 1, 0, 10, 100, 10);
+    second.mSrc = first.mSrc + (follows ? 100 * 10 : 100 * 20);
+    queue.add (first);
+    queue.add (second);
+
+    auto started = drain (queue, running);
+    ok &= started.size() == size_t(follows ? 2 : 3);
+    ok &= started[1].mHeight == (follows ? 20 : 10);
+    }
+  check ("a8", ok);
+  }
+//}}}
+
+//{{{
+int main (int argc, char** argv) {
+
+  testWrap();
+  testFull();
+  testWindow();
+  testOverlap();
+  testM2m();
+  testA8();
+
+  printf ("%s\n", mFails ? "failed" : "all ok");
+  return mFails;
+  }
+//}}}
@@ -0,0 +1,262 @@
+// gradBench.cpp - HOST_BUILD cLcd gradient benchmark
+// - title bar 4 corner, horizontal, vertical, general bilinear, angled linear and radial fills, each plain and dithered
+// - cpu us is wall time of the draw and flush less DMA2D stall, the software DMA2D runs while stalled
+// - previous grad loop timed on the same rects for reference, it only did the 4 corner fill
+// - banding is the worst 8x8 block mean error against a float reference, in 8 bit levels,
+//   truncation sits near half a 565 step, dither pulls the block means onto the reference
+// - build from host/, like lcdBench
+//     g++ -m32 -O2 -DHOST_BUILD -DFT2_BUILD_LIBRARY -I. -I../freetype/Inc -I../nucleo
+//         gradBench.cpp host.cpp dma2d.cpp ../nucleo/cLcd.cpp ../common/utils.cpp <freetype> -o gradBench
+// - run
+//     gradBench [out.ppm]   writes the last dithered radial frame
+//{{{  includes
+#include <chrono>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "../nucleo/cLcd.h"
+
+using namespace std;
+//}}}
+
+enum eMode { eTitle, eHorizontal, eVertical, eBilinear, eLinear, eRadial, eNumModes };
+const char* kModeNames[eNumModes] = { "title", "horizontal", "vertical", "bilinear", "linear", "radial" };
+
+const sRgba565 kFrom (20,40,200);
+const sRgba565 kTo (240,180,30);
+//{{{
+cRect getRect (eMode mode) {
+  return mode == eTitle ? cRect (0,0, cLcd::getWidth(), 22) : cRect (cLcd::getSize());
+  }
+//}}}
+//{{{
+void draw (cLcd* lcd, eMode mode) {
+
+  cRect r = getRect (mode);
+  switch (mode) {
+    case eTitle:      lcd->grad (kFrom, kTo, kFrom, kTo, r); break;
+    case eHorizontal: lcd->grad (kFrom, kTo, kFrom, kTo, r); break;
+    case eVertical:   lcd->grad (kFrom, kFrom, kTo, kTo, r); break;
+    case eBilinear:   lcd->grad (kFrom, kTo, kBlack, kWhite, r); break;
+    case eLinear:     lcd->gradLinear (kFrom, kTo, cPoint (100,50), cPoint (900,500), r); break;
+    case eRadial:     lcd->gradRadial (kTo, kFrom, cPoint (512,300), 400, r); break;
+    default: break;
+    }
+  }
+//}}}
+//{{{
+void reference (eMode mode, int x, int y, double* rgb) {
+// float colour at pixel centre x,y
+
+  cRect r = getRect (mode);
+  double from[3] = { double(kFrom.getR()), double(kFrom.getG()), double(kFrom.getB()) };
+  double to[3] = { double(kTo.getR()), double(kTo.getG()), double(kTo.getB()) };
+
+  double u = double(x - r.left) / r.getWidth();
+  double v = double(y - r.top) / r.getHeight();
+  double t = 0.0;
+  switch (mode) {
+    case eVertical:
+      t = v;
+      break;
+
+    case eBilinear: {
+      double white[3] = { double(kWhite.getR()), double(kWhite.getG()), double(kWhite.getB()) };
+      for (int c = 0; c < 3; c++) {
+        double top = from[c] + (to[c] - from[c]) * u;
+        double bottom = white[c] * u;
+        rgb[c] = top + (bottom - top) * v;
+        }
+      return;
+      }
+
+    case eLinear: {
+      double dx = 800.0;
+      double dy = 450.0;
+      t = ((x - 100) * dx + (y - 50) * dy) / (dx * dx + dy * dy);
+      break;
+      }
+
+    case eRadial: {
+      // centre kTo out to kFrom
+      double distance = sqrt (double(x - 512) * (x - 512) + double(y - 300) * (y - 300)) / 400.0;
+      t = 1.0 - distance;
+      break;
+      }
+
+    default:
+      t = u;
+      break;
+    }
+
+  t = t < 0.0 ? 0.0 : t > 1.0 ? 1.0 : t;
+  for (int c = 0; c < 3; c++)
+    rgb[c] = from[c] + (to[c] - from[c]) * t;
+  }
+//}}}
+//{{{
+double banding (eMode mode, const uint16_t* frameBuffer) {
+// worst 8x8 block mean error, 565 expanded back to 8 bits
+
+  cRect r = getRect (mode);
+  double worst = 0.0;
+  for (int by = r.top; by + 8 <= r.bottom; by += 8)
+    for (int bx = r.left; bx + 8 <= r.right; bx += 8) {
+      double error[3] = { 0.0, 0.0, 0.0 };
+      for (int y = by; y < by + 8; y++)
+        for (int x = bx; x < bx + 8; x++) {
+          uint16_t rgb565 = frameBuffer[(y * cLcd::getWidth()) + x];
+          uint16_t pix[3] = { uint16_t(rgb565 >> 11), uint16_t((rgb565 >> 5) & 0x3F), uint16_t(rgb565 & 0x1F) };
+          double value[3] = { (pix[0] << 3) | (pix[0] >> 2), (pix[1] << 2) | (pix[1] >> 4), (pix[2] << 3) | (pix[2] >> 2) };
+          double rgb[3];
+          reference (mode, x, y, rgb);
+          for (int c = 0; c < 3; c++)
+            error[c] += value[c] - rgb[c];
+          }
+      for (int c = 0; c < 3; c++)
+        worst = fabs (error[c] / 64.0) > worst ? fabs (error[c] / 64.0) : worst;
+      }
+
+  return worst;
+  }
+//}}}
+
+//{{{
+void gradPrevious (uint16_t* buffer, sRgba565 colTL, sRgba565 colTR, sRgba565 colBL, sRgba565 colBR, const cRect& r) {
+// previous cLcd::grad inner loops, per row divides, one clip rect
+
+  int32_t rl16 = colTL.getR() << 16;
+  int32_t gl16 = colTL.getG() << 16;
+  int32_t bl16 = colTL.getB() << 16;
+  int32_t rr16 = colTR.getR() << 16;
+  int32_t gr16 = colTR.getG() << 16;
+  int32_t br16 = colTR.getB() << 16;
+
+  int32_t rGradl16 = ((colBL.getR() << 16) - rl16) / r.getHeight();
+  int32_t gGradl16 = ((colBL.getG() << 16) - gl16) / r.getHeight();
+  int32_t bGradl16 = ((colBL.getB() << 16) - bl16) / r.getHeight();
+  int32_t rGradr16 = ((colBR.getR() << 16) - rr16) / r.getHeight();
+  int32_t gGradr16 = ((colBR.getG() << 16) - gr16) / r.getHeight();
+  int32_t bGradr16 = ((colBR.getB() << 16) - br16) / r.getHeight();
+
+  auto dst = buffer + r.top * cLcd::getWidth() + r.left;
+  for (int16_t y = r.top; y < r.bottom; y++) {
+    int32_t rGradx16 = (rr16 - rl16) / r.getWidth();
+    int32_t gGradx16 = (gr16 - gl16) / r.getWidth();
+    int32_t bGradx16 = (br16 - bl16) / r.getWidth();
+
+    int32_t r16 = rl16;
+    int32_t g16 = gl16;
+    int32_t b16 = bl16;
+    for (int16_t x = r.left; x < r.right; x++) {
+      *dst++ = (b16 >> 16) | ((g16 >> 11) & 0x07E0) | ((r16 >> 5) & 0xF800);
+      r16 += rGradx16;
+      g16 += gGradx16;
+      b16 += bGradx16;
+      }
+    dst += cLcd::getWidth() - r.getWidth();
+
+    rl16 += rGradl16;
+    gl16 += gGradl16;
+    bl16 += bGradl16;
+    rr16 += rGradr16;
+    gr16 += gGradr16;
+    br16 += bGradr16;
+    }
+  }
+//}}}
+//{{{
+double previousUs (eMode mode, uint16_t* buffer) {
+
+  cRect r = getRect (mode);
+  int iterations = 0;
+  auto startTime = chrono::steady_clock::now();
+  chrono::duration<double, micro> elapsed;
+  do {
+    switch (mode) {
+      case eTitle:
+      case eHorizontal: gradPrevious (buffer, kFrom, kTo, kFrom, kTo, r); break;
+      case eVertical:   gradPrevious (buffer, kFrom, kFrom, kTo, kTo, r); break;
+      default:          gradPrevious (buffer, kFrom, kTo, kBlack, kWhite, r); break;
+      }
+    iterations++;
+    elapsed = chrono::steady_clock::now() - startTime;
+    } while (elapsed.count() < 200000.0);
+
+  return elapsed.count() / iterations;
+  }
+//}}}
+
+//{{{
+void writePpm (const string& fileName, const uint16_t* frameBuffer) {
+
+  FILE* file = fopen (fileName.c_str(), "wb");
+  if (!file) {
+    printf ("writePpm %s open fail\n", fileName.c_str());
+    return;
+    }
+
+  fprintf (file, "P6\n%d %d\n255\n", cLcd::getWidth(), cLcd::getHeight());
+  for (int i = 0; i < cLcd::getWidth() * cLcd::getHeight(); i++) {
+    uint16_t rgb565 = frameBuffer[i];
+    uint8_t rgb[3] = { uint8_t((rgb565 >> 8) & 0xF8), uint8_t((rgb565 >> 3) & 0xFC), uint8_t((rgb565 << 3) & 0xF8) };
+    fwrite (rgb, 1, 3, file);
+    }
+
+  fclose (file);
+  }
+//}}}
+
+//{{{
+int main (int argc, char** argv) {
+
+  const int kFrames = 50;
+
+  auto lcd = new cLcd();
+  lcd->init ("gradBench host");
+  lcd->setShowInfo (false);
+
+  vector<uint16_t> previousBuffer (cLcd::getWidth() * cLcd::getHeight());
+
+  for (int mode = 0; mode < eNumModes; mode++) {
+    double previous = (mode <= eBilinear) ? previousUs (eMode(mode), previousBuffer.data()) : 0.0;
+
+    for (bool dither : { false, true }) {
+      lcd->setGradDither (dither);
+
+      uint64_t totalUs = 0;
+      uint64_t totalStallUs = 0;
+      uint32_t startJobs = hostGetDma2dJobs();
+      for (int frame = 0; frame < kFrames; frame++) {
+        lcd->change();
+        lcd->start();
+
+        auto startTime = chrono::steady_clock::now();
+        draw (lcd, eMode(mode));
+        lcd->flush();
+        totalUs += chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - startTime).count();
+
+        lcd->present();
+        totalStallUs += lcd->getStat (cLcd::eStatStall);
+        }
+      uint32_t jobs = (hostGetDma2dJobs() - startJobs) / kFrames;
+
+      // let the line interrupt flip to the last presented frame
+      hostPoll();
+      printf ("%-10s %-8s cpu:%6dus wall:%6dus dma2dJobs:%4d banding:%5.2f",
+              kModeNames[mode], dither ? "dither" : "plain",
+              int((totalUs - totalStallUs) / kFrames), int(totalUs / kFrames), jobs,
+              banding (eMode(mode), hostGetShowBuffer()));
+      if (previous > 0.0)
+        printf ("  previous:%6dus", int(previous));
+      printf ("\n");
+      }
+    }
+
+  if (argc > 1)
+    writePpm (argv[1], hostGetShowBuffer());
+
+  return 0;
+  }
+//}}}
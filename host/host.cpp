@@ -0,0 +1,306 @@
+// host.cpp - HOST_BUILD registers, tick, semaphores, heaps and arena
+//{{{  includes
+#include "host.h"
+#include "../common/heap.h"
+
+#include <stdlib.h>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <sys/mman.h>
+//}}}
+
+DMA2D_TypeDef gHostDma2d;
+LTDC_TypeDef gHostLtdc;
+LTDC_Layer_TypeDef gHostLtdcLayer1;
+TIM_TypeDef gHostTim4;
+uint32_t SystemCoreClock = 1000000000;
+
+extern "C" { void LTDC_IRQHandler(); }
+
+//{{{
+struct sHostSemaphore {
+  int mCount;
+  };
+//}}}
+
+//{{{
+uint32_t HAL_GetTick() {
+
+  static auto baseTime = std::chrono::steady_clock::now();
+  return (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+    std::chrono::steady_clock::now() - baseTime).count();
+  }
+//}}}
+//{{{
+uint32_t hostGetCycles() {
+
+  static auto baseTime = std::chrono::steady_clock::now();
+  return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now() - baseTime).count();
+  }
+//}}}
+
+//{{{
+SemaphoreHandle_t hostSemaphoreCreate (int count) {
+
+  auto semaphore = new sHostSemaphore;
+  semaphore->mCount = count;
+  return semaphore;
+  }
+//}}}
+//{{{
+portBASE_TYPE hostSemaphoreTake (SemaphoreHandle_t semaphore, TickType_t ticks) {
+
+  // single threaded, anything that would give the semaphore has to come from a pending interrupt
+  while (!semaphore->mCount && hostPoll()) {}
+
+  if (!semaphore->mCount)
+    return pdFALSE;
+
+  semaphore->mCount--;
+  return pdTRUE;
+  }
+//}}}
+//{{{
+portBASE_TYPE hostSemaphoreGive (SemaphoreHandle_t semaphore) {
+
+  if (semaphore->mCount)
+    return pdFALSE;
+
+  semaphore->mCount = 1;
+  return pdTRUE;
+  }
+//}}}
+
+//{{{
+struct sHostQueue {
+  std::mutex mMutex;
+  std::condition_variable mChanged;
+
+  UBaseType_t mLength;
+  UBaseType_t mItemSize;
+  UBaseType_t mHead;
+  UBaseType_t mCount;
+  std::vector<uint8_t> mItems;
+  };
+//}}}
+//{{{
+bool hostWait (sHostQueue* queue, std::unique_lock<std::mutex>& lock, TickType_t ticks, bool forSpace) {
+// wait on the queue's condition, ticks are ms
+
+  auto ready = [&]{ return forSpace ? queue->mCount < queue->mLength : queue->mCount > 0; };
+  if (ticks == portMAX_DELAY) {
+    queue->mChanged.wait (lock, ready);
+    return true;
+    }
+  return queue->mChanged.wait_for (lock, std::chrono::milliseconds (ticks), ready);
+  }
+//}}}
+//{{{
+QueueHandle_t xQueueCreate (UBaseType_t length, UBaseType_t itemSize) {
+
+  auto queue = new sHostQueue;
+  queue->mLength = length;
+  queue->mItemSize = itemSize;
+  queue->mHead = 0;
+  queue->mCount = 0;
+  queue->mItems.resize (length * itemSize);
+  return queue;
+  }
+//}}}
+//{{{
+void vQueueDelete (QueueHandle_t queue) {
+  delete queue;
+  }
+//}}}
+//{{{
+BaseType_t xQueueSend (QueueHandle_t queue, const void* item, TickType_t ticks) {
+
+  std::unique_lock<std::mutex> lock (queue->mMutex);
+  if (!hostWait (queue, lock, ticks, true))
+    return pdFALSE;
+
+  UBaseType_t tail = (queue->mHead + queue->mCount) % queue->mLength;
+  memcpy (&queue->mItems[tail * queue->mItemSize], item, queue->mItemSize);
+  queue->mCount++;
+  queue->mChanged.notify_all();
+  return pdTRUE;
+  }
+//}}}
+//{{{
+BaseType_t xQueueReceive (QueueHandle_t queue, void* item, TickType_t ticks) {
+
+  std::unique_lock<std::mutex> lock (queue->mMutex);
+  if (!hostWait (queue, lock, ticks, false))
+    return pdFALSE;
+
+  memcpy (item, &queue->mItems[queue->mHead * queue->mItemSize], queue->mItemSize);
+  queue->mHead = (queue->mHead + 1) % queue->mLength;
+  queue->mCount--;
+  queue->mChanged.notify_all();
+  return pdTRUE;
+  }
+//}}}
+//{{{
+UBaseType_t uxQueueMessagesWaiting (QueueHandle_t queue) {
+
+  std::lock_guard<std::mutex> lock (queue->mMutex);
+  return queue->mCount;
+  }
+//}}}
+
+//{{{
+BaseType_t xTaskCreate (TaskFunction_t code, const char* name, uint16_t stackDepth, void* param,
+                        UBaseType_t priority, TaskHandle_t* handle) {
+// no priorities, the host scheduler runs every thread
+
+  std::thread (code, param).detach();
+  if (handle)
+    *handle = nullptr;
+  return pdPASS;
+  }
+//}}}
+//{{{
+void vTaskDelete (TaskHandle_t task) {
+// the thread ends when its task function returns
+  }
+//}}}
+//{{{
+void vTaskDelay (TickType_t ticks) {
+  std::this_thread::sleep_for (std::chrono::milliseconds (ticks));
+  }
+//}}}
+
+unsigned short osGetCPUUsage() { return 0; }
+
+//{{{
+uint8_t* hostArena (size_t size) {
+
+#if defined(MAP_32BIT) && (UINTPTR_MAX > 0xFFFFFFFF)
+  // keep addresses representable in the 32bit DMA2D address registers
+  void* arena = mmap (nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT, -1, 0);
+  return arena == MAP_FAILED ? nullptr : (uint8_t*)arena;
+#else
+  return (uint8_t*)malloc (size);
+#endif
+  }
+//}}}
+//{{{
+void hostArenaFree (uint8_t* arena, size_t size) {
+
+#if defined(MAP_32BIT) && (UINTPTR_MAX > 0xFFFFFFFF)
+  munmap (arena, size);
+#else
+  free (arena);
+#endif
+  }
+//}}}
+
+//{{{
+class cHostHeap {
+// target sized pool, tracks free and minFree like cRtosHeap, locked like its vTaskSuspendAll
+public:
+  cHostHeap (size_t size) : mSize(size), mFreeSize(size), mMinFreeSize(size) {}
+
+  size_t getSize() { return mSize; }
+  size_t getFreeSize() { return mFreeSize; }
+  size_t getMinFreeSize() { return mMinFreeSize; }
+
+  //{{{
+  uint8_t* alloc (size_t size) {
+
+    std::lock_guard<std::mutex> lock (mMutex);
+    if (size + kHeaderSize > mFreeSize) {
+      printf ("****** cHostHeap::alloc fail size:%d\n", (int)size);
+      return nullptr;
+      }
+
+    auto header = hostArena (size + kHeaderSize);
+    if (!header)
+      return nullptr;
+
+    *(size_t*)header = size;
+    mFreeSize -= size + kHeaderSize;
+    if (mFreeSize < mMinFreeSize)
+      mMinFreeSize = mFreeSize;
+
+    return header + kHeaderSize;
+    }
+  //}}}
+  //{{{
+  void free (void* ptr) {
+
+    if (ptr) {
+      std::lock_guard<std::mutex> lock (mMutex);
+      auto header = (uint8_t*)ptr - kHeaderSize;
+      size_t size = *(size_t*)header;
+      mFreeSize += size + kHeaderSize;
+      hostArenaFree (header, size + kHeaderSize);
+      }
+    }
+  //}}}
+
+private:
+  static const size_t kHeaderSize = 16;
+
+  size_t mSize;
+  size_t mFreeSize;
+  size_t mMinFreeSize;
+  std::mutex mMutex;
+  };
+//}}}
+
+static cHostHeap mDtcmHeap (0x00020000);
+uint8_t* dtcmAlloc (size_t size) { return mDtcmHeap.alloc (size); }
+void dtcmFree (void* ptr) { mDtcmHeap.free (ptr); }
+size_t getDtcmSize() { return mDtcmHeap.getSize(); }
+size_t getDtcmFreeSize() { return mDtcmHeap.getFreeSize(); }
+size_t getDtcmMinFreeSize() { return mDtcmHeap.getMinFreeSize(); }
+
+static cHostHeap mSramHeap (0x00070000);
+void* pvPortMalloc (size_t size) { return mSramHeap.alloc (size); }
+void vPortFree (void* ptr) { mSramHeap.free (ptr); }
+size_t getSramSize() { return mSramHeap.getSize(); }
+size_t getSramFreeSize() { return mSramHeap.getFreeSize(); }
+size_t getSramMinFreeSize() { return mSramHeap.getMinFreeSize(); }
+
+static cHostHeap mSram123Heap (0x00048000);
+uint8_t* sram123Alloc (size_t size) { return mSram123Heap.alloc (size); }
+void sram123Free (void* ptr) { mSram123Heap.free (ptr); }
+size_t getSram123Size() { return mSram123Heap.getSize(); }
+size_t getSram123FreeSize() { return mSram123Heap.getFreeSize(); }
+size_t getSram123MinFreeSize() { return mSram123Heap.getMinFreeSize(); }
+
+static cHostHeap mSdRamHeap (0x08000000);
+uint8_t* sdRamAlloc (size_t size, const std::string& tag) { return mSdRamHeap.alloc (size); }
+void sdRamFree (void* ptr) { mSdRamHeap.free (ptr); }
+size_t getSdRamSize() { return mSdRamHeap.getSize(); }
+size_t getSdRamFreeSize() { return mSdRamHeap.getFreeSize(); }
+size_t getSdRamMinFreeSize() { return mSdRamHeap.getMinFreeSize(); }
+
+//{{{
+bool hostPoll() {
+
+  if (hostDma2dPoll())
+    return true;
+
+  // line interrupt fires as soon as it is enabled, no vsync wait on host
+  if (LTDC->IER & LTDC_IT_LI) {
+    LTDC->ISR |= LTDC_FLAG_LI;
+    LTDC_IRQHandler();
+    LTDC->ISR &= ~LTDC->ICR;
+    LTDC->ICR = 0;
+    return true;
+    }
+
+  return false;
+  }
+//}}}
+//{{{
+uint16_t* hostGetShowBuffer() {
+  return (uint16_t*)(uintptr_t)LTDC_Layer1->CFBAR;
+  }
+//}}}
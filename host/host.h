@@ -0,0 +1,257 @@
+// host.h - HOST_BUILD stand ins for the stm32h7 registers, HAL, CMSIS dsp intrinsics, heap and freeRTOS calls used by cLcd, jpeg_utils, jpegSimd and cDecodeAhead
+// - DMA2D and LTDC are register structs in ram, DMA2D jobs run in software when started
+// - target code is written for a 32bit address space, build with -m32,
+//   or -fpermissive on x86-64 where hostArena maps memory below 4G
+#pragma once
+//{{{  includes
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+//}}}
+//{{{
+#ifdef __cplusplus
+ extern "C" {
+#endif
+//}}}
+
+#define __IO volatile
+#define RESET 0
+#define POSITION_VAL(VAL) (__builtin_ctz(VAL))
+
+//{{{  DMA2D
+typedef struct {
+  __IO uint32_t CR;
+  __IO uint32_t ISR;
+  __IO uint32_t IFCR;
+  __IO uint32_t FGMAR;
+  __IO uint32_t FGOR;
+  __IO uint32_t BGMAR;
+  __IO uint32_t BGOR;
+  __IO uint32_t FGPFCCR;
+  __IO uint32_t FGCOLR;
+  __IO uint32_t BGPFCCR;
+  __IO uint32_t BGCOLR;
+  __IO uint32_t FGCMAR;
+  __IO uint32_t BGCMAR;
+  __IO uint32_t OPFCCR;
+  __IO uint32_t OCOLR;
+  __IO uint32_t OMAR;
+  __IO uint32_t OOR;
+  __IO uint32_t NLR;
+  __IO uint32_t LWR;
+  __IO uint32_t AMTCR;
+  } DMA2D_TypeDef;
+
+extern DMA2D_TypeDef gHostDma2d;
+#define DMA2D (&gHostDma2d)
+
+#define DMA2D_CR_START        0x00000001U
+#define DMA2D_CR_TEIE         0x00000100U
+#define DMA2D_CR_TCIE         0x00000200U
+#define DMA2D_CR_CEIE         0x00002000U
+#define DMA2D_CR_MODE         0x00030000U
+
+#define DMA2D_M2M             0x00000000U
+#define DMA2D_M2M_PFC         0x00010000U
+#define DMA2D_M2M_BLEND       0x00020000U
+#define DMA2D_R2M             0x00030000U
+
+#define DMA2D_FLAG_TE         0x00000001U
+#define DMA2D_FLAG_TC         0x00000002U
+#define DMA2D_FLAG_CE         0x00000020U
+
+#define DMA2D_FGPFCCR_CM      0x0000000FU
+#define DMA2D_FGPFCCR_AM      0x00030000U
+#define DMA2D_FGPFCCR_CSS     0x000C0000U
+#define DMA2D_FGPFCCR_ALPHA   0xFF000000U
+
+#define DMA2D_INPUT_ARGB8888  0x00000000U
+#define DMA2D_INPUT_RGB888    0x00000001U
+#define DMA2D_INPUT_RGB565    0x00000002U
+#define DMA2D_INPUT_A8        0x00000009U
+#define DMA2D_INPUT_YCBCR     0x0000000BU
+
+#define DMA2D_NO_CSS          0x00000000U
+#define DMA2D_CSS_422         0x00000001U
+#define DMA2D_CSS_420         0x00000002U
+
+#define DMA2D_OUTPUT_RGB565   0x00000002U
+
+typedef struct { int mUnused; } DMA2D_HandleTypeDef;
+//}}}
+//{{{  LTDC
+typedef struct {
+  __IO uint32_t ISR;
+  __IO uint32_t ICR;
+  __IO uint32_t IER;
+  __IO uint32_t LIPCR;
+  __IO uint32_t SRCR;
+  __IO uint32_t GCR;
+  } LTDC_TypeDef;
+
+typedef struct {
+  __IO uint32_t CFBAR;
+  } LTDC_Layer_TypeDef;
+
+extern LTDC_TypeDef gHostLtdc;
+extern LTDC_Layer_TypeDef gHostLtdcLayer1;
+#define LTDC (&gHostLtdc)
+#define LTDC_Layer1 (&gHostLtdcLayer1)
+
+#define LTDC_IT_LI            0x00000001U
+#define LTDC_IT_FU            0x00000002U
+#define LTDC_IT_TE            0x00000004U
+#define LTDC_IT_RR            0x00000008U
+
+#define LTDC_FLAG_LI          0x00000001U
+#define LTDC_FLAG_FU          0x00000002U
+#define LTDC_FLAG_TE          0x00000004U
+#define LTDC_FLAG_RR          0x00000008U
+
+#define LTDC_SRCR_IMR         0x00000001U
+#define LTDC_GCR_DEN          0x00010000U
+
+typedef struct { int mUnused; } LTDC_HandleTypeDef;
+//}}}
+//{{{  TIM
+typedef struct {
+  __IO uint32_t CCR2;
+  } TIM_TypeDef;
+
+extern TIM_TypeDef gHostTim4;
+#define TIM4 (&gHostTim4)
+
+typedef struct { int mUnused; } TIM_HandleTypeDef;
+//}}}
+//{{{  HAL
+#define DMA2D_IRQn 0
+#define LTDC_IRQn  0
+#define HAL_NVIC_SetPriority(irq,pre,sub)
+#define HAL_NVIC_EnableIRQ(irq)
+
+uint32_t HAL_GetTick();
+
+// DWT->CYCCNT stand in, 1GHz so a cycle is a ns
+extern uint32_t SystemCoreClock;
+uint32_t hostGetCycles();
+
+typedef enum { HAL_OK = 0x00, HAL_ERROR = 0x01, HAL_BUSY = 0x02, HAL_TIMEOUT = 0x03 } HAL_StatusTypeDef;
+//}}}
+//{{{  CMSIS dsp intrinsics
+// cortex-m7 dsp extension ops the jpegSimd dsp kernels use, exact in C, so they are checked bit exact on host
+//{{{
+static inline uint32_t __SMUAD (uint32_t op1, uint32_t op2) {
+// dual 16bit signed multiply, products added, wraps like the instruction
+  return (uint32_t)((int32_t)(int16_t)op1 * (int16_t)op2) +
+         (uint32_t)((int32_t)(int16_t)(op1 >> 16) * (int16_t)(op2 >> 16));
+  }
+//}}}
+//{{{
+static inline uint32_t __SMLAD (uint32_t op1, uint32_t op2, uint32_t op3) {
+  return __SMUAD (op1, op2) + op3;
+  }
+//}}}
+//{{{
+static inline int32_t __SSAT (int32_t value, uint32_t sat) {
+  int32_t max = (1 << (sat - 1)) - 1;
+  return value > max ? max : value < -max - 1 ? -max - 1 : value;
+  }
+//}}}
+//{{{
+static inline uint32_t __USAT (int32_t value, uint32_t sat) {
+  int32_t max = (1 << sat) - 1;
+  return value > max ? max : value < 0 ? 0 : value;
+  }
+//}}}
+
+#define __PKHBT(ARG1,ARG2,ARG3) ((((uint32_t)(ARG1)) & 0x0000FFFFUL) | ((((uint32_t)(ARG2)) << (ARG3)) & 0xFFFF0000UL))
+//}}}
+//{{{  JPEG
+// header info the hw decoder reports, for the jpeg_utils mcu converters
+typedef struct {
+  uint8_t  ColorSpace;
+  uint8_t  ChromaSubsampling;
+  uint32_t ImageHeight;
+  uint32_t ImageWidth;
+  uint8_t  ImageQuality;
+  } JPEG_ConfTypeDef;
+
+#define JPEG_GRAYSCALE_COLORSPACE  0x00000000U
+#define JPEG_YCBCR_COLORSPACE      0x00000010U
+#define JPEG_CMYK_COLORSPACE       0x00000030U
+
+#define JPEG_444_SUBSAMPLING       0x00000000U
+#define JPEG_420_SUBSAMPLING       0x00000001U
+#define JPEG_422_SUBSAMPLING       0x00000002U
+//}}}
+//{{{  freeRTOS
+typedef long portBASE_TYPE;
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+typedef uint32_t TickType_t;
+#define pdFALSE 0
+#define pdTRUE  1
+#define pdPASS  pdTRUE
+#define portMAX_DELAY 0xFFFFFFFFU
+
+typedef struct sHostSemaphore* SemaphoreHandle_t;
+SemaphoreHandle_t hostSemaphoreCreate (int count);
+portBASE_TYPE hostSemaphoreTake (SemaphoreHandle_t semaphore, TickType_t ticks);
+portBASE_TYPE hostSemaphoreGive (SemaphoreHandle_t semaphore);
+
+#define vSemaphoreCreateBinary(sem)              (sem) = hostSemaphoreCreate (1)
+#define xSemaphoreTake(sem,ticks)                hostSemaphoreTake (sem, ticks)
+#define xSemaphoreGive(sem)                      hostSemaphoreGive (sem)
+#define xSemaphoreGiveFromISR(sem,woken)         hostSemaphoreGive (sem)
+#define portEND_SWITCHING_ISR(woken)
+#define taskYIELD()                              hostPoll()
+#define taskENTER_CRITICAL()
+#define taskEXIT_CRITICAL()
+
+// tasks are detached threads, no handle, a task function returns after its vTaskDelete (nullptr)
+typedef struct sHostTask* TaskHandle_t;
+typedef void (*TaskFunction_t)(void*);
+BaseType_t xTaskCreate (TaskFunction_t code, const char* name, uint16_t stackDepth, void* param,
+                        UBaseType_t priority, TaskHandle_t* handle);
+void vTaskDelete (TaskHandle_t task);
+void vTaskDelay (TickType_t ticks);
+
+// queues block on a condition variable, real cross thread waits, unlike the polled semaphores above
+typedef struct sHostQueue* QueueHandle_t;
+QueueHandle_t xQueueCreate (UBaseType_t length, UBaseType_t itemSize);
+void vQueueDelete (QueueHandle_t queue);
+BaseType_t xQueueSend (QueueHandle_t queue, const void* item, TickType_t ticks);
+BaseType_t xQueueReceive (QueueHandle_t queue, void* item, TickType_t ticks);
+UBaseType_t uxQueueMessagesWaiting (QueueHandle_t queue);
+
+void* pvPortMalloc (size_t size);
+void vPortFree (void* ptr);
+unsigned short osGetCPUUsage();
+//}}}
+//{{{  host
+// heap.h pools are sized like the target, allocated from hostArena
+uint8_t* hostArena (size_t size);
+void hostArenaFree (uint8_t* arena, size_t size);
+
+// run any started DMA2D job, raise any enabled LTDC line interrupt, return true if anything ran
+// - stands in for the interrupts a blocked task waits on, the simulated DMA2D completion source
+bool hostPoll();
+
+// latch DMA2D job described by the DMA2D registers, it runs at the next hostPoll,
+// so software blit time lands in the cpu wait, like the target stall
+void hostDma2dStart();
+bool hostDma2dPoll();
+uint32_t hostGetDma2dJobs();
+uint32_t hostGetDma2dPixels();
+
+// frameBuffer last flipped to by LTDC_IRQHandler
+uint16_t* hostGetShowBuffer();
+//}}}
+
+//{{{
+#ifdef __cplusplus
+}
+#endif
+//}}}
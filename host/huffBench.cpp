@@ -0,0 +1,212 @@
+// huffBench.cpp - HOST_BUILD jdhuff combined lookahead decode against the classic HUFF_LOOKAHEAD decode
+// - jpeg_huff_fast false is the classic decode_mcu, 8 bit lookahead and the bit by bit slow path,
+//   true is decode_mcu_fast, HUFF_FAST_BITS code and magnitude in one lookup, 8 byte refills,
+//   both over the HUFF_FAST_SUPPORTED 64 bit bit buffer
+// - corpus is the scaleBench test card 1920x1080 4:2:2 q90, a noisy test card standing in for a camera jpeg
+//   4000x3000 4:2:0 q95, the same with a restart interval per mcu row, and that cut short at 70%,
+//   args add .jpg, or .ppm encoded 4:2:0 q95
+// - decoded from memory, every coefficient block as the idct gets it and every output row must be the same,
+//   the truncated file must warn and pad the same way
+// - ms per decode at 1:1, and at 1/8 where only dc is kept and the entropy decode is most of the time
+// - build from host/, LibJPEG as C without jmemnobs.c, -I. picks up the jconfig.h stand in
+//     gcc -c -O2 -DHOST_BUILD -I. -I../nucleo -I../LibJPEG/include ../fatFs/*.c ../LibJPEG/source/*.c
+//     rm jmemnobs.o
+//     g++ -O2 -fpermissive -DHOST_BUILD -DFT2_BUILD_LIBRARY -I. -I../nucleo -I../LibJPEG/include -I../freetype/Inc
+//         huffBench.cpp ../nucleo/jmemArena.cpp
+//         benchUtils.cpp host.cpp dma2d.cpp ../nucleo/cLcd.cpp ../common/utils.cpp <freetype> *.o -o huffBench
+// - run
+//     huffBench [photo.jpg|photo.ppm ...]
+//{{{  includes
+#include <chrono>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "../nucleo/jpeg.h"
+#include "benchUtils.h"
+
+#define JPEG_INTERNALS
+#include "jpeglib.h"
+extern "C" {
+  #include "jdct.h"
+  }
+
+using namespace std;
+//}}}
+
+const int kIterations = 5;
+
+//{{{
+bool readPpm (const char* fileName, sImage& image) {
+
+  FILE* file = fopen (fileName, "rb");
+  if (!file) {
+    printf ("readPpm %s open fail\n", fileName);
+    return false;
+    }
+
+  int maxValue = 0;
+  if ((fscanf (file, "P6 %d %d %d", &image.mWidth, &image.mHeight, &maxValue) != 3) || (maxValue != 255)) {
+    printf ("readPpm %s not a binary 8bit ppm\n", fileName);
+    fclose (file);
+    return false;
+    }
+  fgetc (file);
+
+  image.mRgb.resize (image.mWidth * image.mHeight * 3);
+  size_t got = fread (image.mRgb.data(), 3, image.mWidth * image.mHeight, file);
+  fclose (file);
+  return got == (size_t)(image.mWidth * image.mHeight);
+  }
+//}}}
+//{{{
+bool readFile (const char* fileName, vector<uint8_t>& data) {
+
+  FILE* file = fopen (fileName, "rb");
+  if (!file) {
+    printf ("readFile %s open fail\n", fileName);
+    return false;
+    }
+
+  fseek (file, 0, SEEK_END);
+  data.resize (ftell (file));
+  fseek (file, 0, SEEK_SET);
+  size_t got = fread (data.data(), 1, data.size(), file);
+  fclose (file);
+  return got == data.size();
+  }
+//}}}
+
+//{{{  decode
+vector<JCOEF>* mCoefs = nullptr;
+inverse_DCT_method_ptr mIdcts[MAX_COMPONENTS];
+int mWarnings = 0;
+
+//{{{
+void captureIdct (j_decompress_ptr cinfo, jpeg_component_info* compptr, JCOEFPTR coefBlock,
+                  JSAMPARRAY outputBuf, JDIMENSION outputCol) {
+// keep the block as the entropy decoder left it, then the idct start_pass chose
+
+  mCoefs->insert (mCoefs->end(), coefBlock, coefBlock + DCTSIZE2);
+  mIdcts[compptr->component_index] (cinfo, compptr, coefBlock, outputBuf, outputCol);
+  }
+//}}}
+//{{{
+void countWarning (j_common_ptr cinfo, int msgLevel) {
+// warnings counted, not printed, a truncated file warns once per decode
+  if (msgLevel < 0)
+    mWarnings++;
+  }
+//}}}
+//{{{
+double decode (const vector<uint8_t>& jpeg, bool fast, int scaleDenom,
+               vector<JCOEF>* coefs, vector<uint8_t>* pixels, int& warnings) {
+// ms, coefficient blocks and output rows kept if asked for
+
+  jpeg_huff_fast (fast);
+  mWarnings = 0;
+  auto startTime = chrono::steady_clock::now();
+
+  jpeg_decompress_struct cinfo;
+  jpeg_error_mgr jerr;
+  cinfo.err = jpeg_std_error (&jerr);
+  jerr.emit_message = countWarning;
+  jpeg_create_decompress (&cinfo);
+  jpeg_mem_src (&cinfo, (unsigned char*)jpeg.data(), jpeg.size());
+  jpeg_read_header (&cinfo, TRUE);
+  cinfo.dct_method = JDCT_ISLOW;
+  cinfo.scale_num = 1;
+  cinfo.scale_denom = scaleDenom;
+  jpeg_start_decompress (&cinfo);
+
+  if (coefs) {
+    mCoefs = coefs;
+    for (int ci = 0; ci < cinfo.num_components; ci++) {
+      mIdcts[ci] = cinfo.idct->inverse_DCT[ci];
+      cinfo.idct->inverse_DCT[ci] = captureIdct;
+      }
+    }
+
+  size_t pitch = cinfo.output_width * cinfo.output_components;
+  vector<uint8_t> line (pitch);
+  if (pixels)
+    pixels->resize (pitch * cinfo.output_height);
+  while (cinfo.output_scanline < cinfo.output_height) {
+    JSAMPROW row = pixels ? pixels->data() + (cinfo.output_scanline * pitch) : line.data();
+    jpeg_read_scanlines (&cinfo, &row, 1);
+    }
+
+  jpeg_finish_decompress (&cinfo);
+  jpeg_destroy_decompress (&cinfo);
+
+  warnings = mWarnings;
+  return getMs (startTime);
+  }
+//}}}
+//}}}
+
+//{{{
+void run (const char* name, const vector<uint8_t>& jpeg) {
+
+  for (int scaleDenom : { 1, 8 }) {
+    vector<JCOEF> classicCoefs;
+    vector<JCOEF> fastCoefs;
+    vector<uint8_t> classicPixels;
+    vector<uint8_t> fastPixels;
+    int classicWarnings = 0;
+    int fastWarnings = 0;
+    decode (jpeg, false, scaleDenom, &classicCoefs, &classicPixels, classicWarnings);
+    decode (jpeg, true, scaleDenom, &fastCoefs, &fastPixels, fastWarnings);
+    bool same = (classicCoefs == fastCoefs) && (classicPixels == fastPixels) && (classicWarnings == fastWarnings);
+
+    // best of, after the checks have warmed the caches
+    double classicMs = 1e9;
+    double fastMs = 1e9;
+    int warnings;
+    for (int i = 0; i < kIterations; i++) {
+      double ms = decode (jpeg, false, scaleDenom, nullptr, nullptr, warnings);
+      classicMs = ms < classicMs ? ms : classicMs;
+      ms = decode (jpeg, true, scaleDenom, nullptr, nullptr, warnings);
+      fastMs = ms < fastMs ? ms : fastMs;
+      }
+
+    printf ("%-22s %5dk 1/%d classic %8.2fms fast %8.2fms %5.1f%% %6.1fMB/s, %8d blocks %s%s\n",
+            name, int(jpeg.size() / 1024), scaleDenom, classicMs, fastMs, ((classicMs - fastMs) * 100.0) / classicMs,
+            jpeg.size() / (fastMs * 1000.0), int(fastCoefs.size() / DCTSIZE2), same ? "same" : "diff",
+            fastWarnings ? " warned" : "");
+    }
+  }
+//}}}
+
+//{{{
+int main (int argc, char** argv) {
+
+  sImage image;
+  if (argc < 2) {
+    testCard (image, 1920, 1080, 0);
+    run ("testCard 1920x1080", encode (image, 2, 1, 0, 0, 90));
+
+    testCard (image, 4000, 3000, 12);
+    auto jpeg = encode (image, 2, 2, 0, 0, 95);
+    run ("noisy 4000x3000", jpeg);
+    run ("noisy restarts", encode (image, 2, 2, 1, 0, 95));
+
+    jpeg.resize ((jpeg.size() * 7) / 10);
+    run ("noisy truncated", jpeg);
+    }
+
+  for (int arg = 1; arg < argc; arg++) {
+    const char* name = strrchr (argv[arg], '/');
+    name = name ? name + 1 : argv[arg];
+    vector<uint8_t> data;
+    if (strstr (argv[arg], ".ppm")) {
+      if (readPpm (argv[arg], image))
+        run (name, encode (image, 2, 2, 0, 0, 95));
+      }
+    else if (readFile (argv[arg], data))
+      run (name, data);
+    }
+
+  return 0;
+  }
+//}}}
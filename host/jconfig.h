@@ -0,0 +1,28 @@
+// jconfig.h - HOST_BUILD stand in for nucleo/jconfig.h, stdio files and malloc instead of FatFs and pvPortMalloc
+// - -I. ahead of -I../nucleo picks this one up, jmorecfg.h is shared so RGB_RED stays 2, rgb buffers are bgr
+#pragma once
+
+#define DCT_SCALING_SUPPORTED
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#define JFILE  FILE
+#define JFREAD(file,buf,sizeofbuf) fread (buf, 1, sizeofbuf, file)
+#define JFWRITE(file,buf,sizeofbuf) fwrite (buf, 1, sizeofbuf, file)
+
+#define JMALLOC  malloc
+#define JFREE    free
+
+#define NO_GETENV
+#define HAVE_PROTOTYPES
+#define HAVE_UNSIGNED_CHAR
+#define HAVE_UNSIGNED_SHORT
+
+#define HAVE_STDDEF_H
+#define HAVE_STDLIB_H
+
+#ifdef JPEG_INTERNALS
+  #undef RIGHT_SHIFT_IS_UNSIGNED
+#endif
@@ -0,0 +1,194 @@
+// lcdBench.cpp - HOST_BUILD cLcd frame benchmark
+// - draws the nucleo uiThread scene against the software DMA2D, reports per frame draw time and primitive counts
+// - full pass redraws every frame, damage pass only invalidates what the scene animates,
+//   compares sdRam bytes written per frame
+// - optionally writes the last presented frame as .ppm for regression compares
+// - build from host/, with the freetype sources listed in nucleo.emProject, -I. picks up the cmsis_os.h stand in
+//     g++ -m32 -O2 -DHOST_BUILD -DFT2_BUILD_LIBRARY -I. -I../freetype/Inc -I../nucleo
+//         lcdBench.cpp host.cpp dma2d.cpp ../nucleo/cLcd.cpp ../common/utils.cpp <freetype> -o lcdBench
+//   or x86-64 with -fpermissive
+// - run
+//     lcdBench [frames] [out.ppm]
+//{{{  includes
+#include <chrono>
+#include <string>
+
+#include "../nucleo/cLcd.h"
+#include "../common/cTraceVec.h"
+
+using namespace std;
+//}}}
+
+//{{{
+cTile* makeTile (cTile::eFormat format, uint16_t width, uint16_t height) {
+// synthetic test card, colour ramps so scaling and conversion errors show up in a diff
+
+  int bytesPerPixel = format == cTile::eRgb888 ? 3 : 2;
+  auto piccy = sdRamAlloc (width * height * bytesPerPixel, "benchTile");
+  auto tile = new cTile (piccy, format, width, 0, 0, width, height);
+
+  for (int y = 0; y < height; y++)
+    for (int x = 0; x < width; x++) {
+      uint8_t r = (x * 255) / width;
+      uint8_t g = (y * 255) / height;
+      uint8_t b = ((x ^ y) & 0x20) ? 255 : 0;
+
+      if (format == cTile::eRgb565)
+        *((uint16_t*)piccy + y * width + x) = sRgba565 (r, g, b).rgb565;
+
+      else if (format == cTile::eRgb888) {
+        // libjpeg JCS_RGB order for RGB_RED 2
+        auto pix = piccy + (y * width + x) * 3;
+        pix[0] = b;
+        pix[1] = g;
+        pix[2] = r;
+        }
+
+      else {
+        // 4:2:2 mcu 16x8, Y0 Y1 Cb Cr 8x8 blocks
+        auto mcu = piccy + (((y / 8) * (width / 16)) + (x / 16)) * 256;
+        mcu[((x & 8) ? 64 : 0) + ((y & 7) * 8) + (x & 7)] = (r + g + b) / 3;
+        mcu[128 + ((y & 7) * 8) + ((x / 2) & 7)] = b;
+        mcu[192 + ((y & 7) * 8) + ((x / 2) & 7)] = r;
+        }
+      }
+
+  return tile;
+  }
+//}}}
+//{{{
+void drawScene (cLcd* lcd, cTraceVec& traceVec, cTile* sizeTile, cTile* copyTile, int frame) {
+
+  lcd->start();
+  lcd->clear (kBlack);
+  lcd->grad (kBlue, kGrey, kGrey, kBlack, cRect (0,0, lcd->getWidth() * ((frame % 100) + 1) / 100, 22));
+
+  lcd->size (sizeTile, cRect (10, 22, 10 + 480, 22 + 360));
+  lcd->copy (copyTile, cPoint (lcd->getWidth() - copyTile->mWidth - 10, 22));
+
+  lcd->drawInfo();
+  traceVec.draw (lcd, 20, 450);
+
+  // clock
+  cPointF centre (1024.f-105.f, 600.f-105.f-40.f);
+  float radius = 100.f;
+  float width = 4.f;
+  int steps = 64;
+  lcd->aEllipse (centre, cPointF(radius-width, radius), steps);
+  lcd->aRender (sRgba565 (128,128,128, 192), false);
+  lcd->aEllipseOutline (centre, cPointF(radius, radius), width, steps);
+  lcd->aRender (sRgba565 (180,180,0, 255), false);
+
+  float handWidth = radius / 20.f;
+  float secondA = (1.f - ((frame % 60) / 30.f)) * 3.1415926f;
+  float minuteA = (1.f - (((frame / 60) % 60) / 30.f)) * 3.1415926f;
+  lcd->aPointedLine (centre, centre + cPointF (radius * 0.75f * sin (minuteA / 12.f), radius * 0.75f * cos (minuteA / 12.f)), handWidth);
+  lcd->aPointedLine (centre, centre + cPointF (radius * 0.9f * sin (minuteA), radius * 0.9f * cos (minuteA)), handWidth);
+  lcd->aRender (kWhite);
+  lcd->aPointedLine (centre, centre + cPointF (radius * 0.95f * sin (secondA), radius * 0.95f * cos (secondA)), handWidth);
+  lcd->aRender (sRgba565 (255,0,0, 180));
+
+  lcd->text (kBlackSemi, 45, "12:34:" + dec (frame % 60, 2) + " Oct 17 2026", cRect (567,552, 1024,600));
+  lcd->text (kWhite, 45, "12:34:" + dec (frame % 60, 2) + " Oct 17 2026", cRect (567,552, 1024,600) + cPoint(-2,-2));
+
+  lcd->present();
+  }
+//}}}
+//{{{
+void writePpm (const string& fileName, const uint16_t* frameBuffer) {
+
+  FILE* file = fopen (fileName.c_str(), "wb");
+  if (!file) {
+    printf ("writePpm %s open fail\n", fileName.c_str());
+    return;
+    }
+
+  fprintf (file, "P6\n%d %d\n255\n", cLcd::getWidth(), cLcd::getHeight());
+  for (int i = 0; i < cLcd::getWidth() * cLcd::getHeight(); i++) {
+    uint16_t rgb565 = frameBuffer[i];
+    uint8_t rgb[3] = { uint8_t((rgb565 >> 8) & 0xF8), uint8_t((rgb565 >> 3) & 0xFC), uint8_t((rgb565 << 3) & 0xF8) };
+    fwrite (rgb, 1, 3, file);
+    }
+
+  fclose (file);
+  }
+//}}}
+
+//{{{
+void runPass (cLcd* lcd, cTraceVec& traceVec, cTile* sizeTile, cTile* copyTile, int numFrames, bool damage) {
+
+  const char* kStatNames[cLcd::eNumStats] = { "rect", "text", "copy", "size", "grad", "render", "dma2d", "stallUs", "bytes", "renderJobs", "renderUs" };
+  uint64_t totalStats[cLcd::eNumStats] = { 0 };
+  uint64_t totalUs = 0;
+  uint32_t startPixels = hostGetDma2dPixels();
+
+  for (int frame = 0; frame < numFrames; frame++) {
+    if (damage) {
+      // progress bar, clock, time text, occasional log line
+      lcd->invalidate (cRect (0,0, lcd->getWidth(), 24));
+      lcd->invalidate (cRect (1024-105-101, 600-105-40-101, 1024-105+101, 600-105-40+101));
+      lcd->invalidate (cRect (565,550, 1024,600));
+      if (!(frame % 25))
+        lcd->info ("frame " + dec (frame));
+      }
+    else {
+      for (int sample = 0; sample < 8; sample++) {
+        int32_t value = int32_t(sin ((frame * 8 + sample) / 20.f) * 10000.f);
+        traceVec.addSample (0, value);
+        traceVec.addSample (1, value / 2);
+        traceVec.addSample (2, -value);
+        }
+      lcd->info ("frame " + dec (frame));
+      lcd->change();
+      }
+
+    auto startTime = chrono::steady_clock::now();
+    drawScene (lcd, traceVec, sizeTile, copyTile, frame);
+    auto us = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - startTime).count();
+    totalUs += us;
+
+    printf ("%s frame:%d us:%d draw:%dms", damage ? "damage" : "full", frame, (int)us, lcd->getDrawTime());
+    for (int stat = 0; stat < cLcd::eNumStats; stat++) {
+      totalStats[stat] += lcd->getStat (cLcd::eStat(stat));
+      printf (" %s:%d", kStatNames[stat], lcd->getStat (cLcd::eStat(stat)));
+      }
+    printf ("\n");
+    }
+
+  if (numFrames) {
+    printf ("average %s %d frames us:%d", damage ? "damage" : "full", numFrames, (int)(totalUs / numFrames));
+    for (int stat = 0; stat < cLcd::eNumStats; stat++)
+      printf (" %s:%d", kStatNames[stat], (int)(totalStats[stat] / numFrames));
+    printf (" dma2dPixels:%u\n", (hostGetDma2dPixels() - startPixels) / numFrames);
+    }
+  }
+//}}}
+
+//{{{
+int main (int argc, char** argv) {
+
+  int numFrames = argc > 1 ? atoi (argv[1]) : 100;
+
+  auto lcd = new cLcd();
+  lcd->init ("lcdBench host");
+
+  cTraceVec traceVec;
+  traceVec.addTrace (1024, 1, 3);
+
+  auto sizeTile = makeTile (cTile::eRgb888, 1600, 1200);
+  auto copyTile = makeTile (cTile::eYuvMcu422, 400, 304);
+
+  runPass (lcd, traceVec, sizeTile, copyTile, numFrames, false);
+  runPass (lcd, traceVec, sizeTile, copyTile, numFrames, true);
+
+  if (argc > 2) {
+    // let the line interrupt flip to the last presented frame
+    hostPoll();
+    writePpm (argv[2], hostGetShowBuffer());
+    }
+
+  delete sizeTile;
+  delete copyTile;
+  return 0;
+  }
+//}}}
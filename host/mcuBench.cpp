@@ -0,0 +1,325 @@
+// mcuBench.cpp - HOST_BUILD hw jpeg mcu stream to rgb565 tile, the hwJpegDecode conversion path
+// - encodes the photo, or the scaleBench test card, as gray, 4:4:4, 4:2:2 and 4:2:0 jpegs with the repo LibJPEG
+// - raw_data_out decode stands in for the hw decoder, its 8x8 blocks are packed into the mcu stream the
+//   JPEG out fifo delivers, Y blocks in raster order then Cb then Cr, edge mcus padded
+// - stream is fed to the jpeg_utils converter in kOutChunkSize chunks of whole mcus, as the mdma ping pong does
+// - checked against LibJPEG JCS_RGB without fancy upsampling, truncated to 565, converter luts round
+//   independently so a 1 step difference is expected, anything more is a layout or padding error
+// - memory is the mcu padded tile plus the two axi sram chunks, the previous path held a 6000x4000 yuv buffer
+// - build from host/, -I. picks up the jconfig.h stand in ahead of ../nucleo
+//     gcc -c -O2 -DHOST_BUILD -I. -I../nucleo -I../LibJPEG/include ../LibJPEG/source/*.c ../nucleo/jpeg_utils.c
+//     g++ -O2 -DHOST_BUILD -I. -I../nucleo -I../LibJPEG/include mcuBench.cpp *.o -o mcuBench
+// - run
+//     mcuBench [photo.ppm ...]
+//{{{  includes
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "host.h"
+#include "jpeglib.h"
+#include "../nucleo/jpeg_utils.h"
+
+using namespace std;
+//}}}
+
+// as jpeg.cpp
+const uint32_t kOutChunkSize = 0x8000;
+const uint32_t kPreviousYuvBytes = 6000 * 4000 * 2;
+
+enum eMode { eGray, e444, e422, e420, eNumModes };
+const char* kModeNames[eNumModes] = { "gray", "444", "422", "420" };
+const int kSamp[eNumModes][2] = { { 1,1 }, { 1,1 }, { 2,1 }, { 2,2 } };
+
+//{{{
+struct sImage {
+  int mWidth = 0;
+  int mHeight = 0;
+  vector<uint8_t> mRgb;
+  };
+//}}}
+//{{{
+bool readPpm (const char* fileName, sImage& image) {
+
+  FILE* file = fopen (fileName, "rb");
+  if (!file) {
+    printf ("readPpm %s open fail\n", fileName);
+    return false;
+    }
+
+  int maxValue = 0;
+  if ((fscanf (file, "P6 %d %d %d", &image.mWidth, &image.mHeight, &maxValue) != 3) || (maxValue != 255)) {
+    printf ("readPpm %s not a binary 8bit ppm\n", fileName);
+    fclose (file);
+    return false;
+    }
+  fgetc (file);
+
+  image.mRgb.resize (image.mWidth * image.mHeight * 3);
+  size_t got = fread (image.mRgb.data(), 3, image.mWidth * image.mHeight, file);
+  fclose (file);
+  return got == (size_t)(image.mWidth * image.mHeight);
+  }
+//}}}
+//{{{
+void testCard (sImage& image) {
+// scaleBench ramps and checkerboard, odd size so the edge mcus are partial
+
+  image.mWidth = 1601;
+  image.mHeight = 1203;
+  image.mRgb.resize (image.mWidth * image.mHeight * 3);
+  for (int y = 0; y < image.mHeight; y++)
+    for (int x = 0; x < image.mWidth; x++) {
+      auto pix = &image.mRgb[(y * image.mWidth + x) * 3];
+      pix[0] = (x * 255) / image.mWidth;
+      pix[1] = (y * 255) / image.mHeight;
+      pix[2] = ((x ^ y) & 0x20) ? 255 : 0;
+      }
+  }
+//}}}
+
+//{{{
+vector<uint8_t> encode (const sImage& image, eMode mode) {
+
+  jpeg_compress_struct cinfo;
+  jpeg_error_mgr jerr;
+  cinfo.err = jpeg_std_error (&jerr);
+  jpeg_create_compress (&cinfo);
+
+  unsigned char* buf = nullptr;
+  unsigned long size = 0;
+  jpeg_mem_dest (&cinfo, &buf, &size);
+
+  cinfo.image_width = image.mWidth;
+  cinfo.image_height = image.mHeight;
+  cinfo.input_components = 3;
+  cinfo.in_color_space = JCS_RGB;
+  jpeg_set_defaults (&cinfo);
+  jpeg_set_quality (&cinfo, 90, TRUE);
+  if (mode == eGray)
+    jpeg_set_colorspace (&cinfo, JCS_GRAYSCALE);
+  cinfo.comp_info[0].h_samp_factor = kSamp[mode][0];
+  cinfo.comp_info[0].v_samp_factor = kSamp[mode][1];
+
+  jpeg_start_compress (&cinfo, TRUE);
+  vector<uint8_t> line (image.mWidth * 3);
+  while (cinfo.next_scanline < cinfo.image_height) {
+    // JCS_RGB is bgr for RGB_RED 2
+    auto src = &image.mRgb[cinfo.next_scanline * image.mWidth * 3];
+    for (int x = 0; x < image.mWidth; x++) {
+      line[x*3] = src[x*3 + 2];
+      line[x*3 + 1] = src[x*3 + 1];
+      line[x*3 + 2] = src[x*3];
+      }
+    JSAMPROW row = line.data();
+    jpeg_write_scanlines (&cinfo, &row, 1);
+    }
+  jpeg_finish_compress (&cinfo);
+  jpeg_destroy_compress (&cinfo);
+
+  vector<uint8_t> jpeg (buf, buf + size);
+  free (buf);
+  return jpeg;
+  }
+//}}}
+//{{{
+vector<uint8_t> mcuStream (vector<uint8_t>& jpeg, uint32_t& numMcus) {
+// raw downsampled planes packed into hw decoder mcu order
+
+  jpeg_decompress_struct cinfo;
+  jpeg_error_mgr jerr;
+  cinfo.err = jpeg_std_error (&jerr);
+  jpeg_create_decompress (&cinfo);
+  jpeg_mem_src (&cinfo, jpeg.data(), jpeg.size());
+  jpeg_read_header (&cinfo, TRUE);
+  cinfo.raw_data_out = TRUE;
+  // else LibJPEG 8 upsamples chroma in the idct, the hw decoder outputs the coded blocks
+  cinfo.do_fancy_upsampling = FALSE;
+  jpeg_start_decompress (&cinfo);
+
+  int numComponents = cinfo.num_components;
+  int mcusPerRow = (cinfo.image_width + (cinfo.max_h_samp_factor * 8) - 1) / (cinfo.max_h_samp_factor * 8);
+  int mcuRows = (cinfo.image_height + (cinfo.max_v_samp_factor * 8) - 1) / (cinfo.max_v_samp_factor * 8);
+  numMcus = mcusPerRow * mcuRows;
+
+  // one mcu row of each plane, padded to whole mcus
+  vector<vector<uint8_t>> planes (numComponents);
+  vector<vector<JSAMPROW>> rows (numComponents);
+  int pitch[3];
+  int mcuBytes = 0;
+  for (int c = 0; c < numComponents; c++) {
+    auto comp = &cinfo.comp_info[c];
+    pitch[c] = mcusPerRow * comp->h_samp_factor * 8;
+    planes[c].resize (pitch[c] * comp->v_samp_factor * 8);
+    for (int y = 0; y < comp->v_samp_factor * 8; y++)
+      rows[c].push_back (&planes[c][y * pitch[c]]);
+    mcuBytes += comp->h_samp_factor * comp->v_samp_factor * 64;
+    }
+
+  vector<uint8_t> stream (numMcus * mcuBytes);
+  auto dst = stream.data();
+  for (int mcuRow = 0; mcuRow < mcuRows; mcuRow++) {
+    JSAMPARRAY data[3] = { rows[0].data(), numComponents > 1 ? rows[1].data() : nullptr, numComponents > 2 ? rows[2].data() : nullptr };
+    jpeg_read_raw_data (&cinfo, data, cinfo.max_v_samp_factor * 8);
+
+    for (int c = 0; c < numComponents; c++) {
+      // replicate the last decoded column into the padding, the hw decoder outputs dummy blocks there
+      auto comp = &cinfo.comp_info[c];
+      int width = comp->downsampled_width;
+      for (int y = 0; y < comp->v_samp_factor * 8; y++)
+        for (int x = width; x < pitch[c]; x++)
+          rows[c][y][x] = rows[c][y][width - 1];
+      }
+
+    for (int mcu = 0; mcu < mcusPerRow; mcu++)
+      for (int c = 0; c < numComponents; c++) {
+        auto comp = &cinfo.comp_info[c];
+        for (int v = 0; v < comp->v_samp_factor; v++)
+          for (int h = 0; h < comp->h_samp_factor; h++)
+            for (int y = 0; y < 8; y++) {
+              memcpy (dst, &rows[c][(v * 8) + y][(((mcu * comp->h_samp_factor) + h) * 8)], 8);
+              dst += 8;
+              }
+        }
+    }
+
+  jpeg_finish_decompress (&cinfo);
+  jpeg_destroy_decompress (&cinfo);
+  return stream;
+  }
+//}}}
+//{{{
+vector<uint8_t> reference (vector<uint8_t>& jpeg, double& ms) {
+// bgr, no fancy upsampling, the chroma replication the mcu converters do
+
+  auto startTime = chrono::steady_clock::now();
+
+  jpeg_decompress_struct cinfo;
+  jpeg_error_mgr jerr;
+  cinfo.err = jpeg_std_error (&jerr);
+  jpeg_create_decompress (&cinfo);
+  jpeg_mem_src (&cinfo, jpeg.data(), jpeg.size());
+  jpeg_read_header (&cinfo, TRUE);
+  cinfo.out_color_space = JCS_RGB;
+  cinfo.do_fancy_upsampling = FALSE;
+  jpeg_start_decompress (&cinfo);
+
+  vector<uint8_t> rgb (cinfo.output_width * cinfo.output_height * 3);
+  while (cinfo.output_scanline < cinfo.output_height) {
+    JSAMPROW row = &rgb[cinfo.output_scanline * cinfo.output_width * 3];
+    jpeg_read_scanlines (&cinfo, &row, 1);
+    }
+
+  jpeg_finish_decompress (&cinfo);
+  jpeg_destroy_decompress (&cinfo);
+
+  ms = chrono::duration<double, milli>(chrono::steady_clock::now() - startTime).count();
+  return rgb;
+  }
+//}}}
+
+//{{{
+void run (const char* name, const sImage& image) {
+
+  JPEG_InitPostProcColorTables();
+
+  for (int mode = 0; mode < eNumModes; mode++) {
+    auto jpeg = encode (image, eMode(mode));
+    uint32_t streamMcus;
+    auto stream = mcuStream (jpeg, streamMcus);
+    double referenceMs;
+    auto ref = reference (jpeg, referenceMs);
+
+    //{{{  converter from the header, as the HPD interrupt does
+    JPEG_ConfTypeDef conf;
+    conf.ColorSpace = mode == eGray ? JPEG_GRAYSCALE_COLORSPACE : JPEG_YCBCR_COLORSPACE;
+    conf.ChromaSubsampling = mode == e420 ? JPEG_420_SUBSAMPLING : mode == e422 ? JPEG_422_SUBSAMPLING : JPEG_444_SUBSAMPLING;
+    conf.ImageWidth = image.mWidth;
+    conf.ImageHeight = image.mHeight;
+    conf.ImageQuality = 0;
+
+    JPEG_YCbCrToRGB_Convert_Function convert;
+    uint32_t numMcus;
+    if (JPEG_GetDecodeColorConvertFunc (&conf, &convert, &numMcus) != HAL_OK) {
+      printf ("%s %s no converter\n", name, kModeNames[mode]);
+      continue;
+      }
+
+    uint32_t width;
+    uint32_t height;
+    uint32_t mcuBytes;
+    JPEG_GetDecodeOutputSize (&width, &height, &mcuBytes);
+    if ((numMcus != streamMcus) || (numMcus * mcuBytes != stream.size())) {
+      printf ("%s %s mcus %d:%d stream %d:%d mismatch\n",
+              name, kModeNames[mode], numMcus, mcuBytes, streamMcus, (int)stream.size());
+      continue;
+      }
+    //}}}
+    //{{{  convert in whole mcu chunks, through a chunk buffer as from axi sram
+    uint32_t chunkSize = (kOutChunkSize / mcuBytes) * mcuBytes;
+    vector<uint8_t> chunk (kOutChunkSize);
+    vector<uint16_t> tile (width * height);
+
+    int iterations = 0;
+    auto startTime = chrono::steady_clock::now();
+    chrono::duration<double, milli> elapsed;
+    do {
+      uint32_t mcuIndex = 0;
+      for (uint32_t offset = 0; offset < stream.size(); offset += chunkSize) {
+        uint32_t len = stream.size() - offset < chunkSize ? stream.size() - offset : chunkSize;
+        memcpy (chunk.data(), &stream[offset], len);
+        uint32_t convertedBytes;
+        mcuIndex += convert (chunk.data(), (uint8_t*)tile.data(), mcuIndex, len, &convertedBytes);
+        }
+      iterations++;
+      elapsed = chrono::steady_clock::now() - startTime;
+      } while (elapsed.count() < 200.0);
+    double convertMs = elapsed.count() / iterations;
+    //}}}
+    //{{{  compare image area against reference
+    int mismatches = 0;
+    int maxDiff = 0;
+    for (int y = 0; y < image.mHeight; y++)
+      for (int x = 0; x < image.mWidth; x++) {
+        uint16_t rgb565 = tile[(y * width) + x];
+        auto bgr = &ref[((y * image.mWidth) + x) * 3];
+        int diff[3] = { (rgb565 >> 11) - (bgr[2] >> 3), ((rgb565 >> 5) & 0x3F) - (bgr[1] >> 2), (rgb565 & 0x1F) - (bgr[0] >> 3) };
+        bool mismatch = false;
+        for (int c = 0; c < 3; c++) {
+          int absDiff = diff[c] < 0 ? -diff[c] : diff[c];
+          maxDiff = absDiff > maxDiff ? absDiff : maxDiff;
+          mismatch |= absDiff != 0;
+          }
+        mismatches += mismatch;
+        }
+    //}}}
+
+    double mPixels = (image.mWidth * image.mHeight) / 1000000.0;
+    uint32_t memory = (width * height * 2) + (2 * kOutChunkSize);
+    printf ("%-10s %-4s %4dx%-4d tile %4dx%-4d mcus:%6d chunk:%5d convert %6.2fms/MPixel  libjpeg %6.2fms/MPixel"
+            "  565 mismatch:%5.2f%% max:%d  memory:%5dk previous:%dk\n",
+            name, kModeNames[mode], image.mWidth, image.mHeight, width, height, numMcus, chunkSize,
+            convertMs / mPixels, referenceMs / mPixels,
+            (mismatches * 100.0) / (image.mWidth * image.mHeight), maxDiff,
+            memory / 1024, kPreviousYuvBytes / 1024);
+    }
+  }
+//}}}
+//{{{
+int main (int argc, char** argv) {
+
+  sImage image;
+  if (argc < 2) {
+    testCard (image);
+    run ("testCard", image);
+    }
+
+  for (int arg = 1; arg < argc; arg++)
+    if (readPpm (argv[arg], image)) {
+      const char* name = strrchr (argv[arg], '/');
+      run (name ? name + 1 : argv[arg], image);
+      }
+
+  return 0;
+  }
+//}}}
@@ -0,0 +1,232 @@
+// mergeBench.cpp - HOST_BUILD merged upsampling straight to rgb565 against the fancy upsampling path, per chroma mode
+// - the repo FatFs over the benchUtils ram disk, 4G FAT32 32k clusters like an SDHC card
+// - corpus is the parBench test card with noise, q90, 4:2:0, 4:2:2 and 4:4:4, odd sizes so the last pair is partial
+// - checked
+//     jdmerge   swJpegDecode merged, dithered and not, against libjpeg's own jdmerge rgb888 decode of the same file,
+//               dithered and packed here, must be the same pixels
+//     roi       swJpegDecodeRoi merged at an odd offset against the same rect of the merged full decode, undithered
+//     parallel  swJpegDecodeParallel merged on 4 threads, restart interval per mcu row, against swJpegDecode merged
+// - timed, interleaved, best of 9, swJpegDecode fancy, the current path, and merged, at 8/8 down to 4/8, psnr of merged
+//   against fancy, 4:4:4 and 4/8 have nothing to merge, jpegMerged leaves them fancy
+// - build from host/, FatFs and LibJPEG as C, -I. picks up the jconfig.h stand in
+//     gcc -c -O2 -DHOST_BUILD -I. -I../nucleo -I../LibJPEG/include ../fatFs/*.c ../LibJPEG/source/*.c
+//     rm jmemnobs.o
+//     g++ -O2 -fpermissive -pthread -DHOST_BUILD -DFT2_BUILD_LIBRARY -I. -I../nucleo -I../LibJPEG/include -I../freetype/Inc
+//         mergeBench.cpp ../nucleo/swJpeg.cpp ../nucleo/jpegSimd.cpp ../nucleo/jpegThumb.cpp ../nucleo/jmemArena.cpp
+//         benchUtils.cpp host.cpp dma2d.cpp ../nucleo/cLcd.cpp ../common/utils.cpp <freetype> *.o -o mergeBench
+// - run
+//     mergeBench
+//{{{  includes
+#include <chrono>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "../nucleo/cLcd.h"
+#include "../nucleo/jpeg.h"
+#include "jpeglib.h"
+#include "benchUtils.h"
+
+using namespace std;
+//}}}
+
+const int kIterations = 9;
+
+// ordered dither thresholds, as swJpeg
+const uint8_t kBayer4[4][4] = { { 0,8,2,10 }, { 12,4,14,6 }, { 3,11,1,9 }, { 15,7,13,5 } };
+
+//{{{
+vector<uint16_t> jdmergeReference (const vector<uint8_t>& jpeg, int scale, bool dither, int& width, int& height) {
+// libjpeg's own merged upsampling to rgb888, then swJpeg's dither, added before the 565 truncation, and packed
+// - its clamp comes first here, the dither steps are below the truncation so that makes no difference
+
+  jpeg_decompress_struct cinfo;
+  jpeg_error_mgr jerr;
+  cinfo.err = jpeg_std_error (&jerr);
+  jpeg_create_decompress (&cinfo);
+  jpeg_mem_src (&cinfo, (unsigned char*)jpeg.data(), jpeg.size());
+  jpeg_read_header (&cinfo, TRUE);
+  cinfo.scale_num = scale;
+  cinfo.scale_denom = 8;
+  cinfo.dct_method = JDCT_ISLOW;
+  cinfo.out_color_space = JCS_RGB;
+  cinfo.do_fancy_upsampling = FALSE;
+  jpeg_start_decompress (&cinfo);
+
+  width = cinfo.output_width;
+  height = cinfo.output_height;
+  vector<uint8_t> bgr (width * height * 3);
+  while (cinfo.output_scanline < cinfo.output_height) {
+    JSAMPROW rows[2] = { &bgr[cinfo.output_scanline * width * 3], nullptr };
+    if (cinfo.output_scanline + 1 < cinfo.output_height)
+      rows[1] = &bgr[(cinfo.output_scanline + 1) * width * 3];
+    jpeg_read_scanlines (&cinfo, rows, rows[1] ? 2 : 1);
+    }
+  jpeg_finish_decompress (&cinfo);
+  jpeg_destroy_decompress (&cinfo);
+
+  vector<uint16_t> rgb565 (width * height);
+  for (int y = 0; y < height; y++)
+    for (int x = 0; x < width; x++) {
+      int bayer = dither ? (2 * kBayer4[y & 3][x & 3]) + 1 : 0;
+      auto pix = &bgr[((y * width) + x) * 3];
+      int r = pix[2] + (bayer >> 2);
+      int g = pix[1] + (bayer >> 3);
+      int b = pix[0] + (bayer >> 2);
+      r = r > 255 ? 255 : r;
+      g = g > 255 ? 255 : g;
+      b = b > 255 ? 255 : b;
+      rgb565[(y * width) + x] = uint16_t(((r & 0xF8) << 8) | ((g & 0xFC) << 3) | (b >> 3));
+      }
+
+  return rgb565;
+  }
+//}}}
+
+//{{{
+bool samePixels (const cTile* tile, const vector<uint16_t>& ref, int width, int height) {
+
+  return tile && (tile->mWidth == width) && (tile->mHeight == height) &&
+         !memcmp (tile->mPiccy, ref.data(), width * height * 2);
+  }
+//}}}
+//{{{
+bool sameRect (const cTile* tile, const cTile* ref, const cRect& rect) {
+// tile against rect of ref
+
+  if (!tile || !ref || (tile->mWidth != rect.getWidth()) || (tile->mHeight != rect.getHeight()))
+    return false;
+
+  auto pix = (const uint16_t*)tile->mPiccy;
+  auto refPix = (const uint16_t*)ref->mPiccy;
+  for (int y = 0; y < rect.getHeight(); y++)
+    if (memcmp (pix + (y * tile->mWidth), refPix + ((rect.top + y) * ref->mWidth) + rect.left, rect.getWidth() * 2))
+      return false;
+  return true;
+  }
+//}}}
+//{{{
+double psnr (const cTile* tile, const cTile* ref) {
+// rgb565 expanded to 8 bits a channel
+
+  auto pix = (const uint16_t*)tile->mPiccy;
+  auto refPix = (const uint16_t*)ref->mPiccy;
+  double sum = 0.0;
+  int numPixels = tile->mWidth * tile->mHeight;
+  for (int i = 0; i < numPixels; i++) {
+    int r = ((pix[i] >> 11) - (refPix[i] >> 11)) << 3;
+    int g = (((pix[i] >> 5) & 0x3F) - ((refPix[i] >> 5) & 0x3F)) << 2;
+    int b = ((pix[i] & 0x1F) - (refPix[i] & 0x1F)) << 3;
+    sum += (r * r) + (g * g) + (b * b);
+    }
+
+  double mse = sum / (numPixels * 3.0);
+  return mse > 0.0 ? 10.0 * log10 ((255.0 * 255.0) / mse) : 99.0;
+  }
+//}}}
+//{{{
+cTile* timeDecode (const string& fileName, const cPoint& size, bool merged, double& bestMs) {
+// one decode, best time kept
+
+  jpegMergedEnable (merged);
+  auto startTime = chrono::steady_clock::now();
+  auto tile = swJpegDecode (fileName, size, false);
+  double ms = getMs (startTime);
+  bestMs = ms < bestMs ? ms : bestMs;
+  return tile;
+  }
+//}}}
+
+//{{{
+bool check (const string& name, const sImage& image, int hSamp, int vSamp) {
+
+  auto jpeg = encode (image, hSamp, vSamp, 1);
+  string fileName = "merge.jpg";
+  if (!writeRamFile (fileName, jpeg))
+    return false;
+
+  bool same = true;
+  string line;
+  jpegMergedEnable (true);
+  for (int scale : { 8, 7, 6, 5 }) {
+    cPoint size ((image.mWidth * scale) / 8, (image.mHeight * scale) / 8);
+    for (bool dither : { false, true }) {
+      int width;
+      int height;
+      auto ref = jdmergeReference (jpeg, scale, dither, width, height);
+      auto tile = swJpegDecode (fileName, size, dither);
+      bool ok = samePixels (tile, ref, width, height);
+      same &= ok;
+      line += "  " + to_string (scale) + "/8" + (dither ? "d" : " ") + (ok ? " same" : " diff");
+      delete tile;
+      }
+    }
+  printf ("%s jdmerge%s\n", name.c_str(), line.c_str());
+
+  // odd rect, odd first column and row, batches of one row above it
+  auto full = swJpegDecode (fileName, cPoint (image.mWidth, image.mHeight), false);
+  cRect roi (101, 77, 101 + 333, 77 + 211);
+  auto roiTile = swJpegDecodeRoi (fileName, roi, cPoint (roi.getWidth(), roi.getHeight()), false);
+  bool roiSame = sameRect (roiTile, full, roi);
+
+  auto parallelTile = swJpegDecodeParallel (fileName, cPoint (image.mWidth, image.mHeight), false, 4);
+  bool parallelSame = sameTile (parallelTile, full);
+  printf ("%s roi %s parallel %s\n", name.c_str(), roiSame ? "same" : "diff", parallelSame ? "same" : "diff");
+
+  delete parallelTile;
+  delete roiTile;
+  delete full;
+  jpegMergedEnable (false);
+  return same && roiSame && parallelSame;
+  }
+//}}}
+//{{{
+void bench (const string& name, const sImage& image, int hSamp, int vSamp) {
+
+  string fileName = "merge.jpg";
+  if (!writeRamFile (fileName, encode (image, hSamp, vSamp, 0)))
+    return;
+
+  for (int scale : { 8, 6, 5, 4 }) {
+    cPoint size ((image.mWidth * scale) / 8, (image.mHeight * scale) / 8);
+    // interleaved, the best of each
+    double fancyMs = 1e9;
+    double mergedMs = 1e9;
+    cTile* fancy = nullptr;
+    cTile* merged = nullptr;
+    for (int i = 0; i < kIterations; i++) {
+      delete fancy;
+      delete merged;
+      fancy = timeDecode (fileName, size, false, fancyMs);
+      merged = timeDecode (fileName, size, true, mergedMs);
+      }
+    printf ("%s %d/8 fancy %7.2fms merged %7.2fms %4.2fx %5.1fdB\n",
+            name.c_str(), scale, fancyMs, mergedMs, fancyMs / mergedMs, psnr (merged, fancy));
+    delete merged;
+    delete fancy;
+    }
+  }
+//}}}
+
+//{{{
+int main (int argc, char** argv) {
+
+  if (!mountRamDisk())
+    return 1;
+
+  sImage odd;
+  testCard (odd, 1001, 667, 12);
+  bool same = check ("1001x667 4:2:0", odd, 2, 2);
+  same &= check ("1001x667 4:2:2", odd, 2, 1);
+  printf ("%s\n", same ? "all same" : "some diff");
+
+  sImage image;
+  testCard (image, 3000, 2000, 12);
+  bench ("3000x2000 4:2:0", image, 2, 2);
+  bench ("3000x2000 4:2:2", image, 2, 1);
+  bench ("3000x2000 4:4:4", image, 1, 1);
+
+  unmountRamDisk();
+  return same ? 0 : 1;
+  }
+//}}}
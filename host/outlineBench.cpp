@@ -0,0 +1,114 @@
+// outlineBench.cpp - HOST_BUILD cOutline cell sort microbenchmark
+// - y bucket sortCells against the previous pointer fill and qsortCells, over the same cells
+// - clock scene from lcdBench, large random polygons, some cells at -ve x
+// - cOutline is local to cLcd.cpp, so it is included rather than linked
+// - build from host/, like lcdBench without ../nucleo/cLcd.cpp
+//     g++ -m32 -O2 -DHOST_BUILD -DFT2_BUILD_LIBRARY -I. -I../freetype/Inc -I../nucleo
+//         outlineBench.cpp host.cpp dma2d.cpp ../common/utils.cpp <freetype> -o outlineBench
+// - run
+//     outlineBench [iterations]
+//{{{  includes
+#include "../nucleo/cLcd.cpp"
+
+#include <chrono>
+//}}}
+
+//{{{
+class cOutlineBench {
+public:
+  //{{{
+  static void run (const char* name, int iterations) {
+
+    // close the path and add the last cell, getSortedCells sorts once
+    mOutline.getSortedCells();
+    uint16_t numCells = mOutline.mNumCells;
+    if (!numCells)
+      return;
+
+    // bucket sort
+    auto startTime = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++)
+      mOutline.sortCells();
+    auto bucketNs = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime).count();
+
+    auto bucketCells = (sCell**)malloc (numCells * sizeof(sCell*));
+    memcpy (bucketCells, mOutline.mSortedCells, numCells * sizeof(sCell*));
+
+    // previous sort, fill pointers in block order then qsortCells
+    startTime = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) {
+      sCell** sortedPtr = mOutline.mSortedCells;
+      for (uint16_t cell = 0; cell < numCells; cell++)
+        *sortedPtr++ = mOutline.mBlockOfCells[cell / mOutline.mNumCellsInBlock] + (cell % mOutline.mNumCellsInBlock);
+      mOutline.qsortCells (mOutline.mSortedCells, numCells);
+      }
+    auto qsortNs = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime).count();
+
+    int mismatches = 0;
+    for (uint16_t cell = 0; cell < numCells; cell++)
+      if (bucketCells[cell]->mPackedCoord != mOutline.mSortedCells[cell]->mPackedCoord)
+        mismatches++;
+    free (bucketCells);
+
+    printf ("%-12s cells:%5d rows:%4d bucket:%6.1fMcells/s qsort:%6.1fMcells/s x%.2f%s\n",
+            name, numCells, (int)(mOutline.mMaxy - mOutline.mMiny),
+            (numCells * 1000.0 * iterations) / bucketNs, (numCells * 1000.0 * iterations) / qsortNs,
+            double(qsortNs) / bucketNs, mismatches ? " ORDER MISMATCH" : "");
+
+    mOutline.reset();
+    }
+  //}}}
+  };
+//}}}
+
+//{{{
+void randomPolygon (cLcd* lcd, uint32_t& seed, int numPoints, float width, float height) {
+
+  for (int point = 0; point < numPoints; point++) {
+    seed = seed * 1664525 + 1013904223;
+    float x = ((seed >> 8) & 0xFFFF) * width / 0x10000 - 40.f;
+    seed = seed * 1664525 + 1013904223;
+    float y = ((seed >> 8) & 0xFFFF) * height / 0x10000;
+    if (point)
+      lcd->aLineTo (cPointF (x, y));
+    else
+      lcd->aMoveTo (cPointF (x, y));
+    }
+  }
+//}}}
+
+//{{{
+int main (int argc, char** argv) {
+
+  int iterations = argc > 1 ? atoi (argv[1]) : 200;
+
+  // only the outline methods are used, no init
+  auto lcd = new cLcd();
+
+  // clock scene shapes
+  cPointF centre (1024.f-105.f, 600.f-105.f-40.f);
+  float radius = 100.f;
+  lcd->aEllipse (centre, cPointF (radius-4.f, radius), 64);
+  cOutlineBench::run ("clockFace", iterations);
+  lcd->aEllipseOutline (centre, cPointF (radius, radius), 4.f, 64);
+  cOutlineBench::run ("clockRing", iterations);
+  lcd->aPointedLine (centre, centre + cPointF (radius * 0.75f, radius * 0.3f), radius / 20.f);
+  lcd->aPointedLine (centre, centre + cPointF (-radius * 0.2f, radius * 0.9f), radius / 20.f);
+  cOutlineBench::run ("clockHands", iterations);
+
+  // bigger clock
+  lcd->aEllipse (cPointF (512.f, 300.f), cPointF (270.f, 270.f), 64);
+  cOutlineBench::run ("bigFace", iterations);
+
+  // large random polygons, cells live in dtcm blocks so keep them under ~10k cells
+  uint32_t seed = 1;
+  randomPolygon (lcd, seed, 6, 1024.f, 600.f);
+  cOutlineBench::run ("random6", iterations);
+  randomPolygon (lcd, seed, 10, 1024.f, 600.f);
+  cOutlineBench::run ("random10", iterations);
+  randomPolygon (lcd, seed, 14, 1024.f, 600.f);
+  cOutlineBench::run ("random14", iterations);
+
+  return 0;
+  }
+//}}}
@@ -0,0 +1,96 @@
+// parBench.cpp - HOST_BUILD swJpegDecodeParallel restart interval bands on 1 to N threads against swJpegDecode
+// - the repo FatFs over the benchUtils ram disk, 4G FAT32 32k clusters like an SDHC card
+// - corpus is the scaleBench test card with noise at 6000x4000, 4:2:2 and 4:2:0 with a restart interval per mcu row,
+//   4:2:0 with one every 4 mcu rows, and every 7 mcus, only intervals starting an mcu row are bands,
+//   4:2:0 without restarts, the serial fallback
+// - 8/8 and 4/8 dithered, every thread count must match swJpegDecode exactly
+// - ms best of 3 including the index, the file read and the band setup, speedup against 1 thread,
+//   which is swJpegDecode itself
+// - build from host/, FatFs and LibJPEG as C, -I. picks up the jconfig.h stand in
+//     gcc -c -O2 -DHOST_BUILD -I. -I../nucleo -I../LibJPEG/include ../fatFs/*.c ../LibJPEG/source/*.c
+//     rm jmemnobs.o
+//     g++ -O2 -fpermissive -pthread -DHOST_BUILD -DFT2_BUILD_LIBRARY -I. -I../nucleo -I../LibJPEG/include -I../freetype/Inc
+//         parBench.cpp ../nucleo/swJpeg.cpp ../nucleo/jpegSimd.cpp ../nucleo/jpegThumb.cpp ../nucleo/jmemArena.cpp
+//         benchUtils.cpp host.cpp dma2d.cpp ../nucleo/cLcd.cpp ../common/utils.cpp <freetype> *.o -o parBench
+// - run
+//     parBench [maxThreads]
+//{{{  includes
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../nucleo/cLcd.h"
+#include "../nucleo/jpeg.h"
+#include "jpeglib.h"
+#include "benchUtils.h"
+
+using namespace std;
+//}}}
+
+const int kWidth = 6000;
+const int kHeight = 4000;
+const int kIterations = 3;
+
+//{{{
+void run (const char* name, const vector<uint8_t>& jpeg, int maxThreads) {
+
+  string fileName = "par.jpg";
+  if (!writeRamFile (fileName, jpeg))
+    return;
+
+  sJpegIndex index;
+  jpegIndex (fileName, index);
+  printf ("%s %dk, %d restarts starting an mcu row\n", name, (int)jpeg.size() / 1000, (int)index.mRestarts.size());
+
+  for (int scale : { 8, 4 }) {
+    cPoint size ((kWidth * scale) / 8, (kHeight * scale) / 8);
+    auto ref = swJpegDecode (fileName, size, true);
+
+    string line;
+    double oneMs = 0.0;
+    for (int threads = 1; threads <= maxThreads; threads *= 2) {
+      double bestMs = 1e9;
+      bool same = true;
+      for (int i = 0; i < kIterations; i++) {
+        auto startTime = chrono::steady_clock::now();
+        auto tile = swJpegDecodeParallel (fileName, size, true, threads);
+        double ms = getMs (startTime);
+        bestMs = ms < bestMs ? ms : bestMs;
+        same &= sameTile (tile, ref);
+        delete tile;
+        }
+      oneMs = threads == 1 ? bestMs : oneMs;
+
+      char text[80];
+      snprintf (text, sizeof (text), "  %d %7.2fms %4.2fx %s", threads, bestMs, oneMs / bestMs, same ? "same" : "diff");
+      line += text;
+      }
+    printf ("  %d/8%s\n", scale, line.c_str());
+    delete ref;
+    }
+  }
+//}}}
+
+//{{{
+int main (int argc, char** argv) {
+
+  int maxThreads = argc > 1 ? atoi (argv[1]) : (int)thread::hardware_concurrency();
+  maxThreads = maxThreads < 4 ? 4 : maxThreads;
+
+  if (!mountRamDisk())
+    return 1;
+
+  printf ("%d hardware threads\n", (int)thread::hardware_concurrency());
+  sImage image;
+  testCard (image, kWidth, kHeight, 12);
+  run ("6000x4000 4:2:2 restart per row    ", encode (image, 2, 1, 1, 0), maxThreads);
+  run ("6000x4000 4:2:0 restart per row    ", encode (image, 2, 2, 1, 0), maxThreads);
+  run ("6000x4000 4:2:0 restart per 4 rows ", encode (image, 2, 2, 4, 0), maxThreads);
+  run ("6000x4000 4:2:0 restart per 7 mcus ", encode (image, 2, 2, 0, 7), maxThreads);
+  run ("6000x4000 4:2:0 no restarts        ", encode (image, 2, 2, 0, 0), maxThreads);
+
+  unmountRamDisk();
+  return 0;
+  }
+//}}}
@@ -0,0 +1,174 @@
+// pipeBench.cpp - HOST_BUILD cDecodeAhead pipeline against the serial decode then show loop
+// - the repo FatFs over the benchUtils sparse ram disk, 4G FAT32 32k clusters like an SDHC card,
+//   optional card rate, each disk read sleeps for its sectors at that rate, like the sdmmc dma wait the cpu is free for
+// - host.cpp xTaskCreate and queues are real threads and condition variables, the show loop runs on main
+// - corpus is the thumbBench test cards, three sizes, landscape and portrait, decoded to fit main.cpp's 1004x556 picture rect
+// - serial is the previous appThread loop, f_stat, decode, show for dwell ms, so every slide waits for its own decode
+// - pipe is main.cpp's slideshow, two slots held by the show loop, the rest decode ahead,
+//   thumbnail cache rebuild as the decoder idle work, per pool size
+//   - ms/slide, the slowest of decode and dwell when the pipe keeps up
+//   - decoder full stalls, pool exhausted, the back pressure, show empty stalls, nothing decoded yet
+//   - max queue depth, decoded slides waiting to show
+// - build from host/, FatFs and LibJPEG as C, -I. picks up the jconfig.h stand in
+//     gcc -c -O2 -DHOST_BUILD -I. -I../nucleo -I../LibJPEG/include ../fatFs/*.c ../LibJPEG/source/*.c
+//     rm jmemnobs.o
+//     g++ -O2 -fpermissive -pthread -DHOST_BUILD -DFT2_BUILD_LIBRARY -I. -I../nucleo -I../LibJPEG/include -I../freetype/Inc
+//         pipeBench.cpp ../nucleo/cDecodeAhead.cpp ../nucleo/cThumbCache.cpp ../nucleo/jpegThumb.cpp ../nucleo/swJpeg.cpp ../nucleo/jpegSimd.cpp ../nucleo/jmemArena.cpp
+//         benchUtils.cpp host.cpp dma2d.cpp ../nucleo/cLcd.cpp ../common/utils.cpp <freetype> *.o -o pipeBench
+// - run
+//     pipeBench [dwellMs [cardMBs]]
+//{{{  includes
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "../nucleo/cLcd.h"
+#include "../nucleo/jpeg.h"
+#include "../nucleo/cThumbCache.h"
+#include "../nucleo/cDecodeAhead.h"
+#include "jpeglib.h"
+#include "benchUtils.h"
+
+using namespace std;
+//}}}
+
+const cPoint kPanelSize (1024 - 20, 600 - 44); // main.cpp picture rect
+const cPoint kThumbSize (160,120);
+const uint16_t kPoolSizes[] = { 3, 4, 6 };
+
+vector<string> mFileVec;
+
+//{{{
+void makeCorpus() {
+
+  sImage image;
+  for (int i = 0; i < 12; i++) {
+    string fileName = "/img" + dec (i, 3, '0') + ".jpg";
+    switch (i % 3) {
+      case 0: testCard (image, 1600, 1200, 0, i); break;
+      case 1: testCard (image, 1200, 1600, 0, i); break;
+      default: testCard (image, 4000, 3000, 0, i); break;
+      }
+    auto jpeg = encode (image);
+
+    FIL file;
+    UINT written = 0;
+    if (f_open (&file, fileName.c_str(), FA_WRITE | FA_CREATE_ALWAYS) == FR_OK) {
+      f_write (&file, jpeg.data(), jpeg.size(), &written);
+      f_close (&file);
+      }
+    if (written == jpeg.size())
+      mFileVec.push_back (fileName);
+    else
+      printf ("makeCorpus %s write fail\n", fileName.c_str());
+    }
+  }
+//}}}
+
+//{{{
+cTile* decodeSlide (const string& fileName, void* context) {
+// main.cpp decodeSlide, sw decode
+  return swJpegDecode (fileName, kPanelSize, true);
+  }
+//}}}
+//{{{
+bool updateThumbs (void* context) {
+// main.cpp updateThumbs
+  return !((cThumbCache*)context)->update (mFileVec, 20);
+  }
+//}}}
+
+//{{{
+void serial (uint32_t dwell) {
+// previous appThread loop
+
+  double decodeMs = 0.0;
+  auto startTime = chrono::steady_clock::now();
+  for (auto& fileName : mFileVec) {
+    auto decodeTime = chrono::steady_clock::now();
+    FILINFO info;
+    f_stat (fileName.c_str(), &info);
+    auto tile = decodeSlide (fileName, nullptr);
+    decodeMs += getMs (decodeTime);
+    delete tile;
+    vTaskDelay (dwell);
+    }
+
+  double totalMs = getMs (startTime);
+  printf ("serial          %8.2fms %7.2fms/slide  decode %7.2fms/slide\n",
+          totalMs, totalMs / mFileVec.size(), decodeMs / mFileVec.size());
+  }
+//}}}
+//{{{
+void pipeline (uint16_t poolSize, uint32_t dwell) {
+// main.cpp slideshow, fresh thumbnail cache for the decoder idle work
+
+  f_unlink ("thumbs.bin");
+  cThumbCache thumbCache ("thumbs.bin", kThumbSize, false, true);
+  thumbCache.open();
+
+  auto startTime = chrono::steady_clock::now();
+  double firstMs = 0.0;
+  double totalMs = 0.0;
+  uint32_t slides = 0;
+  {
+  cDecodeAhead decodeAhead (mFileVec, poolSize, decodeSlide, updateThumbs, &thumbCache);
+  decodeAhead.start (3);
+
+  bool show = false;
+  cDecodeAhead::sSlot* showSlot[2] = { nullptr, nullptr };
+  while (auto slot = decodeAhead.get()) {
+    if (!slides++)
+      firstMs = getMs (startTime);
+
+    bool hide = !show;
+    if (showSlot[hide])
+      decodeAhead.release (showSlot[hide]);
+    showSlot[hide] = slot;
+    show = hide;
+    vTaskDelay (dwell);
+    // end of the last slide's dwell, not the end marker, that waits for the thumbnail rebuild
+    totalMs = getMs (startTime);
+    }
+
+  printf ("pipe pool %d %8.2fms %7.2fms/slide  decode %7.2fms/slide first %6.2fms  maxQueue %d  "
+          "full stalls %2d %8.2fms  empty stalls %2d %8.2fms  thumbs %d\n",
+          poolSize, totalMs, totalMs / slides, double(decodeAhead.getDecodeTime()) / decodeAhead.getNumDecoded(), firstMs,
+          decodeAhead.getMaxQueueDepth(),
+          decodeAhead.getFullStalls(), double(decodeAhead.getFullStallTime()),
+          decodeAhead.getEmptyStalls(), double(decodeAhead.getEmptyStallTime()), thumbCache.getNumThumbs());
+
+  for (auto slot : showSlot)
+    if (slot)
+      delete slot->mTile;
+  }
+  }
+//}}}
+
+//{{{
+int main (int argc, char** argv) {
+
+  uint32_t dwell = argc > 1 ? atoi (argv[1]) : 100;
+  mCardBytesPerUs = argc > 2 ? atof (argv[2]) : 0.0;
+
+  if (!mountRamDisk())
+    return 1;
+
+  // corpus written at ram speed
+  double cardBytesPerUs = mCardBytesPerUs;
+  mCardBytesPerUs = 0.0;
+  makeCorpus();
+  mCardBytesPerUs = cardBytesPerUs;
+
+  printf ("%d slides, dwell %dms, card %s\n", (int)mFileVec.size(), dwell,
+          mCardBytesPerUs > 0.0 ? (dec (int(mCardBytesPerUs)) + "MB/s").c_str() : "ram");
+
+  serial (dwell);
+  for (auto poolSize : kPoolSizes)
+    pipeline (poolSize, dwell);
+
+  unmountRamDisk();
+  return 0;
+  }
+//}}}
@@ -0,0 +1,165 @@
+// progBench.cpp - HOST_BUILD swJpegDecodeProgressive time to first preview against time to final
+// - the repo FatFs over the benchUtils ram disk, 4G FAT32 32k clusters like an SDHC card
+// - corpus is the parBench test card with noise, jpeg_simple_progression 4:2:0 q90, its 10 scans,
+//   plus any args copied onto the ram disk
+// - each file at 8/8 and fitted to the slideshow area
+//     swJpegDecode          single pass, the reference tile and time
+//     no previews           swJpegDecodeProgressive with wanted false, the buffered image overhead
+//     previews              wanted true, every preview the adaptive policy lets through, its time from the call,
+//                           its scan and its psnr against the final tile
+// - both final tiles must match swJpegDecode exactly
+// - build from host/, FatFs and LibJPEG as C, -I. picks up the jconfig.h stand in
+//     gcc -c -O2 -DHOST_BUILD -I. -I../nucleo -I../LibJPEG/include ../fatFs/*.c ../LibJPEG/source/*.c
+//     rm jmemnobs.o
+//     g++ -O2 -fpermissive -DHOST_BUILD -DFT2_BUILD_LIBRARY -I. -I../nucleo -I../LibJPEG/include -I../freetype/Inc
+//         progBench.cpp ../nucleo/swJpeg.cpp ../nucleo/jpegSimd.cpp ../nucleo/jpegThumb.cpp ../nucleo/jmemArena.cpp
+//         benchUtils.cpp host.cpp dma2d.cpp ../nucleo/cLcd.cpp ../common/utils.cpp <freetype> *.o -o progBench
+// - run
+//     progBench [photo.jpg ...]
+//{{{  includes
+#include <chrono>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "../nucleo/cLcd.h"
+#include "../nucleo/jpeg.h"
+#include "jpeglib.h"
+#include "benchUtils.h"
+
+using namespace std;
+//}}}
+
+// decodeSlide's show area
+const cPoint kSlideSize (1024 - 20, 600 - 44);
+
+//{{{
+bool readHostFile (const char* pathName, vector<uint8_t>& data) {
+
+  FILE* src = fopen (pathName, "rb");
+  if (!src) {
+    printf ("readHostFile %s open fail\n", pathName);
+    return false;
+    }
+
+  fseek (src, 0, SEEK_END);
+  data.resize (ftell (src));
+  fseek (src, 0, SEEK_SET);
+  bool ok = fread (data.data(), 1, data.size(), src) == data.size();
+  fclose (src);
+  return ok;
+  }
+//}}}
+
+//{{{
+double psnr (const cTile* tile, const cTile* ref) {
+// rgb565 expanded to 8 bits a channel
+
+  auto pix = (const uint16_t*)tile->mPiccy;
+  auto refPix = (const uint16_t*)ref->mPiccy;
+  double sum = 0.0;
+  int numPixels = tile->mWidth * tile->mHeight;
+  for (int i = 0; i < numPixels; i++) {
+    int r = ((pix[i] >> 11) - (refPix[i] >> 11)) << 3;
+    int g = (((pix[i] >> 5) & 0x3F) - ((refPix[i] >> 5) & 0x3F)) << 2;
+    int b = ((pix[i] & 0x1F) - (refPix[i] & 0x1F)) << 3;
+    sum += (r * r) + (g * g) + (b * b);
+    }
+
+  double mse = sum / (numPixels * 3.0);
+  return mse > 0.0 ? 10.0 * log10 ((255.0 * 255.0) / mse) : 99.0;
+  }
+//}}}
+
+//{{{
+struct sPreviews {
+  chrono::steady_clock::time_point mStartTime;
+  vector<cTile*> mTiles;
+  vector<int> mScans;
+  vector<double> mMs;
+  };
+//}}}
+//{{{
+bool wantNone (void* context) {
+  return false;
+  }
+//}}}
+//{{{
+bool wantAll (void* context) {
+  return true;
+  }
+//}}}
+//{{{
+void keepPreview (cTile* tile, int scan, void* context) {
+
+  auto previews = (sPreviews*)context;
+  previews->mMs.push_back (getMs (previews->mStartTime));
+  previews->mTiles.push_back (tile);
+  previews->mScans.push_back (scan);
+  }
+//}}}
+
+//{{{
+void run (const string& name, const vector<uint8_t>& jpeg) {
+
+  string fileName = "prog.jpg";
+  if (!writeRamFile (fileName, jpeg))
+    return;
+
+  printf ("%s %dk%s\n", name.c_str(), (int)jpeg.size() / 1000, jpegProgressive (fileName) ? " progressive" : "");
+
+  for (auto size : { cPoint (0x7FFF, 0x7FFF), kSlideSize }) {
+    auto startTime = chrono::steady_clock::now();
+    auto ref = swJpegDecode (fileName, size, true);
+    double refMs = getMs (startTime);
+    if (!ref)
+      continue;
+
+    startTime = chrono::steady_clock::now();
+    auto plain = swJpegDecodeProgressive (fileName, size, true, wantNone, keepPreview, nullptr);
+    double plainMs = getMs (startTime);
+
+    sPreviews previews;
+    previews.mStartTime = chrono::steady_clock::now();
+    auto tile = swJpegDecodeProgressive (fileName, size, true, wantAll, keepPreview, &previews);
+    double finalMs = getMs (previews.mStartTime);
+
+    printf ("  %4dx%-4d swJpegDecode %7.2fms  no previews %7.2fms %s  previews %7.2fms %s\n",
+            ref->mWidth, ref->mHeight, refMs, plainMs, sameTile (plain, ref) ? "same" : "diff",
+            finalMs, sameTile (tile, ref) ? "same" : "diff");
+    for (size_t i = 0; i < previews.mTiles.size(); i++) {
+      printf ("    scan %2d %7.2fms %5.1fdB\n", previews.mScans[i], previews.mMs[i], psnr (previews.mTiles[i], ref));
+      delete previews.mTiles[i];
+      }
+    if (!previews.mTiles.empty())
+      printf ("    first preview %4.1f%% of final\n", (100.0 * previews.mMs[0]) / finalMs);
+
+    delete tile;
+    delete plain;
+    delete ref;
+    }
+  }
+//}}}
+
+//{{{
+int main (int argc, char** argv) {
+
+  if (!mountRamDisk())
+    return 1;
+
+  for (auto size : { cPoint (1024, 768), cPoint (3000, 2000) }) {
+    sImage image;
+    testCard (image, size.x, size.y, 12);
+    run ("card " + to_string (size.x) + "x" + to_string (size.y) + " 4:2:0", encode (image, 2, 2, 0, 0, 90, true));
+    }
+
+  for (int arg = 1; arg < argc; arg++) {
+    vector<uint8_t> jpeg;
+    if (readHostFile (argv[arg], jpeg))
+      run (argv[arg], jpeg);
+    }
+
+  unmountRamDisk();
+  return 0;
+  }
+//}}}
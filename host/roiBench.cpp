@@ -0,0 +1,142 @@
+// roiBench.cpp - HOST_BUILD swJpegDecodeRoi against the full decode a zoom would otherwise need
+// - the repo FatFs over the benchUtils sparse ram disk, 4G FAT32 32k clusters like an SDHC card
+// - corpus is the scaleBench test card at 6000x4000, 24MP, 4:2:2 and 4:2:0 with a restart interval per mcu row,
+//   4:2:0 without restarts
+// - rois are the 1004x556 main.cpp picture rect at 1:1, top left, centre, bottom right, off the mcu grid,
+//   and a 2:1 zoom, a 2008x1112 roi at 4/8
+// - full is swJpegDecode of the whole image at the roi's scale, the roi cropped out of it is the reference,
+//   the roi decodes must match it exactly, undithered
+// - roi is no index, rows above entropy decoded only, index is jpegIndex restart jumps, index build time and sectors
+//   are per image, paid once for all the pans and zooms of it
+// - disk sectors stand in for card time, the rows above the roi are still read without an index
+// - build from host/, FatFs and LibJPEG as C, -I. picks up the jconfig.h stand in
+//     gcc -c -O2 -DHOST_BUILD -I. -I../nucleo -I../LibJPEG/include ../fatFs/*.c ../LibJPEG/source/*.c
+//     rm jmemnobs.o
+//     g++ -O2 -fpermissive -pthread -DHOST_BUILD -DFT2_BUILD_LIBRARY -I. -I../nucleo -I../LibJPEG/include -I../freetype/Inc
+//         roiBench.cpp ../nucleo/swJpeg.cpp ../nucleo/jpegSimd.cpp ../nucleo/jmemArena.cpp ../nucleo/jpegThumb.cpp benchUtils.cpp host.cpp dma2d.cpp ../nucleo/cLcd.cpp ../common/utils.cpp
+//         <freetype> *.o -o roiBench
+// - run
+//     roiBench
+//{{{  includes
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "../nucleo/cLcd.h"
+#include "../nucleo/jpeg.h"
+#include "jpeglib.h"
+#include "benchUtils.h"
+
+using namespace std;
+//}}}
+
+const cPoint kPanelSize (1024 - 20, 600 - 44); // main.cpp picture rect
+const int kWidth = 6000;
+const int kHeight = 4000;
+
+//{{{
+bool sameCrop (const cTile* tile, const cTile* full, int left, int top) {
+// tile against the same pixels of the full decode
+
+  if (!tile || !full || (left + tile->mWidth > full->mWidth) || (top + tile->mHeight > full->mHeight))
+    return false;
+
+  for (int y = 0; y < tile->mHeight; y++)
+    if (memcmp (tile->mPiccy + (y * tile->mWidth * 2),
+                full->mPiccy + ((((top + y) * full->mWidth) + left) * 2), tile->mWidth * 2))
+      return false;
+  return true;
+  }
+//}}}
+
+//{{{
+void run (const char* name, const vector<uint8_t>& jpeg) {
+
+  string fileName = "roi.jpg";
+  if (!writeRamFile (fileName, jpeg))
+    return;
+
+  mDiskSectors = 0;
+  auto startTime = chrono::steady_clock::now();
+  sJpegIndex index;
+  jpegIndex (fileName, index);
+  printf ("%s %dk, index %d restarts %6.2fms %d sectors\n",
+          name, (int)jpeg.size() / 1000, (int)index.mRestarts.size(), getMs (startTime), mDiskSectors);
+
+  //{{{
+  struct sRoi {
+    const char* mName;
+    cRect mRect;
+    };
+  //}}}
+  const sRoi kRois[] = {
+    { "1:1 top left    ", cRect (0,0, kPanelSize.x, kPanelSize.y) },
+    { "1:1 centre      ", cRect ((kWidth - kPanelSize.x) / 2, (kHeight - kPanelSize.y) / 2,
+                                 (kWidth + kPanelSize.x) / 2, (kHeight + kPanelSize.y) / 2) },
+    { "1:1 bottom right", cRect (kWidth - kPanelSize.x, kHeight - kPanelSize.y, kWidth, kHeight) },
+    { "1:1 off grid    ", cRect (1237, 2011, 1237 + kPanelSize.x, 2011 + kPanelSize.y) },
+    { "2:1 centre      ", cRect ((kWidth / 2) - kPanelSize.x, (kHeight / 2) - kPanelSize.y,
+                                 (kWidth / 2) + kPanelSize.x, (kHeight / 2) + kPanelSize.y) },
+    };
+
+  int fullScale = 0;
+  cTile* full = nullptr;
+  double fullMs = 0.0;
+  uint32_t fullSectors = 0;
+  for (auto& roi : kRois) {
+    int scale = roi.mRect.getWidth() > kPanelSize.x ? 4 : 8;
+    if (scale != fullScale) {
+      //{{{  full decode at this scale, the reference
+      delete full;
+      fullScale = scale;
+      mDiskSectors = 0;
+      startTime = chrono::steady_clock::now();
+      full = swJpegDecode (fileName, cPoint ((kWidth * scale) / 8, (kHeight * scale) / 8), false);
+      fullMs = getMs (startTime);
+      fullSectors = mDiskSectors;
+      }
+      //}}}
+
+    mDiskSectors = 0;
+    startTime = chrono::steady_clock::now();
+    auto tile = swJpegDecodeRoi (fileName, roi.mRect, kPanelSize, false);
+    double roiMs = getMs (startTime);
+    uint32_t roiSectors = mDiskSectors;
+
+    mDiskSectors = 0;
+    startTime = chrono::steady_clock::now();
+    auto indexTile = swJpegDecodeRoi (fileName, roi.mRect, kPanelSize, false, &index);
+    double indexMs = getMs (startTime);
+    uint32_t indexSectors = mDiskSectors;
+
+    int left = (roi.mRect.left * scale) / 8;
+    int top = (roi.mRect.top * scale) / 8;
+    printf ("  %s %d/8 full %7.2fms %5d sectors  roi %7.2fms %5d sectors %s  index %7.2fms %5d sectors %s\n",
+            roi.mName, scale, fullMs, fullSectors,
+            roiMs, roiSectors, sameCrop (tile, full, left, top) ? "same" : "diff",
+            indexMs, indexSectors, sameCrop (indexTile, full, left, top) ? "same" : "diff");
+
+    delete tile;
+    delete indexTile;
+    }
+
+  delete full;
+  }
+//}}}
+
+//{{{
+int main (int argc, char** argv) {
+
+  if (!mountRamDisk())
+    return 1;
+
+  sImage image;
+  testCard (image, kWidth, kHeight);
+  run ("6000x4000 4:2:2 restart per row", encode (image, 2, 1, 1));
+  run ("6000x4000 4:2:0 restart per row", encode (image, 2, 2, 1));
+  run ("6000x4000 4:2:0 no restarts    ", encode (image, 2, 2, 0));
+
+  unmountRamDisk();
+  return 0;
+  }
+//}}}
@@ -0,0 +1,293 @@
+// scaleBench.cpp - HOST_BUILD cLcd::size scaler quality and speed
+// - cScaler box/bilinear against the previous nearest neighbour size loop, same tile, same dest sizes
+// - PSNR against a double precision area average (down) or bilinear (up) of the rgb source,
+//   dest rgb565 expanded back to 8 bits, 565 truncation alone limits PSNR to ~40dB
+// - photos are binary .ppm, decoded on the pc, cropped to whole 4:2:2 mcus,
+//   each is scaled from an rgb888 and a yuv mcu tile, no args uses the lcdBench test card
+// - cScaler is local to cLcd.cpp, so it is included rather than linked
+// - build from host/, like outlineBench, add -mavx2 for the AVX2 vertical kernel
+//     g++ -m32 -O2 -DHOST_BUILD -DFT2_BUILD_LIBRARY -I. -I../freetype/Inc -I../nucleo
+//         scaleBench.cpp host.cpp dma2d.cpp ../common/utils.cpp <freetype> -o scaleBench
+// - run
+//     scaleBench [photo.ppm ...]
+//{{{  includes
+#include "../nucleo/cLcd.cpp"
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+//}}}
+
+//{{{
+struct sImage {
+  int mWidth = 0;
+  int mHeight = 0;
+  std::vector<uint8_t> mRgb;
+  };
+//}}}
+//{{{
+bool readPpm (const char* fileName, sImage& image) {
+
+  FILE* file = fopen (fileName, "rb");
+  if (!file) {
+    printf ("readPpm %s open fail\n", fileName);
+    return false;
+    }
+
+  int maxValue = 0;
+  if ((fscanf (file, "P6 %d %d %d", &image.mWidth, &image.mHeight, &maxValue) != 3) || (maxValue != 255)) {
+    printf ("readPpm %s not a binary 8bit ppm\n", fileName);
+    fclose (file);
+    return false;
+    }
+  fgetc (file);
+
+  // whole 16x8 mcus
+  int width = image.mWidth;
+  image.mWidth &= ~15;
+  image.mHeight &= ~7;
+  image.mRgb.resize (image.mWidth * image.mHeight * 3);
+  std::vector<uint8_t> line (width * 3);
+  for (int y = 0; y < image.mHeight; y++) {
+    if (fread (line.data(), 3, width, file) != (size_t)width)
+      break;
+    memcpy (&image.mRgb[y * image.mWidth * 3], line.data(), image.mWidth * 3);
+    }
+
+  fclose (file);
+  return true;
+  }
+//}}}
+//{{{
+void testCard (sImage& image) {
+// lcdBench makeTile ramps and checkerboard
+
+  image.mWidth = 1600;
+  image.mHeight = 1200;
+  image.mRgb.resize (image.mWidth * image.mHeight * 3);
+  for (int y = 0; y < image.mHeight; y++)
+    for (int x = 0; x < image.mWidth; x++) {
+      auto pix = &image.mRgb[(y * image.mWidth + x) * 3];
+      pix[0] = (x * 255) / image.mWidth;
+      pix[1] = (y * 255) / image.mHeight;
+      pix[2] = ((x ^ y) & 0x20) ? 255 : 0;
+      }
+  }
+//}}}
+//{{{
+cTile* makeTile (const sImage& image, cTile::eFormat format) {
+
+  int bytesPerPixel = format == cTile::eRgb888 ? 3 : 2;
+  auto piccy = sdRamAlloc (image.mWidth * image.mHeight * bytesPerPixel, "scaleTile");
+  auto tile = new cTile (piccy, format, image.mWidth, 0, 0, image.mWidth, image.mHeight);
+
+  for (int y = 0; y < image.mHeight; y++)
+    for (int x = 0; x < image.mWidth; x++) {
+      const uint8_t* rgb = &image.mRgb[(y * image.mWidth + x) * 3];
+      if (format == cTile::eRgb888) {
+        // libjpeg JCS_RGB order for RGB_RED 2
+        auto pix = piccy + (y * image.mWidth + x) * 3;
+        pix[0] = rgb[2];
+        pix[1] = rgb[1];
+        pix[2] = rgb[0];
+        }
+      else {
+        // full range BT.601, chroma of the even pixel of each pair
+        auto mcu = piccy + (((y / 8) * (image.mWidth / 16)) + (x / 16)) * 256;
+        double lum = 0.299 * rgb[0] + 0.587 * rgb[1] + 0.114 * rgb[2];
+        mcu[((x & 8) ? 64 : 0) + ((y & 7) * 8) + (x & 7)] = uint8_t(lum + 0.5);
+        if (!(x & 1)) {
+          double cb = 128.0 + (rgb[2] - lum) / 1.772;
+          double cr = 128.0 + (rgb[0] - lum) / 1.402;
+          mcu[128 + ((y & 7) * 8) + ((x / 2) & 7)] = uint8_t(cb < 0 ? 0 : cb > 255 ? 255 : cb + 0.5);
+          mcu[192 + ((y & 7) * 8) + ((x / 2) & 7)] = uint8_t(cr < 0 ? 0 : cr > 255 ? 255 : cr + 0.5);
+          }
+        }
+      }
+
+  return tile;
+  }
+//}}}
+
+//{{{
+std::vector<double> referenceAxis (int srcSize, int dstSize, int dst, int& start) {
+// double weights of one dest pixel, area average when shrinking, centre aligned bilinear when growing
+
+  std::vector<double> weights;
+  double scale = double(srcSize) / dstSize;
+  if (srcSize >= dstSize) {
+    double from = dst * scale;
+    double to = std::min ((dst + 1) * scale, double(srcSize));
+    start = int(from);
+    for (int pix = start; pix < to; pix++)
+      weights.push_back ((std::min (to, pix + 1.0) - std::max (from, double(pix))) / scale);
+    }
+  else {
+    double pos = std::min (std::max ((dst + 0.5) * scale - 0.5, 0.0), srcSize - 1.0);
+    start = int(pos);
+    weights.push_back (1.0 - (pos - start));
+    if (start + 1 < srcSize)
+      weights.push_back (pos - start);
+    }
+  return weights;
+  }
+//}}}
+//{{{
+std::vector<double> reference (const sImage& image, int dstWidth, int dstHeight) {
+
+  // horizontal
+  std::vector<double> rows (image.mHeight * dstWidth * 3);
+  for (int x = 0; x < dstWidth; x++) {
+    int start;
+    auto weights = referenceAxis (image.mWidth, dstWidth, x, start);
+    for (int y = 0; y < image.mHeight; y++)
+      for (size_t tap = 0; tap < weights.size(); tap++)
+        for (int c = 0; c < 3; c++)
+          rows[(y * dstWidth + x) * 3 + c] += weights[tap] * image.mRgb[(y * image.mWidth + start + tap) * 3 + c];
+    }
+
+  // vertical
+  std::vector<double> dst (dstWidth * dstHeight * 3);
+  for (int y = 0; y < dstHeight; y++) {
+    int start;
+    auto weights = referenceAxis (image.mHeight, dstHeight, y, start);
+    for (size_t tap = 0; tap < weights.size(); tap++)
+      for (int i = 0; i < dstWidth * 3; i++)
+        dst[y * dstWidth * 3 + i] += weights[tap] * rows[(start + tap) * dstWidth * 3 + i];
+    }
+
+  return dst;
+  }
+//}}}
+//{{{
+double psnr (const std::vector<double>& reference, const uint16_t* rgb565, int numPixels) {
+
+  double sum = 0.0;
+  for (int i = 0; i < numPixels; i++) {
+    uint16_t r = rgb565[i] >> 11;
+    uint16_t g = (rgb565[i] >> 5) & 0x3F;
+    uint16_t b = rgb565[i] & 0x1F;
+    double error[3] = { ((r << 3) | (r >> 2)) - reference[i*3], ((g << 2) | (g >> 4)) - reference[i*3+1], ((b << 3) | (b >> 2)) - reference[i*3+2] };
+    for (int c = 0; c < 3; c++)
+      sum += error[c] * error[c];
+    }
+  double mse = sum / (numPixels * 3);
+  return mse > 0.0 ? 10.0 * log10 ((255.0 * 255.0) / mse) : 99.0;
+  }
+//}}}
+
+//{{{
+void sizeNearest (cTile* tile, uint16_t width, uint16_t height, uint16_t* dst) {
+// previous cLcd::size, corner aligned nearest neighbour
+
+  uint32_t xStep16 = ((tile->mWidth - 1) << 16) / (width - 1);
+  uint32_t yStep16 = ((tile->mHeight - 1) << 16) / (height - 1);
+
+  for (uint16_t y = 0; y < height; y++) {
+    uint32_t srcY = tile->mY + ((y * yStep16) >> 16);
+    if (tile->mFormat == cTile::eRgb888) {
+      uint8_t* src = tile->mPiccy + srcY * tile->mPitch * 3;
+      for (uint16_t x = 0; x < width; x++) {
+        uint8_t* pix = src + (tile->mX + ((x * xStep16) >> 16)) * 3;
+        *dst++ = ((pix[2] >> 3) << 11) | ((pix[1] >> 2) << 5) | (pix[0] >> 3);
+        }
+      }
+    else {
+      cYuvMcu mcu (tile);
+      mcu.setRow (srcY);
+      for (uint16_t x = 0; x < width; x++)
+        *dst++ = mcu.getRgb565 (tile->mX + ((x * xStep16) >> 16));
+      }
+    }
+  }
+//}}}
+//{{{
+void sizeScaler (cTile* tile, uint16_t width, uint16_t height, uint16_t* dst) {
+
+  mScaler.set (tile, width, height);
+  for (uint16_t y = 0; y < height; y++) {
+    mScaler.filterRow (y);
+    mScaler.writeRow (dst + (y * width), 0, width);
+    }
+  }
+//}}}
+//{{{
+template <typename tSize> double timeMs (tSize size, cTile* tile, uint16_t width, uint16_t height, uint16_t* dst) {
+// repeat for at least 200ms
+
+  int iterations = 0;
+  auto startTime = std::chrono::steady_clock::now();
+  std::chrono::duration<double, std::milli> elapsed;
+  do {
+    size (tile, width, height, dst);
+    iterations++;
+    elapsed = std::chrono::steady_clock::now() - startTime;
+    } while (elapsed.count() < 200.0);
+
+  return elapsed.count() / iterations;
+  }
+//}}}
+
+//{{{
+void run (const char* name, const sImage& image) {
+
+  const int kBoxes[][2] = { { 160, 160 }, { 480, 360 }, { 1024, 600 } };
+  const char* kFormatNames[] = { "rgb565", "rgb888", "yuv422" };
+
+  for (auto format : { cTile::eRgb888, cTile::eYuvMcu422 }) {
+    auto tile = makeTile (image, format);
+
+    for (auto& box : kBoxes) {
+      // fit the box, keep aspect
+      int width = box[0];
+      int height = (image.mHeight * box[0]) / image.mWidth;
+      if (height > box[1]) {
+        height = box[1];
+        width = (image.mWidth * box[1]) / image.mHeight;
+        }
+
+      auto ref = reference (image, width, height);
+      std::vector<uint16_t> dst (width * height);
+
+      double nearestMs = timeMs (sizeNearest, tile, width, height, dst.data());
+      sizeNearest (tile, width, height, dst.data());
+      double nearestPsnr = psnr (ref, dst.data(), width * height);
+
+      double scalerMs = timeMs (sizeScaler, tile, width, height, dst.data());
+      sizeScaler (tile, width, height, dst.data());
+      double scalerPsnr = psnr (ref, dst.data(), width * height);
+
+      printf ("%-10s %s %4dx%-4d to %4dx%-4d nearest %6.2fms %5.2fdB  scaler %6.2fms %5.2fdB  rows converted:%d fetched:%d\n",
+              name, kFormatNames[format], image.mWidth, image.mHeight, width, height,
+              nearestMs, nearestPsnr, scalerMs, scalerPsnr,
+              mScaler.getRowsConverted(), mScaler.getRowFetches());
+      }
+
+    delete tile;
+    }
+  }
+//}}}
+//{{{
+int main (int argc, char** argv) {
+
+  auto lcd = new cLcd();
+  lcd->init ("scaleBench host");
+
+  printf ("scaler taps padded to %d\n", cScaler::kTapPad);
+
+  sImage image;
+  if (argc < 2) {
+    testCard (image);
+    run ("testCard", image);
+    }
+
+  for (int arg = 1; arg < argc; arg++)
+    if (readPpm (argv[arg], image)) {
+      const char* name = strrchr (argv[arg], '/');
+      run (name ? name + 1 : argv[arg], image);
+      }
+
+  return 0;
+  }
+//}}}
@@ -0,0 +1,377 @@
+// simdBench.cpp - HOST_BUILD jpegSimd kernels against the libjpeg routines and swJpeg table converter they replace
+// - blocks are the coefficients of the scaleBench test card 1920x1080 4:2:2 at q90 and q100, captured from
+//   a decode with their own quant tables, plus random wide blocks at q10 that overflow 16bits
+//   and take the libjpeg fallback
+// - idct8x8 against jpeg_idct_islow, idct4x4 against jpeg_idct_4x4, ycc against the swJpeg table loop,
+//   random rows and every dither phase, ns per block or pixel, every output byte must be the same
+// - dsp is the cortex-m7 kernel over the host.h intrinsic stand ins, checked here, its time means nothing on host
+// - end to end is swJpegDecode and swJpegDecodeRoi from the repo FatFs over a ram disk with each kernel set,
+//   1:1 and the 1004x556 main.cpp picture rect, dithered and not, tiles must match the none decode
+// - build from host/, FatFs and LibJPEG as C without jmemnobs.c, -I. picks up the jconfig.h stand in
+//     gcc -c -O2 -DHOST_BUILD -I. -I../nucleo -I../LibJPEG/include ../fatFs/*.c ../LibJPEG/source/*.c
+//     rm jmemnobs.o
+//     g++ -O2 -fpermissive -DHOST_BUILD -DFT2_BUILD_LIBRARY -I. -I../nucleo -I../LibJPEG/include -I../freetype/Inc
+//         simdBench.cpp ../nucleo/swJpeg.cpp ../nucleo/jpegSimd.cpp ../nucleo/jpegThumb.cpp ../nucleo/jmemArena.cpp
+//         benchUtils.cpp host.cpp dma2d.cpp ../nucleo/cLcd.cpp ../common/utils.cpp <freetype> *.o -o simdBench
+// - run
+//     simdBench [iterations]
+//{{{  includes
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../nucleo/cLcd.h"
+#include "../nucleo/jpeg.h"
+#include "../nucleo/jpegSimd.h"
+#include "benchUtils.h"
+
+extern "C" {
+  #include "jdct.h"
+  }
+
+using namespace std;
+//}}}
+
+const cPoint kPanelSize (1024 - 20, 600 - 44); // main.cpp picture rect
+const int kWidth = 1920;
+const int kHeight = 1080;
+const eJpegSimd kSimds[] = { eJpegSimdNone, eJpegSimdDsp, eJpegSimdSse2, eJpegSimdAvx2 };
+
+//{{{  blocks
+//{{{
+struct sBlock {
+  JCOEF mCoef[DCTSIZE2];
+  int mTable;
+  };
+//}}}
+
+vector<sBlock> mBlocks;
+vector<vector<ISLOW_MULT_TYPE>> mTables;
+
+//{{{
+void captureIdct (j_decompress_ptr cinfo, jpeg_component_info* compptr, JCOEFPTR coefBlock,
+                  JSAMPARRAY outputBuf, JDIMENSION outputCol) {
+// keep the block and its component's table, then the libjpeg routine
+
+  sBlock block;
+  memcpy (block.mCoef, coefBlock, sizeof (block.mCoef));
+  block.mTable = (int)mTables.size() - cinfo->num_components + compptr->component_index;
+  mBlocks.push_back (block);
+  jpeg_idct_islow (cinfo, compptr, coefBlock, outputBuf, outputCol);
+  }
+//}}}
+//{{{
+void addBlocks (const vector<uint8_t>& jpeg) {
+// every block of every component and its islow dct_table, captured from a decode,
+// jmorecfg.h leaves out D_MULTISCAN_FILES_SUPPORTED so there is no jpeg_read_coefficients
+
+  jpeg_decompress_struct cinfo;
+  jpeg_error_mgr jerr;
+  cinfo.err = jpeg_std_error (&jerr);
+  jpeg_create_decompress (&cinfo);
+  jpeg_mem_src (&cinfo, (unsigned char*)jpeg.data(), jpeg.size());
+  jpeg_read_header (&cinfo, TRUE);
+  cinfo.dct_method = JDCT_ISLOW;
+  jpeg_start_decompress (&cinfo);
+
+  for (int ci = 0; ci < cinfo.num_components; ci++) {
+    auto table = (const ISLOW_MULT_TYPE*)cinfo.comp_info[ci].dct_table;
+    mTables.push_back (vector<ISLOW_MULT_TYPE> (table, table + DCTSIZE2));
+    cinfo.idct->inverse_DCT[ci] = captureIdct;
+    }
+
+  vector<JSAMPLE> line (cinfo.output_width * cinfo.output_components);
+  while (cinfo.output_scanline < cinfo.output_height) {
+    JSAMPROW row = line.data();
+    jpeg_read_scanlines (&cinfo, &row, 1);
+    }
+
+  jpeg_finish_decompress (&cinfo);
+  jpeg_destroy_decompress (&cinfo);
+  }
+//}}}
+//{{{
+void addRandomBlocks (int count) {
+// q10 luma table, coefficients to +-1023, the dequantized values and pass 1 rows overflow 16bits
+
+  static const int kQ10[DCTSIZE2] = {
+    80, 55, 50, 80, 120, 200, 255, 255,  60, 60, 70, 95, 130, 255, 255, 255,
+    70, 65, 80, 120, 200, 255, 255, 255,  70, 85, 110, 145, 255, 255, 255, 255,
+    90, 110, 185, 255, 255, 255, 255, 255,  120, 175, 255, 255, 255, 255, 255, 255,
+    245, 255, 255, 255, 255, 255, 255, 255,  255, 255, 255, 255, 255, 255, 255, 255 };
+  mTables.push_back (vector<ISLOW_MULT_TYPE> (kQ10, kQ10 + DCTSIZE2));
+
+  mt19937 random (19);
+  for (int i = 0; i < count; i++) {
+    sBlock block;
+    memset (block.mCoef, 0, sizeof (block.mCoef));
+    int terms = random() % DCTSIZE2;
+    for (int k = 0; k <= terms; k++)
+      block.mCoef[random() % DCTSIZE2] = (JCOEF)((int)(random() % 2047) - 1023);
+    block.mTable = (int)mTables.size() - 1;
+    mBlocks.push_back (block);
+    }
+  }
+//}}}
+//}}}
+//{{{  kernels
+jpeg_decompress_struct mCinfo;
+jpeg_error_mgr mJerr;
+
+//{{{
+void rangeLimitCinfo (const vector<uint8_t>& jpeg) {
+// a started decompress, the idcts only take its IDCT_range_limit
+
+  mCinfo.err = jpeg_std_error (&mJerr);
+  jpeg_create_decompress (&mCinfo);
+  jpeg_mem_src (&mCinfo, (unsigned char*)jpeg.data(), jpeg.size());
+  jpeg_read_header (&mCinfo, TRUE);
+  jpeg_start_decompress (&mCinfo);
+  }
+//}}}
+//{{{
+int idctSame (inverse_DCT_method_ptr idct, inverse_DCT_method_ptr reference, int size, int iterations, double& ns) {
+// blocks whose output differs from the libjpeg routine, ns per block
+
+  vector<jpeg_component_info> comps (mTables.size());
+  for (size_t i = 0; i < mTables.size(); i++)
+    comps[i].dct_table = mTables[i].data();
+
+  JSAMPLE out[DCTSIZE][DCTSIZE];
+  JSAMPLE ref[DCTSIZE][DCTSIZE];
+  JSAMPROW outRows[DCTSIZE];
+  JSAMPROW refRows[DCTSIZE];
+  for (int row = 0; row < DCTSIZE; row++) {
+    outRows[row] = out[row];
+    refRows[row] = ref[row];
+    }
+
+  int diffs = 0;
+  for (auto& block : mBlocks) {
+    // the kernels leave coefBlock as it was, libjpeg's routines too
+    memset (out, 0, sizeof (out));
+    memset (ref, 0, sizeof (ref));
+    idct (&mCinfo, &comps[block.mTable], block.mCoef, outRows, 0);
+    reference (&mCinfo, &comps[block.mTable], block.mCoef, refRows, 0);
+    for (int row = 0; row < size; row++)
+      if (memcmp (out[row], ref[row], size)) {
+        diffs++;
+        break;
+        }
+    }
+
+  auto startTime = chrono::steady_clock::now();
+  for (int i = 0; i < iterations; i++)
+    for (auto& block : mBlocks)
+      idct (&mCinfo, &comps[block.mTable], block.mCoef, outRows, 0);
+  ns = (getMs (startTime) * 1000000.0) / (double(iterations) * mBlocks.size());
+
+  return diffs;
+  }
+//}}}
+//{{{
+void yccTable (const JSAMPLE* yRow, const JSAMPLE* cbRow, const JSAMPLE* crRow, uint16_t* dst,
+               JDIMENSION count, const uint8_t* dither5, const uint8_t* dither6) {
+// swJpeg yccRgb565Convert table loop, its fix() tables
+
+  static int32_t crR[MAXJSAMPLE+1];
+  static int32_t cbB[MAXJSAMPLE+1];
+  static int32_t crG[MAXJSAMPLE+1];
+  static int32_t cbG[MAXJSAMPLE+1];
+  if (!crR[0])
+    for (int i = 0, x = -CENTERJSAMPLE; i <= MAXJSAMPLE; i++, x++) {
+      crR[i] = ((int32_t)(1.40200 * 65536 + 0.5) * x + 32768) >> 16;
+      cbB[i] = ((int32_t)(1.77200 * 65536 + 0.5) * x + 32768) >> 16;
+      crG[i] = -(int32_t)(0.71414 * 65536 + 0.5) * x;
+      cbG[i] = -(int32_t)(0.34414 * 65536 + 0.5) * x + 32768;
+      }
+
+  JSAMPLE* rangeLimit = mCinfo.sample_range_limit;
+  for (JDIMENSION x = 0; x < count; x++) {
+    int y = yRow[x];
+    int d5 = dither5[x & 3];
+    uint32_t r = rangeLimit[y + crR[crRow[x]] + d5];
+    uint32_t g = rangeLimit[y + ((cbG[cbRow[x]] + crG[crRow[x]]) >> 16) + dither6[x & 3]];
+    uint32_t b = rangeLimit[y + cbB[cbRow[x]] + d5];
+    dst[x] = ((r & 0xF8) << 8) | ((g & 0xFC) << 3) | (b >> 3);
+    }
+  }
+//}}}
+//{{{
+int yccSame (tYccRgb565Row ycc, int iterations, double& ns) {
+// rows whose pixels differ from the table loop, every length to 64 then a 1920 row, each dither phase, ns per pixel
+
+  const int kRowWidth = kWidth;
+  const int kRows = 64;
+
+  mt19937 random (565);
+  vector<JSAMPLE> yRows (kRows * kRowWidth);
+  vector<JSAMPLE> cbRows (kRows * kRowWidth);
+  vector<JSAMPLE> crRows (kRows * kRowWidth);
+  for (int i = 0; i < kRows * kRowWidth; i++) {
+    yRows[i] = random() & 0xFF;
+    cbRows[i] = random() & 0xFF;
+    crRows[i] = random() & 0xFF;
+    }
+
+  // the swJpeg dither offsets, one row of kBayer4, and none
+  static const uint8_t kDither5[2][4] = { { 0, 4, 1, 5 }, { 0, 0, 0, 0 } };
+  static const uint8_t kDither6[2][4] = { { 0, 2, 0, 2 }, { 0, 0, 0, 0 } };
+
+  vector<uint16_t> out (kRowWidth);
+  vector<uint16_t> ref (kRowWidth);
+  int diffs = 0;
+  for (int row = 0; row < kRows; row++) {
+    int offset = row * kRowWidth;
+    int count = row + 1 < kRows ? row + 1 : kRowWidth;
+    for (int dither = 0; dither < 2; dither++)
+      for (int phase = 0; phase < 4; phase++) {
+        uint8_t d5[4];
+        uint8_t d6[4];
+        for (int i = 0; i < 4; i++) {
+          d5[i] = kDither5[dither][(phase + i) & 3];
+          d6[i] = kDither6[dither][(phase + i) & 3];
+          }
+        ycc (&yRows[offset], &cbRows[offset], &crRows[offset], out.data(), count, d5, d6);
+        yccTable (&yRows[offset], &cbRows[offset], &crRows[offset], ref.data(), count, d5, d6);
+        diffs += memcmp (out.data(), ref.data(), count * 2) ? 1 : 0;
+        }
+    }
+
+  auto startTime = chrono::steady_clock::now();
+  for (int i = 0; i < iterations; i++)
+    for (int row = 0; row < kRows; row++) {
+      int offset = row * kRowWidth;
+      ycc (&yRows[offset], &cbRows[offset], &crRows[offset], out.data(), kRowWidth, kDither5[0], kDither6[0]);
+      }
+  ns = (getMs (startTime) * 1000000.0) / (double(iterations) * kRows * kRowWidth);
+
+  return diffs;
+  }
+//}}}
+//}}}
+
+//{{{
+void runKernels (int iterations) {
+
+  printf ("%d blocks, %d quant tables\n", (int)mBlocks.size(), (int)mTables.size());
+
+  double noneIdct8 = 0;
+  double noneIdct4 = 0;
+  double noneYcc = 0;
+  for (auto simd : kSimds) {
+    if (!jpegSimd (simd))
+      continue;
+    auto kernels = jpegKernels();
+
+    double idct8Ns = 0;
+    double idct4Ns = 0;
+    double yccNs = 0;
+    int idct8Diffs = idctSame (kernels->mIdct8x8 ? kernels->mIdct8x8 : jpeg_idct_islow, jpeg_idct_islow,
+                               DCTSIZE, iterations, idct8Ns);
+    int idct4Diffs = idctSame (kernels->mIdct4x4 ? kernels->mIdct4x4 : jpeg_idct_4x4, jpeg_idct_4x4,
+                               4, iterations, idct4Ns);
+    int yccDiffs = yccSame (kernels->mYccRgb565 ? kernels->mYccRgb565 : yccTable, iterations, yccNs);
+    if (simd == eJpegSimdNone) {
+      noneIdct8 = idct8Ns;
+      noneIdct4 = idct4Ns;
+      noneYcc = yccNs;
+      }
+
+    printf ("%-4s idct8x8 %6.1fns/block %4.2fx %s, idct4x4 %6.1fns/block %4.2fx %s, ycc %5.2fns/pixel %4.2fx %s\n",
+            kernels->mName,
+            idct8Ns, noneIdct8 / idct8Ns, idct8Diffs ? "diff" : "same",
+            idct4Ns, noneIdct4 / idct4Ns, idct4Diffs ? "diff" : "same",
+            yccNs, noneYcc / yccNs, yccDiffs ? "diff" : "same");
+    }
+  }
+//}}}
+//{{{
+void runDecodes (int iterations) {
+// each kernel set's tiles against the none decode
+
+  const cRect kRoi (1237, 211, 1237 + kPanelSize.x, 211 + kPanelSize.y);
+
+  struct sDecode {
+    const char* mName;
+    bool mRoi;
+    cPoint mSize;
+    bool mDither;
+    };
+  const sDecode kDecodes[] = {
+    { "1:1         ", false, cPoint (kWidth, kHeight), false },
+    { "1:1 dithered", false, cPoint (kWidth, kHeight), true },
+    { "panel       ", false, kPanelSize, false },
+    { "panel dither", false, kPanelSize, true },
+    { "roi dithered", true, kPanelSize, true },
+    };
+
+  string fileName = "simd.jpg";
+  for (auto& decode : kDecodes) {
+    // swJpegDecode prints as it goes, the line is built and printed after
+    cTile* noneTile = nullptr;
+    double noneMs = 0;
+    string line = decode.mName;
+    char text[80];
+
+    for (auto simd : kSimds) {
+      if (!jpegSimd (simd))
+        continue;
+
+      cTile* tile = nullptr;
+      auto startTime = chrono::steady_clock::now();
+      for (int i = 0; i < iterations; i++) {
+        delete tile;
+        tile = decode.mRoi ? swJpegDecodeRoi (fileName, kRoi, decode.mSize, decode.mDither) :
+                             swJpegDecode (fileName, decode.mSize, decode.mDither);
+        }
+      double ms = getMs (startTime) / iterations;
+
+      if (simd == eJpegSimdNone) {
+        noneTile = tile;
+        noneMs = ms;
+        snprintf (text, sizeof(text), " %4dx%-4d none %6.2fms", tile ? tile->mWidth : 0, tile ? tile->mHeight : 0, ms);
+        }
+      else {
+        snprintf (text, sizeof(text), ", %s %6.2fms %4.2fx %s",
+                  jpegKernels()->mName, ms, noneMs / ms, sameTile (noneTile, tile) ? "same" : "diff");
+        delete tile;
+        }
+      line += text;
+      }
+
+    printf ("%s\n", line.c_str());
+    delete noneTile;
+    }
+  }
+//}}}
+
+//{{{
+int main (int argc, char** argv) {
+
+  int iterations = argc > 1 ? atoi (argv[1]) : 10;
+
+  if (!mountRamDisk())
+    return 1;
+
+  sImage image;
+  testCard (image, kWidth, kHeight);
+  auto jpeg = encode (image, 2, 1, 0, 0, 90);
+  if (!writeRamFile ("simd.jpg", jpeg))
+    return 1;
+
+  addBlocks (jpeg);
+  addBlocks (encode (image, 2, 1, 0, 0, 100));
+  addRandomBlocks (20000);
+  rangeLimitCinfo (jpeg);
+
+  printf ("best %s\n", jpegKernels()->mName);
+  runKernels (iterations);
+  runDecodes (iterations);
+
+  jpeg_destroy_decompress (&mCinfo);
+  unmountRamDisk();
+  return 0;
+  }
+//}}}
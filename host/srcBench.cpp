@@ -0,0 +1,453 @@
+// srcBench.cpp - HOST_BUILD swJpegDecode FatFs source manager and scanline reader
+// - the repo FatFs over the benchUtils sparse ram disk, 4G FAT32 32k clusters like an SDHC card, the corpus is copied onto it
+// - previous path modelled here, jpeg_stdio_src 4k JFREAD reads, skips read through,
+//   one scanline into a line buffer then memcpy into the tile
+// - bytes copied per pixel is FatFs part sector copies out of its sector buffers plus the line memcpy,
+//   f_read is wrapped to count the bytes disk reads put straight into the caller buffer
+// - disk reads and sectors per read stand in for SDMMC commands, longer multi block reads are what the card likes
+// - corpus args are .jpg, or .ppm encoded 4:2:2 q90, no args encodes the scaleBench test card at two sizes,
+//   the larger with a 60k APP1 standing in for exif and thumbnail
+// - full size swJpegDecode rgb565 undithered must be the previous rgb888 decode truncated
+// - panel line is the previous fixed 1/4 rgb888 against swJpegDecode picking its dct scale for the 1004x556 main.cpp
+//   picture rect, tile bytes, ms/MPixel, and rgb565 psnr against the rgb888 decode at that scale, truncated and dithered,
+//   dither costs psnr by design, it trades the error for no banding in smooth gradients
+// - thumb line is thumbJpegDecode time to first pixel and disk sectors, the exif thumbnail stream or the 1/8 decode,
+//   against the panel decode, the larger test card's APP1 carries a real 160x120 exif thumbnail
+// - build from host/, FatFs and LibJPEG as C, -I. picks up the jconfig.h stand in
+//     gcc -c -O2 -DHOST_BUILD -I. -I../nucleo -I../LibJPEG/include ../fatFs/*.c ../LibJPEG/source/*.c
+//     rm jmemnobs.o
+//     g++ -O2 -fpermissive -pthread -DHOST_BUILD -DFT2_BUILD_LIBRARY -I. -I../nucleo -I../LibJPEG/include -I../freetype/Inc
+//         srcBench.cpp ../nucleo/swJpeg.cpp ../nucleo/jpegSimd.cpp ../nucleo/jmemArena.cpp ../nucleo/jpegThumb.cpp benchUtils.cpp host.cpp dma2d.cpp ../nucleo/cLcd.cpp ../common/utils.cpp
+//         <freetype> *.o -Wl,--wrap=f_read -o srcBench
+// - run
+//     srcBench [photo.jpg|photo.ppm ...]
+//{{{  includes
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "../nucleo/cLcd.h"
+#include "../nucleo/jpeg.h"
+#include "jpeglib.h"
+#include "benchUtils.h"
+
+using namespace std;
+//}}}
+
+const uint32_t kPreviousBufferSize = 4096;  // jdatasrc INPUT_BUF_SIZE
+const int kIterations = 3;
+const int kPreviousScale = 4;                // main.cpp SW_SCALE
+const cPoint kPanelSize (1024 - 20, 600 - 44); // main.cpp picture rect
+
+//{{{  f_read counts
+// f_read destination of the call in progress
+uint8_t* mReadBuf = nullptr;
+uint32_t mReadLen = 0;
+uint64_t mReadBytes = 0;
+uint64_t mDirectBytes = 0;
+uint32_t mReadCalls = 0;
+
+//{{{
+void countDirect (const uint8_t* buff, uint32_t bytes) {
+// ram disk read hook, disk reads straight into the f_read caller buffer
+
+  if ((buff >= mReadBuf) && (buff < mReadBuf + mReadLen))
+    mDirectBytes += bytes;
+  }
+//}}}
+//{{{
+extern "C" FRESULT __real_f_read (FIL* fp, void* buff, UINT btr, UINT* br);
+extern "C" FRESULT __wrap_f_read (FIL* fp, void* buff, UINT btr, UINT* br) {
+
+  mReadBuf = (uint8_t*)buff;
+  mReadLen = btr;
+  FRESULT result = __real_f_read (fp, buff, btr, br);
+  mReadBuf = nullptr;
+  mReadLen = 0;
+
+  mReadCalls++;
+  mReadBytes += *br;
+  return result;
+  }
+//}}}
+//{{{
+void resetCounts() {
+  mDiskReads = 0;
+  mDiskSectors = 0;
+  mReadBytes = 0;
+  mDirectBytes = 0;
+  mReadCalls = 0;
+  }
+//}}}
+//}}}
+//{{{  previous source manager, jpeg_stdio_src over FatFs
+struct sPreviousSource {
+  jpeg_source_mgr mPub;
+  FIL* mFile;
+  JOCTET* mBuffer;
+  };
+
+//{{{
+void previousInit (j_decompress_ptr cinfo) {
+  }
+//}}}
+//{{{
+boolean previousFill (j_decompress_ptr cinfo) {
+
+  auto source = (sPreviousSource*)cinfo->src;
+  UINT bytesRead = 0;
+  f_read (source->mFile, source->mBuffer, kPreviousBufferSize, &bytesRead);
+  if (!bytesRead) {
+    source->mBuffer[0] = (JOCTET)0xFF;
+    source->mBuffer[1] = (JOCTET)JPEG_EOI;
+    bytesRead = 2;
+    }
+
+  source->mPub.next_input_byte = source->mBuffer;
+  source->mPub.bytes_in_buffer = bytesRead;
+  return TRUE;
+  }
+//}}}
+//{{{
+void previousSkip (j_decompress_ptr cinfo, long numBytes) {
+
+  auto source = (sPreviousSource*)cinfo->src;
+  while (numBytes > (long)source->mPub.bytes_in_buffer) {
+    numBytes -= (long)source->mPub.bytes_in_buffer;
+    previousFill (cinfo);
+    }
+  source->mPub.next_input_byte += numBytes;
+  source->mPub.bytes_in_buffer -= numBytes;
+  }
+//}}}
+//{{{
+void previousTerm (j_decompress_ptr cinfo) {
+  }
+//}}}
+
+//{{{
+uint8_t* previousDecode (const string& fileName, int scaleNum, int scaleDenom,
+                         uint32_t& width, uint32_t& height, uint64_t& copiedBytes) {
+
+  FIL file;
+  f_open (&file, fileName.c_str(), FA_READ);
+
+  struct jpeg_error_mgr jerr;
+  struct jpeg_decompress_struct cinfo;
+  cinfo.err = jpeg_std_error (&jerr);
+  jpeg_create_decompress (&cinfo);
+
+  auto source = (sPreviousSource*)(*cinfo.mem->alloc_small) ((j_common_ptr)&cinfo, JPOOL_PERMANENT, sizeof (sPreviousSource));
+  source->mBuffer = (JOCTET*)(*cinfo.mem->alloc_small) ((j_common_ptr)&cinfo, JPOOL_PERMANENT, kPreviousBufferSize);
+  source->mFile = &file;
+  source->mPub.init_source = previousInit;
+  source->mPub.fill_input_buffer = previousFill;
+  source->mPub.skip_input_data = previousSkip;
+  source->mPub.resync_to_restart = jpeg_resync_to_restart;
+  source->mPub.term_source = previousTerm;
+  source->mPub.bytes_in_buffer = 0;
+  source->mPub.next_input_byte = nullptr;
+  cinfo.src = &source->mPub;
+
+  jpeg_read_header (&cinfo, TRUE);
+  cinfo.dct_method = JDCT_ISLOW;
+  cinfo.out_color_space = JCS_RGB;
+  cinfo.scale_num = scaleNum;
+  cinfo.scale_denom = scaleDenom;
+  jpeg_start_decompress (&cinfo);
+
+  width = cinfo.output_width;
+  height = cinfo.output_height;
+  auto pic = (uint8_t*)sdRamAlloc (width * height * 3, "previousPic888");
+  auto dst = pic;
+  auto line = (uint8_t*)pvPortMalloc (width * 3);
+  while (cinfo.output_scanline < cinfo.output_height) {
+    jpeg_read_scanlines (&cinfo, &line, 1);
+    memcpy (dst, line, width * 3);
+    dst += width * 3;
+    copiedBytes += width * 3;
+    }
+  vPortFree (line);
+
+  jpeg_finish_decompress (&cinfo);
+  jpeg_destroy_decompress (&cinfo);
+  f_close (&file);
+  return pic;
+  }
+//}}}
+//}}}
+
+//{{{
+bool sameRgb565 (const cTile* tile, const uint8_t* rgb888, uint32_t width, uint32_t height) {
+// rgb888 is bgr, JCS_RGB with RGB_RED 2
+
+  if (!tile || (tile->mFormat != cTile::eRgb565) || (tile->mWidth != width) || (tile->mHeight != height))
+    return false;
+
+  auto rgb565 = (const uint16_t*)tile->mPiccy;
+  for (uint32_t i = 0; i < width * height; i++, rgb888 += 3)
+    if (rgb565[i] != (((rgb888[2] & 0xF8) << 8) | ((rgb888[1] & 0xFC) << 3) | (rgb888[0] >> 3)))
+      return false;
+  return true;
+  }
+//}}}
+//{{{
+double psnrRgb565 (const cTile* tile, const uint8_t* rgb888) {
+// 565 expanded by bit replication against bgr 888
+
+  auto rgb565 = (const uint16_t*)tile->mPiccy;
+  double sum = 0.0;
+  for (uint32_t i = 0; i < uint32_t(tile->mWidth * tile->mHeight); i++, rgb888 += 3) {
+    int r5 = rgb565[i] >> 11;
+    int g6 = (rgb565[i] >> 5) & 0x3F;
+    int b5 = rgb565[i] & 0x1F;
+    int r = ((r5 << 3) | (r5 >> 2)) - rgb888[2];
+    int g = ((g6 << 2) | (g6 >> 4)) - rgb888[1];
+    int b = ((b5 << 3) | (b5 >> 2)) - rgb888[0];
+    sum += r*r + g*g + b*b;
+    }
+
+  double mse = sum / (3.0 * tile->mWidth * tile->mHeight);
+  return mse > 0.0 ? 10.0 * log10 ((255.0 * 255.0) / mse) : 99.0;
+  }
+//}}}
+
+//{{{
+bool readFile (const char* fileName, vector<uint8_t>& data) {
+
+  FILE* file = fopen (fileName, "rb");
+  if (!file) {
+    printf ("readFile %s open fail\n", fileName);
+    return false;
+    }
+
+  fseek (file, 0, SEEK_END);
+  data.resize (ftell (file));
+  fseek (file, 0, SEEK_SET);
+  size_t got = fread (data.data(), 1, data.size(), file);
+  fclose (file);
+  return got == data.size();
+  }
+//}}}
+//{{{
+bool readPpm (const char* fileName, sImage& image) {
+
+  FILE* file = fopen (fileName, "rb");
+  if (!file) {
+    printf ("readPpm %s open fail\n", fileName);
+    return false;
+    }
+
+  int maxValue = 0;
+  if ((fscanf (file, "P6 %d %d %d", &image.mWidth, &image.mHeight, &maxValue) != 3) || (maxValue != 255)) {
+    printf ("readPpm %s not a binary 8bit ppm\n", fileName);
+    fclose (file);
+    return false;
+    }
+  fgetc (file);
+
+  image.mRgb.resize (image.mWidth * image.mHeight * 3);
+  size_t got = fread (image.mRgb.data(), 3, image.mWidth * image.mHeight, file);
+  fclose (file);
+  return got == (size_t)(image.mWidth * image.mHeight);
+  }
+//}}}
+//{{{
+vector<uint8_t> exifApp1 (const vector<uint8_t>& thumb, uint32_t size) {
+// Exif id, little endian tiff, empty ifd0 linking ifd1, compression 6 and the thumbnail stream, filler to size
+// - ifd1 at 14, three entries, thumbnail at 56
+
+  const uint8_t kHeader[] = { 'E','x','i','f', 0,0,  'I','I', 42,0, 8,0,0,0,  0,0, 14,0,0,0,  3,0 };
+  vector<uint8_t> app1 (kHeader, kHeader + sizeof (kHeader));
+
+  auto entry = [&](uint16_t tag, uint16_t type, uint32_t value) {
+    const uint8_t bytes[12] = { uint8_t(tag), uint8_t(tag >> 8), uint8_t(type), uint8_t(type >> 8), 1,0,0,0,
+                                uint8_t(value), uint8_t(value >> 8), uint8_t(value >> 16), uint8_t(value >> 24) };
+    app1.insert (app1.end(), bytes, bytes + sizeof (bytes));
+    };
+  entry (0x0103, 3, 6);
+  entry (0x0201, 4, 56);
+  entry (0x0202, 4, thumb.size());
+  app1.insert (app1.end(), 4, 0);
+
+  app1.insert (app1.end(), thumb.begin(), thumb.end());
+  if (app1.size() < size)
+    app1.resize (size, 0x55);
+  return app1;
+  }
+//}}}
+
+//{{{
+void run (const char* name, const vector<uint8_t>& jpeg) {
+
+  string fileName = "bench.jpg";
+  if (!writeRamFile (fileName, jpeg))
+    return;
+
+  //{{{  previous
+  uint32_t width = 0;
+  uint32_t height = 0;
+  uint8_t* previousPic = nullptr;
+  uint64_t lineCopied = 0;
+  double previousMs = 1e9;
+
+  resetCounts();
+  for (int i = 0; i < kIterations; i++) {
+    if (previousPic)
+      sdRamFree (previousPic);
+    lineCopied = 0;
+    resetCounts();
+    auto startTime = chrono::steady_clock::now();
+    previousPic = previousDecode (fileName, 1, 1, width, height, lineCopied);
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - startTime).count();
+    previousMs = ms < previousMs ? ms : previousMs;
+    }
+
+  double pixels = double(width) * height;
+  double previousCopied = (lineCopied + (mReadBytes - mDirectBytes)) / pixels;
+  uint32_t previousCalls = mReadCalls;
+  uint32_t previousReads = mDiskReads;
+  double previousSectors = double(mDiskSectors) / mDiskReads;
+  //}}}
+  //{{{  swJpegDecode
+  cTile* tile = nullptr;
+  double ms = 1e9;
+  for (int i = 0; i < kIterations; i++) {
+    delete tile;
+    resetCounts();
+    auto startTime = chrono::steady_clock::now();
+    tile = swJpegDecode (fileName, cPoint (width, height), false);
+    double iterationMs = chrono::duration<double, milli>(chrono::steady_clock::now() - startTime).count();
+    ms = iterationMs < ms ? iterationMs : ms;
+    }
+  double copied = (mReadBytes - mDirectBytes) / pixels;
+  //}}}
+
+  bool same = sameRgb565 (tile, previousPic, width, height);
+
+  printf ("%-12s %4dx%-4d %7dk  previous %6.2fms/MPixel copied %5.3fB/pixel f_read:%5d disk reads:%5d x%5.1f sectors\n"
+          "%-12s %20s  swJpegDecode %6.2fms/MPixel copied %5.3fB/pixel f_read:%5d disk reads:%5d x%5.1f sectors %s\n",
+          name, width, height, (int)(jpeg.size() / 1024),
+          (previousMs * 1000000.0) / pixels, previousCopied, previousCalls, previousReads, previousSectors,
+          "", "",
+          (ms * 1000000.0) / pixels, copied, mReadCalls, mDiskReads, double(mDiskSectors) / mDiskReads,
+          same ? "same" : "DIFFERENT");
+
+  delete tile;
+  sdRamFree (previousPic);
+  previousPic = nullptr;
+
+  //{{{  panel, previous fixed scale rgb888
+  uint32_t scaledWidth = 0;
+  uint32_t scaledHeight = 0;
+  previousMs = 1e9;
+  for (int i = 0; i < kIterations; i++) {
+    if (previousPic)
+      sdRamFree (previousPic);
+    auto startTime = chrono::steady_clock::now();
+    previousPic = previousDecode (fileName, 1, kPreviousScale, scaledWidth, scaledHeight, lineCopied);
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - startTime).count();
+    previousMs = ms < previousMs ? ms : previousMs;
+    }
+  sdRamFree (previousPic);
+  uint32_t previousWidth = scaledWidth;
+  uint32_t previousHeight = scaledHeight;
+  double previousMsPerMPixel = (previousMs * 1000000.0) / (double(previousWidth) * previousHeight);
+  //}}}
+  //{{{  panel, swJpegDecode dct scale rgb565, truncated and dithered
+  cTile* tiles[2] = { nullptr, nullptr };
+  ms = 1e9;
+  for (int dither = 0; dither < 2; dither++)
+    for (int i = 0; i < kIterations; i++) {
+      delete tiles[dither];
+      auto startTime = chrono::steady_clock::now();
+      tiles[dither] = swJpegDecode (fileName, kPanelSize, dither);
+      double iterationMs = chrono::duration<double, milli>(chrono::steady_clock::now() - startTime).count();
+      ms = iterationMs < ms ? iterationMs : ms;
+      }
+
+  // rgb888 reference at the chosen scale, output size is ceil (image * num / 8)
+  int scaleNum = 1;
+  while (scaleNum < 8 && (((width * scaleNum) + 7) / 8 != tiles[0]->mWidth))
+    scaleNum++;
+  previousPic = previousDecode (fileName, scaleNum, 8, scaledWidth, scaledHeight, lineCopied);
+  //}}}
+
+  printf ("%-12s %20s  previous 1/%d rgb888 %4dx%-4d %6dk %6.2fms/MPixel\n"
+          "%-12s %20s  swJpegDecode %d/8 rgb565 %4dx%-4d %6dk %6.2fms/MPixel psnr truncated %5.2fdB dithered %5.2fdB\n",
+          "", "panel", kPreviousScale, previousWidth, previousHeight, (previousWidth * previousHeight * 3) / 1024, previousMsPerMPixel,
+          "", "", scaleNum, tiles[0]->mWidth, tiles[0]->mHeight, (tiles[0]->mWidth * tiles[0]->mHeight * 2) / 1024,
+          (ms * 1000000.0) / (double(tiles[0]->mWidth) * tiles[0]->mHeight),
+          psnrRgb565 (tiles[0], previousPic), psnrRgb565 (tiles[1], previousPic));
+
+  delete tiles[0];
+  delete tiles[1];
+  sdRamFree (previousPic);
+
+  //{{{  thumb, time to first pixel
+  double panelMs = 1e9;
+  double thumbMs = 1e9;
+  uint32_t panelReads = 0;
+  uint32_t panelSectors = 0;
+  for (int i = 0; i < kIterations; i++) {
+    resetCounts();
+    auto startTime = chrono::steady_clock::now();
+    tile = swJpegDecode (fileName, kPanelSize, true);
+    double iterationMs = chrono::duration<double, milli>(chrono::steady_clock::now() - startTime).count();
+    panelMs = iterationMs < panelMs ? iterationMs : panelMs;
+    panelReads = mDiskReads;
+    panelSectors = mDiskSectors;
+    delete tile;
+
+    resetCounts();
+    startTime = chrono::steady_clock::now();
+    tile = thumbJpegDecode (fileName, cPoint (160,120), false, true);
+    iterationMs = chrono::duration<double, milli>(chrono::steady_clock::now() - startTime).count();
+    thumbMs = iterationMs < thumbMs ? iterationMs : thumbMs;
+    if (i < kIterations-1)
+      delete tile;
+    }
+
+  uint32_t offset;
+  uint32_t length;
+  printf ("%-12s %20s  thumbJpegDecode %s %4dx%-4d first pixel %6.2fms disk reads:%3d sectors:%5d,"
+          " panel decode %6.2fms disk reads:%3d sectors:%5d\n",
+          "", "thumb", findExifThumb (fileName, offset, length) ? "exif" : "1/8 ", tile->mWidth, tile->mHeight,
+          thumbMs, mDiskReads, mDiskSectors, panelMs, panelReads, panelSectors);
+  delete tile;
+  //}}}
+  }
+//}}}
+//{{{
+int main (int argc, char** argv) {
+
+  if (!mountRamDisk())
+    return 1;
+  mRamReadHook = countDirect;
+
+  sImage image;
+  if (argc < 2) {
+    testCard (image, 1600, 1200);
+    run ("testCard", encode (image));
+
+    sImage thumb;
+    testCard (thumb, 160, 120);
+    testCard (image, 4000, 3000);
+    run ("testCardExif", encode (image, 2, 1, 0, 0, 90, false, exifApp1 (encode (thumb), 60000)));
+    }
+
+  for (int arg = 1; arg < argc; arg++) {
+    const char* name = strrchr (argv[arg], '/');
+    name = name ? name + 1 : argv[arg];
+    vector<uint8_t> data;
+    if (strstr (argv[arg], ".ppm")) {
+      if (readPpm (argv[arg], image))
+        run (name, encode (image));
+      }
+    else if (readFile (argv[arg], data))
+      run (name, data);
+    }
+
+  return 0;
+  }
+//}}}
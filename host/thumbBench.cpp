@@ -0,0 +1,338 @@
+// thumbBench.cpp - HOST_BUILD cThumbCache against a FatFs disk image file
+// - disk image is a file, pread/pwrite per sector run, so a card dump can be used, a copy, thumbs.bin is written to it
+// - no args makes a sparse 4G FAT32 32k cluster image in /tmp with a generated corpus,
+//   test cards at three sizes, landscape and portrait, the largest with a 160x120 exif thumbnail
+// - build, cold, every thumbnail made, exif or 1/8 decode, scaled and written
+// - boot, remount, cache open, index read
+// - browse, f_stat and cache get per file, checked against a fresh thumbnail, disk reads per get,
+//   one f_read, FatFs splits it at cluster ends, 160x120 is 75 sectors so two 32k clusters at most
+// - change, one file rewritten, update rebuilds just that one
+// - build from host/, FatFs and LibJPEG as C, -I. picks up the jconfig.h stand in
+//     gcc -c -O2 -DHOST_BUILD -I. -I../nucleo -I../LibJPEG/include ../fatFs/*.c ../LibJPEG/source/*.c
+//     rm jmemnobs.o
+//     g++ -O2 -fpermissive -pthread -DHOST_BUILD -DFT2_BUILD_LIBRARY -I. -I../nucleo -I../LibJPEG/include -I../freetype/Inc
+//         thumbBench.cpp ../nucleo/cThumbCache.cpp ../nucleo/jpegThumb.cpp ../nucleo/swJpeg.cpp ../nucleo/jpegSimd.cpp ../nucleo/jmemArena.cpp
+//         benchUtils.cpp host.cpp dma2d.cpp ../nucleo/cLcd.cpp ../common/utils.cpp <freetype> *.o -o thumbBench
+// - run
+//     thumbBench [card.img]
+//{{{  includes
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "../nucleo/cLcd.h"
+#include "../nucleo/jpeg.h"
+#include "../nucleo/cThumbCache.h"
+#include "../fatFs/ff_gen_drv.h"
+#include "jpeglib.h"
+#include "benchUtils.h"
+
+using namespace std;
+//}}}
+
+const uint32_t kSectorSize = 512;
+const uint32_t kNewImageSectors = 0x800000;
+const char* kNewImageName = "/tmp/thumbBench.img";
+const char* kCacheName = "thumbs.bin";
+const cPoint kThumbSize (160,120);
+
+//{{{  disk image driver, counts
+int mImage = -1;
+uint32_t mImageSectors = 0;
+
+// reads count into benchUtils mDiskReads, mDiskSectors
+uint32_t mDiskWrites = 0;
+uint32_t mDiskWriteSectors = 0;
+
+//{{{
+DSTATUS imageInit (BYTE lun) {
+  return 0;
+  }
+//}}}
+//{{{
+DSTATUS imageStatus (BYTE lun) {
+  return 0;
+  }
+//}}}
+//{{{
+DRESULT imageRead (BYTE lun, BYTE* buff, DWORD sector, UINT count) {
+
+  mDiskReads++;
+  mDiskSectors += count;
+  ssize_t len = count * kSectorSize;
+  return pread (mImage, buff, len, off_t(sector) * kSectorSize) == len ? RES_OK : RES_ERROR;
+  }
+//}}}
+//{{{
+DRESULT imageWrite (BYTE lun, const BYTE* buff, DWORD sector, UINT count) {
+
+  mDiskWrites++;
+  mDiskWriteSectors += count;
+  ssize_t len = count * kSectorSize;
+  return pwrite (mImage, buff, len, off_t(sector) * kSectorSize) == len ? RES_OK : RES_ERROR;
+  }
+//}}}
+//{{{
+DRESULT imageIoctl (BYTE lun, BYTE cmd, void* buff) {
+
+  switch (cmd) {
+    case CTRL_SYNC: return fsync (mImage) ? RES_ERROR : RES_OK;
+    case GET_SECTOR_COUNT: *(DWORD*)buff = mImageSectors; return RES_OK;
+    case GET_SECTOR_SIZE: *(WORD*)buff = kSectorSize; return RES_OK;
+    case GET_BLOCK_SIZE: *(DWORD*)buff = 1; return RES_OK;
+    default: return RES_PARERR;
+    }
+  }
+//}}}
+
+const Diskio_drvTypeDef kImageDriver = { imageInit, imageStatus, imageRead, imageWrite, imageIoctl };
+
+//{{{
+void resetCounts() {
+  mDiskReads = 0;
+  mDiskSectors = 0;
+  mDiskWrites = 0;
+  mDiskWriteSectors = 0;
+  }
+//}}}
+//}}}
+
+//{{{
+vector<uint8_t> exifApp1 (const vector<uint8_t>& thumb) {
+// Exif id, little endian tiff, empty ifd0 linking ifd1, compression 6 and the thumbnail stream at 56
+
+  const uint8_t kHeader[] = { 'E','x','i','f', 0,0,  'I','I', 42,0, 8,0,0,0,  0,0, 14,0,0,0,  3,0 };
+  vector<uint8_t> app1 (kHeader, kHeader + sizeof (kHeader));
+
+  auto entry = [&](uint16_t tag, uint16_t type, uint32_t value) {
+    const uint8_t bytes[12] = { uint8_t(tag), uint8_t(tag >> 8), uint8_t(type), uint8_t(type >> 8), 1,0,0,0,
+                                uint8_t(value), uint8_t(value >> 8), uint8_t(value >> 16), uint8_t(value >> 24) };
+    app1.insert (app1.end(), bytes, bytes + sizeof (bytes));
+    };
+  entry (0x0103, 3, 6);
+  entry (0x0201, 4, 56);
+  entry (0x0202, 4, thumb.size());
+  app1.insert (app1.end(), 4, 0);
+
+  app1.insert (app1.end(), thumb.begin(), thumb.end());
+  return app1;
+  }
+//}}}
+//{{{
+bool writeFile (const string& fileName, const vector<uint8_t>& data) {
+
+  FIL file;
+  if (f_open (&file, fileName.c_str(), FA_WRITE | FA_CREATE_ALWAYS) != FR_OK) {
+    printf ("writeFile %s open fail\n", fileName.c_str());
+    return false;
+    }
+
+  UINT written = 0;
+  f_write (&file, data.data(), data.size(), &written);
+  f_close (&file);
+  return written == data.size();
+  }
+//}}}
+//{{{
+void makeCorpus() {
+// three sizes, landscape and portrait, the largest with an exif thumbnail, some in a sub directory
+
+  f_mkdir ("/dcim");
+  sImage image;
+  sImage thumb;
+  for (int i = 0; i < 12; i++) {
+    string fileName = (i & 1 ? "/dcim/img" : "/img") + dec (i, 3, '0') + ".jpg";
+    switch (i % 3) {
+      case 0:
+        testCard (image, 1600, 1200, 0, i);
+        writeFile (fileName, encode (image));
+        break;
+      case 1:
+        testCard (image, 1200, 1600, 0, i);
+        writeFile (fileName, encode (image));
+        break;
+      default:
+        testCard (image, 4000, 3000, 0, i);
+        testCard (thumb, 160, 120, 0, i);
+        writeFile (fileName, encode (image, 2, 1, 0, 0, 90, false, exifApp1 (encode (thumb))));
+        break;
+      }
+    }
+  }
+//}}}
+//{{{
+void findFiles (const string& dirPath, vector<string>& files) {
+// main.cpp findFiles
+
+  DIR dir;
+  if (f_opendir (&dir, dirPath.c_str()) == FR_OK) {
+    while (true) {
+      FILINFO filInfo;
+      if ((f_readdir (&dir, &filInfo) != FR_OK) || !filInfo.fname[0])
+        break;
+      if (filInfo.fname[0] == '.')
+        continue;
+
+      auto filePath = dirPath + "/" + filInfo.fname;
+      transform (filePath.begin(), filePath.end(), filePath.begin(), ::tolower);
+      if (filInfo.fattrib & AM_DIR)
+        findFiles (filePath, files);
+      else if ((filePath.size() > 4) && (filePath.compare (filePath.size() - 4, 4, ".jpg") == 0))
+        files.push_back (filePath);
+      }
+    f_closedir (&dir);
+    }
+  }
+//}}}
+
+//{{{
+bool sameThumb (const cTile* tile, const string& fileName) {
+// cached thumbnail against a fresh thumbJpegDecode scaled like cThumbCache::add
+
+  auto fresh = thumbJpegDecode (fileName, kThumbSize, false, true);
+  if (!fresh)
+    return false;
+
+  vector<uint16_t> pixels (tile->mWidth * tile->mHeight);
+  bool same = cLcd::size (fresh, pixels.data(), tile->mWidth, tile->mHeight) &&
+              !memcmp (pixels.data(), tile->mPiccy, pixels.size() * 2);
+  delete fresh;
+  return same;
+  }
+//}}}
+//{{{
+void browse (cThumbCache& cache, const vector<string>& files, const char* title) {
+
+  double getMs = 0.0;
+  uint32_t hits = 0;
+  uint32_t same = 0;
+  uint32_t reads = 0;
+  uint32_t sectors = 0;
+  for (auto& fileName : files) {
+    FILINFO info;
+    f_stat (fileName.c_str(), &info);
+
+    resetCounts();
+    auto startTime = chrono::steady_clock::now();
+    auto tile = cache.get (fileName, info);
+    getMs += ::getMs (startTime);
+    reads += mDiskReads;
+    sectors += mDiskSectors;
+
+    if (tile) {
+      hits++;
+      same += sameThumb (tile, fileName);
+      delete tile;
+      }
+    }
+
+  printf ("%-7s %3d files %3d hits %3d same  get %6.3fms/thumb  disk reads %4.2f/thumb x%5.1f sectors\n",
+          title, (int)files.size(), hits, same, hits ? getMs / hits : 0.0,
+          hits ? double(reads) / hits : 0.0, reads ? double(sectors) / reads : 0.0);
+  }
+//}}}
+
+//{{{
+int main (int argc, char** argv) {
+
+  //{{{  open or make disk image, mount
+  bool newImage = argc < 2;
+  const char* imageName = newImage ? kNewImageName : argv[1];
+  mImage = open (imageName, newImage ? (O_RDWR | O_CREAT | O_TRUNC) : O_RDWR, 0644);
+  if (mImage < 0) {
+    printf ("open %s fail\n", imageName);
+    return 1;
+    }
+  if (newImage)
+    // sparse, untouched sectors take no space
+    ftruncate (mImage, off_t(kNewImageSectors) * kSectorSize);
+  mImageSectors = uint32_t(lseek (mImage, 0, SEEK_END) / kSectorSize);
+
+  char path[4];
+  FATFS_LinkDriver (&kImageDriver, path);
+
+  vector<uint8_t> work (4096);
+  if (newImage && (f_mkfs (path, FM_FAT32, 32768, work.data(), work.size()) != FR_OK)) {
+    printf ("f_mkfs fail\n");
+    return 1;
+    }
+
+  static FATFS fatFs;
+  if (f_mount (&fatFs, path, 1) != FR_OK) {
+    printf ("f_mount %s fail\n", imageName);
+    return 1;
+    }
+  //}}}
+
+  if (newImage)
+    makeCorpus();
+  f_unlink (kCacheName);
+
+  vector<string> files;
+  findFiles ("", files);
+  printf ("%s %d files\n", imageName, (int)files.size());
+
+  //{{{  build, cold cache
+  double uncachedMs = 0.0;
+  for (auto& fileName : files) {
+    auto startTime = chrono::steady_clock::now();
+    auto tile = thumbJpegDecode (fileName, kThumbSize, false, true);
+    uncachedMs += getMs (startTime);
+    delete tile;
+    }
+
+  auto cache = new cThumbCache (kCacheName, kThumbSize, false, true);
+  cache->open();
+  resetCounts();
+  auto startTime = chrono::steady_clock::now();
+  while (!cache->update (files, 1000)) {}
+  double buildMs = getMs (startTime);
+  printf ("build   %3d thumbs %8.2fms, uncached browse %6.3fms/file, disk writes %d x%5.1f sectors\n",
+          cache->getNumThumbs(), buildMs, uncachedMs / files.size(),
+          mDiskWrites, mDiskWrites ? double(mDiskWriteSectors) / mDiskWrites : 0.0);
+  delete cache;
+  //}}}
+  //{{{  boot, remount, open
+  f_mount (nullptr, path, 0);
+  f_mount (&fatFs, path, 1);
+
+  cache = new cThumbCache (kCacheName, kThumbSize, false, true);
+  resetCounts();
+  startTime = chrono::steady_clock::now();
+  cache->open();
+  printf ("boot    %3d thumbs open %6.3fms disk reads %d x%5.1f sectors\n",
+          cache->getNumThumbs(), getMs (startTime), mDiskReads, mDiskReads ? double(mDiskSectors) / mDiskReads : 0.0);
+  //}}}
+  browse (*cache, files, "browse");
+  //{{{  change one file, rebuild it
+  if (newImage) {
+    sImage image;
+    // another size, host get_fattime is fixed so fsize is what changes
+    testCard (image, 1000, 1000, 0, 99);
+    writeFile (files[0], encode (image));
+
+    FILINFO info;
+    f_stat (files[0].c_str(), &info);
+    auto tile = cache->get (files[0], info);
+    bool stale = !tile;
+    delete tile;
+
+    resetCounts();
+    startTime = chrono::steady_clock::now();
+    while (!cache->update (files, 1000)) {}
+    printf ("change  %s %s, update %6.2fms disk writes %d x%5.1f sectors\n",
+            files[0].c_str(), stale ? "stale" : "not stale", getMs (startTime),
+            mDiskWrites, mDiskWrites ? double(mDiskWriteSectors) / mDiskWrites : 0.0);
+    }
+  //}}}
+  browse (*cache, files, "browse");
+
+  delete cache;
+  f_mount (nullptr, path, 0);
+  close (mImage);
+  return 0;
+  }
+//}}}
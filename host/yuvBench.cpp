@@ -0,0 +1,226 @@
+// yuvBench.cpp - HOST_BUILD yuv mcu tiles, 4:4:4, 4:2:2 and 4:2:0, against a planar reference converter
+// - random Y, Cb, Cr planes, mcu padded, packed here into the hw jpeg decoder mcu order,
+//   Y 8x8 blocks in raster order then Cb then Cr, so the tile layout is checked against its own description
+// - reference converts the planes directly, full range BT.601 16 bit fixed point, truncated to rgb565
+// - checked pixel for pixel
+//     dma2d  cLcd::copy of the whole tile, the software DMA2D in its ycbcr css mode
+//     cpu    cLcd::copy into a damage rect that cuts the tile, the cpu fallback
+//     scaler cLcd::size down and up, against cLcd::size of the reference as an rgb888 tile, same taps,
+//            so any difference is the yuv mcu row fetch
+// - odd sizes so the right and bottom mcus are partial
+// - build from host/, like lcdBench
+//     g++ -m32 -O2 -DHOST_BUILD -DFT2_BUILD_LIBRARY -I. -I../freetype/Inc -I../nucleo
+//         yuvBench.cpp host.cpp dma2d.cpp ../nucleo/cLcd.cpp ../common/utils.cpp <freetype> -o yuvBench
+//   or x86-64 with -fpermissive
+// - run
+//     yuvBench
+//{{{  includes
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../nucleo/cLcd.h"
+
+using namespace std;
+//}}}
+
+//{{{
+struct sLayout {
+  cTile::eFormat mFormat;
+  const char* mName;
+  int mHSamp;
+  int mVSamp;
+  };
+//}}}
+const sLayout kLayouts[] = { { cTile::eYuvMcu444, "444", 1, 1 },
+                             { cTile::eYuvMcu422, "422", 2, 1 },
+                             { cTile::eYuvMcu420, "420", 2, 2 } };
+
+//{{{
+struct sPlanes {
+// mcu padded planes, chroma at its subsampled size
+  int mWidth = 0;
+  int mHeight = 0;
+  int mPitch = 0;
+  int mRows = 0;
+  int mChromaPitch = 0;
+  vector<uint8_t> mY;
+  vector<uint8_t> mCb;
+  vector<uint8_t> mCr;
+  };
+//}}}
+//{{{
+void makePlanes (sPlanes& planes, const sLayout& layout, int width, int height) {
+
+  mt19937 random (width * height);
+  planes.mWidth = width;
+  planes.mHeight = height;
+  planes.mPitch = ((width + (layout.mHSamp * 8) - 1) / (layout.mHSamp * 8)) * layout.mHSamp * 8;
+  planes.mRows = ((height + (layout.mVSamp * 8) - 1) / (layout.mVSamp * 8)) * layout.mVSamp * 8;
+  planes.mChromaPitch = planes.mPitch / layout.mHSamp;
+
+  planes.mY.resize (planes.mPitch * planes.mRows);
+  planes.mCb.resize (planes.mChromaPitch * (planes.mRows / layout.mVSamp));
+  planes.mCr.resize (planes.mCb.size());
+
+  // ramps plus noise, every value and the clamps get hit
+  for (int y = 0; y < planes.mRows; y++)
+    for (int x = 0; x < planes.mPitch; x++)
+      planes.mY[(y * planes.mPitch) + x] = uint8_t (((x * 255) / planes.mPitch) + (random() % 64) - 32);
+  for (size_t i = 0; i < planes.mCb.size(); i++) {
+    planes.mCb[i] = uint8_t (random());
+    planes.mCr[i] = uint8_t (random());
+    }
+  }
+//}}}
+//{{{
+cTile* packTile (const sPlanes& planes, const sLayout& layout) {
+// hw decoder mcu order, Y blocks in raster order, then the Cb block, then the Cr block
+
+  int mcuWidth = layout.mHSamp * 8;
+  int mcuHeight = layout.mVSamp * 8;
+  int mcuBytes = ((layout.mHSamp * layout.mVSamp) + 2) * 64;
+  int numMcus = (planes.mPitch / mcuWidth) * (planes.mRows / mcuHeight);
+
+  auto piccy = sdRamAlloc (numMcus * mcuBytes, "yuvTile");
+  auto dst = piccy;
+  for (int mcuY = 0; mcuY < planes.mRows; mcuY += mcuHeight)
+    for (int mcuX = 0; mcuX < planes.mPitch; mcuX += mcuWidth) {
+      for (int v = 0; v < layout.mVSamp; v++)
+        for (int h = 0; h < layout.mHSamp; h++)
+          for (int y = 0; y < 8; y++)
+            for (int x = 0; x < 8; x++)
+              *dst++ = planes.mY[((mcuY + (v * 8) + y) * planes.mPitch) + mcuX + (h * 8) + x];
+
+      for (auto plane : { &planes.mCb, &planes.mCr })
+        for (int y = 0; y < 8; y++)
+          for (int x = 0; x < 8; x++)
+            *dst++ = (*plane)[(((mcuY / layout.mVSamp) + y) * planes.mChromaPitch) + (mcuX / layout.mHSamp) + x];
+      }
+
+  return new cTile (piccy, layout.mFormat, planes.mPitch, 0, 0, planes.mWidth, planes.mHeight);
+  }
+//}}}
+//{{{
+vector<uint8_t> reference (const sPlanes& planes, const sLayout& layout) {
+// bgr, libjpeg JCS_RGB order for RGB_RED 2, chroma replicated
+
+  auto clamp = [](int32_t value) { return uint8_t (value < 0 ? 0 : value > 255 ? 255 : value); };
+
+  vector<uint8_t> bgr (planes.mWidth * planes.mHeight * 3);
+  auto pix = bgr.data();
+  for (int y = 0; y < planes.mHeight; y++)
+    for (int x = 0; x < planes.mWidth; x++, pix += 3) {
+      int32_t lum = planes.mY[(y * planes.mPitch) + x];
+      int chroma = ((y / layout.mVSamp) * planes.mChromaPitch) + (x / layout.mHSamp);
+      int32_t cb = planes.mCb[chroma] - 128;
+      int32_t cr = planes.mCr[chroma] - 128;
+      pix[0] = clamp (lum + ((116130 * cb + 32768) >> 16));
+      pix[1] = clamp (lum - ((22554 * cb + 46802 * cr - 32768) >> 16));
+      pix[2] = clamp (lum + ((91881 * cr + 32768) >> 16));
+      }
+
+  return bgr;
+  }
+//}}}
+
+//{{{
+int compareFrame (const vector<uint8_t>& bgr, int width, const cRect& tileRect, const cRect& checkRect) {
+// shown frame against the reference truncated to rgb565, mismatches inside checkRect
+
+  auto frame = hostGetShowBuffer();
+  int mismatches = 0;
+  for (int y = checkRect.top; y < checkRect.bottom; y++)
+    for (int x = checkRect.left; x < checkRect.right; x++) {
+      auto pix = &bgr[(((y - tileRect.top) * width) + x - tileRect.left) * 3];
+      uint16_t rgb565 = ((pix[2] >> 3) << 11) | ((pix[1] >> 2) << 5) | (pix[0] >> 3);
+      mismatches += frame[(y * cLcd::getWidth()) + x] != rgb565;
+      }
+
+  return mismatches;
+  }
+//}}}
+//{{{
+int copyFrame (cLcd* lcd, cTile* tile, const cRect& tileRect, const cRect& damage, const vector<uint8_t>& bgr) {
+
+  lcd->invalidate (damage);
+  lcd->start();
+  lcd->clear (kBlack);
+  lcd->copy (tile, tileRect.getTL());
+  lcd->present();
+
+  // let the line interrupt flip to the presented frame
+  hostPoll();
+  return compareFrame (bgr, tile->mWidth, tileRect, damage.intersect (tileRect));
+  }
+//}}}
+//{{{
+int sizeCompare (cTile* tile, cTile* refTile, uint16_t width, uint16_t height, double& ms) {
+
+  vector<uint16_t> dst (width * height);
+  vector<uint16_t> ref (width * height);
+
+  auto startTime = chrono::steady_clock::now();
+  cLcd::size (tile, dst.data(), width, height);
+  ms = chrono::duration<double, milli>(chrono::steady_clock::now() - startTime).count();
+
+  cLcd::size (refTile, ref.data(), width, height);
+
+  int mismatches = 0;
+  for (int i = 0; i < width * height; i++)
+    mismatches += dst[i] != ref[i];
+  return mismatches;
+  }
+//}}}
+
+//{{{
+bool run (cLcd* lcd, const sLayout& layout, int width, int height) {
+
+  sPlanes planes;
+  makePlanes (planes, layout, width, height);
+  auto tile = packTile (planes, layout);
+  auto bgr = reference (planes, layout);
+
+  auto refPiccy = sdRamAlloc (width * height * 3, "yuvRef");
+  memcpy (refPiccy, bgr.data(), bgr.size());
+  auto refTile = new cTile (refPiccy, cTile::eRgb888, width, 0, 0, width, height);
+
+  cRect tileRect (cPoint (10, 30), cPoint (10 + width, 30 + height));
+
+  // whole tile damaged, dma2d, then a damage rect cutting the tile, cpu
+  int dma2dMismatches = copyFrame (lcd, tile, tileRect, cRect (lcd->getSize()), bgr);
+  cRect cut (tileRect.left + 3, tileRect.top + 5, tileRect.left + (width / 2) + 1, tileRect.bottom - 2);
+  int cpuMismatches = copyFrame (lcd, tile, tileRect, cut, bgr);
+
+  double downMs;
+  double upMs;
+  int downMismatches = sizeCompare (tile, refTile, (width / 3) + 1, (height / 3) + 1, downMs);
+  int upMismatches = sizeCompare (tile, refTile, (width * 5) / 2, (height * 5) / 2, upMs);
+
+  bool same = !dma2dMismatches && !cpuMismatches && !downMismatches && !upMismatches;
+  printf ("%s %4dx%-4d pitch:%4d dma2d:%d cpu:%d scaler down:%d %6.2fms up:%d %6.2fms %s\n",
+          layout.mName, width, height, planes.mPitch, dma2dMismatches, cpuMismatches,
+          downMismatches, downMs, upMismatches, upMs, same ? "same" : "diff");
+
+  delete refTile;
+  delete tile;
+  return same;
+  }
+//}}}
+//{{{
+int main (int argc, char** argv) {
+
+  auto lcd = new cLcd();
+  lcd->init ("yuvBench host");
+  lcd->setShowInfo (false);
+
+  bool same = true;
+  for (auto& layout : kLayouts)
+    for (auto size : { cPoint (256, 160), cPoint (401, 299), cPoint (999, 557) })
+      same &= run (lcd, layout, size.x, size.y);
+
+  printf ("%s\n", same ? "all same" : "some diff");
+  return same ? 0 : 1;
+  }
+//}}}
@@ -0,0 +1,197 @@
+// cDecodeAhead.cpp - decode ahead pipeline
+// - free queue holds the slots the decoder may fill, ready queue the decoded slots in file order
+// - decoder blocks on an empty free queue, pool exhaustion is the back pressure, it runs idle work while it waits
+// - show thread blocks on an empty ready queue, each wait is counted as a stall
+// - previews, a one deep queue the decoder overwrites, the stalled show thread polls it, a newer preview
+//   replaces one not yet taken, one left when its slide arrives is dropped
+// - the decoder task is the only FatFs user while it runs, FatFs is built without _FS_REENTRANT
+//{{{  includes
+#include "cDecodeAhead.h"
+
+#include "cLcd.h" // for cTile
+
+using namespace std;
+//}}}
+//{{{  const
+const uint16_t kStackDepth = 4096;
+
+// stalled show thread preview poll, FreeRTOS can't block on two queues without a queue set
+const TickType_t kPreviewPoll = 10;
+//}}}
+
+//{{{
+cDecodeAhead::cDecodeAhead (const vector<string>& files, uint16_t poolSize, tDecode decode, tIdle idle, void* context)
+  : mFiles(files), mPoolSize(poolSize < kMinPoolSize ? kMinPoolSize : poolSize),
+    mDecode(decode), mIdle(idle), mContext(context) {
+
+  if (poolSize < kMinPoolSize)
+    printf ("cDecodeAhead pool %d raised to %d\n", poolSize, kMinPoolSize);
+  }
+//}}}
+//{{{
+cDecodeAhead::~cDecodeAhead() {
+// get until nullptr first, the decoder task has finished with the queues by then
+// - tiles still on show belong to the show thread
+
+  sSlot* slot = nullptr;
+  while (mReadyQueue && xQueueReceive (mReadyQueue, &slot, 0))
+    if (slot)
+      delete slot->mTile;
+
+  dropPreviews();
+
+  if (mFreeQueue)
+    vQueueDelete (mFreeQueue);
+  if (mReadyQueue)
+    vQueueDelete (mReadyQueue);
+  if (mPreviewQueue)
+    vQueueDelete (mPreviewQueue);
+  delete[] mSlots;
+  }
+//}}}
+
+//{{{
+bool cDecodeAhead::start (UBaseType_t priority) {
+
+  mSlots = new sSlot[mPoolSize];
+  mFreeQueue = xQueueCreate (mPoolSize, sizeof (sSlot*));
+  // one more for the end marker
+  mReadyQueue = xQueueCreate (mPoolSize + 1, sizeof (sSlot*));
+  mPreviewQueue = xQueueCreate (1, sizeof (cTile*));
+  if (!mFreeQueue || !mReadyQueue || !mPreviewQueue) {
+    printf ("cDecodeAhead::start queue fail\n");
+    mDone = true;
+    return false;
+    }
+
+  for (uint16_t i = 0; i < mPoolSize; i++) {
+    sSlot* slot = &mSlots[i];
+    slot->mTile = nullptr;
+    xQueueSend (mFreeQueue, &slot, 0);
+    }
+
+  TaskHandle_t decodeHandle;
+  if (xTaskCreate ((TaskFunction_t)decodeThread, "decode", kStackDepth, this, priority, &decodeHandle) != pdPASS) {
+    printf ("cDecodeAhead::start task fail\n");
+    mDone = true;
+    return false;
+    }
+
+  return true;
+  }
+//}}}
+//{{{
+cDecodeAhead::sSlot* cDecodeAhead::get() {
+// next decoded slot in file order, nullptr after the last
+
+  if (mDone)
+    return nullptr;
+
+  sSlot* slot = nullptr;
+  if (!xQueueReceive (mReadyQueue, &slot, 0)) {
+    uint32_t stallTime = HAL_GetTick();
+    uint32_t previewTime = 0;
+    mWaiting = mShowPreview != nullptr;
+    while (!xQueueReceive (mReadyQueue, &slot, mWaiting ? kPreviewPoll : portMAX_DELAY)) {
+      cTile* tile;
+      if (xQueueReceive (mPreviewQueue, &tile, 0)) {
+        // time to the first preview of this stall
+        previewTime = previewTime ? previewTime : HAL_GetTick() - stallTime;
+        mPreviews++;
+        mShowPreview (tile, mPreviewContext);
+        }
+      }
+    mWaiting = false;
+
+    if (slot) {
+      // waiting on the end marker is not a stall
+      mEmptyStalls++;
+      mEmptyStallTime += HAL_GetTick() - stallTime;
+      mPreviewStallTime += previewTime ? previewTime : HAL_GetTick() - stallTime;
+      }
+    }
+
+  dropPreviews();
+  mDone = !slot;
+  return slot;
+  }
+//}}}
+//{{{
+void cDecodeAhead::release (sSlot* slot) {
+// slot off show, its tile freed, back to the decoder
+
+  delete slot->mTile;
+  slot->mTile = nullptr;
+  xQueueSend (mFreeQueue, &slot, 0);
+  }
+//}}}
+
+//{{{
+void cDecodeAhead::preview (cTile* tile) {
+// decoder task, a preview of the slide the show thread waits on, replaces one it hasn't taken yet
+
+  cTile* oldTile;
+  if (xQueueReceive (mPreviewQueue, &oldTile, 0))
+    delete oldTile;
+  if (!mWaiting || !xQueueSend (mPreviewQueue, &tile, 0))
+    delete tile;
+  }
+//}}}
+
+// private
+//{{{
+void cDecodeAhead::dropPreviews() {
+// previews that lost the race with their slide
+
+  cTile* tile;
+  while (mPreviewQueue && xQueueReceive (mPreviewQueue, &tile, 0))
+    delete tile;
+  }
+//}}}
+//{{{
+void cDecodeAhead::decodeThread (void* arg) {
+
+  ((cDecodeAhead*)arg)->run();
+  vTaskDelete (nullptr);
+  }
+//}}}
+//{{{
+void cDecodeAhead::run() {
+
+  bool idleDone = !mIdle;
+  for (auto& fileName : mFiles) {
+    sSlot* slot = nullptr;
+    if (!xQueueReceive (mFreeQueue, &slot, 0)) {
+      // pool exhausted, idle work a slice at a time until a slot comes back off show
+      mFullStalls++;
+      uint32_t stallTime = HAL_GetTick();
+      while (!xQueueReceive (mFreeQueue, &slot, idleDone ? portMAX_DELAY : 0))
+        idleDone = !mIdle (mContext);
+      mFullStallTime += HAL_GetTick() - stallTime;
+      }
+
+    uint32_t startTime = HAL_GetTick();
+    slot->mFileName = fileName;
+    if (f_stat (fileName.c_str(), &slot->mInfo)) {
+      printf ("cDecodeAhead %s fstat fail\n", fileName.c_str());
+      memset (&slot->mInfo, 0, sizeof (FILINFO));
+      }
+    slot->mTile = mDecode (fileName, mContext);
+    slot->mDecodeTime = HAL_GetTick() - startTime;
+    mDecodeTime += slot->mDecodeTime;
+    mNumDecoded++;
+
+    xQueueSend (mReadyQueue, &slot, portMAX_DELAY);
+    uint16_t queueDepth = (uint16_t)uxQueueMessagesWaiting (mReadyQueue);
+    if (queueDepth > mMaxQueueDepth)
+      mMaxQueueDepth = queueDepth;
+    }
+
+  // finish the idle work while the last slides show, then the end marker, members untouched after it
+  while (!idleDone)
+    idleDone = !mIdle (mContext);
+
+  sSlot* endSlot = nullptr;
+  xQueueSend (mReadyQueue, &endSlot, portMAX_DELAY);
+  }
+//}}}
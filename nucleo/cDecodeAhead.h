@@ -0,0 +1,90 @@
+// cDecodeAhead.h - decode ahead pipeline, a decoder task fills a bounded pool of decoded tiles, the show thread takes them in order
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "cmsis_os.h"
+#include "../fatFs/ff.h"
+
+class cTile;
+
+class cDecodeAhead {
+public:
+  typedef cTile* (*tDecode)(const std::string& fileName, void* context);
+  typedef bool (*tIdle)(void* context);
+  typedef void (*tPreview)(cTile* tile, void* context);
+
+  //{{{
+  struct sSlot {
+    std::string mFileName;
+    FILINFO mInfo;
+    cTile* mTile;
+    uint32_t mDecodeTime;
+    };
+  //}}}
+
+  // the show thread holds two slots, the one on show and the one just off it, a pool needs one more for the decoder
+  // - a smaller poolSize is raised to kMinPoolSize, it would deadlock decoder and show thread
+  static const uint16_t kMinPoolSize = 3;
+
+  cDecodeAhead (const std::vector<std::string>& files, uint16_t poolSize, tDecode decode, tIdle idle, void* context);
+  ~cDecodeAhead();
+
+  uint16_t getPoolSize() { return mPoolSize; }
+  uint16_t getQueueDepth() { return (uint16_t)uxQueueMessagesWaiting (mReadyQueue); }
+  uint16_t getMaxQueueDepth() { return mMaxQueueDepth; }
+
+  uint32_t getNumDecoded() { return mNumDecoded; }
+  uint32_t getDecodeTime() { return mDecodeTime; }
+  uint32_t getFullStalls() { return mFullStalls; }
+  uint32_t getFullStallTime() { return mFullStallTime; }
+  uint32_t getEmptyStalls() { return mEmptyStalls; }
+  uint32_t getEmptyStallTime() { return mEmptyStallTime; }
+  uint32_t getPreviews() { return mPreviews; }
+  uint32_t getPreviewStallTime() { return mPreviewStallTime; }
+
+  // show thread, before start, previews of the slide it waits on shown by show
+  void setPreview (tPreview show, void* context) { mShowPreview = show; mPreviewContext = context; }
+
+  // decoder task, the show thread is waiting on the slide being decoded, a preview would be shown
+  bool isWaiting() { return mWaiting; }
+  void preview (cTile* tile);
+
+  bool start (UBaseType_t priority);
+  sSlot* get();
+  void release (sSlot* slot);
+
+private:
+  static void decodeThread (void* arg);
+  void dropPreviews();
+  void run();
+
+  const std::vector<std::string>& mFiles;
+  const uint16_t mPoolSize;
+  const tDecode mDecode;
+  const tIdle mIdle;
+  void* mContext;
+
+  sSlot* mSlots = nullptr;
+  QueueHandle_t mFreeQueue = nullptr;
+  QueueHandle_t mReadyQueue = nullptr;
+  QueueHandle_t mPreviewQueue = nullptr;
+  bool mDone = false;
+
+  tPreview mShowPreview = nullptr;
+  void* mPreviewContext = nullptr;
+  volatile bool mWaiting = false;
+
+  // written by the decoder task, read by the show thread
+  volatile uint16_t mMaxQueueDepth = 0;
+  volatile uint32_t mNumDecoded = 0;
+  volatile uint32_t mDecodeTime = 0;
+  volatile uint32_t mFullStalls = 0;
+  volatile uint32_t mFullStallTime = 0;
+
+  // show thread
+  uint32_t mEmptyStalls = 0;
+  uint32_t mEmptyStallTime = 0;
+  uint32_t mPreviews = 0;
+  uint32_t mPreviewStallTime = 0;
+  };
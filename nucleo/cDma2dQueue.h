@@ -0,0 +1,141 @@
+// cDma2dQueue.h - cLcd's dma2d job ring, in a header of its own so host tests can drive it
+// - cLcd adds in a critical section, DMA2D_IRQHandler completes, a test's own thread stands in for the irq
+#pragma once
+//{{{  includes
+#include <stdint.h>
+#ifdef HOST_BUILD
+  #include "../host/host.h"
+#else
+  #include "cmsis_os.h"
+  #include "../system/stm32h7xx.h"
+#endif
+//}}}
+
+//{{{
+struct sDma2dJob {
+  uint32_t mMode;       // DMA2D_R2M, DMA2D_M2M_PFC, DMA2D_M2M_BLEND
+  uint32_t mFgpfccr;
+  uint32_t mColour;     // R2M OCOLR, A8 FGCOLR
+  uint32_t mSrc;        // FGMAR
+  uint32_t mDst;        // OMAR, BGMAR
+  uint16_t mSrcOffset;  // FGOR
+  uint16_t mDstOffset;  // OOR, BGOR
+  int16_t mX;
+  int16_t mY;
+  uint16_t mWidth;
+  uint16_t mHeight;
+  };
+//}}}
+//{{{
+class cDma2dQueue {
+// ring of dma2d jobs, draw calls add, DMA2D_IRQHandler completes
+// - no register access, add and complete return the job the caller should start
+// - jobs queued behind the running job can still be merged into
+public:
+  //{{{
+  ~cDma2dQueue() {
+    vPortFree (mJobs);
+    }
+  //}}}
+  //{{{
+  void init (uint16_t numJobs) {
+
+    mNumJobs = numJobs;
+    mJobs = (sDma2dJob*)pvPortMalloc (numJobs * sizeof(sDma2dJob));
+    }
+  //}}}
+
+  static const int kMergeWindow = 16;
+
+  bool isBusy() const { return mBusy; }
+  bool isFull() const { return next (mHead) == mTail; }
+
+  //{{{
+  const sDma2dJob* add (const sDma2dJob& job) {
+  // merge or queue job, return it to start if the queue was idle
+
+    if (mBusy) {
+      // look back through jobs not yet started, can't move job past one it overlaps
+      uint16_t index = mHead;
+      for (int i = 0; (i < kMergeWindow) && (index != next (mTail)); i++) {
+        index = prev (index);
+        if (merge (mJobs[index], job))
+          return nullptr;
+        // M2M reads the frame buffer, nothing moves ahead of it
+        if (overlaps (mJobs[index], job) || (mJobs[index].mMode == DMA2D_M2M))
+          break;
+        }
+      }
+
+    mJobs[mHead] = job;
+    mHead = next (mHead);
+    if (mBusy)
+      return nullptr;
+
+    mBusy = true;
+    return mJobs + mTail;
+    }
+  //}}}
+  //{{{
+  const sDma2dJob* complete() {
+  // running job done, return next job to start, nullptr when drained
+
+    mTail = next (mTail);
+    if (mTail != mHead)
+      return mJobs + mTail;
+
+    mBusy = false;
+    return nullptr;
+    }
+  //}}}
+
+private:
+  uint16_t next (uint16_t index) const { return (index + 1 == mNumJobs) ? 0 : index + 1; }
+  uint16_t prev (uint16_t index) const { return (index == 0) ? mNumJobs - 1 : index - 1; }
+
+  //{{{
+  static bool overlaps (const sDma2dJob& a, const sDma2dJob& b) {
+    return (a.mX < b.mX + b.mWidth) && (b.mX < a.mX + a.mWidth) &&
+           (a.mY < b.mY + b.mHeight) && (b.mY < a.mY + a.mHeight);
+    }
+  //}}}
+  //{{{
+  static bool merge (sDma2dJob& to, const sDma2dJob& from) {
+  // - same colour rects in vertical or horizontal runs, trace columns, outlines
+  // - A8 spans in vertical runs whose coverage follows on
+
+    if ((to.mMode != from.mMode) || (to.mFgpfccr != from.mFgpfccr) || (to.mColour != from.mColour))
+      return false;
+
+    if (to.mMode == DMA2D_R2M) {
+      if ((to.mX == from.mX) && (to.mWidth == from.mWidth) && (from.mY == to.mY + to.mHeight)) {
+        to.mHeight += from.mHeight;
+        return true;
+        }
+      if ((to.mY == from.mY) && (to.mHeight == from.mHeight) && (from.mX == to.mX + to.mWidth)) {
+        to.mWidth += from.mWidth;
+        to.mDstOffset -= from.mWidth;
+        return true;
+        }
+      }
+
+    else if (to.mMode == DMA2D_M2M_BLEND) {
+      if ((to.mX == from.mX) && (to.mWidth == from.mWidth) && (from.mY == to.mY + to.mHeight) &&
+          !to.mSrcOffset && !from.mSrcOffset && (from.mSrc == to.mSrc + (to.mWidth * to.mHeight))) {
+        to.mHeight += from.mHeight;
+        return true;
+        }
+      }
+
+    return false;
+    }
+  //}}}
+
+  sDma2dJob* mJobs = nullptr;
+  uint16_t mNumJobs = 0;
+
+  volatile uint16_t mHead = 0;
+  volatile uint16_t mTail = 0;
+  volatile bool mBusy = false;
+  };
+//}}}
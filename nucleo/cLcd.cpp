@@ -1,12 +1,18 @@
 // cLcd.cpp
 //{{{  includes
 #include "cLcd.h"
+#include "cDma2dQueue.h"
 
 #include "math.h"
 #include "../common/heap.h"
 
 #include "../freetype/FreeSansBold.h"
-#include "cpuUsage.h"
+#ifndef HOST_BUILD
+  #include "cpuUsage.h"
+#endif
+#if defined(HOST_BUILD) && defined(__SSE2__)
+  #include <immintrin.h>
+#endif
 //}}}
 //{{{  screen resolution defines
 #ifdef NEXXY_SCREEN
@@ -55,6 +61,7 @@ public:
 //}}}
 //{{{
 class cOutline {
+friend class cOutlineBench;
 public:
   //{{{
   cOutline() {
@@ -66,6 +73,7 @@ public:
   ~cOutline() {
 
     vPortFree (mSortedCells);
+    vPortFree (mRowStarts);
 
     if (mNumBlockOfCells) {
       sCell** ptr = mBlockOfCells + mNumBlockOfCells - 1;
@@ -211,6 +219,7 @@ private:
   //}}}
   //{{{
   void sortCells() {
+  // y bucket counting sort straight from the blocks of cells, then x sort each row
 
     if (mNumCells == 0)
       return;
@@ -218,31 +227,73 @@ private:
     // allocate mSortedCells, a contiguous vector of sCell pointers
     if (mNumCells > mNumSortedCells) {
       vPortFree (mSortedCells);
-      mSortedCells = (sCell**)pvPortMalloc ((mNumCells + 1) * 4);
+      mSortedCells = (sCell**)pvPortMalloc ((mNumCells + 1) * sizeof(sCell*));
       mNumSortedCells = mNumCells;
       }
 
-    // point mSortedCells at sCells
+    // rows, a cell with -ve x packs into the row above
+    int32_t firstRow = mMiny - 1;
+    uint32_t numRows = mMaxy - firstRow + 1;
+    if (numRows > mNumRowStarts) {
+      vPortFree (mRowStarts);
+      mRowStarts = (uint16_t*)pvPortMalloc ((numRows + 1) * sizeof(uint16_t));
+      mNumRowStarts = numRows;
+      }
+    memset (mRowStarts, 0, (numRows + 1) * sizeof(uint16_t));
+
+    // count cells per row, offset by one
     sCell** blockPtr = mBlockOfCells;
-    sCell** sortedPtr = mSortedCells;
-    uint16_t numBlocks = mNumCells / mNumCellsInBlock;
-    while (numBlocks--) {
-      sCell* cellPtr = *blockPtr++;
-      unsigned cellInBlock = mNumCellsInBlock;
+    uint16_t numCells = mNumCells;
+    while (numCells) {
+      const sCell* cellPtr = *blockPtr++;
+      uint16_t cellInBlock = numCells < mNumCellsInBlock ? numCells : mNumCellsInBlock;
+      numCells -= cellInBlock;
       while (cellInBlock--)
-        *sortedPtr++ = cellPtr++;
+        mRowStarts[(cellPtr++->mPackedCoord >> 16) - firstRow + 1]++;
       }
 
-    sCell* cellPtr = *blockPtr++;
-    unsigned cellInBlock = mNumCells % mNumCellsInBlock;
-    while (cellInBlock--)
-      *sortedPtr++ = cellPtr++;
+    // accumulate to row starts
+    for (uint32_t row = 1; row <= numRows; row++)
+      mRowStarts[row] += mRowStarts[row-1];
+
+    // scatter pointers into rows, keeps generation order, row starts advance to row ends
+    blockPtr = mBlockOfCells;
+    numCells = mNumCells;
+    while (numCells) {
+      sCell* cellPtr = *blockPtr++;
+      uint16_t cellInBlock = numCells < mNumCellsInBlock ? numCells : mNumCellsInBlock;
+      numCells -= cellInBlock;
+      while (cellInBlock--) {
+        mSortedCells[mRowStarts[(cellPtr->mPackedCoord >> 16) - firstRow]++] = cellPtr;
+        cellPtr++;
+        }
+      }
 
     // terminate mSortedCells with nullptr
     mSortedCells[mNumCells] = nullptr;
 
-    // sort it
-    qsortCells (mSortedCells, mNumCells);
+    // sort each row by x, edges add runs already in x order, so insertion sort unless the row is long
+    uint16_t rowStart = 0;
+    for (uint32_t row = 0; row < numRows; row++) {
+      uint16_t rowEnd = mRowStarts[row];
+      if (rowEnd - rowStart > kMaxInsertionSort)
+        qsortCells (mSortedCells + rowStart, rowEnd - rowStart);
+      else
+        insertionSortCells (mSortedCells + rowStart, mSortedCells + rowEnd);
+      rowStart = rowEnd;
+      }
+    }
+  //}}}
+  //{{{
+  void insertionSortCells (sCell** start, sCell** end) {
+
+    for (sCell** i = start + 1; i < end; i++) {
+      sCell* cell = *i;
+      sCell** j = i;
+      for (; (j > start) && (cell->mPackedCoord < (*(j-1))->mPackedCoord); j--)
+        *j = *(j-1);
+      *j = cell;
+      }
     }
   //}}}
 
@@ -519,12 +570,18 @@ private:
     }
   //}}}
 
+  static const int kMaxInsertionSort = 32;
+
   uint16_t mNumCellsInBlock = 0;
   uint16_t mNumBlockOfCells = 0;
   uint16_t mNumSortedCells = 0;
   sCell** mBlockOfCells = nullptr;
   sCell** mSortedCells = nullptr;
 
+  // sortCells row bucket starts
+  uint32_t mNumRowStarts = 0;
+  uint16_t* mRowStarts = nullptr;
+
   uint16_t mNumCells;
   sCell mCurCell;
   sCell* mCurCellPtr = nullptr;
@@ -543,115 +600,629 @@ private:
   bool mSortRequired;
   };
 //}}}
+
 //{{{
-class cScanLine {
+class cGlyphAtlas {
+// A8 glyphs of one font height, shelf packed into sram123 pages, cFontChar bitmaps point into the pages
+// - glyphs too big for a page, or past the page limit or budget, get their own heap bitmap
 public:
+  static const uint16_t kWidth = 256;
+  static const int kMaxPages = 8;
+
+  // a page holds two shelves of the tallest glyphs, pages added as glyphs are used
+  cGlyphAtlas (uint16_t fontHeight) : mPageRows(2 * (fontHeight + (fontHeight / 4) + 2)) {}
+  //{{{
+  ~cGlyphAtlas() {
+
+    for (int page = 0; page < mNumPages; page++)
+      sram123Free (mPages[page]);
+
+    for (auto& fontChar : mChars)
+      if (fontChar.bitmap && !inPages (fontChar.bitmap))
+        vPortFree (fontChar.bitmap);
+    }
+  //}}}
+  void* operator new (std::size_t size) { return pvPortMalloc (size); }
+  void operator delete (void* ptr) { vPortFree (ptr); }
+
+  cFontChar* getChar (char ch) { return &mChars[ch - 0x20]; }
+  uint32_t getPageBytes() const { return mNumPages * kWidth * mPageRows; }
+  uint32_t getUsedBytes() const { return mUsedBytes; }
+
   //{{{
-  class iterator {
-  public:
-    iterator (const cScanLine& scanLine) :
-      mCoverage(scanLine.mCoverage), mCurCount(scanLine.mCounts), mCurStartPtr(scanLine.mStartPtrs) {}
+  uint8_t* alloc (uint16_t width, uint16_t rows, uint32_t pageBudget) {
+  // place on the current shelf, else start a shelf, else start a page if pageBudget allows
 
-    int next() {
-      ++mCurCount;
-      ++mCurStartPtr;
-      return int(*mCurStartPtr - mCoverage);
+    if ((width > kWidth) || (rows > mPageRows))
+      return nullptr;
+
+    if (!mNumPages || (mShelfX + width > kWidth)) {
+      mShelfY += mShelfRows;
+      mShelfX = 0;
+      mShelfRows = 0;
       }
 
-    int getNumPix() const { return int(*mCurCount); }
-    const uint8_t* getCoverage() const { return *mCurStartPtr; }
+    if (!mNumPages || (mShelfY + rows > mPageRows)) {
+      if ((mNumPages == kMaxPages) || (uint32_t(kWidth * mPageRows) > pageBudget))
+        return nullptr;
+      auto page = sram123Alloc (kWidth * mPageRows);
+      if (!page)
+        return nullptr;
+      mPages[mNumPages++] = page;
+      mShelfX = 0;
+      mShelfY = 0;
+      mShelfRows = 0;
+      }
 
-  private:
-    const uint8_t* mCoverage;
-    const uint16_t* mCurCount;
-    const uint8_t* const* mCurStartPtr;
-    };
+    // last shelf on the page can grow
+    if (rows > mShelfRows)
+      mShelfRows = rows;
+
+    uint8_t* bitmap = mPages[mNumPages-1] + (mShelfY * kWidth) + mShelfX;
+    mShelfX += width;
+    mUsedBytes += width * rows;
+    return bitmap;
+    }
   //}}}
-  friend class iterator;
 
-  cScanLine() {}
+private:
   //{{{
-  ~cScanLine() {
+  bool inPages (const uint8_t* bitmap) const {
 
-    vPortFree (mCounts);
-    vPortFree (mStartPtrs);
-    vPortFree (mCoverage);
+    for (int page = 0; page < mNumPages; page++)
+      if ((bitmap >= mPages[page]) && (bitmap < mPages[page] + (kWidth * mPageRows)))
+        return true;
+    return false;
     }
   //}}}
 
-  int16_t getY() const { return mLastY; }
-  int16_t getBaseX() const { return mMinx;  }
-  uint16_t getNumSpans() const { return mNumSpans; }
-  int isReady (int16_t y) const { return mNumSpans && (y ^ mLastY); }
+  cFontChar mChars[0x60];
+
+  uint16_t mPageRows;
+  int mNumPages = 0;
+  uint8_t* mPages[kMaxPages];
 
+  uint16_t mShelfX = 0;
+  uint16_t mShelfY = 0;
+  uint16_t mShelfRows = 0;
+  uint32_t mUsedBytes = 0;
+  };
+//}}}
+//{{{
+class cTextRun {
+// composed A8 strip of a string, position independent, for the drawInfo run cache
+public:
+  void* operator new (std::size_t size) { return pvPortMalloc (size); }
+  void operator delete (void* ptr) { vPortFree (ptr); }
+
+  std::string mString;
+  cRect mRect;              // strip relative to the text rect topLeft
+  int16_t mAdvance = 0;     // returned x relative to the text rect left
+  int16_t mNeedWidth = 0;   // narrower text rect would break the run
+  uint32_t mLastUsed = 0;   // mNumPresents
+  uint32_t mBytes = 0;
+  uint8_t* mCoverage = nullptr;
+  };
+//}}}
+//{{{
+struct sGlyphPlace {
+  const cFontChar* mFontChar;
+  int16_t mX;
+  int16_t mY;
+  };
+//}}}
+//{{{
+struct sGradSpan {
+// r,g,b 16.16 at the first pixel, 64bit so far off or steep linear gradients can't wrap
+// - per pixel step, linear gradients clamp to their end colours
+  int64_t mValue[3];
+  int32_t mStep[3];
+  int32_t mMin[3];
+  int32_t mMax[3];
+  };
+//}}}
+//{{{
+class cYuvMcu {
+// hw jpeg decoder mcu stream tile, Y 8x8 blocks in raster order then a Cb and a Cr block
+// - 4:4:4 8x8 192 bytes, 4:2:2 16x8 256 bytes, 4:2:0 16x16 384 bytes, mcus in raster order, mPitch mcu padded
+// - full range BT.601, same arithmetic as the DMA2D, cpu and dma2d conversions of a tile match exactly
+public:
   //{{{
-  void resetSpans() {
+  cYuvMcu (const cTile* tile) :
+      mPiccy(tile->mPiccy),
+      mHShift(tile->mFormat != cTile::eYuvMcu444 ? 1 : 0),
+      mVShift(tile->mFormat == cTile::eYuvMcu420 ? 1 : 0),
+      mChroma(64 << (mHShift + mVShift)),
+      mMcuBytes(mChroma + 128),
+      mMcuRowBytes((tile->mPitch >> (3 + mHShift)) * mMcuBytes) {}
+  //}}}
 
-    mNumSpans = 0;
+  //{{{
+  void setRow (uint32_t y) {
+  // mcu row and the offsets of line y inside its mcus
 
-    mCurCount = mCounts;
-    mCurStartPtr = mStartPtrs;
+    mMcuRow = mPiccy + ((y >> (3 + mVShift)) * mMcuRowBytes);
+    mLumRow = ((((y >> 3) & mVShift) << mHShift) * 64) + ((y & 7) * 8);
+    mChrRow = mChroma + (((y >> mVShift) & 7) * 8);
+    }
+  //}}}
+  //{{{
+  inline void getYuv (uint32_t x, int32_t& lum, int32_t& cb, int32_t& cr) {
+  // pixel x of the setRow line
+
+    auto mcuPtr = mMcuRow + ((x >> (3 + mHShift)) * mMcuBytes);
+    lum = mcuPtr[mLumRow + (((x >> 3) & mHShift) * 64) + (x & 7)];
+    auto chrPtr = mcuPtr + mChrRow + ((x >> mHShift) & 7);
+    cb = chrPtr[0] - 128;
+    cr = chrPtr[64] - 128;
+    }
+  //}}}
+  //{{{
+  inline uint32_t getRun (uint32_t x, const uint8_t*& lumPtr, const uint8_t*& chrRow) {
+  // luma of pixel x and on to the end of its 8x8 block, chroma line of its mcu, pixels in the run
 
-    mLastX = 0x7FFF;
-    mLastY = 0x7FFF;
+    auto mcuPtr = mMcuRow + ((x >> (3 + mHShift)) * mMcuBytes);
+    lumPtr = mcuPtr + mLumRow + (((x >> 3) & mHShift) * 64) + (x & 7);
+    chrRow = mcuPtr + mChrRow;
+    return 8 - (x & 7);
+    }
+  //}}}
+  //{{{
+  inline uint32_t getChroma (uint32_t x) { return (x >> mHShift) & 7; }
+  //}}}
+  //{{{
+  inline uint16_t getRgb565 (uint32_t x) {
+
+    int32_t lum, cb, cr;
+    getYuv (x, lum, cb, cr);
+    int32_t r = lum + ((91881 * cr + 32768) >> 16);
+    int32_t g = lum - ((22554 * cb + 46802 * cr - 32768) >> 16);
+    int32_t b = lum + ((116130 * cb + 32768) >> 16);
+    return ((r < 0 ? 0 : r > 255 ? 255 : r) >> 3) << 11 |
+           ((g < 0 ? 0 : g > 255 ? 255 : g) >> 2) << 5 |
+           ((b < 0 ? 0 : b > 255 ? 255 : b) >> 3);
     }
   //}}}
   //{{{
-  void reset (int16_t minx, int16_t maxx) {
+  inline bool newChroma (uint32_t x) {
+  // first pixel of a chroma sample
+    return !(x & ((1 << mHShift) - 1));
+    }
+  //}}}
+
+private:
+  const uint8_t* mPiccy;
+  const uint32_t mHShift;
+  const uint32_t mVShift;
+  const uint32_t mChroma;
+  const uint32_t mMcuBytes;
+  const uint32_t mMcuRowBytes;
+
+  const uint8_t* mMcuRow = nullptr;
+  uint32_t mLumRow = 0;
+  uint32_t mChrRow = 0;
+  };
+//}}}
 
-    uint16_t maxLen = maxx - minx + 2;
-    if (maxLen > mMaxlen) {
-      // increase allocations
-      mMaxlen = maxLen;
+//{{{
+class cScaleAxis {
+// taps of one scaler axis, box filter when the source is bigger, else bilinear
+// - Q14 weights sum to 1 for every dest pixel, zero padded to mStride taps
+public:
+  static const int kWeightBits = 14;
+
+  ~cScaleAxis() { free(); }
 
-      vPortFree (mStartPtrs);
-      vPortFree (mCounts);
-      vPortFree (mCoverage);
+  //{{{
+  bool set (uint16_t srcSize, uint16_t dstSize, uint16_t tapPad) {
+
+    free();
+    mSrcSize = srcSize;
+    mDstSize = dstSize;
+
+    // a box spans src/dst source pixels, plus a partial pixel at either end
+    uint16_t maxTaps = srcSize > dstSize ? ((srcSize + dstSize - 1) / dstSize) + 1 : 2;
+    mStride = ((maxTaps + tapPad - 1) / tapPad) * tapPad;
+
+    // padded to whole groups of 4 dest pixels, zero weights
+    uint16_t allocSize = (dstSize + 3) & ~3;
+    mStart = (uint16_t*)pvPortMalloc (allocSize * sizeof(uint16_t));
+    mNumTaps = (uint16_t*)pvPortMalloc (allocSize * sizeof(uint16_t));
+    mWeights = (int16_t*)pvPortMalloc (allocSize * mStride * sizeof(int16_t));
+    if (!mStart || !mNumTaps || !mWeights) {
+      printf ("cScaleAxis::set alloc fail %d to %d\n", srcSize, dstSize);
+      free();
+      return false;
+      }
+    memset (mStart, 0, allocSize * sizeof(uint16_t));
+    memset (mNumTaps, 0, allocSize * sizeof(uint16_t));
+    memset (mWeights, 0, allocSize * mStride * sizeof(int16_t));
+
+    for (uint16_t i = 0; i < dstSize; i++) {
+      int16_t* weights = mWeights + (i * mStride);
+      if (srcSize >= dstSize) {
+        //{{{  box, area of each source pixel inside dest pixel i, Q16 source coords
+        uint32_t from = (uint32_t)((((uint64_t)i * srcSize) << 16) / dstSize);
+        uint32_t to = (uint32_t)((((uint64_t)(i + 1) * srcSize) << 16) / dstSize);
+        mStart[i] = from >> 16;
+        mNumTaps[i] = ((to + 0xFFFF) >> 16) - mStart[i];
+
+        int32_t sum = 0;
+        int biggest = 0;
+        for (int tap = 0; tap < mNumTaps[i]; tap++) {
+          uint32_t pixFrom = (uint32_t)(mStart[i] + tap) << 16;
+          uint32_t pixTo = pixFrom + 0x10000;
+          uint32_t area = (to < pixTo ? to : pixTo) - (from > pixFrom ? from : pixFrom);
+          weights[tap] = (int16_t)((((uint64_t)area << kWeightBits) + ((to - from) / 2)) / (to - from));
+          sum += weights[tap];
+          if (weights[tap] > weights[biggest])
+            biggest = tap;
+          }
 
-      mCoverage = (uint8_t*)pvPortMalloc (maxLen);
-      mCounts = (uint16_t*)pvPortMalloc (maxLen * 2);
-      mStartPtrs = (uint8_t**)pvPortMalloc (maxLen * 4);
+        // rounding error into the biggest tap
+        weights[biggest] += (1 << kWeightBits) - sum;
+        }
+        //}}}
+      else {
+        //{{{  bilinear, dest pixel centre back into source, clamped to the edge pixels
+        int32_t pos = (int32_t)((((uint64_t)((2 * i) + 1) * srcSize) << 15) / dstSize) - 0x8000;
+        if (pos < 0)
+          pos = 0;
+        else if (pos > ((srcSize - 1) << 16))
+          pos = (srcSize - 1) << 16;
+
+        int16_t frac = ((pos & 0xFFFF) + 2) >> 2;
+        mStart[i] = pos >> 16;
+        mNumTaps[i] = frac ? 2 : 1;
+        weights[0] = (1 << kWeightBits) - frac;
+        weights[1] = frac;
+        }
+        //}}}
       }
 
-    mMinx = minx;
-    resetSpans();
+    return true;
+    }
+  //}}}
+  //{{{
+  void free() {
+
+    vPortFree (mStart);
+    vPortFree (mNumTaps);
+    vPortFree (mWeights);
+    mStart = nullptr;
+    mNumTaps = nullptr;
+    mWeights = nullptr;
+    mSrcSize = 0;
+    mDstSize = 0;
     }
   //}}}
 
+  uint16_t mSrcSize = 0;
+  uint16_t mDstSize = 0;
+  uint16_t mStride = 0;         // weights per dest pixel, multiple of tapPad
+  uint16_t* mStart = nullptr;   // first source pixel of each dest pixel
+  uint16_t* mNumTaps = nullptr; // unpadded taps
+  int16_t* mWeights = nullptr;
+  };
+//}}}
+//{{{
+class cScaler {
+// separable fixed point cTile scaler to rgb565
+// - source row converted from the tile format into 16bit planes once,
+//   horizontally filtered into a row cache slot, slots reused while dest rows still need them
+// - dest row accumulates its cached source rows, two vertical taps a pass
+// - kernels SMLAD on target, SSE2 or AVX2 on host, plain C otherwise
+friend class cScaleBench;
+public:
+#if defined(__ARM_FEATURE_DSP)
+  static const uint16_t kTapPad = 2;
+#elif defined(HOST_BUILD) && defined(__SSE2__)
+  static const uint16_t kTapPad = 4;
+#else
+  static const uint16_t kTapPad = 1;
+#endif
+
+  ~cScaler() { free(); }
+
+  uint32_t getRowsConverted() const { return mRowsConverted; }
+  uint32_t getRowFetches() const { return mRowFetches; }
+
   //{{{
-  void addSpan (int16_t x, int16_t y, uint16_t num, uint16_t coverage) {
+  bool set (const cTile* tile, uint16_t dstWidth, uint16_t dstHeight) {
+  // tile contents may have changed, cached rows are dropped, taps kept while the sizes match
+
+    mTile = tile;
+    mRowsConverted = 0;
+    mRowFetches = 0;
+
+    if ((tile->mWidth != mX.mSrcSize) || (tile->mHeight != mY.mSrcSize) ||
+        (dstWidth != mX.mDstSize) || (dstHeight != mY.mDstSize)) {
+      free();
+      if (!mX.set (tile->mWidth, dstWidth, kTapPad) || !mY.set (tile->mHeight, dstHeight, 1))
+        return false;
+
+      // planes padded so horizontal taps can run past the last pixel, rows to a multiple of 8 pixels
+      mSrcPlane = tile->mWidth + mX.mStride;
+      mRowPitch = (dstWidth + 7) & ~7;
+      mNumSlots = mY.mStride + 1;
+
+      mSrc = (int16_t*)pvPortMalloc (mSrcPlane * 3 * sizeof(int16_t));
+      mRows = (int16_t*)pvPortMalloc (mNumSlots * mRowPitch * 3 * sizeof(int16_t));
+      mSlotRow = (int32_t*)pvPortMalloc (mNumSlots * sizeof(int32_t));
+      mAcc = (int32_t*)pvPortMalloc (mRowPitch * 3 * sizeof(int32_t));
+      if (!mSrc || !mRows || !mSlotRow || !mAcc) {
+        printf ("cScaler::set alloc fail %dx%d to %dx%d\n", tile->mWidth, tile->mHeight, dstWidth, dstHeight);
+        free();
+        return false;
+        }
 
-    x -= mMinx;
+      memset (mSrc, 0, mSrcPlane * 3 * sizeof(int16_t));
+      memset (mRows, 0, mNumSlots * mRowPitch * 3 * sizeof(int16_t));
+      }
 
-    memset (mCoverage + x, coverage, num);
-    if (x == mLastX+1)
-      (*mCurCount) += (uint16_t)num;
-    else {
-      *++mCurCount = (uint16_t)num;
-      *++mCurStartPtr = mCoverage + x;
-      mNumSpans++;
+    for (int slot = 0; slot < mNumSlots; slot++)
+      mSlotRow[slot] = -1;
+    return true;
+    }
+  //}}}
+  //{{{
+  void filterRow (uint16_t dstY) {
+  // vertical pass, mAcc planes Q21
+
+    memset (mAcc, 0, mRowPitch * 3 * sizeof(int32_t));
+
+    const int16_t* weights = mY.mWeights + (dstY * mY.mStride);
+    uint16_t srcY = mY.mStart[dstY];
+    int numTaps = mY.mNumTaps[dstY];
+    for (int tap = 0; tap < numTaps; tap += 2) {
+      const int16_t* rowA = getRow (srcY + tap);
+      if (tap + 1 < numTaps)
+        accumulate (rowA, getRow (srcY + tap + 1), weights[tap], weights[tap + 1]);
+      else
+        accumulate (rowA, rowA, weights[tap], 0);
       }
+    }
+  //}}}
+  //{{{
+  void writeRow (uint16_t* dst, uint16_t left, uint16_t right) {
+  // filtered row to rgb565, round to 8 bits then truncate like sRgba565
+
+    const int32_t kRound = 1 << (cScaleAxis::kWeightBits + kFracBits - 1);
+    const int32_t* red = mAcc;
+    const int32_t* green = mAcc + mRowPitch;
+    const int32_t* blue = mAcc + (mRowPitch * 2);
 
-    mLastX = x + num - 1;
-    mLastY = y;
+    for (uint16_t x = left; x < right; x++)
+      *dst++ = (((red[x] + kRound) >> 24) << 11) | (((green[x] + kRound) >> 23) << 5) | ((blue[x] + kRound) >> 24);
     }
   //}}}
 
 private:
-  int16_t mMinx = 0;
-  uint16_t mMaxlen = 0;
-  int16_t mLastX = 0x7FFF;
-  int16_t mLastY = 0x7FFF;
+  // horizontally filtered rows hold Q7 values, pairs of them times Q14 weights stay inside int32
+  static const int kFracBits = 7;
 
-  uint8_t* mCoverage = nullptr;
+  //{{{
+  static inline uint32_t read32 (const int16_t* ptr) {
+  // two int16, unaligned is fine on cortex-m7
+
+    uint32_t value;
+    memcpy (&value, ptr, sizeof(value));
+    return value;
+    }
+  //}}}
+  //{{{
+  void filterTaps (const int16_t* src, int16_t* dst) {
+  // horizontal pass of one plane, Q7 out, mStride multiple of kTapPad
+
+    const int kShift = cScaleAxis::kWeightBits - kFracBits;
+    const int16_t* weights = mX.mWeights;
+    uint16_t stride = mX.mStride;
+
+  #if defined(__ARM_FEATURE_DSP)
+    for (uint16_t x = 0; x < mX.mDstSize; x++, weights += stride) {
+      const int16_t* taps = src + mX.mStart[x];
+      uint32_t sum = 1 << (kShift - 1);
+      for (uint16_t tap = 0; tap < stride; tap += 2)
+        sum = __SMLAD (read32 (taps + tap), read32 (weights + tap), sum);
+      *dst++ = (int16_t)((int32_t)sum >> kShift);
+      }
+
+  #elif defined(HOST_BUILD) && defined(__SSE2__)
+    // four dest pixels a pass, pmaddwd sums tap pairs, pairs of pairs summed across the four at the end
+    const __m128i kRound = _mm_set1_epi32 (1 << (kShift - 1));
+    for (uint16_t x = 0; x < mX.mDstSize; x += 4, weights += stride * 4, dst += 4) {
+      const int16_t* taps[4] = { src + mX.mStart[x], src + mX.mStart[x+1], src + mX.mStart[x+2], src + mX.mStart[x+3] };
+      __m128i sum01 = _mm_setzero_si128();
+      __m128i sum23 = _mm_setzero_si128();
+      for (uint16_t tap = 0; tap < stride; tap += 4) {
+        __m128i src01 = _mm_unpacklo_epi64 (_mm_loadl_epi64 ((const __m128i*)(taps[0] + tap)), _mm_loadl_epi64 ((const __m128i*)(taps[1] + tap)));
+        __m128i src23 = _mm_unpacklo_epi64 (_mm_loadl_epi64 ((const __m128i*)(taps[2] + tap)), _mm_loadl_epi64 ((const __m128i*)(taps[3] + tap)));
+        __m128i weights01 = _mm_unpacklo_epi64 (_mm_loadl_epi64 ((const __m128i*)(weights + tap)), _mm_loadl_epi64 ((const __m128i*)(weights + stride + tap)));
+        __m128i weights23 = _mm_unpacklo_epi64 (_mm_loadl_epi64 ((const __m128i*)(weights + (stride * 2) + tap)), _mm_loadl_epi64 ((const __m128i*)(weights + (stride * 3) + tap)));
+        sum01 = _mm_add_epi32 (sum01, _mm_madd_epi16 (src01, weights01));
+        sum23 = _mm_add_epi32 (sum23, _mm_madd_epi16 (src23, weights23));
+        }
+      __m128 even = _mm_shuffle_ps (_mm_castsi128_ps (sum01), _mm_castsi128_ps (sum23), _MM_SHUFFLE (2,0,2,0));
+      __m128 odd = _mm_shuffle_ps (_mm_castsi128_ps (sum01), _mm_castsi128_ps (sum23), _MM_SHUFFLE (3,1,3,1));
+      __m128i sum = _mm_srai_epi32 (_mm_add_epi32 (_mm_add_epi32 (_mm_castps_si128 (even), _mm_castps_si128 (odd)), kRound), kShift);
+      _mm_storel_epi64 ((__m128i*)dst, _mm_packs_epi32 (sum, sum));
+      }
+
+  #else
+    for (uint16_t x = 0; x < mX.mDstSize; x++, weights += stride) {
+      const int16_t* taps = src + mX.mStart[x];
+      int32_t sum = 1 << (kShift - 1);
+      for (uint16_t tap = 0; tap < stride; tap++)
+        sum += taps[tap] * weights[tap];
+      *dst++ = (int16_t)(sum >> kShift);
+      }
+  #endif
+    }
+  //}}}
+  //{{{
+  void accumulate (const int16_t* rowA, const int16_t* rowB, int16_t weightA, int16_t weightB) {
+  // mAcc += rowA * weightA + rowB * weightB, all three planes, multiple of 8 values
+
+    int32_t* acc = mAcc;
+    uint32_t numValues = mRowPitch * 3;
+
+  #if defined(__ARM_FEATURE_DSP)
+    uint32_t weights = __PKHBT ((uint16_t)weightA, (uint16_t)weightB, 16);
+    for (uint32_t i = 0; i < numValues; i += 2) {
+      uint32_t a = read32 (rowA + i);
+      uint32_t b = read32 (rowB + i);
+      acc[i] = (int32_t)__SMLAD (__PKHBT (a, b, 16), weights, (uint32_t)acc[i]);
+      acc[i+1] = (int32_t)__SMLAD (__PKHTB (b, a, 16), weights, (uint32_t)acc[i+1]);
+      }
+
+  #elif defined(HOST_BUILD) && defined(__AVX2__)
+    __m256i weights = _mm256_set1_epi32 ((uint16_t)weightA | ((uint32_t)(uint16_t)weightB << 16));
+    for (uint32_t i = 0; i < numValues; i += 8) {
+      __m128i a = _mm_loadu_si128 ((const __m128i*)(rowA + i));
+      __m128i b = _mm_loadu_si128 ((const __m128i*)(rowB + i));
+      __m256i pairs = _mm256_set_m128i (_mm_unpackhi_epi16 (a, b), _mm_unpacklo_epi16 (a, b));
+      __m256i* accPtr = (__m256i*)(acc + i);
+      _mm256_storeu_si256 (accPtr, _mm256_add_epi32 (_mm256_loadu_si256 (accPtr), _mm256_madd_epi16 (pairs, weights)));
+      }
+
+  #elif defined(HOST_BUILD) && defined(__SSE2__)
+    __m128i weights = _mm_set1_epi32 ((uint16_t)weightA | ((uint32_t)(uint16_t)weightB << 16));
+    for (uint32_t i = 0; i < numValues; i += 8) {
+      __m128i a = _mm_loadu_si128 ((const __m128i*)(rowA + i));
+      __m128i b = _mm_loadu_si128 ((const __m128i*)(rowB + i));
+      __m128i* accPtr = (__m128i*)(acc + i);
+      _mm_storeu_si128 (accPtr, _mm_add_epi32 (_mm_loadu_si128 (accPtr), _mm_madd_epi16 (_mm_unpacklo_epi16 (a, b), weights)));
+      _mm_storeu_si128 (accPtr + 1, _mm_add_epi32 (_mm_loadu_si128 (accPtr + 1), _mm_madd_epi16 (_mm_unpackhi_epi16 (a, b), weights)));
+      }
+
+  #else
+    for (uint32_t i = 0; i < numValues; i++)
+      acc[i] += (rowA[i] * weightA) + (rowB[i] * weightB);
+  #endif
+    }
+  //}}}
+
+  //{{{
+  const int16_t* getRow (uint16_t srcY) {
+  // horizontally filtered source row, from the row cache or converted now
+
+    mRowFetches++;
+    int slot = srcY % mNumSlots;
+    int16_t* row = mRows + (slot * mRowPitch * 3);
+    if (mSlotRow[slot] == srcY)
+      return row;
+
+    mSlotRow[slot] = srcY;
+    mRowsConverted++;
+    convertRow (srcY);
+
+    for (int plane = 0; plane < 3; plane++)
+      filterTaps (mSrc + (plane * mSrcPlane), row + (plane * mRowPitch));
+
+    return row;
+    }
+  //}}}
+  //{{{
+  void convertRow (uint16_t srcY) {
+  // tile row to 8bit r,g,b planes in mSrc
+
+    int16_t* red = mSrc;
+    int16_t* green = mSrc + mSrcPlane;
+    int16_t* blue = mSrc + (mSrcPlane * 2);
+    uint16_t width = mTile->mWidth;
+    uint32_t y = mTile->mY + srcY;
+
+    if (mTile->mFormat == cTile::eRgb565) {
+      //{{{  rgb565
+      auto src = (const uint16_t*)mTile->mPiccy + (y * mTile->mPitch) + mTile->mX;
+      for (uint16_t x = 0; x < width; x++) {
+        uint16_t rgb565 = *src++;
+        uint16_t r = rgb565 >> 11;
+        uint16_t g = (rgb565 >> 5) & 0x3F;
+        uint16_t b = rgb565 & 0x1F;
+        red[x] = (r << 3) | (r >> 2);
+        green[x] = (g << 2) | (g >> 4);
+        blue[x] = (b << 3) | (b >> 2);
+        }
+      }
+      //}}}
+    else if (mTile->mFormat == cTile::eRgb888) {
+      //{{{  rgb888, libjpeg RGB_RED 2 order
+      auto src = mTile->mPiccy + ((y * mTile->mPitch) + mTile->mX) * 3;
+      for (uint16_t x = 0; x < width; x++, src += 3) {
+        red[x] = src[2];
+        green[x] = src[1];
+        blue[x] = src[0];
+        }
+      }
+      //}}}
+    else {
+      //{{{  yuv mcu 4:2:0, 4:2:2, 4:4:4, full range BT.601 like the DMA2D
+      cYuvMcu mcu (mTile);
+      mcu.setRow (y);
+      int32_t redOffset = 0;
+      int32_t greenOffset = 0;
+      int32_t blueOffset = 0;
+      for (uint16_t x = 0; x < width; ) {
+        // runs to the end of an 8x8 luma block, chroma shared by a pixel pair, except 4:4:4
+        uint32_t srcX = mTile->mX + x;
+        const uint8_t* lumPtr;
+        const uint8_t* chrRow;
+        uint32_t run = mcu.getRun (srcX, lumPtr, chrRow);
+        run = run < uint32_t(width - x) ? run : width - x;
+        for (uint32_t i = 0; i < run; i++, x++, srcX++) {
+          if (!i || mcu.newChroma (srcX)) {
+            auto chrPtr = chrRow + mcu.getChroma (srcX);
+            int32_t cb = chrPtr[0] - 128;
+            int32_t cr = chrPtr[64] - 128;
+            redOffset = (91881 * cr + 32768) >> 16;
+            greenOffset = (22554 * cb + 46802 * cr - 32768) >> 16;
+            blueOffset = (116130 * cb + 32768) >> 16;
+            }
+          int32_t lum = lumPtr[i];
+          red[x] = clamp8 (lum + redOffset);
+          green[x] = clamp8 (lum - greenOffset);
+          blue[x] = clamp8 (lum + blueOffset);
+          }
+        }
+      }
+      //}}}
+    }
+  //}}}
+  static inline int16_t clamp8 (int32_t value) { return value < 0 ? 0 : value > 255 ? 255 : (int16_t)value; }
 
-  uint8_t** mStartPtrs = nullptr;
-  uint8_t** mCurStartPtr = nullptr;
+  //{{{
+  void free() {
+
+    mX.free();
+    mY.free();
+
+    vPortFree (mSrc);
+    vPortFree (mRows);
+    vPortFree (mSlotRow);
+    vPortFree (mAcc);
+    mSrc = nullptr;
+    mRows = nullptr;
+    mSlotRow = nullptr;
+    mAcc = nullptr;
+    }
+  //}}}
+
+  const cTile* mTile = nullptr;
+  cScaleAxis mX;
+  cScaleAxis mY;
 
-  uint16_t* mCounts = nullptr;
-  uint16_t* mCurCount = nullptr;
+  uint16_t mSrcPlane = 0;
+  uint16_t mRowPitch = 0;
+  int mNumSlots = 0;
 
-  uint16_t mNumSpans = 0;
+  int16_t* mSrc = nullptr;      // converted source row, r,g,b planes of mSrcPlane
+  int16_t* mRows = nullptr;     // row cache, mNumSlots of r,g,b planes of mRowPitch, Q7
+  int32_t* mSlotRow = nullptr;  // source row in each slot, -1 empty
+  int32_t* mAcc = nullptr;      // vertical pass, r,g,b planes of mRowPitch
+
+  uint32_t mRowsConverted = 0;
+  uint32_t mRowFetches = 0;
   };
 //}}}
 
@@ -666,18 +1237,171 @@ static cLcd::eDma2dWait mDma2dWait = cLcd::eWaitNone;
 static SemaphoreHandle_t mDma2dSem;
 static SemaphoreHandle_t mFrameSem;
 
-static int32_t* gRedLut = nullptr;
-static int32_t* gBlueLut = nullptr;
-static int32_t* gUGreenLut = nullptr;
-static int32_t* gVGreenLut = nullptr;
-static uint8_t* gClampLut5 = nullptr;
-static uint8_t* gClampLut6 = nullptr;
+// LTDC_ER_IRQHandler flags, uiThread reports them in start, info takes a critical section an irq can't
+static volatile uint32_t mLtdcErrors = 0;
 
 static cOutline mOutline;
-static cScanLine mScanLine;
 static uint8_t mGamma[256];
 
-static uint32_t mNumStamps = 0;
+static cScaler mScaler;
+
+// grad ordered dither thresholds, radial colours by distance squared, r,g,b 8.8
+static const uint8_t kBayer4[4][4] = { { 0,8,2,10 }, { 12,4,14,6 }, { 3,11,1,9 }, { 15,7,13,5 } };
+static const int kRadialLutSize = 1024;
+static uint16_t mRadialLut[kRadialLutSize + 1][3];
+
+// text strip glyphs
+static const int kMaxStripGlyphs = 64;
+static sGlyphPlace mStripGlyphs[kMaxStripGlyphs];
+
+static cDma2dQueue mDma2dQueue;
+static uint32_t mDma2dJobs = 0;
+
+// drawInfo layout
+static const int kTitleHeight = 20;
+static const int kFooterHeight = 14;
+static const int kInfoHeight = 12;
+static const int kGap = 4;
+static const int kSmallGap = 2;
+//}}}
+//{{{
+static inline uint32_t getCycles() {
+#ifdef HOST_BUILD
+  return hostGetCycles();
+#else
+  return DWT->CYCCNT;
+#endif
+  }
+//}}}
+//{{{
+static uint16_t getBytesPerPixel (uint32_t fgpfccr) {
+
+  switch (fgpfccr & DMA2D_FGPFCCR_CM) {
+    case DMA2D_INPUT_ARGB8888: return 4;
+    case DMA2D_INPUT_RGB888: return 3;
+    case DMA2D_INPUT_RGB565: return 2;
+    default: return 1;
+    }
+  }
+//}}}
+//{{{
+static inline uint16_t gradRgb565 (const int32_t* value) {
+// r,g,b 16.16, truncated like sRgba565
+
+  return ((value[0] >> 8) & 0xF800) | ((value[1] >> 13) & 0x07E0) | (value[2] >> 19);
+  }
+//}}}
+//{{{
+static inline uint16_t gradRgb565 (const int32_t* value, int32_t threshold) {
+// r,g,b 16.16, ordered dither, threshold 0..15 offsets by (2t+1)/32 of a 565 step
+// - scaled by 31/255, 63/255, LTDC expands 565 by copying msbs, so levels land on v*31/255 not v/8
+
+  int32_t r = (((value[0] >> 8) * (31 * 257)) + (threshold << 20) + (1 << 19)) >> 24;
+  int32_t g = (((value[1] >> 8) * (63 * 257)) + (threshold << 20) + (1 << 19)) >> 24;
+  int32_t b = (((value[2] >> 8) * (31 * 257)) + (threshold << 20) + (1 << 19)) >> 24;
+  return ((r > 31 ? 31 : r) << 11) | ((g > 63 ? 63 : g) << 5) | (b > 31 ? 31 : b);
+  }
+//}}}
+//{{{
+static void gradSpan (uint16_t* dst, const sGradSpan& span, int16_t x, int16_t y, int16_t width, bool dither) {
+// span values stepped per pixel, clamped to mMin..mMax
+// - clamped head, unclamped 32bit middle, clamped tail, a divide per channel only when a span end is out of range
+
+  int16_t begin = 0;
+  int16_t end = width;
+  for (int c = 0; c < 3; c++) {
+    int64_t first = span.mValue[c];
+    int64_t last = first + (int64_t(span.mStep[c]) * (width - 1));
+    if (span.mStep[c] > 0) {
+      if (first < span.mMin[c]) {
+        int64_t pixels = (span.mMin[c] - first + span.mStep[c] - 1) / span.mStep[c];
+        begin = pixels > begin ? (pixels < width ? int16_t(pixels) : width) : begin;
+        }
+      if (last > span.mMax[c]) {
+        int64_t pixels = first > span.mMax[c] ? 0 : ((span.mMax[c] - first) / span.mStep[c]) + 1;
+        end = pixels < end ? int16_t(pixels) : end;
+        }
+      }
+    else if (span.mStep[c] < 0) {
+      if (first > span.mMax[c]) {
+        int64_t pixels = (first - span.mMax[c] - span.mStep[c] - 1) / -span.mStep[c];
+        begin = pixels > begin ? (pixels < width ? int16_t(pixels) : width) : begin;
+        }
+      if (last < span.mMin[c]) {
+        int64_t pixels = first < span.mMin[c] ? 0 : ((first - span.mMin[c]) / -span.mStep[c]) + 1;
+        end = pixels < end ? int16_t(pixels) : end;
+        }
+      }
+    else if ((first < span.mMin[c]) || (first > span.mMax[c]))
+      begin = width;
+    }
+  if (end < begin)
+    end = begin;
+
+  const uint8_t* bayer = kBayer4[y & 3];
+  int64_t value64[3] = { span.mValue[0], span.mValue[1], span.mValue[2] };
+  auto clamped = [&](int16_t numPixels) {
+    for (int16_t i = 0; i < numPixels; i++, x++) {
+      int32_t value[3];
+      for (int c = 0; c < 3; c++) {
+        value[c] = int32_t(value64[c] < span.mMin[c] ? span.mMin[c] : value64[c] > span.mMax[c] ? span.mMax[c] : value64[c]);
+        value64[c] += span.mStep[c];
+        }
+      *dst++ = dither ? gradRgb565 (value, bayer[x & 3]) : gradRgb565 (value);
+      }
+    };
+
+  clamped (begin);
+
+  int32_t value[3] = { int32_t(value64[0]), int32_t(value64[1]), int32_t(value64[2]) };
+  if (dither)
+    for (int16_t i = begin; i < end; i++, x++) {
+      *dst++ = gradRgb565 (value, bayer[x & 3]);
+      value[0] += span.mStep[0];
+      value[1] += span.mStep[1];
+      value[2] += span.mStep[2];
+      }
+  else {
+    for (int16_t i = begin; i < end; i++) {
+      *dst++ = gradRgb565 (value);
+      value[0] += span.mStep[0];
+      value[1] += span.mStep[1];
+      value[2] += span.mStep[2];
+      }
+    x += end - begin;
+    }
+
+  for (int c = 0; c < 3; c++)
+    value64[c] += int64_t(span.mStep[c]) * (end - begin);
+  clamped (width - end);
+  }
+//}}}
+//{{{
+static void dma2dStart (uint32_t cr) {
+
+  mDma2dJobs++;
+  DMA2D->CR = cr;
+
+#ifdef HOST_BUILD
+  hostDma2dStart();
+#endif
+  }
+//}}}
+//{{{
+static void dma2dStartJob (const sDma2dJob* job) {
+
+  DMA2D->FGPFCCR = job->mFgpfccr;
+  DMA2D->FGCOLR = job->mColour;
+  DMA2D->OCOLR = job->mColour;
+  DMA2D->FGMAR = job->mSrc;
+  DMA2D->FGOR = job->mSrcOffset;
+  DMA2D->BGMAR = job->mDst;
+  DMA2D->BGOR = job->mDstOffset;
+  DMA2D->OMAR = job->mDst;
+  DMA2D->OOR = job->mDstOffset;
+  DMA2D->NLR = (job->mWidth << 16) | job->mHeight;
+  dma2dStart (job->mMode | DMA2D_CR_START | DMA2D_CR_TCIE | DMA2D_CR_TEIE | DMA2D_CR_CEIE);
+  }
 //}}}
 
 //{{{
@@ -712,14 +1436,14 @@ extern "C" { void LTDC_ER_IRQHandler() {
   if ((LTDC->ISR &  LTDC_FLAG_TE) != RESET) {
     LTDC->IER &= ~(LTDC_IT_TE | LTDC_IT_FU | LTDC_IT_LI);
     LTDC->ICR = LTDC_IT_TE;
-    cLcd::mLcd->info (kRed, "ltdc te IRQ");
+    mLtdcErrors |= LTDC_FLAG_TE;
     }
 
   // FIFO underrun Interrupt
   if ((LTDC->ISR &  LTDC_FLAG_FU) != RESET) {
     LTDC->IER &= ~(LTDC_IT_TE | LTDC_IT_FU | LTDC_IT_LI);
     LTDC->ICR = LTDC_FLAG_FU;
-    cLcd::mLcd->info (kRed, "ltdc fifoUnderrun IRQ");
+    mLtdcErrors |= LTDC_FLAG_FU;
     }
   }
 }
@@ -727,21 +1451,24 @@ extern "C" { void LTDC_ER_IRQHandler() {
 //{{{
 extern "C" { void DMA2D_IRQHandler() {
 
-  uint32_t isr = DMA2D->ISR;
-  if (isr & DMA2D_FLAG_TC) {
-    DMA2D->IFCR = DMA2D_FLAG_TC;
+  uint32_t isr = DMA2D->ISR & (DMA2D_FLAG_TC | DMA2D_FLAG_TE | DMA2D_FLAG_CE);
+  DMA2D->IFCR = isr;
 
-    portBASE_TYPE taskWoken = pdFALSE;
-    if (xSemaphoreGiveFromISR (mDma2dSem, &taskWoken) == pdTRUE)
-      portEND_SWITCHING_ISR (taskWoken);
-    }
-  if (isr & DMA2D_FLAG_TE) {
+  if (isr & DMA2D_FLAG_TE)
     printf ("DMA2D_IRQHandler transfer error\n");
-    DMA2D->IFCR = DMA2D_FLAG_TE;
-    }
-  if (isr & DMA2D_FLAG_CE) {
+  if (isr & DMA2D_FLAG_CE)
     printf ("DMA2D_IRQHandler config error\n");
-    DMA2D->IFCR = DMA2D_FLAG_CE;
+
+  // errors abort the job, chain on regardless
+  if (isr && mDma2dQueue.isBusy()) {
+    auto job = mDma2dQueue.complete();
+    if (job)
+      dma2dStartJob (job);
+    else {
+      portBASE_TYPE taskWoken = pdFALSE;
+      if (xSemaphoreGiveFromISR (mDma2dSem, &taskWoken) == pdTRUE)
+        portEND_SWITCHING_ISR (taskWoken);
+      }
     }
   }
 }
@@ -750,6 +1477,17 @@ extern "C" { void DMA2D_IRQHandler() {
 cLcd::cLcd()  { mLcd = this; }
 //{{{
 cLcd::~cLcd() {
+
+  vPortFree (mCoverage);
+
+  for (auto atlas : mAtlasMap)
+    delete atlas.second;
+
+  for (auto textRun : mTextRunMap) {
+    sram123Free (textRun.second->mCoverage);
+    delete textRun.second;
+    }
+
   FT_Done_Face (FTface);
   FT_Done_FreeType (FTlibrary);
   }
@@ -760,53 +1498,43 @@ void cLcd::init (const std::string& title) {
   mBuffer[0] = (uint16_t*)sdRamAlloc (LCD_WIDTH*LCD_HEIGHT*2, "lcdBuf0");
   mBuffer[1] = (uint16_t*)sdRamAlloc (LCD_WIDTH*LCD_HEIGHT*2, "lcdBuf1");
 
+  // dma2d job queue, coverage must be dma2d visible, not dtcm
+  mDma2dQueue.init (1024);
+  mCoverage = (uint8_t*)pvPortMalloc (kCoverageSize);
+
   FT_Init_FreeType (&FTlibrary);
   FT_New_Memory_Face (FTlibrary, (FT_Byte*)freeSansBold, sizeof (freeSansBold), 0, &FTface);
   FTglyphSlot = FTface->glyph;
 
   mTitle = title;
 
+  // present waits for its own flip, the draw buffer is then never on screen
   vSemaphoreCreateBinary (mFrameSem);
+  xSemaphoreTake (mFrameSem, 0);
   ltdcInit (mBuffer[mDrawBuffer]);
 
   vSemaphoreCreateBinary (mDma2dSem);
+  xSemaphoreTake (mDma2dSem, 0);
   HAL_NVIC_SetPriority (DMA2D_IRQn, 0x0F, 0);
   HAL_NVIC_EnableIRQ (DMA2D_IRQn);
 
-  // sw yuv to rgb565
-  gRedLut = (int32_t*)dtcmAlloc (256*4);
-  gBlueLut = (int32_t*)dtcmAlloc (256*4);
-  gUGreenLut = (int32_t*)dtcmAlloc (256*4);
-  gVGreenLut = (int32_t*)dtcmAlloc (256*4);
-
-  for (int32_t i = 0; i <= 255; i++) {
-    int32_t index = (i * 2) - 256;
-    gRedLut[i] = ((((int32_t) ((1.40200 / 2) * (1L << 16))) * index) + ((int32_t) 1 << (16 - 1))) >> 16;
-    gBlueLut[i] = ((((int32_t) ((1.77200 / 2) * (1L << 16))) * index) + ((int32_t) 1 << (16 - 1))) >> 16;
-    gUGreenLut[i] = (-((int32_t) ((0.71414 / 2) * (1L << 16)))) * index;
-    gVGreenLut[i] = (-((int32_t) ((0.34414 / 2) * (1L << 16)))) * index;
-    }
-
-  gClampLut5 = dtcmAlloc (256*3);
-  gClampLut6 = dtcmAlloc (256*3);
-  for (int i = 0; i < 256; i++) {
-    gClampLut5[i] = 0;
-    gClampLut6[i] = 0;
-    }
-  for (int i = 256; i < 512; i++) {
-    gClampLut5[i] = (i - 256) >> 3;
-    gClampLut6[i] = (i - 256) >> 2;
-    }
-  for (int i = 512; i < 768; i++) {
-    gClampLut5[i] = 0x1F;
-    gClampLut6[i] = 0x3F;
-    }
-
   // set gamma 1.2 lut
   for (unsigned i = 0; i < 256; i++)
     mGamma[i] = (uint8_t)(pow(double(i) / 255.0, 1.6) * 255.0);
 
   DMA2D->OPFCCR = DMA2D_OUTPUT_RGB565;
+  DMA2D->BGPFCCR = DMA2D_INPUT_RGB565;
+
+#ifndef HOST_BUILD
+  // cycle counter, dma2d stall timing
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->LAR = 0xC5ACCE55;
+  DWT->CYCCNT = 0;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+
+  // both buffers start undrawn
+  change();
   }
 //}}}
 
@@ -815,11 +1543,18 @@ void cLcd::init (const std::string& title) {
 void cLcd::setShowInfo (bool show) {
   if (show != mShowInfo) {
     mShowInfo = show;
-    mChanged = true;
+    change();
     }
   }
 //}}}
 //{{{
+void cLcd::setTitle (const std::string& str) {
+
+  mTitle = str;
+  invalidate (cRect (0,0, getWidth(), kTitleHeight+kGap));
+  }
+//}}}
+//{{{
 void cLcd::info (sRgba565 colour, const std::string& str) {
 
   uint16_t line = mCurLine++ % kMaxLines;
@@ -827,7 +1562,9 @@ void cLcd::info (sRgba565 colour, const std::string& str) {
   mLines[line].mColour = colour;
   mLines[line].mString = str;
 
-  mChanged = true;
+  // log band between title and footer
+  if (mShowInfo)
+    invalidate (cRect (0, kTitleHeight, getWidth(), getHeight() - kFooterHeight - kGap));
   }
 //}}}
 
@@ -835,16 +1572,9 @@ void cLcd::info (sRgba565 colour, const std::string& str) {
 //{{{
 void cLcd::rect (sRgba565 colour, const cRect& r) {
 
-  uint32_t rectRegs[4];
-  rectRegs[0] = colour.rgb565;                                                 // OCOLR
-  rectRegs[1] = uint32_t (mBuffer[mDrawBuffer] + r.top * getWidth() + r.left); // OMAR
-  rectRegs[2] = getWidth() - r.getWidth();                                     // OOR
-  rectRegs[3] = (r.getWidth() << 16) | r.getHeight();                          // NLR
+  mCurStats[eStatRect]++;
 
-  ready();
-  memcpy ((void*)(&DMA2D->OCOLR), rectRegs, 5*4);
-  DMA2D->CR = DMA2D_R2M | DMA2D_CR_START | DMA2D_CR_TCIE | DMA2D_CR_TEIE | DMA2D_CR_CEIE;
-  mDma2dWait = eWaitIrq;
+  addJob (DMA2D_R2M, 0, colour.rgb565, nullptr, 0, r);
   }
 //}}}
 //{{{
@@ -924,123 +1654,278 @@ void cLcd::ellipse (sRgba565 colour, cPoint centre, cPoint radius) {
 //}}}
 //{{{
 int cLcd::text (sRgba565 colour, uint16_t fontHeight, const std::string& str, cRect r) {
+// place glyphs into a strip, strip composed from the atlas, one blend per strip
+
+  mCurStats[eStatText]++;
 
-  ready();
-  DMA2D->FGPFCCR = (colour.getA() < 255) ? ((colour.getA() << 24) | 0x20000 | DMA2D_INPUT_A8) : DMA2D_INPUT_A8;
-  DMA2D->FGCOLR = (colour.getR() << 16) | (colour.getG() << 8) | colour.getB();
+  auto atlas = getAtlas (fontHeight);
+  cRect strip;
+  int numGlyphs = 0;
 
   for (auto ch : str) {
     if ((ch >= 0x20) && (ch <= 0x7F)) {
-      auto fontCharIt = mFontCharMap.find ((fontHeight << 8) | ch);
-      cFontChar* fontChar = fontCharIt != mFontCharMap.end() ? fontCharIt->second : nullptr;
-      if (!fontChar)
-        fontChar = loadChar (fontHeight, ch);
-      if (fontChar) {
-        if (r.left + fontChar->left + fontChar->pitch >= r.right)
-          break;
-        else if (fontChar->bitmap) {
-          auto src = fontChar->bitmap;
-          cRect charRect (r.left + fontChar->left, r.top + fontHeight - fontChar->top,
-                          r.left + fontChar->left + fontChar->pitch,
-                          r.top + fontHeight - fontChar->top + fontChar->rows);
-
-          // simple clips
-          if (charRect.top < 0) {
-            src += -charRect.top * charRect.getWidth();
-            charRect.top = 0;
-            }
-          if (charRect.bottom > getHeight())
-            charRect.bottom = getHeight();
-
-          if ((charRect.left >= 0) && (charRect.bottom > 0) && (charRect.top < getHeight())) {
-            uint32_t dstAddr = uint32_t(mBuffer[mDrawBuffer] + charRect.top * getWidth() + charRect.left);
-            uint32_t stride = getWidth() - charRect.getWidth();
-
-            ready();
-            DMA2D->BGPFCCR = DMA2D_INPUT_RGB565;
-            DMA2D->BGMAR = dstAddr;
-            DMA2D->OMAR = dstAddr;
-            DMA2D->BGOR = stride;
-            DMA2D->OOR = stride;
-            DMA2D->NLR = (charRect.getWidth() << 16) | charRect.getHeight();
-            DMA2D->FGMAR = (uint32_t)src;
-            DMA2D->FGOR = 0;
-            DMA2D->CR = DMA2D_M2M_BLEND | DMA2D_CR_START | DMA2D_CR_TCIE | DMA2D_CR_TEIE | DMA2D_CR_CEIE;
-            mDma2dWait = eWaitIrq;
+      mGlyphLookups++;
+      auto fontChar = atlas->getChar (ch);
+      if (!fontChar->loaded) {
+        mGlyphMisses++;
+        loadChar (atlas, fontHeight, ch);
+        }
+
+      if (r.left + fontChar->left + fontChar->pitch >= r.right)
+        break;
+      else if (fontChar->bitmap) {
+        cRect charRect (r.left + fontChar->left, r.top + fontHeight - fontChar->top,
+                        r.left + fontChar->left + fontChar->pitch,
+                        r.top + fontHeight - fontChar->top + fontChar->rows);
+        auto clipRect = charRect.intersect (cRect (getSize()));
+        if ((charRect.left >= 0) && !clipRect.isEmpty()) {
+          if (numGlyphs) {
+            // strip full, or would outgrow the coverage buffer
+            auto combined = strip.combine (clipRect);
+            if ((numGlyphs == kMaxStripGlyphs) || (combined.getWidth() * combined.getHeight() > (int)kCoverageSize)) {
+              renderStrip (colour, strip, numGlyphs);
+              numGlyphs = 0;
+              }
             }
+          strip = numGlyphs ? strip.combine (clipRect) : clipRect;
+          mStripGlyphs[numGlyphs++] = { fontChar, charRect.left, charRect.top };
           }
-        r.left += fontChar->advance;
         }
+
+      r.left += fontChar->advance;
       }
     }
 
+  renderStrip (colour, strip, numGlyphs);
   return r.left;
   }
 //}}}
-
 // cpu draw
 //{{{
+template <typename tGetSpan> void cLcd::gradFill (const cRect& r, bool horizontal, bool vertical, tGetSpan getSpan) {
+// per clip rect, cpu renders seed rows or columns, DMA2D doubles them out
+// - horizontal, colour only changes along x, seed rows copied down
+// - vertical, colour only changes along y, undithered rows are R2M rects, dithered seed columns copied across
+// - otherwise every row is cpu rendered, getSpan is stepped, no divides per row
+
+  int16_t seed = mGradDither ? 4 : 1;
+  for (int i = 0; i < mNumClip; i++) {
+    auto clipRect = r.intersect (mClip[i]);
+    if (clipRect.isEmpty())
+      continue;
+
+    sGradSpan span;
+    if (vertical && !mGradDither) {
+      // rows of the same 565 colour merge in the queue, no cpu pixels
+      for (int16_t y = clipRect.top; y < clipRect.bottom; y++) {
+        getSpan (y, clipRect.left, span);
+        int32_t value[3];
+        for (int c = 0; c < 3; c++)
+          value[c] = int32_t(span.mValue[c] < span.mMin[c] ? span.mMin[c] : span.mValue[c] > span.mMax[c] ? span.mMax[c] : span.mValue[c]);
+        queueJob (DMA2D_R2M, 0, gradRgb565 (value), nullptr, 0, cRect (clipRect.left, y, clipRect.right, y + 1));
+        }
+      continue;
+      }
+
+    // cpu writes, queued jobs must land first
+    flush();
+
+    int16_t rows = clipRect.getHeight();
+    if (horizontal && (seed < rows))
+      rows = seed;
+    int16_t width = clipRect.getWidth();
+    if (vertical && (seed < width))
+      width = seed;
+    for (int16_t y = clipRect.top; y < clipRect.top + rows; y++) {
+      getSpan (y, clipRect.left, span);
+      gradSpan (mBuffer[mDrawBuffer] + (y * getWidth()) + clipRect.left, span, clipRect.left, y, width, mGradDither);
+      }
+    mCurStats[eStatBytes] += rows * width * 2;
+
+    if (horizontal)
+      gradRows (clipRect, rows);
+    else if (vertical)
+      gradColumns (clipRect, width);
+    }
+  }
+//}}}
+//{{{
+void cLcd::gradRows (const cRect& clipRect, int16_t seedRows) {
+// double the rows at the top of clipRect down it, M2M from the draw buffer to itself
+
+  auto src = (uint8_t*)(mBuffer[mDrawBuffer] + (clipRect.top * getWidth()) + clipRect.left);
+  for (int16_t done = seedRows; done < clipRect.getHeight();) {
+    int16_t rows = done < clipRect.getHeight() - done ? done : clipRect.getHeight() - done;
+    queueJob (DMA2D_M2M, DMA2D_INPUT_RGB565, 0, src, getWidth() - clipRect.getWidth(),
+              cRect (clipRect.left, clipRect.top + done, clipRect.right, clipRect.top + done + rows));
+    done += rows;
+    }
+  }
+//}}}
+//{{{
+void cLcd::gradColumns (const cRect& clipRect, int16_t seedColumns) {
+// double the columns at the left of clipRect across it
+
+  auto src = (uint8_t*)(mBuffer[mDrawBuffer] + (clipRect.top * getWidth()) + clipRect.left);
+  for (int16_t done = seedColumns; done < clipRect.getWidth();) {
+    int16_t columns = done < clipRect.getWidth() - done ? done : clipRect.getWidth() - done;
+    queueJob (DMA2D_M2M, DMA2D_INPUT_RGB565, 0, src, getWidth() - columns,
+              cRect (clipRect.left + done, clipRect.top, clipRect.left + done + columns, clipRect.bottom));
+    done += columns;
+    }
+  }
+//}}}
+//{{{
 void cLcd::grad (sRgba565 colTL, sRgba565 colTR, sRgba565 colBL, sRgba565 colBR, const cRect& r) {
+// bilinear 4 corner, rows stepped without divides
 
-  int32_t rTL = colTL.getR() << 16;
-  int32_t rTR = colTR.getR() << 16;
-  int32_t rBL = colBL.getR() << 16;
-  int32_t rBR = colBR.getR() << 16;
+  mCurStats[eStatGrad]++;
+  if (r.isEmpty() || !isDamaged (r))
+    return;
 
-  int32_t gTL = colTL.getG() << 16;
-  int32_t gTR = colTR.getG() << 16;
-  int32_t gBL = colBL.getG() << 16;
-  int32_t gBR = colBR.getG() << 16;
+  bool horizontal = (colTL.rgb565 == colBL.rgb565) && (colTR.rgb565 == colBR.rgb565);
+  bool vertical = (colTL.rgb565 == colTR.rgb565) && (colBL.rgb565 == colBR.rgb565);
+  if (horizontal && vertical) {
+    rect (colTL, r);
+    return;
+    }
+
+  int32_t left[3] = { colTL.getR() << 16, colTL.getG() << 16, colTL.getB() << 16 };
+  int32_t right[3] = { colTR.getR() << 16, colTR.getG() << 16, colTR.getB() << 16 };
+  int32_t bottomLeft[3] = { colBL.getR() << 16, colBL.getG() << 16, colBL.getB() << 16 };
+  int32_t bottomRight[3] = { colBR.getR() << 16, colBR.getG() << 16, colBR.getB() << 16 };
 
-  int32_t bTL = colTL.getB() << 16;
-  int32_t bTR = colTR.getB() << 16;
-  int32_t bBL = colBL.getB() << 16;
-  int32_t bBR = colBR.getB() << 16;
+  int32_t leftStep[3];
+  int32_t rightStep[3];
+  for (int c = 0; c < 3; c++) {
+    leftStep[c] = (bottomLeft[c] - left[c]) / r.getHeight();
+    rightStep[c] = (bottomRight[c] - right[c]) / r.getHeight();
+    }
+  int64_t invWidth = (int64_t(1) << 32) / r.getWidth();
+
+  gradFill (r, horizontal, vertical, [&](int16_t y, int16_t x, sGradSpan& span) {
+    for (int c = 0; c < 3; c++) {
+      int32_t rowLeft = left[c] + (leftStep[c] * (y - r.top));
+      int32_t rowRight = right[c] + (rightStep[c] * (y - r.top));
+      span.mStep[c] = (int32_t)(((rowRight - rowLeft) * invWidth) >> 32);
+      span.mValue[c] = rowLeft + (int64_t(span.mStep[c]) * (x - r.left));
+      span.mMin[c] = 0;
+      span.mMax[c] = 255 << 16;
+      }
+    });
+  }
+//}}}
+//{{{
+void cLcd::gradLinear (sRgba565 colFrom, sRgba565 colTo, cPoint from, cPoint to, const cRect& r) {
+// colour along from to to, constant across it, end colours beyond the ends
 
-  int32_t rl16 = rTL;
-  int32_t gl16 = gTL;
-  int32_t bl16 = bTL;
-  int32_t rGradl16 = (rBL - rTL) / r.getHeight();
-  int32_t gGradl16 = (gBL - gTL) / r.getHeight();
-  int32_t bGradl16 = (bBL - bTL) / r.getHeight();
+  mCurStats[eStatGrad]++;
+  if (r.isEmpty() || !isDamaged (r))
+    return;
 
-  int32_t rr16 = rTR;
-  int32_t gr16 = gTR;
-  int32_t br16 = bTR;
-  int32_t rGradr16 = (rBR - rTR) / r.getHeight();
-  int32_t gGradr16 = (gBR - gTR) / r.getHeight();
-  int32_t bGradr16 = (bBR - bTR) / r.getHeight();
+  int32_t dx = to.x - from.x;
+  int32_t dy = to.y - from.y;
+  int32_t length2 = (dx * dx) + (dy * dy);
+  if (!length2 || (colFrom.rgb565 == colTo.rgb565)) {
+    rect (colFrom, r);
+    return;
+    }
 
-  auto dst = mBuffer[mDrawBuffer] + r.top * getWidth() + r.left;
-  for (uint16_t y = r.top; y < r.bottom; y++) {
-    int32_t rGradx16 = (rr16 - rl16) / r.getWidth();
-    int32_t gGradx16 = (gr16 - gl16) / r.getWidth();
-    int32_t bGradx16 = (br16 - bl16) / r.getWidth();
+  int32_t fromValue[3] = { colFrom.getR() << 16, colFrom.getG() << 16, colFrom.getB() << 16 };
+  int32_t toValue[3] = { colTo.getR() << 16, colTo.getG() << 16, colTo.getB() << 16 };
+
+  // per channel x and y steps, clamping each channel to its end colours clamps along the line
+  int32_t xStep[3];
+  int32_t yStep[3];
+  int32_t minValue[3];
+  int32_t maxValue[3];
+  for (int c = 0; c < 3; c++) {
+    int64_t delta = toValue[c] - fromValue[c];
+    xStep[c] = (int32_t)((delta * dx) / length2);
+    yStep[c] = (int32_t)((delta * dy) / length2);
+    minValue[c] = fromValue[c] < toValue[c] ? fromValue[c] : toValue[c];
+    maxValue[c] = fromValue[c] < toValue[c] ? toValue[c] : fromValue[c];
+    }
 
-    int32_t r16 = rl16;
-    int32_t g16 = gl16;
-    int32_t b16 = bl16;
-    for (uint16_t x = r.left; x < r.right; x++) {
-      *dst++ = (b16 >> 16) | ((g16 >> 11) & 0x07E0) | ((r16 >> 5) & 0xF800);
-      r16 += rGradx16;
-      g16 += gGradx16;
-      b16 += bGradx16;
+  gradFill (r, dy == 0, dx == 0, [&](int16_t y, int16_t x, sGradSpan& span) {
+    for (int c = 0; c < 3; c++) {
+      span.mValue[c] = fromValue[c] + (int64_t(xStep[c]) * (x - from.x)) + (int64_t(yStep[c]) * (y - from.y));
+      span.mStep[c] = xStep[c];
+      span.mMin[c] = minValue[c];
+      span.mMax[c] = maxValue[c];
       }
-    dst += getWidth() - r.getWidth();
+    });
+  }
+//}}}
+//{{{
+void cLcd::gradRadial (sRgba565 colCentre, sRgba565 colEdge, cPoint centre, uint16_t radius, const cRect& r) {
+// colour by distance from centre, colEdge beyond radius
+// - distance squared indexes a lut of sqrt spaced colours, lerped between entries, no per pixel sqrt
+// - rows below centre are DMA2D copies of their mirror row above, when the dither phase matches
+
+  mCurStats[eStatGrad]++;
+  if (r.isEmpty() || !isDamaged (r))
+    return;
+  if (!radius || (colCentre.rgb565 == colEdge.rgb565)) {
+    rect (colEdge, r);
+    return;
+    }
+  flush();
+
+  int32_t centreValue[3] = { colCentre.getR() << 8, colCentre.getG() << 8, colCentre.getB() << 8 };
+  int32_t edgeValue[3] = { colEdge.getR() << 8, colEdge.getG() << 8, colEdge.getB() << 8 };
+  for (int i = 0; i <= kRadialLutSize; i++) {
+    float distance = sqrtf (float(i) / kRadialLutSize);
+    for (int c = 0; c < 3; c++)
+      mRadialLut[i][c] = uint16_t(centreValue[c] + int32_t((edgeValue[c] - centreValue[c]) * distance));
+    }
+
+  uint32_t radius2 = radius * radius;
+  uint64_t lutScale = (uint64_t(kRadialLutSize) << 32) / radius2;
+
+  for (int i = 0; i < mNumClip; i++) {
+    auto clipRect = r.intersect (mClip[i]);
+    if (clipRect.isEmpty())
+      continue;
 
-    rl16 += rGradl16;
-    gl16 += gGradl16;
-    bl16 += bGradl16;
+    for (int16_t y = clipRect.top; y < clipRect.bottom; y++) {
+      auto dst = mBuffer[mDrawBuffer] + (y * getWidth()) + clipRect.left;
+
+      int16_t mirrorY = (2 * centre.y) - y;
+      if ((mirrorY >= clipRect.top) && (mirrorY < y) && (!mGradDither || !((y - mirrorY) & 3))) {
+        queueJob (DMA2D_M2M, DMA2D_INPUT_RGB565, 0, (uint8_t*)(mBuffer[mDrawBuffer] + (mirrorY * getWidth()) + clipRect.left),
+                  getWidth() - clipRect.getWidth(), cRect (clipRect.left, y, clipRect.right, y + 1));
+        continue;
+        }
 
-    rr16 += rGradr16;
-    gr16 += gGradr16;
-    br16 += bGradr16;
+      // distance squared stepped along the row
+      int32_t dx = clipRect.left - centre.x;
+      int32_t dy = y - centre.y;
+      uint32_t distance2 = (dx * dx) + (dy * dy);
+      const uint8_t* bayer = kBayer4[y & 3];
+      for (int16_t x = clipRect.left; x < clipRect.right; x++) {
+        // lut index 22.10, lerp between entries
+        uint32_t index = distance2 < radius2 ? uint32_t((distance2 * lutScale) >> 22) : kRadialLutSize << 10;
+        const uint16_t* lut = mRadialLut[index >> 10];
+        const uint16_t* lutNext = mRadialLut[(index >> 10) + ((index >> 10) < kRadialLutSize)];
+        int32_t fraction = index & 0x3FF;
+        int32_t value[3];
+        for (int c = 0; c < 3; c++)
+          value[c] = (lut[c] << 8) + (((lutNext[c] - lut[c]) * fraction) >> 2);
+        *dst++ = mGradDither ? gradRgb565 (value, bayer[x & 3]) : gradRgb565 (value);
+        distance2 += (2 * dx) + 1;
+        dx++;
+        }
+      mCurStats[eStatBytes] += clipRect.getWidth() * 2;
+      }
     }
   }
 //}}}
 //{{{
 void cLcd::line (sRgba565 colour, cPoint p1, cPoint p2) {
 
+  flush();
+
   int16_t deltax = abs(p2.x - p1.x); // The difference between the x's
   int16_t deltay = abs(p2.y - p1.y); // The difference between the y's
 
@@ -1062,7 +1947,7 @@ void cLcd::line (sRgba565 colour, cPoint p1, cPoint p2) {
   int16_t num = den / 2;
   int16_t numPix = den;
   for (int16_t pix = 0; pix <= numPix; pix++) {
-    pixel (colour, p);
+    pixelClipped (colour, p);
     num += numAdd;     // Increase the numerator by the top of the fraction
     if (num >= den) {   // Check if numerator >= denominator
       num -= den;       // Calculate the new numerator value
@@ -1075,6 +1960,8 @@ void cLcd::line (sRgba565 colour, cPoint p1, cPoint p2) {
 //{{{
 void cLcd::ellipseOutline (sRgba565 colour, cPoint centre, cPoint radius) {
 
+  flush();
+
   int x = 0;
   int y = -radius.y;
 
@@ -1082,10 +1969,10 @@ void cLcd::ellipseOutline (sRgba565 colour, cPoint centre, cPoint radius) {
   float k = (float)radius.y / (float)radius.x;
 
   do {
-    pixel (colour, centre + cPoint (-(int16_t)(x / k), y));
-    pixel (colour, centre + cPoint ((int16_t)(x / k), y));
-    pixel (colour, centre + cPoint ((int16_t)(x / k), -y));
-    pixel (colour, centre + cPoint (- (int16_t)(x / k), - y));
+    pixelClipped (colour, centre + cPoint (-(int16_t)(x / k), y));
+    pixelClipped (colour, centre + cPoint ((int16_t)(x / k), y));
+    pixelClipped (colour, centre + cPoint ((int16_t)(x / k), -y));
+    pixelClipped (colour, centre + cPoint (- (int16_t)(x / k), - y));
 
     int e2 = err;
     if (e2 <= x) {
@@ -1174,18 +2061,31 @@ void cLcd::aEllipseOutline (const cPointF& centre, const cPointF& radius, float
 //{{{
 void cLcd::aRender (sRgba565 colour, bool fillNonZero) {
 
+  // outline outside the damage, skip the sort and scan
+  if ((mOutline.getMaxx() <= mOutline.getMinx()) || (mOutline.getMaxy() <= mOutline.getMiny()) ||
+      !isDamaged (cRect (mOutline.getMinx(), mOutline.getMiny(), mOutline.getMaxx(), mOutline.getMaxy()))) {
+    mOutline.reset();
+    return;
+    }
+
   const sCell* const* sortedCells = mOutline.getSortedCells();
   uint32_t numCells = mOutline.getNumCells();
   if (!numCells)
     return;
 
-  mNumStamps = 0;
-  mScanLine.reset (mOutline.getMinx(), mOutline.getMaxx());
+  uint32_t startCycles = getCycles();
+  mCurStats[eStatRender]++;
+
+  // mask band across the outline clipped to the screen, half the coverage buffer so the next band fills while it blends
+  mMaskRect = cRect (mOutline.getMinx() < 0 ? 0 : mOutline.getMinx(), 0,
+                     mOutline.getMaxx() > getWidth() ? getWidth() : mOutline.getMaxx(), 0);
+  mMaskRows = (kCoverageSize / 2) / mMaskRect.getWidth();
+  mMask = nullptr;
 
   int coverage = 0;
   const sCell* cell = *sortedCells++;
   while (true) {
-    int x = cell->mPackedCoord & 0xFFFF;
+    int x = int16_t(cell->mPackedCoord & 0xFFFF);
     int y = cell->mPackedCoord >> 16;
     int packedCoord = cell->mPackedCoord;
     int area = cell->mArea;
@@ -1201,13 +2101,8 @@ void cLcd::aRender (sRgba565 colour, bool fillNonZero) {
 
     if (area) {
       uint8_t alpha = calcAlpha ((coverage << 9) - area, fillNonZero);
-      if (alpha) {
-        if (mScanLine.isReady (y)) {
-          renderScanLine (&mScanLine, colour);
-          mScanLine.resetSpans();
-          }
-        mScanLine.addSpan (x, y, 1, mGamma[alpha]);
-        }
+      if (alpha)
+        addMaskSpan (x, y, 1, mGamma[alpha], colour);
       x++;
       }
 
@@ -1216,20 +2111,13 @@ void cLcd::aRender (sRgba565 colour, bool fillNonZero) {
 
     if (int16_t(cell->mPackedCoord & 0xFFFF) > x) {
       uint8_t alpha = calcAlpha (coverage << 9, fillNonZero);
-      if (alpha) {
-        if (mScanLine.isReady (y)) {
-           renderScanLine (&mScanLine, colour);
-           mScanLine.resetSpans();
-           }
-         mScanLine.addSpan (x, y, int16_t(cell->mPackedCoord & 0xFFFF) - x, mGamma[alpha]);
-         }
+      if (alpha)
+        addMaskSpan (x, y, int16_t(cell->mPackedCoord & 0xFFFF) - x, mGamma[alpha], colour);
       }
     }
 
-  if (mScanLine.getNumSpans())
-    renderScanLine (&mScanLine, colour);
-
-  printf ("render cells:%d stamps:%d\n", numCells, mNumStamps);
+  renderMask (colour);
+  mCurStats[eStatRenderTime] += getCycles() - startCycles;
   }
 //}}}
 
@@ -1237,53 +2125,61 @@ void cLcd::aRender (sRgba565 colour, bool fillNonZero) {
 //{{{
 void cLcd::copy (cTile* tile, cPoint p) {
 
+  mCurStats[eStatCopy]++;
+
   uint16_t width = p.x + tile->mWidth > getWidth() ? getWidth() - p.x : tile->mWidth;
   uint16_t height = p.y + tile->mHeight > getHeight() ? getHeight() - p.y : tile->mHeight;
 
-  ready();
-
+  // ycbcr line offset in pixels like rgb, mPitch of a yuv tile is mcu padded
+  uint32_t fgpfccr = DMA2D_INPUT_RGB565;
   switch (tile->mFormat) {
-    case cTile::eRgb565 : DMA2D->FGPFCCR = DMA2D_INPUT_RGB565; break;
-    case cTile::eRgb888 : DMA2D->FGPFCCR = DMA2D_INPUT_RGB888; break;
-    case cTile::eYuvMcu422 : {
-      DMA2D->FGPFCCR = DMA2D_INPUT_YCBCR | (DMA2D_CSS_422 << POSITION_VAL(DMA2D_FGPFCCR_CSS));
-      auto inputLineOffset = width % 8;
-      if (inputLineOffset != 0)
-        inputLineOffset = 8 - inputLineOffset;
-      DMA2D->FGOR = inputLineOffset;
-      }
-    //if (chromaSampling == JPEG_420_SUBSAMPLING) {
-      //cssMode = DMA2D_CSS_420;
-      //inputLineOffset = xsize % 16;
-      //if (inputLineOffset != 0)
-        //inputLineOffset = 16 - inputLineOffset;
-    //else if (chromaSampling == JPEG_444_SUBSAMPLING) {
-      //cssMode = DMA2D_NO_CSS;
-      //inputLineOffset = xsize % 8;
-      //if (inputLineOffset != 0)
-        //inputLineOffset = 8 - inputLineOffset;
-      //}
+    case cTile::eRgb565 : fgpfccr = DMA2D_INPUT_RGB565; break;
+    case cTile::eRgb888 : fgpfccr = DMA2D_INPUT_RGB888; break;
+    case cTile::eYuvMcu420 : fgpfccr = DMA2D_INPUT_YCBCR | (DMA2D_CSS_420 << POSITION_VAL(DMA2D_FGPFCCR_CSS)); break;
+    case cTile::eYuvMcu422 : fgpfccr = DMA2D_INPUT_YCBCR | (DMA2D_CSS_422 << POSITION_VAL(DMA2D_FGPFCCR_CSS)); break;
+    case cTile::eYuvMcu444 : fgpfccr = DMA2D_INPUT_YCBCR | (DMA2D_NO_CSS << POSITION_VAL(DMA2D_FGPFCCR_CSS)); break;
     }
 
-  DMA2D->FGMAR = (uint32_t)tile->mPiccy;
-  DMA2D->FGOR = tile->mPitch - width;
-
-  DMA2D->OMAR = uint32_t(mBuffer[mDrawBuffer] + (p.y * getWidth()) + p.x);
-  DMA2D->OOR = getWidth() > tile->mWidth ? getWidth() - tile->mWidth : 0;
+  cRect r (p.x, p.y, p.x + width, p.y + height);
+  if ((fgpfccr & DMA2D_FGPFCCR_CM) != DMA2D_INPUT_YCBCR) {
+    addJob (DMA2D_M2M_PFC, fgpfccr, 0, tile->mPiccy, tile->mPitch - width, r);
+    return;
+    }
 
-  DMA2D->NLR = (width << 16) | height;
+  // dma2d ycbcr source must start on an mcu, partly damaged tile converted by cpu
+  for (int i = 0; i < mNumClip; i++)
+    if (mClip[i].contains (r)) {
+      queueJob (DMA2D_M2M_PFC, fgpfccr, 0, tile->mPiccy, tile->mPitch - width, r);
+      return;
+      }
 
-  DMA2D->CR = DMA2D_M2M_PFC | DMA2D_CR_START | DMA2D_CR_TCIE | DMA2D_CR_TEIE | DMA2D_CR_CEIE;
-  mDma2dWait = eWaitIrq;
+  flush();
+  cYuvMcu mcu (tile);
+  for (int i = 0; i < mNumClip; i++) {
+    auto clipRect = r.intersect (mClip[i]);
+    if (clipRect.isEmpty())
+      continue;
+    mCurStats[eStatBytes] += clipRect.getWidth() * clipRect.getHeight() * 2;
+
+    auto dst = mBuffer[mDrawBuffer] + clipRect.top * getWidth() + clipRect.left;
+    for (int16_t y = clipRect.top; y < clipRect.bottom; y++) {
+      mcu.setRow (y - r.top);
+      for (int16_t x = clipRect.left; x < clipRect.right; x++)
+        *dst++ = mcu.getRgb565 (x - r.left);
+      dst += getWidth() - clipRect.getWidth();
+      }
+    }
   }
 //}}}
 //{{{
 void cLcd::copy90 (cTile* tile, cPoint p) {
 
+  mCurStats[eStatCopy]++;
+
   uint32_t src = (uint32_t)tile->mPiccy;
   uint32_t dst = (uint32_t)mBuffer[mDrawBuffer];
 
-  ready();
+  flush();
   DMA2D->FGPFCCR = DMA2D_INPUT_RGB565;
   DMA2D->FGOR = 0;
 
@@ -1293,7 +2189,7 @@ void cLcd::copy90 (cTile* tile, cPoint p) {
   for (int line = 0; line < tile->mHeight; line++) {
     DMA2D->FGMAR = src;
     DMA2D->OMAR = dst;
-    DMA2D->CR = DMA2D_M2M_PFC | DMA2D_CR_START | DMA2D_CR_TCIE | DMA2D_CR_TEIE | DMA2D_CR_CEIE;
+    dma2dStart (DMA2D_M2M_PFC | DMA2D_CR_START | DMA2D_CR_TEIE | DMA2D_CR_CEIE);
     src += tile->mWidth * tile->mComponents;
     dst += 2;
 
@@ -1304,108 +2200,169 @@ void cLcd::copy90 (cTile* tile, cPoint p) {
 //}}}
 //{{{
 void cLcd::size (cTile* tile, const cRect& r) {
+// separable box or bilinear scale, damaged spans of each dest row
+
+  mCurStats[eStatSize]++;
+  if (r.isEmpty() || !isDamaged (r))
+    return;
+  if (!mScaler.set (tile, r.getWidth(), r.getHeight()))
+    return;
+  flush();
+
+  for (int16_t y = r.top; y < r.bottom; y++) {
+    bool filtered = false;
+    for (int i = 0; i < mNumClip; i++) {
+      if ((y < mClip[i].top) || (y >= mClip[i].bottom))
+        continue;
+      int16_t left = r.left > mClip[i].left ? r.left : mClip[i].left;
+      int16_t right = r.right < mClip[i].right ? r.right : mClip[i].right;
+      if (left >= right)
+        continue;
 
-  uint32_t xStep16 = ((tile->mWidth - 1) << 16) / (r.getWidth() - 1);
-  uint32_t yStep16 = ((tile->mHeight - 1) << 16) / (r.getHeight() - 1);
-  __IO uint16_t* dst = mBuffer[mDrawBuffer] + r.top * getWidth() + r.left;
-
-  if (tile->mFormat == cTile::eRgb565) {
-    //{{{  rgb565 size
-    for (uint32_t y16 = (tile->mY << 16); y16 < ((tile->mY + r.getHeight()) * yStep16); y16 += yStep16) {
-      auto src = (uint16_t*)(tile->mPiccy) + (tile->mY + (y16 >> 16)) * tile->mPitch + tile->mX;
-      for (uint32_t x16 = tile->mX << 16; x16 < (tile->mX + r.getWidth()) * xStep16; x16 += xStep16)
-        *dst++ = *(src + (x16 >> 16));
-      dst += getWidth() - r.getWidth();
-      }
-    }
-    //}}}
-  else if (tile->mFormat == cTile::eRgb888) {
-    //{{{  rgb888 size
-    for (uint32_t y16 = (tile->mY << 16); y16 < ((tile->mY + r.getHeight()) * yStep16); y16 += yStep16) {
-      uint8_t* src = tile->mPiccy + ((tile->mY + (y16 >> 16)) * tile->mPitch + tile->mX) * 3;
-      for (uint32_t x16 = tile->mX << 16; x16 < (tile->mX + r.getWidth()) * xStep16; x16 += xStep16) {
-        uint8_t r = *src++;
-        uint8_t g = *src++;
-        uint8_t b = *src++;
-        *dst++ = ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+      if (!filtered) {
+        mScaler.filterRow (y - r.top);
+        filtered = true;
         }
-      dst += getWidth() - r.getWidth();
+      mScaler.writeRow (mBuffer[mDrawBuffer] + (y * getWidth()) + left, left - r.left, right - r.left);
+      mCurStats[eStatBytes] += (right - left) * 2;
       }
     }
-    //}}}
-  else {
-    // yuv422 size
-    for (uint32_t y16 = (tile->mY << 16); y16 < ((tile->mY + r.getHeight()) * yStep16); y16 += yStep16) {
-      uint32_t y = y16 >> 16;
-      for (uint32_t x16 = tile->mX << 16; x16 < (tile->mX + r.getWidth()) * xStep16; x16 += xStep16) {
-        uint32_t x = x16 >> 16;
-        uint32_t mcu = ((y/8) * (tile->mWidth/16)) + (x/16);
-        uint8_t* mcuPtr = tile->mPiccy + (mcu * 256) + ((y & 0x07) * 8);
-        uint8_t* lumPtr = mcuPtr + ((x & 0x08) ? 64 : 0) + (x & 0x07);
-        uint8_t* chrPtr = mcuPtr + 128 + ((x/2) & 0x07);
-        uint16_t y = *lumPtr + 0x100;
-        *dst++ = (gClampLut5[y + *(gRedLut + *(chrPtr + 64))] << 11) |
-                 (gClampLut6[y + ((*(gUGreenLut + *chrPtr) + *(gVGreenLut + *(chrPtr + 64))) >> 16)] << 5) |
-                  gClampLut5[y + *(gBlueLut + *chrPtr)];
-        }
-      dst += getWidth() - r.getWidth();
-      }
+  }
+//}}}
+//{{{
+bool cLcd::size (const cTile* tile, uint16_t* dst, uint16_t width, uint16_t height) {
+// scale into a packed rgb565 buffer, own scaler, not the frame's, so any task can make thumbnails
+
+  cScaler scaler;
+  if (!scaler.set (tile, width, height))
+    return false;
+
+  for (uint16_t y = 0; y < height; y++) {
+    scaler.filterRow (y);
+    scaler.writeRow (dst + (y * width), 0, width);
     }
+  return true;
   }
 //}}}
 
 //{{{
 void cLcd::start() {
+
   mStartTime = HAL_GetTick();
+  memset (mCurStats, 0, sizeof(mCurStats));
+  mDma2dJobs = 0;
+
+  if (mLtdcErrors) {
+    taskENTER_CRITICAL();
+    uint32_t ltdcErrors = mLtdcErrors;
+    mLtdcErrors = 0;
+    taskEXIT_CRITICAL();
+    if (ltdcErrors & LTDC_FLAG_TE)
+      info (kRed, "ltdc te IRQ");
+    if (ltdcErrors & LTDC_FLAG_FU)
+      info (kRed, "ltdc fifoUnderrun IRQ");
+    }
+
+  // latch damage, draws until present are clipped to it, other tasks invalidate while we draw
+  taskENTER_CRITICAL();
+  // footer stats change every frame
+  if (mShowInfo)
+    addDamage (cRect (0, getHeight() - kFooterHeight - kGap, getWidth(), getHeight()));
+  memcpy (mClip, mDamage, mNumDamage * sizeof(cRect));
+  mNumClip = mNumDamage;
+  mNumDamage = 0;
+  taskEXIT_CRITICAL();
+
+  // draw buffer is two frames old, copy back last frame's damage unless it is all redrawn
+  for (int i = 0; i < mNumLastClip; i++) {
+    bool redrawn = false;
+    for (int j = 0; j < mNumClip; j++)
+      redrawn |= mClip[j].contains (mLastClip[i]);
+
+    if (!redrawn) {
+      const cRect& r = mLastClip[i];
+      queueJob (DMA2D_M2M, DMA2D_INPUT_RGB565, 0, (uint8_t*)(mBuffer[!mDrawBuffer] + r.top * getWidth() + r.left),
+                getWidth() - r.getWidth(), r);
+      }
+    }
   }
 //}}}
 //{{{
 void cLcd::drawInfo() {
 
-  const int kTitleHeight = 20;
-  const int kFooterHeight = 14;
-  const int kInfoHeight = 12;
-  const int kGap = 4;
-  const int kSmallGap = 2;
-
   // draw title
   const cRect titleRect (0,0, getWidth(), kTitleHeight+kGap);
-  text (kBlackSemi, kTitleHeight, mTitle, titleRect);
-  text (kYellow, kTitleHeight, mTitle, titleRect + cPoint(-2,-2));
+  textCached (kBlackSemi, kTitleHeight, mTitle, titleRect);
+  textCached (kYellow, kTitleHeight, mTitle, titleRect + cPoint(-2,-2));
 
   if (mShowInfo) {
-    // draw footer
+    // atlas occupancy, glyph hit rate
+    uint32_t atlasBytes = 0;
+    uint32_t atlasUsedBytes = 0;
+    for (auto atlas : mAtlasMap) {
+      atlasBytes += atlas.second->getPageBytes();
+      atlasUsedBytes += atlas.second->getUsedBytes();
+      }
+
+    // draw footer, a run per field so only the changed fields miss the cache
     auto y = getHeight() - kFooterHeight - kGap;
-    text (kWhite, kFooterHeight,
-          dec(mNumPresents) + ":" + dec (mDrawTime) + ":" + dec (mWaitTime) + " " +
-          dec (osGetCPUUsage()) + "%:" + dec (mBrightness) + "% " +
-          "dtcm:" + dec (getDtcmFreeSize()/1000) + ":" + dec (getDtcmSize()/1000) + " " +
-          "s123:" + dec (getSram123FreeSize()/1000) + ":" + dec (getSram123Size()/1000) + " " +
-          "axi:" + dec (getSramFreeSize()/1000) + ":" + dec (getSramMinFreeSize()/1000) + ":" + dec (getSramSize()/1000) + " " +
-          "sd:" + dec (getSdRamFreeSize()/1000) + ":" + dec (getSdRamMinFreeSize()/1000) + ":" + dec (getSdRamSize()/1000),
-          cRect(0, y, getWidth(), kTitleHeight+kGap));
+    const std::string footer[] = {
+      dec(mNumPresents) + ":" + dec (mDrawTime) + ":" + dec (mWaitTime) + " ",
+      "dma2d:" + dec (mStats[eStatDma2d]) + ":" + dec (mStats[eStatStall]) + "us:" + dec (mStats[eStatBytes] / 1000) + "k ",
+      "render:" + dec (mStats[eStatRender]) + ":" + dec (mStats[eStatRenderJobs]) + ":" + dec (mStats[eStatRenderTime]) + "us ",
+      "atlas:" + dec (atlasBytes / 1000) + "k:" + dec (atlasBytes ? (atlasUsedBytes * 100) / atlasBytes : 0) + "%:" +
+                 dec (mGlyphLookups ? ((mGlyphLookups - mGlyphMisses) * 100ull) / mGlyphLookups : 0) + "% ",
+      "runs:" + dec (mTextRunMap.size()) + ":" + dec (mTextRunBytes / 1000) + "k:" +
+                dec ((mTextRunHits + mTextRunMisses) ? (mTextRunHits * 100ull) / (mTextRunHits + mTextRunMisses) : 0) + "% ",
+      dec (osGetCPUUsage()) + "%:" + dec (mBrightness) + "% ",
+      "dtcm:" + dec (getDtcmFreeSize()/1000) + ":" + dec (getDtcmSize()/1000) + " ",
+      "s123:" + dec (getSram123FreeSize()/1000) + ":" + dec (getSram123Size()/1000) + " ",
+      "axi:" + dec (getSramFreeSize()/1000) + ":" + dec (getSramMinFreeSize()/1000) + ":" + dec (getSramSize()/1000) + " ",
+      "sd:" + dec (getSdRamFreeSize()/1000) + ":" + dec (getSdRamMinFreeSize()/1000) + ":" + dec (getSdRamSize()/1000) };
+    int16_t x = 0;
+    for (auto& field : footer)
+      x = textCached (kWhite, kFooterHeight, field, cRect (x, y, getWidth(), getHeight()));
 
     // draw log
     y -= kTitleHeight - kGap;
     auto line = mCurLine - 1;
     while ((y > kTitleHeight) && (line >= 0)) {
       int lineIndex = line-- % kMaxLines;
-      auto x = text (kGreen, kInfoHeight,
-                     dec ((mLines[lineIndex].mTime-mBaseTime) / 1000) + "." +
-                     dec ((mLines[lineIndex].mTime-mBaseTime) % 1000, 3, '0'),
-                     cRect(0, y, getWidth(), 20));
-      text (mLines[lineIndex].mColour, kInfoHeight, mLines[lineIndex].mString,
-            cRect (x + kSmallGap, y, getWidth(), 20));
+      auto x = textCached (kGreen, kInfoHeight,
+                           dec ((mLines[lineIndex].mTime-mBaseTime) / 1000) + "." +
+                           dec ((mLines[lineIndex].mTime-mBaseTime) % 1000, 3, '0'),
+                           cRect(0, y, getWidth(), 20));
+      textCached (mLines[lineIndex].mColour, kInfoHeight, mLines[lineIndex].mString,
+                  cRect (x + kSmallGap, y, getWidth(), 20));
       y -= kInfoHeight + kSmallGap;
       }
     }
   }
 //}}}
 //{{{
+void cLcd::flush() {
+// wait for the dma2d queue to drain, before cpu access to the draw buffer or coverage reuse
+
+  uint32_t startCycles = getCycles();
+  while (mDma2dQueue.isBusy())
+    if (!xSemaphoreTake (mDma2dSem, 5000)) {
+      printf ("cLcd flush take fail\n");
+      break;
+      }
+  mCurStats[eStatStall] += getCycles() - startCycles;
+
+  mCoverageUsed = 0;
+  }
+//}}}
+//{{{
 void cLcd::present() {
 
-  ready();
+  flush();
   mDrawTime = HAL_GetTick() - mStartTime;
+  mCurStats[eStatDma2d] = mDma2dJobs;
+  memcpy (mStats, mCurStats, sizeof(mStats));
+  mStats[eStatStall] = mCurStats[eStatStall] / (SystemCoreClock / 1000000);
+  mStats[eStatRenderTime] = mCurStats[eStatRenderTime] / (SystemCoreClock / 1000000);
 
   // enable interrupts
   mShowBuffer = (uint32_t)mBuffer[mDrawBuffer];
@@ -1419,6 +2376,8 @@ void cLcd::present() {
 
   // flip
   mDrawBuffer = !mDrawBuffer;
+  memcpy (mLastClip, mClip, mNumClip * sizeof(cRect));
+  mNumLastClip = mNumClip;
   }
 //}}}
 //{{{
@@ -1433,6 +2392,10 @@ void cLcd::display (int brightness) {
 //{{{
 void cLcd::ltdcInit (uint16_t* frameBufferAddress) {
 
+#ifdef HOST_BUILD
+  // no gpio, backlight pwm or timing, point emulated layer at frameBuffer
+  LTDC_Layer1->CFBAR = (uint32_t)frameBufferAddress;
+#else
   //{{{  config gpio
   //  R2 <-> PC.10
   //  B2 <-> PD.06
@@ -1591,32 +2554,234 @@ void cLcd::ltdcInit (uint16_t* frameBufferAddress) {
   HAL_NVIC_EnableIRQ (LTDC_IRQn);
 
   __HAL_RCC_DMA2D_CLK_ENABLE();
+#endif
+  }
+//}}}
+//{{{
+cGlyphAtlas* cLcd::getAtlas (uint16_t fontHeight) {
+
+  auto atlasIt = mAtlasMap.find (fontHeight);
+  if (atlasIt != mAtlasMap.end())
+    return atlasIt->second;
+
+  return mAtlasMap.insert (
+    std::map<uint16_t, cGlyphAtlas*>::value_type (fontHeight, new cGlyphAtlas (fontHeight))).first->second;
   }
 //}}}
 //{{{
-cFontChar* cLcd::loadChar (uint16_t fontHeight, char ch) {
+void cLcd::loadChar (cGlyphAtlas* atlas, uint16_t fontHeight, char ch) {
 
   FT_Set_Pixel_Sizes (FTface, 0, fontHeight);
   FT_Load_Char (FTface, ch, FT_LOAD_RENDER);
 
-  auto fontChar = new cFontChar();
+  auto fontChar = atlas->getChar (ch);
   fontChar->left = FTglyphSlot->bitmap_left;
   fontChar->top = FTglyphSlot->bitmap_top;
   fontChar->pitch = FTglyphSlot->bitmap.pitch;
   fontChar->rows = FTglyphSlot->bitmap.rows;
   fontChar->advance = FTglyphSlot->advance.x / 64;
+  fontChar->loaded = true;
   fontChar->bitmap = nullptr;
+  fontChar->stride = 0;
 
   if (FTglyphSlot->bitmap.buffer) {
-    fontChar->bitmap = (uint8_t*)pvPortMalloc (FTglyphSlot->bitmap.pitch * FTglyphSlot->bitmap.rows);
-    memcpy (fontChar->bitmap, FTglyphSlot->bitmap.buffer, FTglyphSlot->bitmap.pitch * FTglyphSlot->bitmap.rows);
+    // all atlas pages, any height, share mAtlasBudget of sram123 with the text runs
+    uint32_t atlasBytes = 0;
+    for (auto& atlasIt : mAtlasMap)
+      atlasBytes += atlasIt.second->getPageBytes();
+
+    fontChar->bitmap = atlas->alloc (fontChar->pitch, fontChar->rows,
+                                     atlasBytes < mAtlasBudget ? mAtlasBudget - atlasBytes : 0);
+    fontChar->stride = cGlyphAtlas::kWidth;
+    if (!fontChar->bitmap) {
+      // too big for a page, or atlas full, a heap bitmap of its own
+      fontChar->bitmap = (uint8_t*)pvPortMalloc (fontChar->pitch * fontChar->rows);
+      fontChar->stride = fontChar->pitch;
+      }
+
+    if (fontChar->bitmap) {
+      for (int row = 0; row < fontChar->rows; row++)
+        memcpy (fontChar->bitmap + (row * fontChar->stride),
+                FTglyphSlot->bitmap.buffer + (row * fontChar->pitch), fontChar->pitch);
+      }
+    else {
+      // nothing drawn, loaded again next time
+      printf ("cLcd::loadChar alloc fail height:%d ch:%c\n", fontHeight, ch);
+      fontChar->stride = 0;
+      fontChar->loaded = false;
+      }
+    }
+  }
+//}}}
+//{{{
+void cLcd::renderStrip (sRgba565 colour, const cRect& strip, int numGlyphs) {
+// compose placed glyphs into an A8 strip, blend it with one job
+// - a single glyph can outgrow the coverage buffer, blend it in bands of rows
+
+  if (!numGlyphs || !isDamaged (strip))
+    return;
+
+  uint32_t fgpfccr = (colour.getA() < 255) ? ((colour.getA() << 24) | 0x20000 | DMA2D_INPUT_A8) : DMA2D_INPUT_A8;
+  uint32_t fgcolr = (colour.getR() << 16) | (colour.getG() << 8) | colour.getB();
+
+  int16_t bandRows = int16_t(kCoverageSize / strip.getWidth());
+  for (int16_t top = strip.top; top < strip.bottom; top += bandRows) {
+    cRect band (strip.left, top, strip.right, strip.bottom - top > bandRows ? top + bandRows : strip.bottom);
+    if (isDamaged (band)) {
+      auto coverage = allocCoverage (band.getWidth() * band.getHeight());
+      composeStrip (coverage, band, numGlyphs);
+      addJob (DMA2D_M2M_BLEND, fgpfccr, fgcolr, coverage, 0, band);
+      }
+    }
+  }
+//}}}
+//{{{
+void cLcd::composeStrip (uint8_t* coverage, const cRect& strip, int numGlyphs) {
+// mStripGlyphs into A8 strip, max where glyphs overlap
+
+  uint16_t width = strip.getWidth();
+  memset (coverage, 0, width * strip.getHeight());
+
+  for (int glyph = 0; glyph < numGlyphs; glyph++) {
+    auto fontChar = mStripGlyphs[glyph].mFontChar;
+    int16_t x = mStripGlyphs[glyph].mX;
+    int16_t y = mStripGlyphs[glyph].mY;
+    auto glyphRect = cRect (x, y, x + fontChar->pitch, y + fontChar->rows).intersect (strip);
+
+    for (int16_t row = glyphRect.top; row < glyphRect.bottom; row++) {
+      const uint8_t* src = fontChar->bitmap + ((row - y) * fontChar->stride) + glyphRect.left - x;
+      uint8_t* dst = coverage + ((row - strip.top) * width) + glyphRect.left - strip.left;
+      for (int16_t i = 0; i < glyphRect.getWidth(); i++)
+        if (src[i] > dst[i])
+          dst[i] = src[i];
+      }
+    }
+  }
+//}}}
+
+//{{{
+void cLcd::setTextRunBudget (uint32_t bytes) {
+
+  mTextRunBudget = bytes;
+  evictTextRuns (0);
+  }
+//}}}
+//{{{
+bool cLcd::evictTextRuns (uint32_t bytes) {
+// evict least recently used runs until bytes fit the budget
+// - runs used this frame can still be read by queued jobs, they stay
+
+  while (mTextRunBytes + bytes > mTextRunBudget) {
+    auto lruIt = mTextRunMap.end();
+    for (auto it = mTextRunMap.begin(); it != mTextRunMap.end(); ++it)
+      if ((it->second->mLastUsed != mNumPresents) &&
+          ((lruIt == mTextRunMap.end()) || (it->second->mLastUsed < lruIt->second->mLastUsed)))
+        lruIt = it;
+    if (lruIt == mTextRunMap.end())
+      return false;
+
+    mTextRunBytes -= lruIt->second->mBytes;
+    sram123Free (lruIt->second->mCoverage);
+    delete lruIt->second;
+    mTextRunMap.erase (lruIt);
+    }
+
+  return true;
+  }
+//}}}
+//{{{
+cTextRun* cLcd::getTextRun (uint16_t fontHeight, const std::string& str) {
+// find or compose run, nullptr if it can't be cached
+
+  // fnv1a
+  uint32_t hash = 2166136261u;
+  for (auto ch : str)
+    hash = (hash ^ uint8_t(ch)) * 16777619u;
+  uint64_t key = (uint64_t(hash) << 16) | fontHeight;
+
+  auto textRunIt = mTextRunMap.find (key);
+  if (textRunIt != mTextRunMap.end()) {
+    if (textRunIt->second->mString == str) {
+      mTextRunHits++;
+      textRunIt->second->mLastUsed = mNumPresents;
+      return textRunIt->second;
+      }
+    // hash collision, leave the resident run
+    return nullptr;
+    }
+  mTextRunMisses++;
+
+  // place glyphs relative to the text rect topLeft
+  auto atlas = getAtlas (fontHeight);
+  cRect strip;
+  int numGlyphs = 0;
+  int16_t x = 0;
+  int16_t needWidth = 0;
+  for (auto ch : str) {
+    if ((ch >= 0x20) && (ch <= 0x7F)) {
+      auto fontChar = atlas->getChar (ch);
+      if (!fontChar->loaded)
+        loadChar (atlas, fontHeight, ch);
+
+      if (x + fontChar->left + fontChar->pitch + 1 > needWidth)
+        needWidth = x + fontChar->left + fontChar->pitch + 1;
+
+      if (fontChar->bitmap) {
+        if (numGlyphs == kMaxStripGlyphs)
+          return nullptr;
+        cRect charRect (x + fontChar->left, fontHeight - fontChar->top,
+                        x + fontChar->left + fontChar->pitch, fontHeight - fontChar->top + fontChar->rows);
+        strip = numGlyphs ? strip.combine (charRect) : charRect;
+        mStripGlyphs[numGlyphs++] = { fontChar, charRect.left, charRect.top };
+        }
+
+      x += fontChar->advance;
+      }
     }
 
-  return mFontCharMap.insert (
-    std::map<uint16_t, cFontChar*>::value_type (fontHeight<<8 | ch, fontChar)).first->second;
+  uint32_t bytes = strip.getWidth() * strip.getHeight();
+  if (!numGlyphs || !evictTextRuns (bytes))
+    return nullptr;
+
+  auto coverage = sram123Alloc (bytes);
+  if (!coverage)
+    return nullptr;
+  composeStrip (coverage, strip, numGlyphs);
+
+  auto textRun = new cTextRun();
+  textRun->mString = str;
+  textRun->mRect = strip;
+  textRun->mAdvance = x;
+  textRun->mNeedWidth = needWidth;
+  textRun->mLastUsed = mNumPresents;
+  textRun->mBytes = bytes;
+  textRun->mCoverage = coverage;
+  mTextRunBytes += bytes;
+
+  return mTextRunMap.insert (std::map<uint64_t, cTextRun*>::value_type (key, textRun)).first->second;
   }
 //}}}
+//{{{
+int cLcd::textCached (sRgba565 colour, uint16_t fontHeight, const std::string& str, const cRect& r) {
+// text through the run cache, a hit costs one blend of the cached strip
+
+  auto textRun = getTextRun (fontHeight, str);
+  if (!textRun)
+    return text (colour, fontHeight, str, r);
+
+  // run would break or clip, uncached
+  cRect runRect = textRun->mRect + cPoint (r.left, r.top);
+  if ((r.right - r.left < textRun->mNeedWidth) || !cRect (getSize()).contains (runRect))
+    return text (colour, fontHeight, str, r);
 
+  mCurStats[eStatText]++;
+  uint32_t fgpfccr = (colour.getA() < 255) ? ((colour.getA() << 24) | 0x20000 | DMA2D_INPUT_A8) : DMA2D_INPUT_A8;
+  uint32_t fgcolr = (colour.getR() << 16) | (colour.getG() << 8) | colour.getB();
+  addJob (DMA2D_M2M_BLEND, fgpfccr, fgcolr, textRun->mCoverage, 0, runRect);
+
+  return r.left + textRun->mAdvance;
+  }
+//}}}
 //{{{
 void cLcd::reset() {
 
@@ -1630,6 +2795,7 @@ void cLcd::reset() {
 //{{{
 void cLcd::ready() {
 
+  uint32_t startCycles = getCycles();
   switch (mDma2dWait) {
     case eWaitDone:
       while (!(DMA2D->ISR & DMA2D_FLAG_TC))
@@ -1643,12 +2809,169 @@ void cLcd::ready() {
       break;
 
     case eWaitNone:
-      break;
+      return;
     }
 
+  mCurStats[eStatStall] += getCycles() - startCycles;
   mDma2dWait = eWaitNone;
   }
 //}}}
+//{{{
+void cLcd::addJob (uint32_t mode, uint32_t fgpfccr, uint32_t colour, const uint8_t* src, uint16_t srcOffset, const cRect& r) {
+// queue a job per damage rect it intersects
+
+  uint16_t srcPitch = r.getWidth() + srcOffset;
+  uint16_t bytesPerPixel = getBytesPerPixel (fgpfccr);
+
+  for (int i = 0; i < mNumClip; i++) {
+    auto clipRect = r.intersect (mClip[i]);
+    if (!clipRect.isEmpty()) {
+      auto clipSrc = src ? src + (((clipRect.top - r.top) * srcPitch) + clipRect.left - r.left) * bytesPerPixel : nullptr;
+      queueJob (mode, fgpfccr, colour, clipSrc, srcPitch - clipRect.getWidth(), clipRect);
+      }
+    }
+  }
+//}}}
+//{{{
+void cLcd::queueJob (uint32_t mode, uint32_t fgpfccr, uint32_t colour, const uint8_t* src, uint16_t srcOffset, const cRect& r) {
+
+  sDma2dJob job;
+  job.mMode = mode;
+  job.mFgpfccr = fgpfccr;
+  job.mColour = colour;
+  job.mSrc = (uint32_t)src;
+  job.mDst = uint32_t(mBuffer[mDrawBuffer] + r.top * getWidth() + r.left);
+  job.mSrcOffset = srcOffset;
+  job.mDstOffset = getWidth() - r.getWidth();
+  job.mX = r.left;
+  job.mY = r.top;
+  job.mWidth = r.getWidth();
+  job.mHeight = r.getHeight();
+  mCurStats[eStatBytes] += r.getWidth() * r.getHeight() * 2;
+
+  if (mDma2dQueue.isFull()) {
+    uint32_t startCycles = getCycles();
+    while (mDma2dQueue.isFull())
+      taskYIELD();
+    mCurStats[eStatStall] += getCycles() - startCycles;
+    }
+
+  // irq could be starting a job we merge into
+  taskENTER_CRITICAL();
+  auto startJob = mDma2dQueue.add (job);
+  if (startJob)
+    dma2dStartJob (startJob);
+  taskEXIT_CRITICAL();
+  }
+//}}}
+
+//{{{
+void cLcd::invalidate (const cRect& r) {
+// any task, not an irq, uiThread latches mDamage in start
+
+  auto damageRect = r.intersect (cRect (getSize()));
+  if (!damageRect.isEmpty()) {
+    taskENTER_CRITICAL();
+    addDamage (damageRect);
+    mChanged = true;
+    taskEXIT_CRITICAL();
+    }
+  }
+//}}}
+//{{{
+void cLcd::addDamage (cRect r) {
+// keep damage rects disjoint, a blend clipped to two overlapping rects would draw twice
+// - caller in a critical section, bounded by kMaxDamage
+
+  for (int i = 0; i < mNumDamage; i++)
+    if (r.overlaps (mDamage[i])) {
+      cRect damageRect = mDamage[i];
+      if (damageRect.contains (r))
+        return;
+
+      // add the parts of r outside damageRect, bands above and below, then either side
+      if (r.top < damageRect.top)
+        addDamage (cRect (r.left, r.top, r.right, damageRect.top));
+      if (r.bottom > damageRect.bottom)
+        addDamage (cRect (r.left, damageRect.bottom, r.right, r.bottom));
+
+      int16_t top = r.top > damageRect.top ? r.top : damageRect.top;
+      int16_t bottom = r.bottom < damageRect.bottom ? r.bottom : damageRect.bottom;
+      if (r.left < damageRect.left)
+        addDamage (cRect (r.left, top, damageRect.left, bottom));
+      if (r.right > damageRect.right)
+        addDamage (cRect (damageRect.right, top, r.right, bottom));
+      return;
+      }
+
+  if (mNumDamage == kMaxDamage) {
+    // full, merge into the rect that grows least
+    int best = 0;
+    int bestGrowth = 0x7FFFFFFF;
+    for (int i = 0; i < mNumDamage; i++) {
+      auto combined = r.combine (mDamage[i]);
+      int growth = (combined.getWidth() * combined.getHeight()) - (mDamage[i].getWidth() * mDamage[i].getHeight());
+      if (growth < bestGrowth) {
+        best = i;
+        bestGrowth = growth;
+        }
+      }
+    r = r.combine (mDamage[best]);
+    mDamage[best] = mDamage[--mNumDamage];
+
+    // absorb anything the grown rect now overlaps, rescan as it grows
+    for (int i = 0; i < mNumDamage; i++)
+      if (r.overlaps (mDamage[i])) {
+        r = r.combine (mDamage[i]);
+        mDamage[i] = mDamage[--mNumDamage];
+        i = -1;
+        }
+    }
+
+  mDamage[mNumDamage++] = r;
+  }
+//}}}
+//{{{
+bool cLcd::isDamaged (const cRect& r) {
+
+  for (int i = 0; i < mNumClip; i++)
+    if (mClip[i].overlaps (r))
+      return true;
+
+  return false;
+  }
+//}}}
+//{{{
+bool cLcd::isDamaged (cPoint p) {
+
+  for (int i = 0; i < mNumClip; i++)
+    if ((p.x >= mClip[i].left) && (p.x < mClip[i].right) && (p.y >= mClip[i].top) && (p.y < mClip[i].bottom))
+      return true;
+
+  return false;
+  }
+//}}}
+//{{{
+void cLcd::pixelClipped (sRgba565 colour, cPoint p) {
+
+  if (isDamaged (p)) {
+    mCurStats[eStatBytes] += 2;
+    pixel (colour, p);
+    }
+  }
+//}}}
+//{{{
+uint8_t* cLcd::allocCoverage (uint16_t size) {
+// coverage is only released when the queue drains
+
+  if (mCoverageUsed + size > kCoverageSize)
+    flush();
+
+  auto coverage = mCoverage + mCoverageUsed;
+  mCoverageUsed += size;
+  return coverage;
+  }
+//}}}
 
 //{{{
 uint8_t cLcd::calcAlpha (int area, bool fillNonZero) const {
@@ -1670,61 +2993,56 @@ uint8_t cLcd::calcAlpha (int area, bool fillNonZero) const {
   }
 //}}}
 //{{{
-void cLcd::renderScanLine (cScanLine* scanLine, sRgba565 colour) {
+void cLcd::addMaskSpan (int16_t x, int16_t y, int16_t numPix, uint8_t coverage, sRgba565 colour) {
+// spans arrive in y then x order
 
-  // yclip top
-  auto y = scanLine->getY();
-  if (y < 0)
+  if ((y < 0) || (y >= getHeight()))
     return;
 
-  // yclip bottom
-  if (y >= getHeight())
+  // xclip
+  if (x < mMaskRect.left) {
+    numPix -= mMaskRect.left - x;
+    x = mMaskRect.left;
+    }
+  if (x + numPix > mMaskRect.right)
+    numPix = mMaskRect.right - x;
+  if (numPix <= 0)
     return;
 
-  ready();
-  DMA2D->FGPFCCR = (colour.getA() < 255) ? ((colour.getA() << 24) | 0x20000 | DMA2D_INPUT_A8) : DMA2D_INPUT_A8;
-  DMA2D->FGCOLR = (colour.getR() << 16) | (colour.getG() << 8) | colour.getB();;
+  if (mMask && (y >= mMaskRect.top + mMaskRows))
+    renderMask (colour);
 
-  int baseX = scanLine->getBaseX();
-  uint16_t numSpans = scanLine->getNumSpans();
-  cScanLine::iterator span (*scanLine);
-  do {
-    auto x = baseX + span.next() ;
-    auto coverage = (uint8_t*)span.getCoverage();
-
-    // xclip left
-    int16_t numPix = span.getNumPix();
-    if (x < 0) {
-      numPix += x;
-      if (numPix <= 0)
-        continue;
-      coverage -= x;
-      x = 0;
-      }
+  if (!mMask) {
+    // new band, coverage is read by the queued job so it comes from the coverage buffer
+    mMask = allocCoverage (mMaskRows * mMaskRect.getWidth());
+    mMaskRect.top = y;
+    mMaskRect.bottom = y;
+    }
 
-    // xclip right
-    if (x + numPix >= getWidth()) {
-      numPix = getWidth() - x;
-      if (numPix <= 0)
-        continue;
-      }
+  // zero rows as they are reached
+  if (y >= mMaskRect.bottom) {
+    memset (mMask + (mMaskRect.getHeight() * mMaskRect.getWidth()), 0, (y + 1 - mMaskRect.bottom) * mMaskRect.getWidth());
+    mMaskRect.bottom = y + 1;
+    }
+
+  memset (mMask + ((y - mMaskRect.top) * mMaskRect.getWidth()) + x - mMaskRect.left, coverage, numPix);
+  }
+//}}}
+//{{{
+void cLcd::renderMask (sRgba565 colour) {
+// blend mask band with one A8 job
 
-    mNumStamps++;
+  if (!mMask)
+    return;
 
-    uint32_t dstAddr = uint32_t(mBuffer[mDrawBuffer] + y * getWidth() + x);
-    uint32_t stride = getWidth() - numPix;
+  // return unused band rows to the coverage buffer
+  mCoverageUsed -= (mMaskRows - mMaskRect.getHeight()) * mMaskRect.getWidth();
 
-    ready();
-    DMA2D->BGPFCCR = DMA2D_INPUT_RGB565;
-    DMA2D->BGMAR = dstAddr;
-    DMA2D->OMAR = dstAddr;
-    DMA2D->BGOR = stride;
-    DMA2D->OOR = stride;
-    DMA2D->NLR = (numPix << 16) | 1;
-    DMA2D->FGMAR = (uint32_t)coverage;
-    DMA2D->FGOR = 0;
-    DMA2D->CR = DMA2D_M2M_BLEND | DMA2D_CR_START;
-    mDma2dWait = eWaitDone;
-    } while (--numSpans);
+  uint32_t fgpfccr = (colour.getA() < 255) ? ((colour.getA() << 24) | 0x20000 | DMA2D_INPUT_A8) : DMA2D_INPUT_A8;
+  uint32_t fgcolr = (colour.getR() << 16) | (colour.getG() << 8) | colour.getB();
+  addJob (DMA2D_M2M_BLEND, fgpfccr, fgcolr, mMask, 0, mMaskRect);
+
+  mCurStats[eStatRenderJobs]++;
+  mMask = nullptr;
   }
 //}}}
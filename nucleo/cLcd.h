@@ -1,14 +1,20 @@
 #pragma once
 //{{{  includes
-#include "cmsis_os.h"
-#include "semphr.h"
+#ifdef HOST_BUILD
+  #include "../host/host.h"
+#else
+  #include "cmsis_os.h"
+  #include "semphr.h"
+#endif
 
 #include "../common/utils.h"
 #include "../common/cPointRect.h"
 #include <map>
 #include <vector>
 
-#include "../system/stm32h7xx.h"
+#ifndef HOST_BUILD
+  #include "../system/stm32h7xx.h"
+#endif
 #include "../common/heap.h"
 
 #include <ft2build.h>
@@ -68,7 +74,7 @@ const sRgba565 kYellow (255,255,0);
 //{{{
 class cTile {
 public:
-  enum eFormat { eRgb565, eRgb888, eYuvMcu422 };
+  enum eFormat { eRgb565, eRgb888, eYuvMcu422, eYuvMcu420, eYuvMcu444 };
 
   cTile() {};
   cTile (uint8_t* piccy, eFormat format, uint16_t pitch, uint16_t x, uint16_t y, uint16_t width, uint16_t height)
@@ -95,22 +101,24 @@ public:
 //{{{
 class cFontChar {
 public:
-  void* operator new (std::size_t size) { return pvPortMalloc (size); }
-  void operator delete (void* ptr) { vPortFree (ptr); }
-
-  uint8_t* bitmap;
-  int16_t left;
-  int16_t top;
-  int16_t pitch;
-  int16_t rows;
-  int16_t advance;
+  uint8_t* bitmap = nullptr;  // in cGlyphAtlas page, else on the heap
+  uint16_t stride = 0;        // cGlyphAtlas::kWidth in a page, pitch on the heap
+  int16_t left = 0;
+  int16_t top = 0;
+  int16_t pitch = 0;
+  int16_t rows = 0;
+  int16_t advance = 0;
+  bool loaded = false;
   };
 //}}}
 
-class cScanLine;
+class cGlyphAtlas;
+class cTextRun;
+
 class cLcd {
 public:
   enum eDma2dWait { eWaitNone, eWaitDone, eWaitIrq };
+  enum eStat { eStatRect, eStatText, eStatCopy, eStatSize, eStatGrad, eStatRender, eStatDma2d, eStatStall, eStatBytes, eStatRenderJobs, eStatRenderTime, eNumStats };
   cLcd();
   ~cLcd();
   void* operator new (std::size_t size) { return pvPortMalloc (size); }
@@ -128,13 +136,27 @@ public:
 
   uint16_t getBrightness() { return mBrightness; }
 
+  // last presented frame
+  uint32_t getDrawTime() { return mDrawTime; }
+  uint32_t getWaitTime() { return mWaitTime; }
+  uint32_t getStat (eStat stat) { return mStats[stat]; }
+
   void setShowInfo (bool show);
-  void setTitle (const std::string& str) { mTitle = str; mChanged = true; }
-  void change() { mChanged = true; }
+  void setTitle (const std::string& str);
+  void setTextRunBudget (uint32_t bytes);
+  void setAtlasBudget (uint32_t bytes) { mAtlasBudget = bytes; }
+  void setGradDither (bool dither) { mGradDither = dither; }
+
+  // damage for the next frame, draws between start and present are clipped to it
+  // - tasks only, the critical sections assert in an irq
+  void invalidate (const cRect& r);
+  void change() { invalidate (cRect (getSize())); }
   //{{{
   bool isChanged() {
+    taskENTER_CRITICAL();
     bool wasChanged = mChanged;
     mChanged = false;
+    taskEXIT_CRITICAL();
     return wasChanged;
     }
   //}}}
@@ -152,9 +174,12 @@ public:
   void copy (cTile* tile, cPoint p);
   void copy90 (cTile* tile, cPoint p);
   void size (cTile* tile, const cRect& r);
+  static bool size (const cTile* tile, uint16_t* dst, uint16_t width, uint16_t height);
 
   inline void pixel (sRgba565 colour, cPoint p) { *(mBuffer[mDrawBuffer] + p.y * getWidth() + p.x) = colour.rgb565; }
   void grad (sRgba565 colTL, sRgba565 colTR, sRgba565 colBL, sRgba565 colBR, const cRect& r);
+  void gradLinear (sRgba565 colFrom, sRgba565 colTo, cPoint from, cPoint to, const cRect& r);
+  void gradRadial (sRgba565 colCentre, sRgba565 colEdge, cPoint centre, uint16_t radius, const cRect& r);
   void line (sRgba565 colour, cPoint p1, cPoint p2);
   void ellipseOutline (sRgba565 colour, cPoint centre, cPoint radius);
 
@@ -169,6 +194,7 @@ public:
 
   void start();
   void drawInfo();
+  void flush();
   void present();
 
   void display (int brightness);
@@ -177,14 +203,34 @@ public:
 
 private:
   void ready();
+  void addJob (uint32_t mode, uint32_t fgpfccr, uint32_t colour, const uint8_t* src, uint16_t srcOffset, const cRect& r);
+  void queueJob (uint32_t mode, uint32_t fgpfccr, uint32_t colour, const uint8_t* src, uint16_t srcOffset, const cRect& r);
+  uint8_t* allocCoverage (uint16_t size);
+
+  void addDamage (cRect r);
+  bool isDamaged (const cRect& r);
+  bool isDamaged (cPoint p);
+  void pixelClipped (sRgba565 colour, cPoint p);
+
+  template <typename tGetSpan> void gradFill (const cRect& r, bool horizontal, bool vertical, tGetSpan getSpan);
+  void gradRows (const cRect& clipRect, int16_t seedRows);
+  void gradColumns (const cRect& clipRect, int16_t seedColumns);
 
   void ltdcInit (uint16_t* frameBufferAddress);
-  cFontChar* loadChar (uint16_t fontHeight, char ch);
+  cGlyphAtlas* getAtlas (uint16_t fontHeight);
+  void loadChar (cGlyphAtlas* atlas, uint16_t fontHeight, char ch);
+  void renderStrip (sRgba565 colour, const cRect& strip, int numGlyphs);
+  void composeStrip (uint8_t* coverage, const cRect& strip, int numGlyphs);
+
+  bool evictTextRuns (uint32_t bytes);
+  cTextRun* getTextRun (uint16_t fontHeight, const std::string& str);
+  int textCached (sRgba565 colour, uint16_t fontHeight, const std::string& str, const cRect& r);
 
   void reset();
 
   uint8_t calcAlpha (int area, bool fillNonZero) const;
-  void renderScanLine (cScanLine* scanLine, sRgba565 colour);
+  void addMaskSpan (int16_t x, int16_t y, int16_t numPix, uint8_t coverage, sRgba565 colour);
+  void renderMask (sRgba565 colour);
 
   //{{{  vars
   LTDC_HandleTypeDef mLtdcHandle;
@@ -201,8 +247,44 @@ private:
   uint32_t mWaitTime = 0;
   uint32_t mNumPresents = 0;
 
+  // damage, mDamage accumulates for the next frame, mClip is being drawn, mLastClip went into the shown buffer
+  static const int kMaxDamage = 8;
+  cRect mDamage[kMaxDamage];
+  cRect mClip[kMaxDamage];
+  cRect mLastClip[kMaxDamage];
+  int mNumDamage = 0;
+  int mNumClip = 0;
+  int mNumLastClip = 0;
+
+  // coverage read by queued dma2d jobs, reused after flush
+  static const uint32_t kCoverageSize = 0x8000;
+  uint8_t* mCoverage = nullptr;
+  uint32_t mCoverageUsed = 0;
+
+  // aRender A8 mask band, mMaskRect grows down to mMaskRows
+  uint8_t* mMask = nullptr;
+  cRect mMaskRect;
+  uint16_t mMaskRows = 0;
+
+  // ordered dither grad output
+  bool mGradDither = false;
+
+  // primitive counts, mCurStats accumulates, mStats last presented frame, stall and renderTime in us
+  uint32_t mCurStats[eNumStats] = { 0 };
+  uint32_t mStats[eNumStats] = { 0 };
+
   // truetype
-  std::map<uint16_t, cFontChar*> mFontCharMap;
+  std::map<uint16_t, cGlyphAtlas*> mAtlasMap;
+  uint32_t mAtlasBudget = 0x20000;
+  uint32_t mGlyphLookups = 0;
+  uint32_t mGlyphMisses = 0;
+
+  // drawInfo text run lru cache, strips in sram123
+  std::map<uint64_t, cTextRun*> mTextRunMap;
+  uint32_t mTextRunBudget = 0x10000;
+  uint32_t mTextRunBytes = 0;
+  uint32_t mTextRunHits = 0;
+  uint32_t mTextRunMisses = 0;
 
   FT_Library FTlibrary;
   FT_Face FTface;
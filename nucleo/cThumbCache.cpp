@@ -0,0 +1,315 @@
+// cThumbCache.cpp - on card rgb565 thumbnail cache
+// - index of fixed size entries at the start of the file, thumbnails appended after it, each padded to whole sectors
+// - a thumbnail is one f_lseek and one sector aligned f_read, FatFs hands it to the card a multi block read per cluster
+// - reads use a fast seek cluster map, no FAT sector reads to follow the chain
+// - a changed file gets a new thumbnail, in its old slot if it fits, the index entry is rewritten in place
+// - dead entries, pathHash 0, keep their slot, an outgrown slot or a failed write, reused before the file grows
+//{{{  includes
+#include "cThumbCache.h"
+#include <stddef.h>
+
+#include "cLcd.h" // for cTile
+#include "jpeg.h"
+
+using namespace std;
+//}}}
+//{{{  const
+const uint32_t kMagic = 0x31424D54;  // TMB1
+const uint16_t kVersion = 2;
+
+const uint32_t kSectorSize = 512;
+
+// thumbnails start cluster aligned past the index
+const uint32_t kDataOffset = 0x8000;
+//}}}
+
+//{{{
+cThumbCache::cThumbCache (const string& fileName, const cPoint& size, bool hwJpeg, bool dither)
+  : mFileName(fileName), mWidth(size.x), mHeight(size.y), mHwJpeg(hwJpeg), mDither(dither) {}
+//}}}
+//{{{
+cThumbCache::~cThumbCache() {
+
+  if (mFile) {
+    f_close (mFile);
+    vPortFree (mFile);
+    }
+  vPortFree (mIndex);
+  }
+//}}}
+
+//{{{
+bool cThumbCache::open() {
+// read the index, or start a new one if there is none or it is for another thumbnail size
+
+  static_assert (sizeof (sIndex) <= kDataOffset, "thumb index overlaps thumbnails");
+
+  mFile = (FIL*)pvPortMalloc (sizeof (FIL));
+  if (f_open (mFile, mFileName.c_str(), FA_READ | FA_WRITE | FA_OPEN_ALWAYS)) {
+    printf ("cThumbCache %s open fail\n", mFileName.c_str());
+    vPortFree (mFile);
+    mFile = nullptr;
+    return false;
+    }
+
+  mIndex = (sIndex*)pvPortMalloc (sizeof (sIndex));
+  UINT bytesRead = 0;
+  f_read (mFile, mIndex, sizeof (sIndex), &bytesRead);
+
+  if ((bytesRead != sizeof (sIndex)) ||
+      (mIndex->mMagic != kMagic) || (mIndex->mVersion != kVersion) ||
+      (mIndex->mWidth != mWidth) || (mIndex->mHeight != mHeight) ||
+      (mIndex->mNumEntries > kMaxThumbs)) {
+    memset (mIndex, 0, sizeof (sIndex));
+    mIndex->mMagic = kMagic;
+    mIndex->mVersion = kVersion;
+    mIndex->mWidth = mWidth;
+    mIndex->mHeight = mHeight;
+    mIndex->mEnd = kDataOffset;
+
+    UINT bytesWritten = 0;
+    f_lseek (mFile, 0);
+    f_write (mFile, mIndex, sizeof (sIndex), &bytesWritten);
+    f_sync (mFile);
+    if (bytesWritten != sizeof (sIndex)) {
+      printf ("cThumbCache %s index write fail\n", mFileName.c_str());
+      vPortFree (mIndex);
+      mIndex = nullptr;
+      return false;
+      }
+    printf ("cThumbCache %s new\n", mFileName.c_str());
+    }
+  else
+    printf ("cThumbCache %s %d thumbs\n", mFileName.c_str(), mIndex->mNumEntries);
+
+  mUpdateIndex = 0;
+  return true;
+  }
+//}}}
+//{{{
+cTile* cThumbCache::get (const string& path, const FILINFO& info) {
+
+  if (!mIndex)
+    return nullptr;
+
+  auto entry = find (getHash (path));
+  if (!entry || !isCurrent (entry, info))
+    return nullptr;
+
+  if (!mFile->cltbl) {
+    mLinkMap[0] = kLinkMapSize;
+    mFile->cltbl = mLinkMap;
+    if (f_lseek (mFile, CREATE_LINKMAP) != FR_OK)
+      // too fragmented for the map, follow the FAT
+      mFile->cltbl = nullptr;
+    }
+
+  uint32_t size = getPaddedSize (entry->mWidth, entry->mHeight);
+  auto piccy = sdRamAlloc (size, "thumb");
+  if (!piccy)
+    return nullptr;
+
+  UINT bytesRead = 0;
+  f_lseek (mFile, entry->mOffset);
+  f_read (mFile, piccy, size, &bytesRead);
+  if (bytesRead != size) {
+    printf ("cThumbCache::get %s read fail\n", path.c_str());
+    sdRamFree (piccy);
+    return nullptr;
+    }
+
+#ifndef HOST_BUILD
+  // sdRam is write through, no dirty lines, drop whatever the cache held before the sdmmc dma
+  SCB_InvalidateDCache_by_Addr ((uint32_t*)((uint32_t)piccy & ~0x1F), size + 32);
+#endif
+
+  return new cTile (piccy, cTile::eRgb565, entry->mWidth, 0,0, entry->mWidth, entry->mHeight);
+  }
+//}}}
+//{{{
+bool cThumbCache::add (const string& path, const FILINFO& info, const cTile* tile) {
+// scale to fit mWidth x mHeight, no upscaling, write thumbnail then its index entry
+
+  if (!mIndex)
+    return false;
+
+  uint16_t width = mWidth;
+  uint16_t height = mHeight;
+  if (tile->mWidth * mHeight > tile->mHeight * mWidth)
+    height = (tile->mHeight * mWidth) / tile->mWidth;
+  else
+    width = (tile->mWidth * mHeight) / tile->mHeight;
+  width = width > tile->mWidth ? tile->mWidth : width;
+  height = height > tile->mHeight ? tile->mHeight : height;
+  width = width ? width : 1;
+  height = height ? height : 1;
+
+  uint32_t size = getPaddedSize (width, height);
+  auto piccy = sdRamAlloc (size, "thumbAdd");
+  if (!piccy)
+    return false;
+  memset (piccy, 0, size);
+  if (!cLcd::size (tile, (uint16_t*)piccy, width, height)) {
+    sdRamFree (piccy);
+    return false;
+    }
+
+  // writes past the end grow the file, fast seek can't
+  mFile->cltbl = nullptr;
+
+  uint32_t pathHash = getHash (path);
+  auto entry = find (pathHash);
+  if (!entry) {
+    // a dead entry whose slot fits, any dead entry, else a new one
+    entry = findDead (size, nullptr);
+    entry = entry ? entry : find (0);
+    if (!entry) {
+      if (mIndex->mNumEntries >= kMaxThumbs) {
+        printf ("cThumbCache::add %s full\n", path.c_str());
+        sdRamFree (piccy);
+        return false;
+        }
+      entry = &mIndex->mEntries[mIndex->mNumEntries++];
+      entry->mPathHash = 0;
+      entry->mOffset = 0;
+      entry->mSlotSize = 0;
+      }
+    }
+
+  if (!entry->mOffset || (entry->mSlotSize < size)) {
+    // swap slots with a dead entry it fits, else append, an outgrown slot is left to a dead entry
+    auto dead = findDead (size, entry);
+    if (!dead && entry->mOffset && (mIndex->mNumEntries < kMaxThumbs)) {
+      dead = &mIndex->mEntries[mIndex->mNumEntries++];
+      dead->mOffset = 0;
+      dead->mSlotSize = 0;
+      }
+    if (dead) {
+      uint32_t offset = dead->mOffset;
+      uint32_t slotSize = dead->mSlotSize;
+      dead->mPathHash = 0;
+      dead->mFileSize = 0;
+      dead->mOffset = entry->mOffset;
+      dead->mSlotSize = entry->mSlotSize;
+      entry->mOffset = offset;
+      entry->mSlotSize = slotSize;
+      writeIndex (dead);
+      }
+    if (!entry->mOffset) {
+      entry->mOffset = mIndex->mEnd;
+      entry->mSlotSize = size;
+      mIndex->mEnd += size;
+      }
+    }
+
+  UINT bytesWritten = 0;
+  f_lseek (mFile, entry->mOffset);
+  f_write (mFile, piccy, size, &bytesWritten);
+  sdRamFree (piccy);
+  if (bytesWritten != size) {
+    // dead, its slot kept for reuse
+    printf ("cThumbCache::add %s write fail\n", path.c_str());
+    entry->mPathHash = 0;
+    entry->mFileSize = 0;
+    writeIndex (entry);
+    return false;
+    }
+
+  entry->mPathHash = pathHash;
+  entry->mFileSize = (uint32_t)info.fsize;
+  entry->mDate = info.fdate;
+  entry->mTime = info.ftime;
+  entry->mWidth = width;
+  entry->mHeight = height;
+  return writeIndex (entry);
+  }
+//}}}
+//{{{
+bool cThumbCache::update (const vector<string>& files, uint32_t ms) {
+// incremental rebuild, makes missing or stale thumbnails for up to ms, carries on from there next call
+// - returns true once every file has been checked
+
+  uint32_t startTime = HAL_GetTick();
+  while (mIndex && (mUpdateIndex < files.size()) && (HAL_GetTick() - startTime < ms)) {
+    auto& path = files[mUpdateIndex++];
+
+    FILINFO info;
+    if (f_stat (path.c_str(), &info))
+      continue;
+
+    auto entry = find (getHash (path));
+    if (entry && isCurrent (entry, info))
+      continue;
+
+    auto tile = thumbJpegDecode (path, cPoint (mWidth, mHeight), mHwJpeg, mDither);
+    if (tile) {
+      add (path, info, tile);
+      delete tile;
+      }
+    }
+
+  return !mIndex || (mUpdateIndex >= files.size());
+  }
+//}}}
+
+// private
+//{{{
+uint32_t cThumbCache::getHash (const string& path) {
+// fnv-1a
+
+  uint32_t hash = 0x811C9DC5;
+  for (auto ch : path)
+    hash = (hash ^ (uint8_t)ch) * 0x01000193;
+  return hash;
+  }
+//}}}
+//{{{
+uint32_t cThumbCache::getPaddedSize (uint16_t width, uint16_t height) {
+  return ((width * height * 2) + kSectorSize - 1) & ~(kSectorSize - 1);
+  }
+//}}}
+
+//{{{
+cThumbCache::sEntry* cThumbCache::find (uint32_t pathHash) {
+
+  for (uint16_t i = 0; i < mIndex->mNumEntries; i++)
+    if (mIndex->mEntries[i].mPathHash == pathHash)
+      return &mIndex->mEntries[i];
+
+  return nullptr;
+  }
+//}}}
+//{{{
+cThumbCache::sEntry* cThumbCache::findDead (uint32_t size, const sEntry* except) {
+// dead entry with a slot of at least size
+
+  for (uint16_t i = 0; i < mIndex->mNumEntries; i++) {
+    auto entry = &mIndex->mEntries[i];
+    if ((entry != except) && !entry->mPathHash && entry->mOffset && (entry->mSlotSize >= size))
+      return entry;
+    }
+
+  return nullptr;
+  }
+//}}}
+//{{{
+bool cThumbCache::isCurrent (const sEntry* entry, const FILINFO& info) {
+  return (entry->mFileSize == (uint32_t)info.fsize) && (entry->mDate == info.fdate) && (entry->mTime == info.ftime);
+  }
+//}}}
+//{{{
+bool cThumbCache::writeIndex (const sEntry* entry) {
+// header then just the changed entry, FatFs read modify writes their sectors
+
+  UINT headerWritten = 0;
+  f_lseek (mFile, 0);
+  f_write (mFile, mIndex, offsetof (sIndex, mEntries), &headerWritten);
+
+  UINT entryWritten = 0;
+  f_lseek (mFile, (uint8_t*)entry - (uint8_t*)mIndex);
+  f_write (mFile, entry, sizeof (sEntry), &entryWritten);
+  f_sync (mFile);
+
+  return (headerWritten == offsetof (sIndex, mEntries)) && (entryWritten == sizeof (sEntry));
+  }
+//}}}
@@ -0,0 +1,72 @@
+// cThumbCache.h - on card rgb565 thumbnail cache, keyed by path hash, fsize, fdate, ftime
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "../fatFs/ff.h"
+
+class cTile;
+class cPoint;
+
+class cThumbCache {
+public:
+  cThumbCache (const std::string& fileName, const cPoint& size, bool hwJpeg, bool dither);
+  ~cThumbCache();
+
+  uint16_t getNumThumbs() { return mIndex ? mIndex->mNumEntries : 0; }
+
+  bool open();
+  cTile* get (const std::string& path, const FILINFO& info);
+  bool add (const std::string& path, const FILINFO& info, const cTile* tile);
+  bool update (const std::vector<std::string>& files, uint32_t ms);
+
+private:
+  static const uint16_t kMaxThumbs = 1024;
+  static const uint16_t kLinkMapSize = 64;
+
+  //{{{
+  struct sEntry {
+    uint32_t mPathHash;
+    uint32_t mFileSize;
+    uint16_t mDate;
+    uint16_t mTime;
+    uint32_t mOffset;
+    uint32_t mSlotSize;
+    uint16_t mWidth;
+    uint16_t mHeight;
+    };
+  //}}}
+  //{{{
+  struct sIndex {
+  // file starts with this, read in one f_read at open
+    uint32_t mMagic;
+    uint16_t mVersion;
+    uint16_t mNumEntries;
+    uint16_t mWidth;
+    uint16_t mHeight;
+    uint32_t mEnd;
+    sEntry mEntries[kMaxThumbs];
+    };
+  //}}}
+
+  static uint32_t getHash (const std::string& path);
+  static uint32_t getPaddedSize (uint16_t width, uint16_t height);
+
+  sEntry* find (uint32_t pathHash);
+  sEntry* findDead (uint32_t size, const sEntry* except);
+  bool isCurrent (const sEntry* entry, const FILINFO& info);
+  bool writeIndex (const sEntry* entry);
+
+  const std::string mFileName;
+  const uint16_t mWidth;
+  const uint16_t mHeight;
+  const bool mHwJpeg;
+  const bool mDither;
+
+  FIL* mFile = nullptr;
+  sIndex* mIndex = nullptr;
+  uint32_t mUpdateIndex = 0;
+
+  // FatFs fast seek cluster map, set while reading, dropped by writes that may grow the file
+  DWORD mLinkMap[kLinkMapSize];
+  };
@@ -0,0 +1,258 @@
+// jmemArena.cpp - libjpeg jmemsys, replaces jmemnobs.c, pools from arenas allocated once, reset between images
+// - small pools in dtcm, axi sram if dtcm is short, large pools in sdRam
+// - jpeg_free_small and jpeg_free_large are no ops for arena memory,
+//   the arenas reset when the last live jpeg object is destroyed, one bump per allocation, no heap churn
+// - an allocation that doesn't fit falls back to the heap like jmemnobs, freed as before, counted in the report
+// - high water per image and output size, jpegArenaReport prints it, sizes the arenas
+// - arenas aren't locked, one task decodes at a time, disabled nothing is counted either,
+//   swJpegDecodeParallel's workers create and destroy their jpeg objects at once
+//{{{  includes
+#include "jpeg.h"
+#include <string.h>
+
+#include "cmsis_os.h"
+#include "../common/heap.h"
+
+#define JPEG_INTERNALS
+#include "jpeglib.h"
+extern "C" {
+  #include "jmemsys.h"
+  }
+
+using namespace std;
+//}}}
+//{{{  const
+const size_t kSmallArenaSize = 0xC000;
+const size_t kLargeArenaSize = 0x80000;
+
+// pool headers are ALIGN_TYPE double, large stays cache line aligned for the sdmmc dma into the source buffer
+const size_t kSmallAlign = 8;
+const size_t kLargeAlign = 32;
+
+const int kMaxReports = 16;
+//}}}
+
+//{{{
+struct sArena {
+  uint8_t* mBase;
+  size_t mSize;
+  size_t mUsed;
+  size_t mHighWater;
+  bool mDtcm;
+  };
+//}}}
+//{{{
+struct sArenaReport {
+  uint32_t mImageWidth;
+  uint32_t mImageHeight;
+  uint32_t mOutputWidth;
+  uint32_t mOutputHeight;
+
+  uint32_t mImages;
+  size_t mSmall;
+  size_t mLarge;
+  uint32_t mAllocs;
+  uint32_t mFallbacks;
+  };
+//}}}
+
+sArena mSmallArena = { nullptr, 0, 0, 0, false };
+sArena mLargeArena = { nullptr, 0, 0, 0, false };
+bool mArenaEnabled = true;
+
+int mLiveObjects = 0;
+uint32_t mAllocs = 0;
+uint32_t mFallbacks = 0;
+
+size_t mLastSmall = 0;
+size_t mLastLarge = 0;
+uint32_t mLastFallbacks = 0;
+
+sArenaReport mReports[kMaxReports];
+int mNumReports = 0;
+
+//{{{
+void* arenaAlloc (sArena& arena, size_t size, size_t align) {
+
+  size_t offset = (arena.mUsed + align - 1) & ~(align - 1);
+  if (!mArenaEnabled || !arena.mBase || (offset + size > arena.mSize))
+    return nullptr;
+
+  arena.mUsed = offset + size;
+  if (arena.mUsed > arena.mHighWater)
+    arena.mHighWater = arena.mUsed;
+  return arena.mBase + offset;
+  }
+//}}}
+//{{{
+bool inArena (const sArena& arena, const void* object) {
+  return ((const uint8_t*)object >= arena.mBase) && ((const uint8_t*)object < arena.mBase + arena.mSize);
+  }
+//}}}
+//{{{
+void arenaReport (j_common_ptr cinfo) {
+// high water of the image just destroyed, the largest seen for its image and output size
+
+  auto dinfo = (j_decompress_ptr)cinfo;
+  sArenaReport* report = nullptr;
+  for (int i = 0; i < mNumReports; i++)
+    if ((mReports[i].mImageWidth == dinfo->image_width) && (mReports[i].mImageHeight == dinfo->image_height) &&
+        (mReports[i].mOutputWidth == dinfo->output_width) && (mReports[i].mOutputHeight == dinfo->output_height))
+      report = &mReports[i];
+
+  if (!report) {
+    if (mNumReports >= kMaxReports)
+      return;
+    report = &mReports[mNumReports++];
+    memset (report, 0, sizeof (sArenaReport));
+    report->mImageWidth = dinfo->image_width;
+    report->mImageHeight = dinfo->image_height;
+    report->mOutputWidth = dinfo->output_width;
+    report->mOutputHeight = dinfo->output_height;
+    }
+
+  report->mImages++;
+  report->mSmall = mSmallArena.mHighWater > report->mSmall ? mSmallArena.mHighWater : report->mSmall;
+  report->mLarge = mLargeArena.mHighWater > report->mLarge ? mLargeArena.mHighWater : report->mLarge;
+  report->mAllocs = mAllocs > report->mAllocs ? mAllocs : report->mAllocs;
+  report->mFallbacks += mFallbacks;
+  }
+//}}}
+
+// jmemsys.h
+//{{{
+void* jpeg_get_small (j_common_ptr cinfo, size_t sizeofobject) {
+
+  if (!mArenaEnabled)
+    return pvPortMalloc (sizeofobject);
+
+  mAllocs++;
+  void* object = arenaAlloc (mSmallArena, sizeofobject, kSmallAlign);
+  if (!object) {
+    mFallbacks++;
+    object = pvPortMalloc (sizeofobject);
+    }
+  return object;
+  }
+//}}}
+//{{{
+void jpeg_free_small (j_common_ptr cinfo, void* object, size_t sizeofobject) {
+
+  if (!inArena (mSmallArena, object))
+    vPortFree (object);
+  }
+//}}}
+//{{{
+void* jpeg_get_large (j_common_ptr cinfo, size_t sizeofobject) {
+
+  if (!mArenaEnabled)
+    return sdRamAlloc (sizeofobject, "jpegLarge");
+
+  mAllocs++;
+  void* object = arenaAlloc (mLargeArena, sizeofobject, kLargeAlign);
+  if (!object) {
+    mFallbacks++;
+    object = sdRamAlloc (sizeofobject, "jpegLarge");
+    }
+  return object;
+  }
+//}}}
+//{{{
+void jpeg_free_large (j_common_ptr cinfo, void* object, size_t sizeofobject) {
+
+  if (!inArena (mLargeArena, object))
+    sdRamFree (object);
+  }
+//}}}
+//{{{
+long jpeg_mem_available (j_common_ptr cinfo, long min_bytes_needed, long max_bytes_needed, long already_allocated) {
+// anything past the large arena falls back to sdRam
+  return max_bytes_needed;
+  }
+//}}}
+//{{{
+void jpeg_open_backing_store (j_common_ptr cinfo, backing_store_ptr info, long total_bytes_needed) {
+  ERREXIT (cinfo, JERR_NO_BACKING_STORE);
+  }
+//}}}
+//{{{
+long jpeg_mem_init (j_common_ptr cinfo) {
+// arenas allocated by the first jpeg object, kept for the life of the app
+
+  if (!mSmallArena.mBase) {
+    mSmallArena.mBase = dtcmAlloc (kSmallArenaSize);
+    mSmallArena.mDtcm = mSmallArena.mBase != nullptr;
+    if (!mSmallArena.mBase)
+      mSmallArena.mBase = (uint8_t*)pvPortMalloc (kSmallArenaSize);
+    mSmallArena.mSize = mSmallArena.mBase ? kSmallArenaSize : 0;
+    }
+
+  if (!mLargeArena.mBase) {
+    mLargeArena.mBase = sdRamAlloc (kLargeArenaSize, "jpegArena");
+    mLargeArena.mSize = mLargeArena.mBase ? kLargeArenaSize : 0;
+    }
+
+  if (mArenaEnabled)
+    mLiveObjects++;
+  return 0;
+  }
+//}}}
+//{{{
+void jpeg_mem_term (j_common_ptr cinfo) {
+// every pool of this object is freed, reset once no other object is live
+
+  if (!mArenaEnabled)
+    return;
+
+  if (cinfo->is_decompressor && ((j_decompress_ptr)cinfo)->output_width)
+    arenaReport (cinfo);
+
+  mLastSmall = mSmallArena.mHighWater;
+  mLastLarge = mLargeArena.mHighWater;
+  mLastFallbacks = mFallbacks;
+
+  if (--mLiveObjects <= 0) {
+    mLiveObjects = 0;
+    mSmallArena.mUsed = 0;
+    mSmallArena.mHighWater = 0;
+    mLargeArena.mUsed = 0;
+    mLargeArena.mHighWater = 0;
+    mAllocs = 0;
+    mFallbacks = 0;
+    }
+  }
+//}}}
+
+// interface
+//{{{
+bool jpegArenaEnable (bool enable) {
+// disabled, every allocation takes the heap fallback, jmemnobs behaviour, for comparison
+// - between decodes, no jpeg object live, returns the previous setting
+
+  bool enabled = mArenaEnabled;
+  mArenaEnabled = enable;
+  return enabled;
+  }
+//}}}
+//{{{
+void jpegArenaLast (size_t& small, size_t& large, uint32_t& fallbacks) {
+// high water of the last jpeg object destroyed, and its heap fallbacks, for jpegBench
+
+  small = mLastSmall;
+  large = mLastLarge;
+  fallbacks = mLastFallbacks;
+  }
+//}}}
+//{{{
+void jpegArenaReport() {
+
+  printf ("jpegArena small %dk %s, large %dk sdRam\n",
+          int(mSmallArena.mSize / 1024), mSmallArena.mDtcm ? "dtcm" : "axi", int(mLargeArena.mSize / 1024));
+
+  for (int i = 0; i < mNumReports; i++)
+    printf ("- %5dx%-5d to %5dx%-5d %4d images, high water small %6d large %8d, allocs %4d, fallbacks %d\n",
+            mReports[i].mImageWidth, mReports[i].mImageHeight, mReports[i].mOutputWidth, mReports[i].mOutputHeight,
+            mReports[i].mImages, int(mReports[i].mSmall), int(mReports[i].mLarge),
+            mReports[i].mAllocs, mReports[i].mFallbacks);
+  }
+//}}}
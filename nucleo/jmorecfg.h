@@ -43,10 +43,10 @@ typedef int boolean;
 
   /* Encoder capability options: */
   #define C_ARITH_CODING_SUPPORTED    /* Arithmetic coding back end? */
-  #undef  C_MULTISCAN_FILES_SUPPORTED /* Multiple-scan JPEG files? */
-  #undef  C_PROGRESSIVE_SUPPORTED     /* Progressive JPEG? (Requires MULTISCAN)*/
+  #define C_MULTISCAN_FILES_SUPPORTED /* Multiple-scan JPEG files? */
+  #define C_PROGRESSIVE_SUPPORTED     /* Progressive JPEG? (Requires MULTISCAN)*/
   #undef  DCT_SCALING_SUPPORTED     /* Input rescaling via DCT? (Requires DCT_ISLOW)*/
-  #undef  ENTROPY_OPT_SUPPORTED     /* Optimization of entropy coding parms? */
+  #define ENTROPY_OPT_SUPPORTED     /* Optimization of entropy coding parms? */
 
   /* Note: if you selected 12-bit data precision, it is dangerous to turn off
    * ENTROPY_OPT_SUPPORTED.  The standard Huffman tables are only good for 8-bit
@@ -60,13 +60,14 @@ typedef int boolean;
 
   /* Decoder capability options: */
   #define D_ARITH_CODING_SUPPORTED    /* Arithmetic coding back end? */
-  #undef D_MULTISCAN_FILES_SUPPORTED  /* Multiple-scan JPEG files? */
-  #undef D_PROGRESSIVE_SUPPORTED      /* Progressive JPEG? (Requires MULTISCAN)*/
+  #define D_MULTISCAN_FILES_SUPPORTED /* Multiple-scan JPEG files? */
+  #define D_PROGRESSIVE_SUPPORTED     /* Progressive JPEG? (Requires MULTISCAN)*/
   #define IDCT_SCALING_SUPPORTED      /* Output rescaling via IDCT? */
   #undef SAVE_MARKERS_SUPPORTED       /* jpeg_save_markers() needed? */
-  #undef BLOCK_SMOOTHING_SUPPORTED    /* Block smoothing? (Progressive only) */
+  #define BLOCK_SMOOTHING_SUPPORTED   /* Block smoothing? (Progressive only) */
   #undef UPSAMPLE_SCALING_SUPPORTED   /* Output rescaling at upsample stage? */
   #define UPSAMPLE_MERGING_SUPPORTED  /* Fast path for sloppy upsampling? */
+  #define HUFF_FAST_SUPPORTED         /* Combined code and value lookahead, 64 bit bit buffer? */
   #define QUANT_1PASS_SUPPORTED       /* 1-pass color quantization? */
   #define QUANT_2PASS_SUPPORTED       /* 2-pass color quantization? */
 
@@ -8,7 +8,7 @@
 #include "cLcd.h" // for cTile
 
 #include "../fatFs/ff.h"
-#include "jpeglib.h"
+#include "jpeg_utils.h"
 
 using namespace std;
 //}}}
@@ -108,10 +108,16 @@ typedef struct {
   __IO uint32_t        mReadIndex = 0;
   __IO uint32_t        mWriteIndex = 0;
   __IO bool            mDecodeDone = false;
+
+  __IO uint32_t        mOutReadIndex = 0;
+  __IO uint32_t        mOutWriteIndex = 0;
+  __IO bool            mOutPaused = false;
+  __IO bool            mHeaderDone = false;
   } tHandle;
 //}}}
 //{{{  const
-const uint32_t kYuvChunkSize = 0x10000;
+// mcu chunk buffer, a pair in axi sram, mdma fills one while the other is converted
+const uint32_t kOutChunkSize = 0x8000;
 
 //{{{
 const JPEG_DCHuffTableTypeDef DCLUM_HuffTable = {
@@ -199,12 +205,48 @@ tHandle mHandle;
 #define INBUF_SIZE 16384
 tBufs mInBuf[2] = { { false, nullptr, 0 }, { false, nullptr, 0 } };
 
+tBufs mOutBuf[2] = { { false, nullptr, 0 }, { false, nullptr, 0 } };
+
 uint32_t mOutChunkSize = 0;
 uint32_t mOutYuvLen = 0;
-uint8_t* mOutYuvBuf = nullptr;
+__IO uint32_t mOutDmaLen = 0;
+
+JPEG_YCbCrToRGB_Convert_Function mConvert = nullptr;
+uint32_t mNumMcus = 0;
+uint32_t mMcuBytes = 0;
 
 // callbacks
 //{{{
+void dmaOutStart (uint32_t index) {
+// start mdma out of the next chunk of whole mcus into mOutBuf[index]
+
+  uint32_t len = mOutYuvLen - mOutDmaLen;
+  if (len > mOutChunkSize)
+    len = mOutChunkSize;
+
+  mOutBuf[index].mSize = len;
+  mOutDmaLen += len;
+  mHandle.mOutWriteIndex = index;
+  HAL_MDMA_Start_IT (&mHandle.hmdmaOut, (uint32_t)&JPEG->DOR, (uint32_t)mOutBuf[index].mBuf, len, 1);
+  }
+//}}}
+//{{{
+void dmaOutCpltCallback (MDMA_HandleTypeDef* hmdma) {
+// chunk of mcus complete, carry on into the other buffer, pause if it is still being converted
+// - paused, the jpeg out fifo fills and the decoder stalls until hwJpegDecode restarts it
+
+  mOutBuf[mHandle.mOutWriteIndex].mFull = true;
+
+  if (mOutDmaLen < mOutYuvLen) {
+    uint32_t index = mHandle.mOutWriteIndex ? 0 : 1;
+    if (mOutBuf[index].mFull)
+      mHandle.mOutPaused = true;
+    else
+      dmaOutStart (index);
+    }
+  }
+//}}}
+//{{{
 void dmaInCpltCallback (MDMA_HandleTypeDef* hmdma) {
 
   // Disable JPEG IT so DMA Input Callback can not be interrupted by the JPEG EOC IT or JPEG HPD IT
@@ -339,7 +381,10 @@ void init() {
 
   mHandle.hmdmaIn.XferCpltCallback = dmaInCpltCallback;
   mHandle.hmdmaIn.XferErrorCallback = dmaErrorCallback;
+  mHandle.hmdmaOut.XferCpltCallback = dmaOutCpltCallback;
   mHandle.hmdmaOut.XferErrorCallback = dmaErrorCallback;
+
+  JPEG_InitPostProcColorTables();
   }
 //}}}
 
@@ -380,45 +425,35 @@ extern "C" { void JPEG_IRQHandler() {
     __HAL_JPEG_DISABLE_IT (&mHandle, JPEG_IT_HPD);
     __HAL_JPEG_CLEAR_FLAG (&mHandle, JPEG_FLAG_HPDF);
 
-    //{{{  calc mOutYuvLen from mHandle.mChromaSampling
-    if (mHandle.mChromaSampling == JPEG_444_SUBSAMPLING) {
-      mOutChunkSize = (mHandle.mWidth / 8) * 192;
-      mOutYuvLen = mHandle.mWidth * mHandle.mHeight * 3;
-      printf ("- JPEG header 422 %dx%d %d chunk:%d\n",
-              mHandle.mWidth, mHandle.mHeight, mOutYuvLen, mOutChunkSize);
-      }
-
-    else if (mHandle.mChromaSampling == JPEG_420_SUBSAMPLING) {
-      mOutChunkSize = (mHandle.mWidth / 32) * 384;
-      mOutYuvLen = (mHandle.mWidth * mHandle.mHeight * 3) / 2;
-      printf ("- JPEG header 420 %dx%d %d chunk:%d\n",
-              mHandle.mWidth, mHandle.mHeight, mOutYuvLen, mOutChunkSize);
+    //{{{  pick mcu converter, size chunks to whole mcus
+    JPEG_ConfTypeDef conf;
+    conf.ColorSpace = mHandle.mColorSpace;
+    conf.ChromaSubsampling = mHandle.mChromaSampling;
+    conf.ImageWidth = mHandle.mWidth;
+    conf.ImageHeight = mHandle.mHeight;
+    conf.ImageQuality = 0;
+
+    if (JPEG_GetDecodeColorConvertFunc (&conf, &mConvert, &mNumMcus) == HAL_OK) {
+      uint32_t width;
+      uint32_t height;
+      JPEG_GetDecodeOutputSize (&width, &height, &mMcuBytes);
+
+      // mcus are multiples of the 32 byte mdma buffer transfer, so are chunks of them
+      mOutChunkSize = (kOutChunkSize / mMcuBytes) * mMcuBytes;
+      mOutYuvLen = mNumMcus * mMcuBytes;
+      mOutDmaLen = 0;
+      printf ("- JPEG header %d:%d %dx%d mcus:%d:%d chunk:%d\n",
+              mHandle.mColorSpace, mHandle.mChromaSampling, mHandle.mWidth, mHandle.mHeight,
+              mNumMcus, mMcuBytes, mOutChunkSize);
+
+      dmaOutStart (0);
       }
-
-    else if (mHandle.mChromaSampling == JPEG_422_SUBSAMPLING) {
-      mOutChunkSize = (mHandle.mWidth / 16) * 256;
-      mOutYuvLen = mHandle.mWidth * mHandle.mHeight * 2;
-      printf ("- JPEG header 422 %dx%d %d chunk:%d\n",
-              mHandle.mWidth, mHandle.mHeight, mOutYuvLen, mOutChunkSize);
+    else {
+      mConvert = nullptr;
+      printf ("JPEG unsupported colorspace %d\n", mHandle.mColorSpace);
       }
-
-    else
-      printf ("JPEG unrecognised chroma sampling %d\n", mHandle.mChromaSampling);
-
-    while (mOutChunkSize > 0x10000)
-      mOutChunkSize /= 2;
     //}}}
-    // if the MDMA Out is triggred with JPEG Out FIFO Threshold flag then MDMA out buffer size is 32 bytes
-    // else (MDMA Out is triggred with JPEG Out FIFO not empty flag then MDMA buffer size is 4 bytes
-    // MDMA transfer size (BNDTR) must be a multiple of MDMA buffer size (TLEN)
-    mHandle.OutBuffPtr = mOutYuvBuf;
-    mHandle.OutLen = mOutChunkSize;
-    uint32_t outXfrSize = mHandle.hmdmaOut.Init.BufferTransferLength;
-    mHandle.OutLen = mHandle.OutLen - (mHandle.OutLen % outXfrSize);
-
-    // start MDMA FIFO Out transfer
-    HAL_MDMA_Start_IT (&mHandle.hmdmaOut, (uint32_t)&JPEG->DOR,
-                       (uint32_t)mHandle.OutBuffPtr, mOutChunkSize, mOutYuvLen / mOutChunkSize);
+    mHandle.mHeaderDone = true;
     }
 
   if (__HAL_JPEG_GET_FLAG (&mHandle, JPEG_FLAG_EOCF) != RESET) {
@@ -433,20 +468,7 @@ extern "C" { void JPEG_IRQHandler() {
     if (mHandle.hmdmaIn.State == HAL_MDMA_STATE_BUSY) // Stop the MDMA In Xfer
       HAL_MDMA_Abort_IT (&mHandle.hmdmaIn);
 
-    if (__HAL_JPEG_GET_FLAG (&mHandle, JPEG_FLAG_OFNEF) != 0) {
-      //{{{  output dma residual data
-      uint32_t count = JPEG_FIFO_SIZE;
-      while ((__HAL_JPEG_GET_FLAG (&mHandle, JPEG_FLAG_OFNEF) != 0) && (count > 0) ) {
-        count--;
-        uint32_t dataOut = JPEG->DOR;
-        mHandle.OutBuffPtr[mHandle.OutCount] = dataOut & 0x000000FF;
-        mHandle.OutBuffPtr[mHandle.OutCount + 1] = (dataOut & 0x0000FF00) >> 8;
-        mHandle.OutBuffPtr[mHandle.OutCount + 2] = (dataOut & 0x00FF0000) >> 16;
-        mHandle.OutBuffPtr[mHandle.OutCount + 3] = (dataOut & 0xFF000000) >> 24;
-        mHandle.OutCount += 4;
-        }
-      }
-      //}}}
+    // no residual out fifo read, mcus are whole mdma transfers, out mdma drains the fifo when not paused
 
     mHandle.mDecodeDone = true;
     }
@@ -471,24 +493,54 @@ size_t read_file (FIL* file, uint8_t* buf, uint32_t sizeofbuf) {
   }
 //}}}
 
+//{{{
+bool readInBuf (FIL* file, tBufs& inBuf, uint32_t& remaining) {
+// next INBUF_SIZE of the stream, stops at its end, an exif thumbnail stream ends inside the file
+// - nothing read, end of stream, truncated file or bad thumbnail offset, feed an EOI so the decoder ends,
+//   returns false, caller stops reading
+
+  uint32_t len = remaining < INBUF_SIZE ? remaining : INBUF_SIZE;
+  if ((f_read (file, inBuf.mBuf, len, &inBuf.mSize) != FR_OK) || !inBuf.mSize) {
+    // mdma rounds short lengths up to words
+    inBuf.mBuf[0] = 0xFF;
+    inBuf.mBuf[1] = 0xD9;
+    inBuf.mBuf[2] = 0;
+    inBuf.mBuf[3] = 0;
+    inBuf.mSize = 2;
+    inBuf.mFull = true;
+    return false;
+    }
+
+  remaining -= inBuf.mSize;
+  inBuf.mFull = true;
+  return true;
+  }
+//}}}
+
 // interface
 //{{{
-cTile* hwJpegDecode (const string& fileName) {
+cTile* hwJpegDecode (const string& fileName, uint32_t offset, uint32_t length, bool yuv) {
+// stream mcu chunks from the hw decoder, convert each into a right sized rgb565 tile while the next decodes
+// - length 0 is the whole file, else decode the length byte jpeg stream at offset in it
+// - yuv keeps ycbcr mcus as they come, a cTile format per chroma subsampling, DMA2D converts them on copy,
+//   gray and cmyk are still converted
 
   mHandle.Instance = JPEG;
   init();
 
   mInBuf[0].mBuf = (uint8_t*)pvPortMalloc (INBUF_SIZE);
   mInBuf[1].mBuf = (uint8_t*)pvPortMalloc (INBUF_SIZE);
-  mOutYuvBuf = sdRamAlloc (6000*4000*2, "yuvBuf");
+  mOutBuf[0].mBuf = (uint8_t*)pvPortMalloc (kOutChunkSize);
+  mOutBuf[1].mBuf = (uint8_t*)pvPortMalloc (kOutChunkSize);
+  mOutBuf[0].mFull = false;
+  mOutBuf[1].mFull = false;
 
   cTile* tile = nullptr;
   FIL* file = (FIL*)pvPortMalloc (sizeof (FIL));
   if (f_open (file, fileName.c_str(), FA_READ) == FR_OK) {
-    if (f_read (file, mInBuf[0].mBuf, INBUF_SIZE, &mInBuf[0].mSize) == FR_OK)
-      mInBuf[0].mFull = true;
-    if (f_read (file, mInBuf[1].mBuf, INBUF_SIZE, &mInBuf[1].mSize) == FR_OK)
-      mInBuf[1].mFull = true;
+    uint32_t remaining = length ? length : uint32_t(f_size (file) - offset);
+    f_lseek (file, offset);
+    bool endOfStream = !readInBuf (file, mInBuf[0], remaining) || !readInBuf (file, mInBuf[1], remaining);
     //{{{  init stuff
     mHandle.mReadIndex = 0;
     mHandle.mDecodeDone = false;
@@ -502,6 +554,11 @@ cTile* hwJpegDecode (const string& fileName) {
     mHandle.OutBuffPtr = nullptr;
     mHandle.OutLen = 0;
     mHandle.OutCount = 0;
+
+    mHandle.mOutReadIndex = 0;
+    mHandle.mOutWriteIndex = 0;
+    mHandle.mOutPaused = false;
+    mHandle.mHeaderDone = false;
     //}}}
     //{{{  start JPEG ecode
     JPEG->CONFR1 |= JPEG_CONFR1_DE;
@@ -525,18 +582,24 @@ cTile* hwJpegDecode (const string& fileName) {
     // if the MDMA In is triggred with JPEG In FIFO Threshold flag then MDMA In buffer size is 32 bytes
     // else (MDMA In is triggred with JPEG In FIFO not full flag then MDMA In buffer size is 4 bytes
     // MDMA transfer size (BNDTR) must be a multiple of MDMA buffer size (TLEN)
+    // a stream shorter than one transfer, or just the EOI, is rounded up to words
     uint32_t inXfrSize = mHandle.hmdmaIn.Init.BufferTransferLength;
-    mHandle.InLen = mHandle.InLen - (mHandle.InLen % inXfrSize);
+    if (mHandle.InLen >= inXfrSize)
+      mHandle.InLen = mHandle.InLen - (mHandle.InLen % inXfrSize);
+    else
+      mHandle.InLen = ((mHandle.InLen + 3) / 4) * 4;
     HAL_MDMA_Start_IT (&mHandle.hmdmaIn, (uint32_t)mHandle.InBuffPtr, (uint32_t)&JPEG->DIR, mHandle.InLen, 1);
 
-    while (!mHandle.mDecodeDone)
-      if (mInBuf[mHandle.mWriteIndex].mFull) {
-        taskYIELD();
-        }
-      else {
+    uint32_t mcuIndex = 0;
+    uint32_t tileBytes = 0;
+    uint32_t convertTime = 0;
+    uint32_t lastTime = HAL_GetTick();
+    bool ok = true;
+    while (ok && (!mHandle.mHeaderDone || (mcuIndex < mNumMcus))) {
+      if (!endOfStream && !mInBuf[mHandle.mWriteIndex].mFull) {
         //{{{  fill next buffer
-        if (f_read (file, mInBuf[mHandle.mWriteIndex].mBuf, INBUF_SIZE, &mInBuf[mHandle.mWriteIndex].mSize) == FR_OK)
-          mInBuf[mHandle.mWriteIndex].mFull = true;
+        endOfStream = !readInBuf (file, mInBuf[mHandle.mWriteIndex], remaining);
+        lastTime = HAL_GetTick();
 
         if (((mHandle.Context & JPEG_CONTEXT_PAUSE_INPUT) != 0) && (mHandle.mWriteIndex == mHandle.mReadIndex)) {
           // resume
@@ -547,73 +610,109 @@ cTile* hwJpegDecode (const string& fileName) {
           // if MDMA In is triggred with JPEG In FIFO Threshold flag then MDMA In buffer size is 32 bytes
           // else MDMA In is triggred with JPEG In FIFO not full flag then MDMA In buffer size is 4 bytes
           // MDMA transfer size (BNDTR) must be a multiple of MDMA buffer size (TLEN)
+          // a short last buffer is rounded up to words, as dmaInCpltCallback does
           uint32_t xfrSize = mHandle.hmdmaIn.Init.BufferTransferLength;
-          mHandle.InLen = mHandle.InLen - (mHandle.InLen % xfrSize);
+          if (mHandle.InLen >= xfrSize)
+            mHandle.InLen = mHandle.InLen - (mHandle.InLen % xfrSize);
+          else
+            mHandle.InLen = ((mHandle.InLen + 3) / 4) * 4;
           if (mHandle.InLen > 0) // Start DMA FIFO In transfer
             HAL_MDMA_Start_IT (&mHandle.hmdmaIn, (uint32_t)mHandle.InBuffPtr, (uint32_t)&JPEG->DIR, mHandle.InLen, 1);
           }
         mHandle.mWriteIndex = mHandle.mWriteIndex ? 0 : 1;
         }
         //}}}
-    f_close (file);
-    vPortFree (file);
 
-    printf ("- JPEG decode %p %d:%dx%d - out %d\n",
-            mOutYuvBuf, mHandle.mChromaSampling, mHandle.mWidth, mHandle.mHeight, mOutYuvLen);
-    tile = new cTile (mOutYuvBuf, cTile::eYuvMcu422, mHandle.mWidth, 0, 0, mHandle.mWidth,  mHandle.mHeight);
-    }
+      else if (mHandle.mHeaderDone && !tile) {
+        //{{{  header known, allocate mcu padded rgb565 or yuv mcu tile
+        if (!mConvert) {
+          ok = false;
+          break;
+          }
 
-  vPortFree (mInBuf[0].mBuf);
-  vPortFree (mInBuf[1].mBuf);
+        uint32_t width;
+        uint32_t height;
+        JPEG_GetDecodeOutputSize (&width, &height, &mMcuBytes);
+
+        cTile::eFormat format = cTile::eRgb565;
+        if (yuv && (mHandle.mColorSpace == JPEG_YCBCR_COLORSPACE))
+          format = mHandle.mChromaSampling == JPEG_420_SUBSAMPLING ? cTile::eYuvMcu420 :
+                   mHandle.mChromaSampling == JPEG_422_SUBSAMPLING ? cTile::eYuvMcu422 : cTile::eYuvMcu444;
+        tileBytes = format == cTile::eRgb565 ? width * height * 2 : mNumMcus * mMcuBytes;
+
+        auto piccy = sdRamAlloc (tileBytes, "hwJpegTile");
+        if (!piccy) {
+          printf ("hwJpegDecode %s tile alloc fail\n", fileName.c_str());
+          ok = false;
+          break;
+          }
+        tile = new cTile (piccy, format, width, 0, 0, mHandle.mWidth, mHandle.mHeight);
+        lastTime = HAL_GetTick();
+        }
+        //}}}
 
-  return tile;
-  }
-//}}}
-//{{{
-cTile* swJpegDecode (const string& fileName, int scale) {
+      else if (tile && mOutBuf[mHandle.mOutReadIndex].mFull) {
+        //{{{  convert chunk, hand its buffer back to mdma if it paused waiting for it
+        // axi sram region is shareable, m7 dcache doesn't hold it, no invalidate after mdma
+        uint32_t startTime = HAL_GetTick();
+        uint32_t convertedBytes;
+        auto& buf = mOutBuf[mHandle.mOutReadIndex];
+        if (tile->mFormat == cTile::eRgb565)
+          mcuIndex += mConvert (buf.mBuf, tile->mPiccy, mcuIndex, buf.mSize, &convertedBytes);
+        else {
+          // mcus already in dma2d ycbcr order
+          memcpy (tile->mPiccy + (mcuIndex * mMcuBytes), buf.mBuf, buf.mSize);
+          mcuIndex += buf.mSize / mMcuBytes;
+          }
+        lastTime = HAL_GetTick();
+        convertTime += lastTime - startTime;
+
+        taskENTER_CRITICAL();
+        buf.mFull = false;
+        if (mHandle.mOutPaused) {
+          mHandle.mOutPaused = false;
+          dmaOutStart (mHandle.mOutReadIndex);
+          }
+        taskEXIT_CRITICAL();
 
-  cTile* tile = nullptr;
+        mHandle.mOutReadIndex = mHandle.mOutReadIndex ? 0 : 1;
+        }
+        //}}}
 
-  FIL* file = (FIL*)pvPortMalloc (sizeof (FIL));
-  if (f_open (file, fileName.c_str(), FA_READ))
-    printf ("swJpegDecode %s open fail\n", fileName.c_str());
-  else {
-    printf ("swJpegDecode %s start decoding\n", fileName.c_str());
-
-    struct jpeg_error_mgr jerr;
-    struct jpeg_decompress_struct mCinfo;
-    mCinfo.err = jpeg_std_error (&jerr);
-    jpeg_create_decompress (&mCinfo);
-
-    jpeg_stdio_src (&mCinfo, file);
-    jpeg_read_header (&mCinfo, TRUE);
-
-    mCinfo.dct_method = JDCT_FLOAT;
-    mCinfo.out_color_space = JCS_RGB;
-    mCinfo.scale_num = 1;
-    mCinfo.scale_denom = scale;
-    jpeg_start_decompress (&mCinfo);
-
-    auto rgb888Pic = (uint8_t*)sdRamAlloc (mCinfo.output_width * mCinfo.output_height*3, "swJpegPic888");
-    if (rgb888Pic) {
-      // will not render to rgb88pic in sdram directly ???
-      uint8_t* rgb888Line = (uint8_t*)pvPortMalloc (mCinfo.output_width * 3);
-      tile = new cTile (rgb888Pic, cTile::eRgb888, mCinfo.output_width, 0,0, mCinfo.output_width, mCinfo.output_height);
-      while (mCinfo.output_scanline < mCinfo.output_height) {
-        jpeg_read_scanlines (&mCinfo, &rgb888Line, 1);
-        memcpy (rgb888Pic, rgb888Line, mCinfo.output_width * 3);
-        rgb888Pic += mCinfo.output_width * 3;
+      else if (HAL_GetTick() - lastTime > 100) {
+        // no input read, tile or chunk for 100ms, corrupt stream, or an EOI before the last mcu
+        printf ("hwJpegDecode %s stalled%s mcu %d of %d\n",
+                fileName.c_str(), mHandle.mHeaderDone ? "" : " before header", mcuIndex, mNumMcus);
+        ok = false;
         }
-      vPortFree (rgb888Line);
+
+      else
+        taskYIELD();
+      }
+
+    if (!ok) {
+      //{{{  stop decoder and mdma, drop tile
+      JPEG->CONFR0 &= ~JPEG_CONFR0_START;
+      __HAL_JPEG_DISABLE_IT (&mHandle, JPEG_INTERRUPT_MASK);
+      HAL_MDMA_Abort (&mHandle.hmdmaIn);
+      HAL_MDMA_Abort (&mHandle.hmdmaOut);
+
+      delete tile;
+      tile = nullptr;
       }
+      //}}}
     else
-      printf ("swJpegDecode %s rgb565pic alloc fail\n", fileName.c_str());
+      printf ("- JPEG decode %dx%d mcus:%d convert:%dms tile:%dk\n",
+              mHandle.mWidth, mHandle.mHeight, mNumMcus, convertTime, tileBytes / 1024);
 
-    jpeg_finish_decompress (&mCinfo);
-    jpeg_destroy_decompress (&mCinfo);
     f_close (file);
-    vPortFree (file);
     }
+  vPortFree (file);
+
+  vPortFree (mInBuf[0].mBuf);
+  vPortFree (mInBuf[1].mBuf);
+  vPortFree (mOutBuf[0].mBuf);
+  vPortFree (mOutBuf[1].mBuf);
 
   return tile;
   }
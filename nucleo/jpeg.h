@@ -1,13 +1,65 @@
 // jpeg.h
 #pragma once
 #include <string>
+#include <vector>
 #include <stdint.h>
 #include "../Fatfs/ff.h"
 
 class cTile;
+class cPoint;
+class cRect;
 
 extern "C" { size_t read_file (FIL* file, uint8_t* buf, uint32_t sizeofbuf); }
 extern "C" { size_t write_file (FIL* file, uint8_t* buf, uint32_t sizeofbuf); }
 
-cTile* hwJpegDecode (const std::string& fileName);
-cTile* swJpegDecode (const std::string& fileName, int scale);
+cTile* hwJpegDecode (const std::string& fileName, uint32_t offset = 0, uint32_t length = 0, bool yuv = false);
+cTile* swJpegDecode (const std::string& fileName, const cPoint& size, bool dither, uint32_t offset = 0, uint32_t length = 0);
+bool jpegMergedEnable (bool enable);
+
+// progressive previews, wanted asked after each completed scan before an output pass is spent on it,
+// preview takes the tile
+typedef bool (*tJpegPreviewWanted)(void* context);
+typedef void (*tJpegPreview)(cTile* tile, int scan, void* context);
+cTile* swJpegDecodeProgressive (const std::string& fileName, const cPoint& size, bool dither,
+                                tJpegPreviewWanted wanted, tJpegPreview preview, void* context);
+
+bool jpegArenaEnable (bool enable);
+void jpegArenaLast (size_t& small, size_t& large, uint32_t& fallbacks);
+void jpegArenaReport();
+
+bool readAt (FIL* file, FSIZE_t offset, void* buf, UINT len);
+bool findExifThumb (const std::string& fileName, uint32_t& offset, uint32_t& length);
+bool jpegProgressive (const std::string& fileName);
+cTile* thumbJpegDecode (const std::string& fileName, const cPoint& size, bool hwJpeg, bool dither);
+
+//{{{
+struct sJpegIndex {
+// restart marker index for roi decodes, built once per image, reused for every pan and zoom
+// - header is the file's tables, SOF, DRI, SOS, without its APPn and COM, SOF height patched per jump
+  //{{{
+  struct sRestart {
+    uint16_t mMcuRow;
+    uint8_t mRstNum;
+    uint32_t mOffset;   // after the RSTn marker, the first byte of the interval starting mMcuRow
+    };
+  //}}}
+
+  std::vector<uint8_t> mHeader;
+  uint32_t mSofHeight = 0;
+  uint16_t mWidth = 0;
+  uint16_t mHeight = 0;
+  uint16_t mMcuHeight = 0;
+  uint16_t mMcusPerRow = 0;
+  uint16_t mRestartInterval = 0;
+
+  // only intervals starting an mcu row, the only places a decode can start
+  std::vector<sRestart> mRestarts;
+  };
+//}}}
+bool jpegIndex (const std::string& fileName, sJpegIndex& index);
+cTile* swJpegDecodeRoi (const std::string& fileName, const cRect& roi, const cPoint& size, bool dither,
+                        const sJpegIndex* index = nullptr);
+void jpegBench (const std::vector<std::string>& fileNames);
+
+cTile* swJpegDecodeParallel (const std::string& fileName, const cPoint& size, bool dither, int threads,
+                             const sJpegIndex* index = nullptr);
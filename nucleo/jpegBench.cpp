@@ -0,0 +1,533 @@
+// jpegBench.cpp - decode benchmark, a fixed corpus and card files, the same LibJPEG sources on host and target
+// - corpus is the test card with noise, 4:4:4, 4:2:2, 4:2:0, grayscale, progressive and 4:2:0 with a restart
+//   interval per mcu row, q90 at 320x240, 1024x600 and 1920x1080, 4000x3000 too on host, encoded into sdRam
+// - progressive needs C_PROGRESSIVE_SUPPORTED to encode and D_PROGRESSIVE_SUPPORTED to decode, else it says so
+// - per image, 8/8 islow ifast float rgb888, 4/8 2/8 1/8 islow rgb888, 8/8 islow rgb565 and rgb565 dithered
+//   through the swJpeg converter, each decoded from memory as swJpegDecode does, jpegSimdIdct kernels swapped in
+// - ms/MPixel of the source image, best of kIterations on the cycle counter
+// - peak small and large pool of each decode and its heap fallbacks, jmemArena's high water
+// - psnr against the reference, the test card box filtered to the output size,
+//   a card file's 8/8 float decode, rgb565 compared widened back to 8 bits
+// - card files also through swJpegDecode and hwJpegDecode from the card at 8/8
+// - printf, RTT on target, a libjpeg error ends that decode's line, not the run
+//{{{  includes
+#include "jpeg.h"
+#include <math.h>
+#include <setjmp.h>
+#include <string.h>
+
+#include "cLcd.h" // for cTile
+#include "../common/heap.h"
+
+#define JPEG_INTERNALS
+#include "jpeglib.h"
+#include "jerror.h"
+#include "jpegSimd.h"
+
+using namespace std;
+//}}}
+//{{{  const
+const int kIterations = 2;
+const int kQuality = 90;
+const int kNoise = 12;
+
+// reference, output and source in sdRam at once
+const uint32_t kMaxPixels = 12000000;
+//}}}
+
+// swJpeg.cpp
+void jpegMemorySrc (j_decompress_ptr cinfo, const JOCTET* prefix, size_t prefixSize, const JOCTET* data, size_t size);
+bool jpegRgb565 (j_decompress_ptr cinfo, uint8_t* piccy, uint32_t pitch, bool dither);
+
+//{{{
+struct sBenchImage {
+// pixels in libjpeg's JCS_RGB order, bgr for RGB_RED 2, 3 bytes a pixel even when gray
+  uint32_t mWidth;
+  uint32_t mHeight;
+  uint8_t* mPixels;
+  };
+//}}}
+//{{{
+struct sBenchError {
+  jpeg_error_mgr mPub;
+  jmp_buf mJmpBuf;
+  char mMessage[JMSG_LENGTH_MAX];
+  };
+//}}}
+//{{{
+struct sBenchResult {
+  double mMs;
+  uint32_t mWidth;
+  uint32_t mHeight;
+  size_t mSmall;
+  size_t mLarge;
+  uint32_t mFallbacks;
+  };
+//}}}
+enum eBenchFormat { eBenchRgb888, eBenchRgb565, eBenchRgb565Dither };
+
+//{{{
+static inline uint32_t getCycles() {
+#ifdef HOST_BUILD
+  return hostGetCycles();
+#else
+  return DWT->CYCCNT;
+#endif
+  }
+//}}}
+//{{{
+void benchErrorExit (j_common_ptr cinfo) {
+// keep the message, back to the decode's setjmp
+
+  auto error = (sBenchError*)cinfo->err;
+  (*cinfo->err->format_message) (cinfo, error->mMessage);
+  longjmp (error->mJmpBuf, 1);
+  }
+//}}}
+
+//{{{
+void testCard (sBenchImage& image, bool gray) {
+// scaleBench ramps and checkerboard, plus noise for a camera jpeg's share of entropy decoding
+
+  uint32_t seed = image.mWidth;
+  for (uint32_t y = 0; y < image.mHeight; y++)
+    for (uint32_t x = 0; x < image.mWidth; x++) {
+      int value[3] = { int((x * 255) / image.mWidth), int((y * 255) / image.mHeight), ((x ^ y) & 0x20) ? 255 : 0 };
+      for (int i = 0; i < 3; i++) {
+        seed = (seed * 1103515245) + 12345;
+        int v = value[i] + int((seed >> 16) % (2 * kNoise + 1)) - kNoise;
+        value[i] = v < 0 ? 0 : v > 255 ? 255 : v;
+        }
+
+      auto pix = image.mPixels + ((y * image.mWidth) + x) * 3;
+      if (gray)
+        pix[0] = pix[1] = pix[2] = uint8_t(((value[0] * 77) + (value[1] * 150) + (value[2] * 29)) >> 8);
+      else {
+        // bgr
+        pix[0] = uint8_t(value[2]);
+        pix[1] = uint8_t(value[1]);
+        pix[2] = uint8_t(value[0]);
+        }
+      }
+  }
+//}}}
+//{{{
+size_t encode (const sBenchImage& image, uint8_t* dst, size_t dstSize,
+               bool gray, int hSamp, int vSamp, bool progressive, int restartRows) {
+// jpeg_mem_dest into the caller's sdRam, 0 if it would have grown it or the encoder lacks progressive
+
+  sBenchError error;
+  jpeg_compress_struct cinfo;
+  cinfo.err = jpeg_std_error (&error.mPub);
+  error.mPub.error_exit = benchErrorExit;
+  jpeg_create_compress (&cinfo);
+  if (setjmp (error.mJmpBuf)) {
+    printf ("jpegBench encode %s\n", error.mMessage);
+    jpeg_destroy_compress (&cinfo);
+    return 0;
+    }
+
+  unsigned char* buf = dst;
+  unsigned long size = dstSize;
+  jpeg_mem_dest (&cinfo, &buf, &size);
+
+  cinfo.image_width = image.mWidth;
+  cinfo.image_height = image.mHeight;
+  cinfo.input_components = gray ? 1 : 3;
+  cinfo.in_color_space = gray ? JCS_GRAYSCALE : JCS_RGB;
+  jpeg_set_defaults (&cinfo);
+  jpeg_set_quality (&cinfo, kQuality, TRUE);
+  cinfo.comp_info[0].h_samp_factor = hSamp;
+  cinfo.comp_info[0].v_samp_factor = vSamp;
+  cinfo.restart_in_rows = restartRows;
+  if (progressive) {
+  #ifdef C_PROGRESSIVE_SUPPORTED
+    jpeg_simple_progression (&cinfo);
+  #else
+    jpeg_destroy_compress (&cinfo);
+    return 0;
+  #endif
+    }
+
+  jpeg_start_compress (&cinfo, TRUE);
+  uint8_t* line = gray ? (uint8_t*)sdRamAlloc (image.mWidth, "jpegBenchLine") : nullptr;
+  while (cinfo.next_scanline < cinfo.image_height) {
+    JSAMPROW row = image.mPixels + (cinfo.next_scanline * image.mWidth * 3);
+    if (line) {
+      for (uint32_t x = 0; x < image.mWidth; x++)
+        line[x] = row[x * 3];
+      row = line;
+      }
+    jpeg_write_scanlines (&cinfo, &row, 1);
+    }
+  jpeg_finish_compress (&cinfo);
+  jpeg_destroy_compress (&cinfo);
+  sdRamFree (line);
+
+  if (buf != dst) {
+    // jdatadst malloc'd a bigger buffer
+    free (buf);
+    return 0;
+    }
+  return size;
+  }
+//}}}
+
+//{{{
+bool readHeader (const uint8_t* jpeg, size_t size, uint32_t& width, uint32_t& height, size_t& coefBytes, char* message) {
+// coefBytes, progressive decodes hold every coefficient of the image, 0 for sequential
+
+  sBenchError error;
+  jpeg_decompress_struct cinfo;
+  cinfo.err = jpeg_std_error (&error.mPub);
+  error.mPub.error_exit = benchErrorExit;
+  jpeg_create_decompress (&cinfo);
+  if (setjmp (error.mJmpBuf)) {
+    strcpy (message, error.mMessage);
+    jpeg_destroy_decompress (&cinfo);
+    return false;
+    }
+
+  jpegMemorySrc (&cinfo, nullptr, 0, jpeg, size);
+  jpeg_read_header (&cinfo, TRUE);
+  width = cinfo.image_width;
+  height = cinfo.image_height;
+  coefBytes = 0;
+  if (cinfo.progressive_mode)
+    for (int i = 0; i < cinfo.num_components; i++)
+      coefBytes += size_t(cinfo.comp_info[i].width_in_blocks) * cinfo.comp_info[i].height_in_blocks * sizeof(JBLOCK);
+  jpeg_destroy_decompress (&cinfo);
+  return true;
+  }
+//}}}
+//{{{
+bool decode (const uint8_t* jpeg, size_t size, int scale, J_DCT_METHOD dct, eBenchFormat format,
+             uint8_t* out, sBenchResult& result, char* message) {
+// one decode from memory into out, swJpegDecode's settings, rgb565 through its converter
+
+  sBenchError error;
+  jpeg_decompress_struct cinfo;
+  cinfo.err = jpeg_std_error (&error.mPub);
+  error.mPub.error_exit = benchErrorExit;
+
+  uint32_t startCycles = getCycles();
+  jpeg_create_decompress (&cinfo);
+  if (setjmp (error.mJmpBuf)) {
+    strcpy (message, error.mMessage);
+    jpeg_destroy_decompress (&cinfo);
+    return false;
+    }
+
+  jpegMemorySrc (&cinfo, nullptr, 0, jpeg, size);
+  jpeg_read_header (&cinfo, TRUE);
+  cinfo.scale_num = scale;
+  cinfo.scale_denom = 8;
+  cinfo.dct_method = dct;
+  cinfo.out_color_space = JCS_RGB;
+  jpeg_start_decompress (&cinfo);
+  jpegSimdIdct (&cinfo);
+
+  uint32_t pitch = cinfo.output_width * (format == eBenchRgb888 ? 3 : 2);
+  if (format != eBenchRgb888)
+    jpegRgb565 (&cinfo, out, pitch, format == eBenchRgb565Dither);
+
+  JSAMPROW rows[4];
+  while (cinfo.output_scanline < cinfo.output_height) {
+    int numRows = cinfo.output_height - cinfo.output_scanline;
+    numRows = numRows > cinfo.rec_outbuf_height ? cinfo.rec_outbuf_height : numRows;
+    numRows = numRows > 4 ? 4 : numRows;
+    for (int row = 0; row < numRows; row++)
+      rows[row] = out + ((cinfo.output_scanline + row) * pitch);
+    jpeg_read_scanlines (&cinfo, rows, numRows);
+    }
+
+  result.mWidth = cinfo.output_width;
+  result.mHeight = cinfo.output_height;
+  jpeg_finish_decompress (&cinfo);
+  jpeg_destroy_decompress (&cinfo);
+  result.mMs = (getCycles() - startCycles) / (SystemCoreClock / 1000.0);
+
+  jpegArenaLast (result.mSmall, result.mLarge, result.mFallbacks);
+  return true;
+  }
+//}}}
+//{{{
+void boxFilter (const sBenchImage& image, int scale, sBenchImage& filtered) {
+// reference at scale/8, each output pixel the mean of the source pixels it covers, output size as libjpeg's
+
+  uint32_t factor = 8 / scale;
+  filtered.mWidth = (image.mWidth * scale + 7) / 8;
+  filtered.mHeight = (image.mHeight * scale + 7) / 8;
+  for (uint32_t y = 0; y < filtered.mHeight; y++)
+    for (uint32_t x = 0; x < filtered.mWidth; x++) {
+      uint32_t sum[3] = { 0, 0, 0 };
+      uint32_t count = 0;
+      for (uint32_t sy = y * factor; (sy < (y + 1) * factor) && (sy < image.mHeight); sy++)
+        for (uint32_t sx = x * factor; (sx < (x + 1) * factor) && (sx < image.mWidth); sx++) {
+          auto pix = image.mPixels + ((sy * image.mWidth) + sx) * 3;
+          sum[0] += pix[0];
+          sum[1] += pix[1];
+          sum[2] += pix[2];
+          count++;
+          }
+      auto pix = filtered.mPixels + ((y * filtered.mWidth) + x) * 3;
+      for (int i = 0; i < 3; i++)
+        pix[i] = uint8_t((sum[i] + (count / 2)) / count);
+      }
+  }
+//}}}
+//{{{
+double psnr (const sBenchImage& reference, const uint8_t* out, eBenchFormat format) {
+// rgb565 widened back to 8 bits, bit replicated, b g r as the reference
+
+  uint64_t sumSquares = 0;
+  uint32_t pixels = reference.mWidth * reference.mHeight;
+  for (uint32_t i = 0; i < pixels; i++) {
+    const uint8_t* ref = reference.mPixels + (i * 3);
+    int bgr[3];
+    if (format == eBenchRgb888) {
+      bgr[0] = out[i * 3];
+      bgr[1] = out[(i * 3) + 1];
+      bgr[2] = out[(i * 3) + 2];
+      }
+    else {
+      uint16_t rgb565 = ((const uint16_t*)out)[i];
+      int r = rgb565 >> 11;
+      int g = (rgb565 >> 5) & 0x3F;
+      int b = rgb565 & 0x1F;
+      bgr[0] = (b << 3) | (b >> 2);
+      bgr[1] = (g << 2) | (g >> 4);
+      bgr[2] = (r << 3) | (r >> 2);
+      }
+    for (int c = 0; c < 3; c++) {
+      int diff = bgr[c] - ref[c];
+      sumSquares += diff * diff;
+      }
+    }
+
+  if (!sumSquares)
+    return 99.0;
+  double mse = double(sumSquares) / (pixels * 3.0);
+  return 10.0 * log10 ((255.0 * 255.0) / mse);
+  }
+//}}}
+
+//{{{
+void benchImage (const char* name, const uint8_t* jpeg, size_t size, const sBenchImage& source) {
+// the decode matrix of one image against its full size source
+
+  //{{{
+  struct sCase {
+    const char* mName;
+    int mScale;
+    J_DCT_METHOD mDct;
+    eBenchFormat mFormat;
+    };
+  //}}}
+  const sCase kCases[] = {
+    { "8/8 islow rgb888      ", 8, JDCT_ISLOW, eBenchRgb888 },
+    { "8/8 ifast rgb888      ", 8, JDCT_IFAST, eBenchRgb888 },
+    { "8/8 float rgb888      ", 8, JDCT_FLOAT, eBenchRgb888 },
+    { "4/8 islow rgb888      ", 4, JDCT_ISLOW, eBenchRgb888 },
+    { "2/8 islow rgb888      ", 2, JDCT_ISLOW, eBenchRgb888 },
+    { "1/8 islow rgb888      ", 1, JDCT_ISLOW, eBenchRgb888 },
+    { "8/8 islow rgb565      ", 8, JDCT_ISLOW, eBenchRgb565 },
+    { "8/8 islow rgb565 dith ", 8, JDCT_ISLOW, eBenchRgb565Dither },
+    };
+
+  printf ("%s %dx%d %dk\n", name, source.mWidth, source.mHeight, int(size / 1024));
+
+  uint32_t pixels = source.mWidth * source.mHeight;
+  auto out = (uint8_t*)sdRamAlloc (pixels * 3, "jpegBenchOut");
+  sBenchImage filtered = { 0, 0, (uint8_t*)sdRamAlloc (((source.mWidth + 1) / 2) * ((source.mHeight + 1) / 2) * 3, "jpegBenchRef") };
+  uint32_t width;
+  uint32_t height;
+  size_t coefBytes = 0;
+  char headerMessage[JMSG_LENGTH_MAX] = { 0 };
+  readHeader (jpeg, size, width, height, coefBytes, headerMessage);
+
+  if (!out || !filtered.mPixels)
+    printf ("- alloc fail\n");
+  else if (coefBytes > getSdRamFreeSize())
+    // the source, reference and output already take sdRam
+    printf ("- skipped, coefficient buffer %dk, sdRam free %dk\n", int(coefBytes / 1024), int(getSdRamFreeSize() / 1024));
+
+  else
+    for (auto& test : kCases) {
+      sBenchResult best = { 1e9, 0, 0, 0, 0, 0 };
+      char message[JMSG_LENGTH_MAX] = { 0 };
+      bool ok = true;
+      for (int i = 0; ok && (i < kIterations); i++) {
+        sBenchResult result;
+        ok = decode (jpeg, size, test.mScale, test.mDct, test.mFormat, out, result, message);
+        if (ok && (result.mMs < best.mMs))
+          best = result;
+        }
+      if (!ok) {
+        printf ("- %s %s\n", test.mName, message);
+        continue;
+        }
+
+      // reference at this scale
+      const sBenchImage* reference = &source;
+      if (test.mScale != 8) {
+        if ((filtered.mWidth != best.mWidth) || (filtered.mHeight != best.mHeight))
+          boxFilter (source, test.mScale, filtered);
+        reference = &filtered;
+        }
+
+      printf ("- %s %5dx%-5d %8.2fms %7.2fms/MP small %6d large %7d fallbacks %d psnr %5.2fdB\n",
+              test.mName, best.mWidth, best.mHeight, best.mMs, best.mMs / (pixels / 1000000.0),
+              int(best.mSmall), int(best.mLarge), best.mFallbacks,
+              (reference->mWidth == best.mWidth) && (reference->mHeight == best.mHeight) ?
+                psnr (*reference, out, test.mFormat) : 0.0);
+      }
+
+  sdRamFree (out);
+  sdRamFree (filtered.mPixels);
+  }
+//}}}
+//{{{
+void benchCorpus (uint32_t width, uint32_t height) {
+
+  //{{{
+  struct sVariant {
+    const char* mName;
+    bool mGray;
+    int mHSamp;
+    int mVSamp;
+    bool mProgressive;
+    int mRestartRows;
+    };
+  //}}}
+  const sVariant kVariants[] = {
+    { "4:4:4      ", false, 1, 1, false, 0 },
+    { "4:2:2      ", false, 2, 1, false, 0 },
+    { "4:2:0      ", false, 2, 2, false, 0 },
+    { "gray       ", true,  1, 1, false, 0 },
+    { "progressive", false, 2, 2, true,  0 },
+    { "4:2:0 rst  ", false, 2, 2, false, 1 },
+    };
+
+  size_t encodeSize = (width * height * 3) + 0x10000;
+  sBenchImage image = { width, height, (uint8_t*)sdRamAlloc (width * height * 3, "jpegBenchSrc") };
+  if (!image.mPixels)
+    printf ("jpegBench %dx%d alloc fail\n", width, height);
+
+  else
+    for (bool gray : { false, true }) {
+      testCard (image, gray);
+      for (auto& variant : kVariants)
+        if (variant.mGray == gray) {
+          // encode into a worst case buffer, bench from a copy its size, the sdRam left is the decoder's
+          size_t size = 0;
+          uint8_t* jpeg = nullptr;
+          auto encoded = (uint8_t*)sdRamAlloc (encodeSize, "jpegBenchEncode");
+          if (encoded) {
+            size = encode (image, encoded, encodeSize, variant.mGray,
+                           variant.mHSamp, variant.mVSamp, variant.mProgressive, variant.mRestartRows);
+            jpeg = size ? (uint8_t*)sdRamAlloc (size, "jpegBenchJpeg") : nullptr;
+            if (jpeg)
+              memcpy (jpeg, encoded, size);
+            sdRamFree (encoded);
+            }
+
+          if (jpeg)
+            benchImage (variant.mName, jpeg, size, image);
+          else if (!encoded || size)
+            printf ("%s %dx%d alloc fail\n", variant.mName, width, height);
+          else
+            printf ("%s %dx%d not encoded%s\n", variant.mName, width, height,
+                    variant.mProgressive ? ", needs C_PROGRESSIVE_SUPPORTED" : "");
+          sdRamFree (jpeg);
+          }
+      }
+
+  sdRamFree (image.mPixels);
+  }
+//}}}
+//{{{
+void benchFile (const string& fileName) {
+// card file, into sdRam, its 8/8 float decode the reference, then swJpegDecode and hwJpegDecode from the card
+
+  FIL file;
+  if (f_open (&file, fileName.c_str(), FA_READ)) {
+    printf ("jpegBench %s open fail\n", fileName.c_str());
+    return;
+    }
+
+  uint32_t size = (uint32_t)f_size (&file);
+  auto jpeg = (uint8_t*)sdRamAlloc (size, "jpegBenchJpeg");
+  UINT bytesRead = 0;
+  if (jpeg)
+    f_read (&file, jpeg, size, &bytesRead);
+  f_close (&file);
+
+  sBenchResult result;
+  char message[JMSG_LENGTH_MAX] = { 0 };
+  if (!jpeg || (bytesRead != size))
+    printf ("jpegBench %s read fail\n", fileName.c_str());
+
+  else {
+    uint32_t width = 0;
+    uint32_t height = 0;
+    size_t coefBytes;
+    if (!readHeader (jpeg, size, width, height, coefBytes, message))
+      printf ("jpegBench %s %s\n", fileName.c_str(), message);
+    else if (width * height > kMaxPixels)
+      printf ("jpegBench %s %dx%d too big\n", fileName.c_str(), width, height);
+    else {
+      sBenchImage reference = { width, height, (uint8_t*)sdRamAlloc (width * height * 3, "jpegBenchRef") };
+      if (reference.mPixels && decode (jpeg, size, 8, JDCT_FLOAT, eBenchRgb888, reference.mPixels, result, message)) {
+        benchImage (fileName.c_str(), jpeg, size, reference);
+
+        double pixels = (reference.mWidth * reference.mHeight) / 1000000.0;
+        for (bool hw : { false, true }) {
+          uint32_t startCycles = getCycles();
+          auto tile = hw ? hwJpegDecode (fileName) :
+                           swJpegDecode (fileName, cPoint (reference.mWidth, reference.mHeight), false);
+          double ms = (getCycles() - startCycles) / (SystemCoreClock / 1000.0);
+          if (tile)
+            printf ("- %s from card    %5dx%-5d %8.2fms %7.2fms/MP\n",
+                    hw ? "hwJpegDecode" : "swJpegDecode", tile->mWidth, tile->mHeight, ms, ms / pixels);
+          else
+            printf ("- %s none\n", hw ? "hwJpegDecode" : "swJpegDecode");
+          delete tile;
+          }
+        }
+      else
+        printf ("jpegBench %s reference fail %s\n", fileName.c_str(), message);
+      sdRamFree (reference.mPixels);
+      }
+    }
+
+  sdRamFree (jpeg);
+  }
+//}}}
+
+// interface
+//{{{
+void jpegBench (const vector<string>& fileNames) {
+
+#ifndef HOST_BUILD
+  // cycle counter, as cLcd
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->LAR = 0xC5ACCE55;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+
+  printf ("jpegBench %s kernels, q%d, best of %d\n", jpegKernels()->mName, kQuality, kIterations);
+
+  benchCorpus (320, 240);
+  benchCorpus (1024, 600);
+  benchCorpus (1920, 1080);
+#ifdef HOST_BUILD
+  benchCorpus (4000, 3000);
+#endif
+
+  for (auto& fileName : fileNames)
+    benchFile (fileName);
+
+  printf ("jpegBench done\n");
+  }
+//}}}
@@ -0,0 +1,736 @@
+// jpegSimd.cpp - swJpeg idct and ycc to rgb565 kernels, cortex-m7 dsp, sse2 and avx2, chosen once at first use
+// - islow and 4x4 are the jidctint arithmetic regrouped so every multiply is a pair of 16bit products, smuad on the m7,
+//   pmaddwd on sse2, the sums of products are the same 32bit integers as libjpeg's, fudge, descale and the
+//   range_limit wrap to 10 bits included, so the output bytes are the same
+// - pairs need 16bit dequantized coefficients and pass 1 rows, a block breaking that goes to the libjpeg routine,
+//   quant tables above 32767 keep the libjpeg routine for the component
+// - ycc is the jdcolor fixed point computed, not looked up, each constant split into a multiple of 65536 and
+//   a 16bit part so the products are exact, then the swJpeg dither, clamp and 565 pack
+// - avx2 is ycc only, an 8x8 block of 16bit rows already fills an sse2 register
+// - dsp kernels also build on host over the host.h intrinsic stand ins, checked bit exact there, timed on target only
+//{{{  includes
+#include "jpegSimd.h"
+
+#include <string.h>
+
+#ifdef HOST_BUILD
+  #include "../host/host.h"
+  #define JPEG_SIMD_DSP
+  #if defined(__SSE2__)
+    #include <immintrin.h>
+    #define JPEG_SIMD_SSE2
+  #endif
+#else
+  #include "stm32h7xx.h"
+  #if defined(__ARM_FEATURE_DSP)
+    #define JPEG_SIMD_DSP
+  #endif
+#endif
+
+extern "C" {
+  #include "jdct.h"
+  }
+//}}}
+//{{{  const
+// jidctint CONST_BITS 13 constants
+const int kFix0298 = 2446;
+const int kFix0390 = 3196;
+const int kFix0541 = 4433;
+const int kFix0765 = 6270;
+const int kFix0899 = 7373;
+const int kFix1175 = 9633;
+const int kFix1501 = 12299;
+const int kFix1847 = 15137;
+const int kFix1961 = 16069;
+const int kFix2053 = 16819;
+const int kFix2562 = 20995;
+const int kFix3072 = 25172;
+
+// islow regrouped, even part pairs (d0,d4) (d2,d6), odd part pairs (d7,d5) (d3,d1)
+const int kEven0[2] = { 8192, 8192 };
+const int kEven1[2] = { 8192, -8192 };
+const int kEven2[2] = { kFix0541 + kFix0765, kFix0541 };
+const int kEven3[2] = { kFix0541, kFix0541 - kFix1847 };
+
+const int kOdd0[4] = { kFix0298 - kFix0899 + kFix1175 - kFix1961, kFix1175, kFix1175 - kFix1961, kFix1175 - kFix0899 };
+const int kOdd1[4] = { kFix1175, kFix2053 - kFix2562 + kFix1175 - kFix0390, kFix1175 - kFix2562, kFix1175 - kFix0390 };
+const int kOdd2[4] = { kFix1175 - kFix1961, kFix1175 - kFix2562, kFix3072 - kFix2562 + kFix1175 - kFix1961, kFix1175 };
+const int kOdd3[4] = { kFix1175 - kFix0899, kFix1175 - kFix0390, kFix1175, kFix1501 - kFix0899 + kFix1175 - kFix0390 };
+
+// pass 1 descales by CONST_BITS-PASS1_BITS, pass 2 by CONST_BITS+PASS1_BITS+3, fudge is the rounding
+const int kPass1Bits = 11;
+const int kPass2Bits = 18;
+const int kPass1Fudge = 1 << (kPass1Bits - 1);
+const int kPass2Fudge = 16 << 13;
+
+// ycc fixed point, swJpeg fix() of 1.402, 1.772, 0.34414, 0.71414, as multiples of 65536 and a 16bit remainder
+const int kCrR = 26345;    // 91881 = 65536 + 26345
+const int kCbB = -14942;   // 116130 = 2*65536 - 14942
+const int kCbG = -22554;
+const int kCrG = 18734;    // -46802 = -65536 + 18734
+const int kOneHalf = 1 << 15;
+//}}}
+
+//{{{
+inline uint16_t yccPixel (int y, int cb, int cr, int d5, int d6) {
+// one pixel of the jdcolor table converter, computed, clamped as range_limit
+
+  cb -= CENTERJSAMPLE;
+  cr -= CENTERJSAMPLE;
+  int r = y + cr + ((kCrR * cr + kOneHalf) >> 16) + d5;
+  int g = y - cr + ((kCbG * cb + kCrG * cr + kOneHalf) >> 16) + d6;
+  int b = y + (2 * cb) + ((kCbB * cb + kOneHalf) >> 16) + d5;
+  r = r < 0 ? 0 : r > MAXJSAMPLE ? MAXJSAMPLE : r;
+  g = g < 0 ? 0 : g > MAXJSAMPLE ? MAXJSAMPLE : g;
+  b = b < 0 ? 0 : b > MAXJSAMPLE ? MAXJSAMPLE : b;
+  return ((r & 0xF8) << 8) | ((g & 0xFC) << 3) | (b >> 3);
+  }
+//}}}
+
+#ifdef JPEG_SIMD_DSP
+  //{{{
+  inline uint32_t pair (int lo, int hi) {
+    return (uint16_t)lo | ((uint32_t)(uint16_t)hi << 16);
+    }
+  //}}}
+  //{{{
+  inline uint32_t read32 (const int16_t* ptr) {
+  // two int16, unaligned is fine on cortex-m7
+
+    uint32_t value;
+    memcpy (&value, ptr, sizeof(value));
+    return value;
+    }
+  //}}}
+  //{{{
+  inline bool fits16 (int32_t value) {
+    return __SSAT (value, 16) == value;
+    }
+  //}}}
+
+  //{{{
+  void idct8x8Dsp (j_decompress_ptr cinfo, jpeg_component_info* compptr, JCOEFPTR coefBlock,
+                   JSAMPARRAY outputBuf, JDIMENSION outputCol) {
+  // columns then rows as jpeg_idct_islow, workspace int16 in pair order 0,4,2,6,7,5,3,1 so pass 2 reads pairs
+
+    // column c to its workspace position
+    static const uint8_t kPosition[DCTSIZE] = { 0,7,2,6,1,5,3,4 };
+
+    const uint32_t kE0 = pair (kEven0[0], kEven0[1]);
+    const uint32_t kE1 = pair (kEven1[0], kEven1[1]);
+    const uint32_t kE2 = pair (kEven2[0], kEven2[1]);
+    const uint32_t kE3 = pair (kEven3[0], kEven3[1]);
+    const uint32_t kO0a = pair (kOdd0[0], kOdd0[1]);
+    const uint32_t kO0b = pair (kOdd0[2], kOdd0[3]);
+    const uint32_t kO1a = pair (kOdd1[0], kOdd1[1]);
+    const uint32_t kO1b = pair (kOdd1[2], kOdd1[3]);
+    const uint32_t kO2a = pair (kOdd2[0], kOdd2[1]);
+    const uint32_t kO2b = pair (kOdd2[2], kOdd2[3]);
+    const uint32_t kO3a = pair (kOdd3[0], kOdd3[1]);
+    const uint32_t kO3b = pair (kOdd3[2], kOdd3[3]);
+
+    auto quant = (const ISLOW_MULT_TYPE*)compptr->dct_table;
+    int16_t workspace[DCTSIZE2] __attribute__((aligned(4)));
+
+    bool fits = true;
+    for (int c = 0; (c < DCTSIZE) && fits; c++) {
+      const JCOEF* in = coefBlock + c;
+      const ISLOW_MULT_TYPE* q = quant + c;
+      int16_t* ws = workspace + kPosition[c];
+
+      if (!(in[DCTSIZE*1] | in[DCTSIZE*2] | in[DCTSIZE*3] | in[DCTSIZE*4] |
+            in[DCTSIZE*5] | in[DCTSIZE*6] | in[DCTSIZE*7])) {
+        // ac terms all zero
+        int dc = (in[0] * q[0]) << 2;
+        fits = fits16 (dc);
+        for (int k = 0; k < DCTSIZE; k++)
+          ws[DCTSIZE*k] = (int16_t)dc;
+        continue;
+        }
+
+      int32_t d[DCTSIZE];
+      for (int k = 0; k < DCTSIZE; k++) {
+        d[k] = in[DCTSIZE*k] * q[DCTSIZE*k];
+        fits &= fits16 (d[k]);
+        }
+
+      uint32_t p04 = __PKHBT (d[0], d[4], 16);
+      uint32_t p26 = __PKHBT (d[2], d[6], 16);
+      uint32_t p75 = __PKHBT (d[7], d[5], 16);
+      uint32_t p31 = __PKHBT (d[3], d[1], 16);
+
+      int32_t e0 = (int32_t)__SMLAD (p04, kE0, kPass1Fudge);
+      int32_t e1 = (int32_t)__SMLAD (p04, kE1, kPass1Fudge);
+      int32_t e2 = (int32_t)__SMUAD (p26, kE2);
+      int32_t e3 = (int32_t)__SMUAD (p26, kE3);
+      int32_t t10 = e0 + e2;
+      int32_t t13 = e0 - e2;
+      int32_t t11 = e1 + e3;
+      int32_t t12 = e1 - e3;
+
+      int32_t o0 = (int32_t)__SMLAD (p75, kO0a, __SMUAD (p31, kO0b));
+      int32_t o1 = (int32_t)__SMLAD (p75, kO1a, __SMUAD (p31, kO1b));
+      int32_t o2 = (int32_t)__SMLAD (p75, kO2a, __SMUAD (p31, kO2b));
+      int32_t o3 = (int32_t)__SMLAD (p75, kO3a, __SMUAD (p31, kO3b));
+
+      int32_t w[DCTSIZE];
+      w[0] = (t10 + o3) >> kPass1Bits;
+      w[7] = (t10 - o3) >> kPass1Bits;
+      w[1] = (t11 + o2) >> kPass1Bits;
+      w[6] = (t11 - o2) >> kPass1Bits;
+      w[2] = (t12 + o1) >> kPass1Bits;
+      w[5] = (t12 - o1) >> kPass1Bits;
+      w[3] = (t13 + o0) >> kPass1Bits;
+      w[4] = (t13 - o0) >> kPass1Bits;
+      for (int k = 0; k < DCTSIZE; k++) {
+        fits &= fits16 (w[k]);
+        ws[DCTSIZE*k] = (int16_t)w[k];
+        }
+      }
+
+    if (!fits) {
+      jpeg_idct_islow (cinfo, compptr, coefBlock, outputBuf, outputCol);
+      return;
+      }
+
+    JSAMPLE* rangeLimit = IDCT_range_limit (cinfo);
+    const int16_t* ws = workspace;
+    for (int row = 0; row < DCTSIZE; row++, ws += DCTSIZE) {
+      JSAMPROW out = outputBuf[row] + outputCol;
+      uint32_t p04 = read32 (ws);
+      uint32_t p26 = read32 (ws + 2);
+      uint32_t p75 = read32 (ws + 4);
+      uint32_t p31 = read32 (ws + 6);
+
+      if (!((p04 >> 16) | p26 | p75 | p31)) {
+        // ac terms all zero
+        memset (out, rangeLimit[((ws[0] + 16) >> 5) & RANGE_MASK], DCTSIZE);
+        continue;
+        }
+
+      int32_t e0 = (int32_t)__SMLAD (p04, kE0, kPass2Fudge);
+      int32_t e1 = (int32_t)__SMLAD (p04, kE1, kPass2Fudge);
+      int32_t e2 = (int32_t)__SMUAD (p26, kE2);
+      int32_t e3 = (int32_t)__SMUAD (p26, kE3);
+      int32_t t10 = e0 + e2;
+      int32_t t13 = e0 - e2;
+      int32_t t11 = e1 + e3;
+      int32_t t12 = e1 - e3;
+
+      int32_t o0 = (int32_t)__SMLAD (p75, kO0a, __SMUAD (p31, kO0b));
+      int32_t o1 = (int32_t)__SMLAD (p75, kO1a, __SMUAD (p31, kO1b));
+      int32_t o2 = (int32_t)__SMLAD (p75, kO2a, __SMUAD (p31, kO2b));
+      int32_t o3 = (int32_t)__SMLAD (p75, kO3a, __SMUAD (p31, kO3b));
+
+      out[0] = rangeLimit[((t10 + o3) >> kPass2Bits) & RANGE_MASK];
+      out[7] = rangeLimit[((t10 - o3) >> kPass2Bits) & RANGE_MASK];
+      out[1] = rangeLimit[((t11 + o2) >> kPass2Bits) & RANGE_MASK];
+      out[6] = rangeLimit[((t11 - o2) >> kPass2Bits) & RANGE_MASK];
+      out[2] = rangeLimit[((t12 + o1) >> kPass2Bits) & RANGE_MASK];
+      out[5] = rangeLimit[((t12 - o1) >> kPass2Bits) & RANGE_MASK];
+      out[3] = rangeLimit[((t13 + o0) >> kPass2Bits) & RANGE_MASK];
+      out[4] = rangeLimit[((t13 - o0) >> kPass2Bits) & RANGE_MASK];
+      }
+    }
+  //}}}
+  //{{{
+  void idct4x4Dsp (j_decompress_ptr cinfo, jpeg_component_info* compptr, JCOEFPTR coefBlock,
+                   JSAMPARRAY outputBuf, JDIMENSION outputCol) {
+  // jpeg_idct_4x4, the c6 rotation as two smuads
+
+    const uint32_t kE2 = pair (kEven2[0], kEven2[1]);
+    const uint32_t kE3 = pair (kEven3[0], kEven3[1]);
+
+    auto quant = (const ISLOW_MULT_TYPE*)compptr->dct_table;
+    int32_t workspace[4*4];
+
+    bool fits = true;
+    for (int c = 0; c < 4; c++) {
+      const JCOEF* in = coefBlock + c;
+      const ISLOW_MULT_TYPE* q = quant + c;
+      int32_t d0 = in[DCTSIZE*0] * q[DCTSIZE*0];
+      int32_t d1 = in[DCTSIZE*1] * q[DCTSIZE*1];
+      int32_t d2 = in[DCTSIZE*2] * q[DCTSIZE*2];
+      int32_t d3 = in[DCTSIZE*3] * q[DCTSIZE*3];
+      fits &= fits16 (d1) && fits16 (d3);
+
+      int32_t t10 = (d0 + d2) << 2;
+      int32_t t12 = (d0 - d2) << 2;
+      uint32_t p13 = __PKHBT (d1, d3, 16);
+      int32_t t0 = (int32_t)__SMLAD (p13, kE2, kPass1Fudge) >> kPass1Bits;
+      int32_t t2 = (int32_t)__SMLAD (p13, kE3, kPass1Fudge) >> kPass1Bits;
+
+      workspace[4*0 + c] = t10 + t0;
+      workspace[4*3 + c] = t10 - t0;
+      workspace[4*1 + c] = t12 + t2;
+      workspace[4*2 + c] = t12 - t2;
+      }
+
+    for (int row = 0; (row < 4) && fits; row++)
+      fits = fits16 (workspace[row*4 + 1]) && fits16 (workspace[row*4 + 3]);
+
+    if (!fits) {
+      jpeg_idct_4x4 (cinfo, compptr, coefBlock, outputBuf, outputCol);
+      return;
+      }
+
+    JSAMPLE* rangeLimit = IDCT_range_limit (cinfo);
+    const int32_t* ws = workspace;
+    for (int row = 0; row < 4; row++, ws += 4) {
+      JSAMPROW out = outputBuf[row] + outputCol;
+      int32_t t0 = ws[0] + 16;
+      int32_t t10 = (t0 + ws[2]) << 13;
+      int32_t t12 = (t0 - ws[2]) << 13;
+      uint32_t p13 = __PKHBT (ws[1], ws[3], 16);
+      int32_t o0 = (int32_t)__SMUAD (p13, kE2);
+      int32_t o2 = (int32_t)__SMUAD (p13, kE3);
+
+      out[0] = rangeLimit[((t10 + o0) >> kPass2Bits) & RANGE_MASK];
+      out[3] = rangeLimit[((t10 - o0) >> kPass2Bits) & RANGE_MASK];
+      out[1] = rangeLimit[((t12 + o2) >> kPass2Bits) & RANGE_MASK];
+      out[2] = rangeLimit[((t12 - o2) >> kPass2Bits) & RANGE_MASK];
+      }
+    }
+  //}}}
+  //{{{
+  void yccRgb565Dsp (const JSAMPLE* yRow, const JSAMPLE* cbRow, const JSAMPLE* crRow, uint16_t* dst,
+                     JDIMENSION count, const uint8_t* dither5, const uint8_t* dither6) {
+  // a pixel's three products as smuads, usat clamps
+
+    const uint32_t kR = pair (kCrR, kOneHalf >> 1);
+    const uint32_t kB = pair (kCbB, kOneHalf >> 1);
+    const uint32_t kG = pair (kCbG, kCrG);
+
+    for (JDIMENSION x = 0; x < count; x++) {
+      int y = yRow[x];
+      int cb = cbRow[x] - CENTERJSAMPLE;
+      int cr = crRow[x] - CENTERJSAMPLE;
+      int d5 = dither5[x & 3];
+
+      // (cr,2).(26345,16384) is cr * 26345 + kOneHalf
+      uint32_t r = __USAT (y + cr + ((int32_t)__SMUAD (__PKHBT (cr, 2, 16), kR) >> 16) + d5, 8);
+      uint32_t g = __USAT (y - cr + ((int32_t)__SMLAD (__PKHBT (cb, cr, 16), kG, kOneHalf) >> 16) + dither6[x & 3], 8);
+      uint32_t b = __USAT (y + (2 * cb) + ((int32_t)__SMUAD (__PKHBT (cb, 2, 16), kB) >> 16) + d5, 8);
+      dst[x] = ((r & 0xF8) << 8) | ((g & 0xFC) << 3) | (b >> 3);
+      }
+    }
+  //}}}
+#endif
+
+#ifdef JPEG_SIMD_SSE2
+  static_assert (sizeof (ISLOW_MULT_TYPE) == 4, "sse2 idcts read dct_table as int32");
+
+  //{{{
+  inline __m128i pair128 (int lo, int hi) {
+    return _mm_set1_epi32 ((uint16_t)lo | ((uint32_t)(uint16_t)hi << 16));
+    }
+  //}}}
+  //{{{
+  inline void transpose8x8 (__m128i* r) {
+  // 8x8 int16, r[i] lane j to r[j] lane i
+
+    __m128i a0 = _mm_unpacklo_epi16 (r[0], r[1]);
+    __m128i a1 = _mm_unpackhi_epi16 (r[0], r[1]);
+    __m128i a2 = _mm_unpacklo_epi16 (r[2], r[3]);
+    __m128i a3 = _mm_unpackhi_epi16 (r[2], r[3]);
+    __m128i a4 = _mm_unpacklo_epi16 (r[4], r[5]);
+    __m128i a5 = _mm_unpackhi_epi16 (r[4], r[5]);
+    __m128i a6 = _mm_unpacklo_epi16 (r[6], r[7]);
+    __m128i a7 = _mm_unpackhi_epi16 (r[6], r[7]);
+
+    __m128i b0 = _mm_unpacklo_epi32 (a0, a2);
+    __m128i b1 = _mm_unpackhi_epi32 (a0, a2);
+    __m128i b2 = _mm_unpacklo_epi32 (a1, a3);
+    __m128i b3 = _mm_unpackhi_epi32 (a1, a3);
+    __m128i b4 = _mm_unpacklo_epi32 (a4, a6);
+    __m128i b5 = _mm_unpackhi_epi32 (a4, a6);
+    __m128i b6 = _mm_unpacklo_epi32 (a5, a7);
+    __m128i b7 = _mm_unpackhi_epi32 (a5, a7);
+
+    r[0] = _mm_unpacklo_epi64 (b0, b4);
+    r[1] = _mm_unpackhi_epi64 (b0, b4);
+    r[2] = _mm_unpacklo_epi64 (b1, b5);
+    r[3] = _mm_unpackhi_epi64 (b1, b5);
+    r[4] = _mm_unpacklo_epi64 (b2, b6);
+    r[5] = _mm_unpackhi_epi64 (b2, b6);
+    r[6] = _mm_unpacklo_epi64 (b3, b7);
+    r[7] = _mm_unpackhi_epi64 (b3, b7);
+    }
+  //}}}
+  //{{{
+  inline void idct8Sse2 (__m128i p04, __m128i p26, __m128i p75, __m128i p31, __m128i fudge, __m128i* out) {
+  // one 1d islow on four lanes of pairs, undescaled 32bit outputs
+
+    __m128i e0 = _mm_add_epi32 (_mm_madd_epi16 (p04, pair128 (kEven0[0], kEven0[1])), fudge);
+    __m128i e1 = _mm_add_epi32 (_mm_madd_epi16 (p04, pair128 (kEven1[0], kEven1[1])), fudge);
+    __m128i e2 = _mm_madd_epi16 (p26, pair128 (kEven2[0], kEven2[1]));
+    __m128i e3 = _mm_madd_epi16 (p26, pair128 (kEven3[0], kEven3[1]));
+    __m128i t10 = _mm_add_epi32 (e0, e2);
+    __m128i t13 = _mm_sub_epi32 (e0, e2);
+    __m128i t11 = _mm_add_epi32 (e1, e3);
+    __m128i t12 = _mm_sub_epi32 (e1, e3);
+
+    __m128i o0 = _mm_add_epi32 (_mm_madd_epi16 (p75, pair128 (kOdd0[0], kOdd0[1])), _mm_madd_epi16 (p31, pair128 (kOdd0[2], kOdd0[3])));
+    __m128i o1 = _mm_add_epi32 (_mm_madd_epi16 (p75, pair128 (kOdd1[0], kOdd1[1])), _mm_madd_epi16 (p31, pair128 (kOdd1[2], kOdd1[3])));
+    __m128i o2 = _mm_add_epi32 (_mm_madd_epi16 (p75, pair128 (kOdd2[0], kOdd2[1])), _mm_madd_epi16 (p31, pair128 (kOdd2[2], kOdd2[3])));
+    __m128i o3 = _mm_add_epi32 (_mm_madd_epi16 (p75, pair128 (kOdd3[0], kOdd3[1])), _mm_madd_epi16 (p31, pair128 (kOdd3[2], kOdd3[3])));
+
+    out[0] = _mm_add_epi32 (t10, o3);
+    out[7] = _mm_sub_epi32 (t10, o3);
+    out[1] = _mm_add_epi32 (t11, o2);
+    out[6] = _mm_sub_epi32 (t11, o2);
+    out[2] = _mm_add_epi32 (t12, o1);
+    out[5] = _mm_sub_epi32 (t12, o1);
+    out[3] = _mm_add_epi32 (t13, o0);
+    out[4] = _mm_sub_epi32 (t13, o0);
+    }
+  //}}}
+  //{{{
+  inline void idct8x8PassSse2 (const __m128i* in, __m128i fudge, __m128i* lo, __m128i* hi) {
+  // eight lanes, the low four then the high four
+
+    idct8Sse2 (_mm_unpacklo_epi16 (in[0], in[4]), _mm_unpacklo_epi16 (in[2], in[6]),
+               _mm_unpacklo_epi16 (in[7], in[5]), _mm_unpacklo_epi16 (in[3], in[1]), fudge, lo);
+    idct8Sse2 (_mm_unpackhi_epi16 (in[0], in[4]), _mm_unpackhi_epi16 (in[2], in[6]),
+               _mm_unpackhi_epi16 (in[7], in[5]), _mm_unpackhi_epi16 (in[3], in[1]), fudge, hi);
+    }
+  //}}}
+
+  //{{{
+  void idct8x8Sse2 (j_decompress_ptr cinfo, jpeg_component_info* compptr, JCOEFPTR coefBlock,
+                    JSAMPARRAY outputBuf, JDIMENSION outputCol) {
+  // eight columns at once, transpose, eight rows at once, transpose back to output rows
+
+    auto quant = (const ISLOW_MULT_TYPE*)compptr->dct_table;
+    auto coef = (const __m128i*)coefBlock;
+    auto quant32 = (const __m128i*)quant;
+
+    __m128i ac = _mm_srli_si128 (_mm_loadu_si128 (coef), 2);
+    for (int k = 1; k < DCTSIZE; k++)
+      ac = _mm_or_si128 (ac, _mm_loadu_si128 (coef + k));
+    if (_mm_movemask_epi8 (_mm_cmpeq_epi16 (ac, _mm_setzero_si128())) == 0xFFFF) {
+      //{{{  ac terms all zero, the libjpeg zero column and zero row shortcuts
+      int dc = (coefBlock[0] * quant[0]) << 2;
+      JSAMPLE value = IDCT_range_limit (cinfo)[((dc + 16) >> 5) & RANGE_MASK];
+      for (int row = 0; row < DCTSIZE; row++)
+        memset (outputBuf[row] + outputCol, value, DCTSIZE);
+      return;
+      }
+      //}}}
+
+    // dequantize, mulhi must be the sign of mullo, else the product overflowed 16bits
+    __m128i rows[DCTSIZE];
+    __m128i overflow = _mm_setzero_si128();
+    for (int k = 0; k < DCTSIZE; k++) {
+      __m128i c = _mm_loadu_si128 (coef + k);
+      __m128i q = _mm_packs_epi32 (_mm_loadu_si128 (quant32 + (k * 2)), _mm_loadu_si128 (quant32 + (k * 2) + 1));
+      rows[k] = _mm_mullo_epi16 (c, q);
+      overflow = _mm_or_si128 (overflow, _mm_xor_si128 (_mm_mulhi_epi16 (c, q), _mm_srai_epi16 (rows[k], 15)));
+      }
+
+    // pass 1 columns, 32767 or -32768 after the saturating pack might have been clipped
+    __m128i lo[DCTSIZE];
+    __m128i hi[DCTSIZE];
+    idct8x8PassSse2 (rows, _mm_set1_epi32 (kPass1Fudge), lo, hi);
+    __m128i maxAbs = _mm_setzero_si128();
+    for (int k = 0; k < DCTSIZE; k++) {
+      rows[k] = _mm_packs_epi32 (_mm_srai_epi32 (lo[k], kPass1Bits), _mm_srai_epi32 (hi[k], kPass1Bits));
+      maxAbs = _mm_max_epi16 (maxAbs, _mm_xor_si128 (rows[k], _mm_srai_epi16 (rows[k], 15)));
+      }
+
+    if ((_mm_movemask_epi8 (_mm_cmpeq_epi16 (overflow, _mm_setzero_si128())) != 0xFFFF) ||
+        _mm_movemask_epi8 (_mm_cmpeq_epi16 (maxAbs, _mm_set1_epi16 (0x7FFF)))) {
+      jpeg_idct_islow (cinfo, compptr, coefBlock, outputBuf, outputCol);
+      return;
+      }
+
+    // pass 2 rows, descale and the 10bit range_limit wrap in one shift pair, centre, clamp
+    transpose8x8 (rows);
+    idct8x8PassSse2 (rows, _mm_set1_epi32 (kPass2Fudge), lo, hi);
+    for (int k = 0; k < DCTSIZE; k++)
+      rows[k] = _mm_add_epi16 (_mm_packs_epi32 (_mm_srai_epi32 (_mm_slli_epi32 (lo[k], 4), 22),
+                                                _mm_srai_epi32 (_mm_slli_epi32 (hi[k], 4), 22)),
+                               _mm_set1_epi16 (CENTERJSAMPLE));
+    transpose8x8 (rows);
+
+    for (int row = 0; row < DCTSIZE; row += 2) {
+      __m128i out = _mm_packus_epi16 (rows[row], rows[row+1]);
+      _mm_storel_epi64 ((__m128i*)(outputBuf[row] + outputCol), out);
+      _mm_storel_epi64 ((__m128i*)(outputBuf[row+1] + outputCol), _mm_srli_si128 (out, 8));
+      }
+    }
+  //}}}
+  //{{{
+  inline void transpose4x4 (__m128i* r) {
+  // 4x4 int32, r[i] lane j to r[j] lane i
+
+    __m128i a0 = _mm_unpacklo_epi32 (r[0], r[1]);
+    __m128i a1 = _mm_unpackhi_epi32 (r[0], r[1]);
+    __m128i a2 = _mm_unpacklo_epi32 (r[2], r[3]);
+    __m128i a3 = _mm_unpackhi_epi32 (r[2], r[3]);
+
+    r[0] = _mm_unpacklo_epi64 (a0, a2);
+    r[1] = _mm_unpackhi_epi64 (a0, a2);
+    r[2] = _mm_unpacklo_epi64 (a1, a3);
+    r[3] = _mm_unpackhi_epi64 (a1, a3);
+    }
+  //}}}
+  //{{{
+  inline __m128i pairs16 (__m128i a, __m128i b, __m128i& maxAbs) {
+  // 32bit lanes of a and b as 16bit pairs, 32767 or -32768 after the saturating pack might have been clipped
+
+    __m128i a16 = _mm_packs_epi32 (a, a);
+    __m128i b16 = _mm_packs_epi32 (b, b);
+    maxAbs = _mm_max_epi16 (maxAbs, _mm_xor_si128 (a16, _mm_srai_epi16 (a16, 15)));
+    maxAbs = _mm_max_epi16 (maxAbs, _mm_xor_si128 (b16, _mm_srai_epi16 (b16, 15)));
+    return _mm_unpacklo_epi16 (a16, b16);
+    }
+  //}}}
+  //{{{
+  void idct4x4Sse2 (j_decompress_ptr cinfo, jpeg_component_info* compptr, JCOEFPTR coefBlock,
+                    JSAMPARRAY outputBuf, JDIMENSION outputCol) {
+  // jpeg_idct_4x4, four columns in 32bit lanes, the c6 rotation a pmaddwd of 16bit pairs, transpose, four rows
+
+    auto quant = (const ISLOW_MULT_TYPE*)compptr->dct_table;
+    const __m128i kE2 = pair128 (kEven2[0], kEven2[1]);
+    const __m128i kE3 = pair128 (kEven3[0], kEven3[1]);
+    const __m128i zero = _mm_setzero_si128();
+
+    // dequantize to 32bit, (c,0).(q,0), q fits 16bits
+    __m128i d[4];
+    for (int k = 0; k < 4; k++)
+      d[k] = _mm_madd_epi16 (_mm_unpacklo_epi16 (_mm_loadl_epi64 ((const __m128i*)(coefBlock + (DCTSIZE * k))), zero),
+                             _mm_loadu_si128 ((const __m128i*)(quant + (DCTSIZE * k))));
+
+    // pass 1 columns
+    __m128i maxAbs = zero;
+    const __m128i kFudge1 = _mm_set1_epi32 (kPass1Fudge);
+    __m128i p13 = pairs16 (d[1], d[3], maxAbs);
+    __m128i t10 = _mm_slli_epi32 (_mm_add_epi32 (d[0], d[2]), 2);
+    __m128i t12 = _mm_slli_epi32 (_mm_sub_epi32 (d[0], d[2]), 2);
+    __m128i t0 = _mm_srai_epi32 (_mm_add_epi32 (_mm_madd_epi16 (p13, kE2), kFudge1), kPass1Bits);
+    __m128i t2 = _mm_srai_epi32 (_mm_add_epi32 (_mm_madd_epi16 (p13, kE3), kFudge1), kPass1Bits);
+
+    __m128i w[4];
+    w[0] = _mm_add_epi32 (t10, t0);
+    w[3] = _mm_sub_epi32 (t10, t0);
+    w[1] = _mm_add_epi32 (t12, t2);
+    w[2] = _mm_sub_epi32 (t12, t2);
+
+    // pass 2 rows
+    transpose4x4 (w);
+    p13 = pairs16 (w[1], w[3], maxAbs);
+    if (_mm_movemask_epi8 (_mm_cmpeq_epi16 (maxAbs, _mm_set1_epi16 (0x7FFF)))) {
+      jpeg_idct_4x4 (cinfo, compptr, coefBlock, outputBuf, outputCol);
+      return;
+      }
+
+    t0 = _mm_add_epi32 (w[0], _mm_set1_epi32 (16));
+    t10 = _mm_slli_epi32 (_mm_add_epi32 (t0, w[2]), 13);
+    t12 = _mm_slli_epi32 (_mm_sub_epi32 (t0, w[2]), 13);
+    __m128i o0 = _mm_madd_epi16 (p13, kE2);
+    __m128i o2 = _mm_madd_epi16 (p13, kE3);
+
+    // descale and the 10bit range_limit wrap in one shift pair
+    w[0] = _mm_srai_epi32 (_mm_slli_epi32 (_mm_add_epi32 (t10, o0), 4), 22);
+    w[3] = _mm_srai_epi32 (_mm_slli_epi32 (_mm_sub_epi32 (t10, o0), 4), 22);
+    w[1] = _mm_srai_epi32 (_mm_slli_epi32 (_mm_add_epi32 (t12, o2), 4), 22);
+    w[2] = _mm_srai_epi32 (_mm_slli_epi32 (_mm_sub_epi32 (t12, o2), 4), 22);
+    transpose4x4 (w);
+
+    const __m128i kCentre = _mm_set1_epi16 (CENTERJSAMPLE);
+    __m128i out = _mm_packus_epi16 (_mm_add_epi16 (_mm_packs_epi32 (w[0], w[1]), kCentre),
+                                    _mm_add_epi16 (_mm_packs_epi32 (w[2], w[3]), kCentre));
+    for (int row = 0; row < 4; row++, out = _mm_srli_si128 (out, 4)) {
+      uint32_t value = (uint32_t)_mm_cvtsi128_si32 (out);
+      memcpy (outputBuf[row] + outputCol, &value, 4);
+      }
+    }
+  //}}}
+
+  //{{{
+  void yccRgb565Sse2 (const JSAMPLE* yRow, const JSAMPLE* cbRow, const JSAMPLE* crRow, uint16_t* dst,
+                      JDIMENSION count, const uint8_t* dither5, const uint8_t* dither6) {
+  // eight pixels a pass, (cr,2).(26345,16384) is cr * 26345 + kOneHalf
+
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i kCentre = _mm_set1_epi16 (CENTERJSAMPLE);
+    const __m128i kTwo = _mm_set1_epi16 (2);
+    const __m128i kR = pair128 (kCrR, kOneHalf >> 1);
+    const __m128i kB = pair128 (kCbB, kOneHalf >> 1);
+    const __m128i kG = pair128 (kCbG, kCrG);
+    const __m128i kHalf = _mm_set1_epi32 (kOneHalf);
+    const __m128i kMax = _mm_set1_epi16 (MAXJSAMPLE);
+    const __m128i d5 = _mm_setr_epi16 (dither5[0], dither5[1], dither5[2], dither5[3],
+                                       dither5[0], dither5[1], dither5[2], dither5[3]);
+    const __m128i d6 = _mm_setr_epi16 (dither6[0], dither6[1], dither6[2], dither6[3],
+                                       dither6[0], dither6[1], dither6[2], dither6[3]);
+
+    JDIMENSION x = 0;
+    for (; x + 8 <= count; x += 8) {
+      __m128i y = _mm_unpacklo_epi8 (_mm_loadl_epi64 ((const __m128i*)(yRow + x)), zero);
+      __m128i cb = _mm_sub_epi16 (_mm_unpacklo_epi8 (_mm_loadl_epi64 ((const __m128i*)(cbRow + x)), zero), kCentre);
+      __m128i cr = _mm_sub_epi16 (_mm_unpacklo_epi8 (_mm_loadl_epi64 ((const __m128i*)(crRow + x)), zero), kCentre);
+
+      __m128i rOff = _mm_packs_epi32 (_mm_srai_epi32 (_mm_madd_epi16 (_mm_unpacklo_epi16 (cr, kTwo), kR), 16),
+                                      _mm_srai_epi32 (_mm_madd_epi16 (_mm_unpackhi_epi16 (cr, kTwo), kR), 16));
+      __m128i bOff = _mm_packs_epi32 (_mm_srai_epi32 (_mm_madd_epi16 (_mm_unpacklo_epi16 (cb, kTwo), kB), 16),
+                                      _mm_srai_epi32 (_mm_madd_epi16 (_mm_unpackhi_epi16 (cb, kTwo), kB), 16));
+      __m128i gOff = _mm_packs_epi32 (
+        _mm_srai_epi32 (_mm_add_epi32 (_mm_madd_epi16 (_mm_unpacklo_epi16 (cb, cr), kG), kHalf), 16),
+        _mm_srai_epi32 (_mm_add_epi32 (_mm_madd_epi16 (_mm_unpackhi_epi16 (cb, cr), kG), kHalf), 16));
+
+      __m128i r = _mm_add_epi16 (_mm_add_epi16 (y, cr), _mm_add_epi16 (rOff, d5));
+      __m128i g = _mm_add_epi16 (_mm_sub_epi16 (y, cr), _mm_add_epi16 (gOff, d6));
+      __m128i b = _mm_add_epi16 (_mm_add_epi16 (y, _mm_add_epi16 (cb, cb)), _mm_add_epi16 (bOff, d5));
+      r = _mm_min_epi16 (_mm_max_epi16 (r, zero), kMax);
+      g = _mm_min_epi16 (_mm_max_epi16 (g, zero), kMax);
+      b = _mm_min_epi16 (_mm_max_epi16 (b, zero), kMax);
+
+      __m128i rgb = _mm_or_si128 (_mm_slli_epi16 (_mm_and_si128 (r, _mm_set1_epi16 (0xF8)), 8),
+                                  _mm_or_si128 (_mm_slli_epi16 (_mm_and_si128 (g, _mm_set1_epi16 (0xFC)), 3),
+                                                _mm_srli_epi16 (b, 3)));
+      _mm_storeu_si128 ((__m128i*)(dst + x), rgb);
+      }
+
+    for (; x < count; x++)
+      dst[x] = yccPixel (yRow[x], cbRow[x], crRow[x], dither5[x & 3], dither6[x & 3]);
+    }
+  //}}}
+  //{{{
+  __attribute__((target("avx2")))
+  void yccRgb565Avx2 (const JSAMPLE* yRow, const JSAMPLE* cbRow, const JSAMPLE* crRow, uint16_t* dst,
+                      JDIMENSION count, const uint8_t* dither5, const uint8_t* dither6) {
+  // sixteen pixels a pass, unpack, pmaddwd and pack stay within 128bit lanes, so pixel order is kept
+
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i kCentre = _mm256_set1_epi16 (CENTERJSAMPLE);
+    const __m256i kTwo = _mm256_set1_epi16 (2);
+    const __m256i kR = _mm256_set1_epi32 ((uint16_t)kCrR | ((uint32_t)(kOneHalf >> 1) << 16));
+    const __m256i kB = _mm256_set1_epi32 ((uint16_t)kCbB | ((uint32_t)(kOneHalf >> 1) << 16));
+    const __m256i kG = _mm256_set1_epi32 ((uint16_t)kCbG | ((uint32_t)(uint16_t)kCrG << 16));
+    const __m256i kHalf = _mm256_set1_epi32 (kOneHalf);
+    const __m256i kMax = _mm256_set1_epi16 (MAXJSAMPLE);
+    const __m256i d5 = _mm256_setr_epi16 (dither5[0], dither5[1], dither5[2], dither5[3],
+                                          dither5[0], dither5[1], dither5[2], dither5[3],
+                                          dither5[0], dither5[1], dither5[2], dither5[3],
+                                          dither5[0], dither5[1], dither5[2], dither5[3]);
+    const __m256i d6 = _mm256_setr_epi16 (dither6[0], dither6[1], dither6[2], dither6[3],
+                                          dither6[0], dither6[1], dither6[2], dither6[3],
+                                          dither6[0], dither6[1], dither6[2], dither6[3],
+                                          dither6[0], dither6[1], dither6[2], dither6[3]);
+
+    JDIMENSION x = 0;
+    for (; x + 16 <= count; x += 16) {
+      __m256i y = _mm256_cvtepu8_epi16 (_mm_loadu_si128 ((const __m128i*)(yRow + x)));
+      __m256i cb = _mm256_sub_epi16 (_mm256_cvtepu8_epi16 (_mm_loadu_si128 ((const __m128i*)(cbRow + x))), kCentre);
+      __m256i cr = _mm256_sub_epi16 (_mm256_cvtepu8_epi16 (_mm_loadu_si128 ((const __m128i*)(crRow + x))), kCentre);
+
+      __m256i rOff = _mm256_packs_epi32 (_mm256_srai_epi32 (_mm256_madd_epi16 (_mm256_unpacklo_epi16 (cr, kTwo), kR), 16),
+                                         _mm256_srai_epi32 (_mm256_madd_epi16 (_mm256_unpackhi_epi16 (cr, kTwo), kR), 16));
+      __m256i bOff = _mm256_packs_epi32 (_mm256_srai_epi32 (_mm256_madd_epi16 (_mm256_unpacklo_epi16 (cb, kTwo), kB), 16),
+                                         _mm256_srai_epi32 (_mm256_madd_epi16 (_mm256_unpackhi_epi16 (cb, kTwo), kB), 16));
+      __m256i gOff = _mm256_packs_epi32 (
+        _mm256_srai_epi32 (_mm256_add_epi32 (_mm256_madd_epi16 (_mm256_unpacklo_epi16 (cb, cr), kG), kHalf), 16),
+        _mm256_srai_epi32 (_mm256_add_epi32 (_mm256_madd_epi16 (_mm256_unpackhi_epi16 (cb, cr), kG), kHalf), 16));
+
+      __m256i r = _mm256_add_epi16 (_mm256_add_epi16 (y, cr), _mm256_add_epi16 (rOff, d5));
+      __m256i g = _mm256_add_epi16 (_mm256_sub_epi16 (y, cr), _mm256_add_epi16 (gOff, d6));
+      __m256i b = _mm256_add_epi16 (_mm256_add_epi16 (y, _mm256_add_epi16 (cb, cb)), _mm256_add_epi16 (bOff, d5));
+      r = _mm256_min_epi16 (_mm256_max_epi16 (r, zero), kMax);
+      g = _mm256_min_epi16 (_mm256_max_epi16 (g, zero), kMax);
+      b = _mm256_min_epi16 (_mm256_max_epi16 (b, zero), kMax);
+
+      __m256i rgb = _mm256_or_si256 (_mm256_slli_epi16 (_mm256_and_si256 (r, _mm256_set1_epi16 (0xF8)), 8),
+                                     _mm256_or_si256 (_mm256_slli_epi16 (_mm256_and_si256 (g, _mm256_set1_epi16 (0xFC)), 3),
+                                                      _mm256_srli_epi16 (b, 3)));
+      _mm256_storeu_si256 ((__m256i*)(dst + x), rgb);
+      }
+
+    // the rest, dither phase unchanged, x is a multiple of 16
+    yccRgb565Sse2 (yRow + x, cbRow + x, crRow + x, dst + x, count - x, dither5, dither6);
+    }
+  //}}}
+#endif
+
+//{{{
+const sJpegKernels kKernels[] = {
+  { eJpegSimdNone, "none", nullptr, nullptr, nullptr },
+#ifdef JPEG_SIMD_DSP
+  { eJpegSimdDsp, "dsp", idct8x8Dsp, idct4x4Dsp, yccRgb565Dsp },
+#endif
+#ifdef JPEG_SIMD_SSE2
+  { eJpegSimdSse2, "sse2", idct8x8Sse2, idct4x4Sse2, yccRgb565Sse2 },
+  { eJpegSimdAvx2, "avx2", idct8x8Sse2, idct4x4Sse2, yccRgb565Avx2 },
+#endif
+  };
+//}}}
+const sJpegKernels* mKernels = nullptr;
+
+//{{{
+const sJpegKernels* jpegKernels() {
+// best kernels this cpu has, chosen at first use, dsp on host is for checking only, never chosen
+
+  if (!mKernels) {
+  #if defined(JPEG_SIMD_SSE2)
+    if (!jpegSimd (eJpegSimdAvx2))
+      jpegSimd (eJpegSimdSse2);
+  #elif defined(JPEG_SIMD_DSP) && !defined(HOST_BUILD)
+    jpegSimd (eJpegSimdDsp);
+  #else
+    jpegSimd (eJpegSimdNone);
+  #endif
+    }
+
+  return mKernels;
+  }
+//}}}
+//{{{
+bool jpegSimd (eJpegSimd simd) {
+// select kernels, false if not built or this cpu lacks them
+
+#if defined(JPEG_SIMD_SSE2)
+  if ((simd == eJpegSimdAvx2) && !__builtin_cpu_supports ("avx2"))
+    return false;
+#endif
+
+  for (auto& kernels : kKernels)
+    if (kernels.mSimd == simd) {
+      mKernels = &kernels;
+      return true;
+      }
+
+  return false;
+  }
+//}}}
+//{{{
+void jpegSimdIdct (j_decompress_ptr cinfo) {
+// after jpeg_start_decompress, or each jpeg_start_output of a buffered image, its idct start_pass chose
+// the libjpeg routines and built their quant tables, swap in the kernels for the islow and 4x4 ones
+// - before jpegRoiIdct, it wraps whatever is chosen here
+
+  auto kernels = jpegKernels();
+  for (int ci = 0; ci < cinfo->num_components; ci++) {
+    auto compptr = &cinfo->comp_info[ci];
+    auto quant = (const ISLOW_MULT_TYPE*)compptr->dct_table;
+    if (!compptr->component_needed || !quant)
+      continue;
+
+    auto& idct = cinfo->idct->inverse_DCT[ci];
+    if ((idct != jpeg_idct_islow) && (idct != jpeg_idct_4x4))
+      continue;
+
+    // the kernels pack quant values to 16bits
+    bool fits = true;
+    for (int i = 0; i < DCTSIZE2; i++)
+      fits &= quant[i] <= 0x7FFF;
+    if (!fits)
+      continue;
+
+    if ((idct == jpeg_idct_islow) && kernels->mIdct8x8)
+      idct = kernels->mIdct8x8;
+    else if ((idct == jpeg_idct_4x4) && kernels->mIdct4x4)
+      idct = kernels->mIdct4x4;
+    }
+  }
+//}}}
@@ -0,0 +1,34 @@
+// jpegSimd.h - swJpeg idct and colour convert kernels, cortex-m7 dsp on target, sse2 avx2 on host, chosen once
+// - idcts are jidctint islow, bit exact, a block whose dequantized coefficients or pass 1 rows overflow 16bits
+//   falls back to the libjpeg routine
+// - ycc to rgb565 is bit exact with the jdcolor table converter in swJpeg
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+
+#ifndef JPEG_INTERNALS
+  #define JPEG_INTERNALS
+#endif
+#include "jpeglib.h"
+
+enum eJpegSimd { eJpegSimdNone, eJpegSimdDsp, eJpegSimdSse2, eJpegSimdAvx2 };
+
+// one row of ycc samples to rgb565, dither5 and dither6 are the 4 wide ordered dither offsets from the row's first pixel
+typedef void (*tYccRgb565Row) (const JSAMPLE* yRow, const JSAMPLE* cbRow, const JSAMPLE* crRow, uint16_t* dst,
+                               JDIMENSION count, const uint8_t* dither5, const uint8_t* dither6);
+
+//{{{
+struct sJpegKernels {
+  eJpegSimd mSimd;
+  const char* mName;
+
+  // nullptr keeps the libjpeg routine
+  inverse_DCT_method_ptr mIdct8x8;
+  inverse_DCT_method_ptr mIdct4x4;
+  tYccRgb565Row mYccRgb565;
+  };
+//}}}
+
+const sJpegKernels* jpegKernels();
+bool jpegSimd (eJpegSimd simd);
+void jpegSimdIdct (j_decompress_ptr cinfo);
@@ -0,0 +1,217 @@
+// jpegThumb.cpp - exif thumbnail and progressive marker scans, browse decode
+//{{{  includes
+#include "jpeg.h"
+
+#include "cLcd.h" // for cTile
+
+#include "../fatFs/ff.h"
+
+using namespace std;
+//}}}
+//{{{  const
+const uint8_t kExifId[6] = { 'E','x','i','f', 0,0 };
+
+const uint16_t kTagThumbOffset = 0x0201;  // JPEGInterchangeFormat
+const uint16_t kTagThumbLength = 0x0202;  // JPEGInterchangeFormatLength
+const uint16_t kTypeShort = 3;
+
+// ifd1 of a camera thumbnail has a handful of entries, more is a broken file
+const uint16_t kMaxIfdEntries = 32;
+const uint32_t kIfdEntrySize = 12;
+//}}}
+
+//{{{
+bool readAt (FIL* file, FSIZE_t offset, void* buf, UINT len) {
+
+  UINT bytesRead = 0;
+  return (f_lseek (file, offset) == FR_OK) && (f_read (file, buf, len, &bytesRead) == FR_OK) && (bytesRead == len);
+  }
+//}}}
+//{{{
+uint16_t get16 (const uint8_t* ptr, bool bigEndian) {
+  return bigEndian ? (ptr[0] << 8) | ptr[1] : (ptr[1] << 8) | ptr[0];
+  }
+//}}}
+//{{{
+uint32_t get32 (const uint8_t* ptr, bool bigEndian) {
+  return bigEndian ? (ptr[0] << 24) | (ptr[1] << 16) | (ptr[2] << 8) | ptr[3] :
+                     (ptr[3] << 24) | (ptr[2] << 16) | (ptr[1] << 8) | ptr[0];
+  }
+//}}}
+
+//{{{
+bool findTiffThumb (FIL* file, FSIZE_t tiff, uint32_t tiffLength, uint32_t& offset, uint32_t& length) {
+// tiff header, ifd0 only for its next ifd link, ifd1 entries for the thumbnail stream
+
+  uint8_t header[8];
+  if ((tiffLength < sizeof (header)) || !readAt (file, tiff, header, sizeof (header)))
+    return false;
+
+  bool bigEndian = (header[0] == 'M') && (header[1] == 'M');
+  if (!bigEndian && ((header[0] != 'I') || (header[1] != 'I')))
+    return false;
+  if (get16 (header + 2, bigEndian) != 42)
+    return false;
+
+  // ifd0 count, next ifd link after its entries
+  uint32_t ifd0 = get32 (header + 4, bigEndian);
+  uint8_t buf[4];
+  if ((ifd0 > tiffLength - 2) || !readAt (file, tiff + ifd0, buf, 2))
+    return false;
+  uint32_t ifd1Link = ifd0 + 2 + get16 (buf, bigEndian) * kIfdEntrySize;
+  if ((ifd1Link > tiffLength - 4) || !readAt (file, tiff + ifd1Link, buf, 4))
+    return false;
+
+  uint32_t ifd1 = get32 (buf, bigEndian);
+  if (!ifd1 || (ifd1 > tiffLength - 2) || !readAt (file, tiff + ifd1, buf, 2))
+    return false;
+
+  uint16_t numEntries = get16 (buf, bigEndian);
+  numEntries = numEntries > kMaxIfdEntries ? kMaxIfdEntries : numEntries;
+  if (numEntries * kIfdEntrySize > tiffLength - 2 - ifd1)
+    return false;
+
+  uint8_t entries[kMaxIfdEntries * kIfdEntrySize];
+  if (!readAt (file, tiff + ifd1 + 2, entries, numEntries * kIfdEntrySize))
+    return false;
+
+  uint32_t thumbOffset = 0;
+  uint32_t thumbLength = 0;
+  for (uint16_t i = 0; i < numEntries; i++) {
+    const uint8_t* entry = entries + (i * kIfdEntrySize);
+    uint16_t tag = get16 (entry, bigEndian);
+    uint32_t value = get16 (entry + 2, bigEndian) == kTypeShort ? get16 (entry + 8, bigEndian) : get32 (entry + 8, bigEndian);
+    if (tag == kTagThumbOffset)
+      thumbOffset = value;
+    else if (tag == kTagThumbLength)
+      thumbLength = value;
+    }
+
+  // stream must sit inside the APP1 and start with SOI
+  if (!thumbOffset || !thumbLength || (thumbOffset > tiffLength) || (thumbLength > tiffLength - thumbOffset))
+    return false;
+  if (!readAt (file, tiff + thumbOffset, buf, 2) || (buf[0] != 0xFF) || (buf[1] != 0xD8))
+    return false;
+
+  offset = uint32_t(tiff + thumbOffset);
+  length = thumbLength;
+  return true;
+  }
+//}}}
+
+// interface
+//{{{
+bool findExifThumb (const string& fileName, uint32_t& offset, uint32_t& length) {
+// walk the marker segments up to SOS, never reads the entropy coded data
+// - seeks over each segment by its length, a few small reads from FatFs's sector buffer
+
+  FIL* file = (FIL*)pvPortMalloc (sizeof (FIL));
+  if (f_open (file, fileName.c_str(), FA_READ)) {
+    vPortFree (file);
+    return false;
+    }
+
+  bool found = false;
+  uint8_t buf[sizeof (kExifId)];
+  FSIZE_t pos = 2;
+  if (readAt (file, 0, buf, 2) && (buf[0] == 0xFF) && (buf[1] == 0xD8)) {
+    while (!found && readAt (file, pos, buf, 4)) {
+      if (buf[0] != 0xFF)
+        break;
+      if (buf[1] == 0xFF) {
+        // fill byte
+        pos++;
+        continue;
+        }
+      if ((buf[1] == 0xDA) || (buf[1] == 0xD9))
+        // SOS, EOI, no thumbnail in the header
+        break;
+
+      uint32_t segmentLength = (buf[2] << 8) | buf[3];
+      if (segmentLength < 2)
+        break;
+
+      if ((buf[1] == 0xE1) && (segmentLength >= 2 + sizeof (kExifId)) &&
+          readAt (file, pos + 4, buf, sizeof (kExifId)) && !memcmp (buf, kExifId, sizeof (kExifId)))
+        found = findTiffThumb (file, pos + 4 + sizeof (kExifId), segmentLength - 2 - sizeof (kExifId), offset, length);
+
+      pos += 2 + segmentLength;
+      }
+    }
+
+  f_close (file);
+  vPortFree (file);
+  return found;
+  }
+//}}}
+//{{{
+bool jpegProgressive (const string& fileName) {
+// marker walk to the SOFn, true for progressive, SOF2 huffman or SOF10 arithmetic, which the hw decoder can't do
+
+  FIL* file = (FIL*)pvPortMalloc (sizeof (FIL));
+  if (f_open (file, fileName.c_str(), FA_READ)) {
+    vPortFree (file);
+    return false;
+    }
+
+  bool progressive = false;
+  uint8_t buf[4];
+  FSIZE_t pos = 2;
+  if (readAt (file, 0, buf, 2) && (buf[0] == 0xFF) && (buf[1] == 0xD8)) {
+    while (readAt (file, pos, buf, 4)) {
+      if (buf[0] != 0xFF)
+        break;
+      if (buf[1] == 0xFF) {
+        // fill byte
+        pos++;
+        continue;
+        }
+      if ((buf[1] >= 0xC0) && (buf[1] <= 0xCF) && (buf[1] != 0xC4) && (buf[1] != 0xC8) && (buf[1] != 0xCC)) {
+        // SOFn, not DHT, JPG or DAC
+        progressive = (buf[1] == 0xC2) || (buf[1] == 0xCA);
+        break;
+        }
+      if ((buf[1] == 0xDA) || (buf[1] == 0xD9))
+        // SOS, EOI, no frame header
+        break;
+
+      uint32_t segmentLength = (buf[2] << 8) | buf[3];
+      if (segmentLength < 2)
+        break;
+      pos += 2 + segmentLength;
+      }
+    }
+
+  f_close (file);
+  vPortFree (file);
+  return progressive;
+  }
+//}}}
+//{{{
+cTile* thumbJpegDecode (const string& fileName, const cPoint& size, bool hwJpeg, bool dither) {
+// browse decode, the exif thumbnail stream on its own if there is one, else the image at 1/8 dct scale
+// - reports time to first pixel, from the call until a tile is ready to show
+
+  uint32_t startTime = HAL_GetTick();
+
+  cTile* tile = nullptr;
+  uint32_t offset = 0;
+  uint32_t length = 0;
+  if (findExifThumb (fileName, offset, length)) {
+    if (hwJpeg)
+      tile = hwJpegDecode (fileName, offset, length);
+    if (!tile)
+      tile = swJpegDecode (fileName, size, dither, offset, length);
+    }
+  bool exif = tile != nullptr;
+
+  if (!tile)
+    // a size of 1x1 is always covered by the smallest scale
+    tile = swJpegDecode (fileName, cPoint (1,1), dither);
+
+  if (tile)
+    printf ("thumbJpegDecode %s %s %dx%d first pixel %dms\n",
+            fileName.c_str(), exif ? "exif" : "1/8", tile->mWidth, tile->mHeight, HAL_GetTick() - startTime);
+  return tile;
+  }
+//}}}
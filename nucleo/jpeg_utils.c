@@ -1,3 +1,9 @@
+// jpeg_utils.c - jpeg hw decoder mcu stream to rgb converters, from the STM32Cube jpeg utilities
+// - output lines are mcu padded, pitch WidthExtend, so edge mcus never wrap into the next line
+// - no chroma upsampling filter, each chroma sample covers its 2 or 2x2 luma samples
+//{{{  includes
+#include "jpeg_utils.h"
+//}}}
 /**
   *      - YCbCr 4:2:0 : Each MCU is composed of 4 Y 8x8 blocks + 1 Cb 8x8 block + Cr 8x8 block
   *      - YCbCr 4:2:2 : Each MCU is composed of 2 Y 8x8 blocks + 1 Cb 8x8 block + Cr 8x8 block
@@ -20,6 +26,7 @@ typedef struct __JPEG_MCU_RGB_ConvertorTypeDef
   uint32_t V_factor;
 
   uint32_t WidthExtend;
+  uint32_t HeightExtend;
   uint32_t ScaledWidth;
 
   uint32_t MCU_Total_Nb;
@@ -34,6 +41,7 @@ typedef struct __JPEG_MCU_RGB_ConvertorTypeDef
 #define YCBCR_420_BLOCK_SIZE       384     /* YCbCr 4:2:0 MCU : 4 8x8 blocks of Y + 1 8x8 block of Cb + 1 8x8 block of Cr   */
 #define YCBCR_422_BLOCK_SIZE       256     /* YCbCr 4:2:2 MCU : 2 8x8 blocks of Y + 1 8x8 block of Cb + 1 8x8 block of Cr   */
 #define YCBCR_444_BLOCK_SIZE       192     /* YCbCr 4:4:4 MCU : 1 8x8 block of Y + 1 8x8 block of Cb + 1 8x8 block of Cr   */
+#define GRAY_444_BLOCK_SIZE        64      /* GrayScale MCU : 1 8x8 block of Y */
 
 #if (JPEG_RGB_FORMAT == JPEG_ARGB8888)
   #define JPEG_GREEN_OFFSET        8       /* Offset of the GREEN color in a pixel         */
@@ -543,13 +551,82 @@ static uint32_t JPEG_MCU_YCbCr420_ARGB_ConvertBlocks(uint8_t *pInBuffer,
 }
 //}}}
 //{{{
+static uint32_t JPEG_MCU_Gray_ARGB_ConvertBlocks(uint8_t *pInBuffer,
+                                      uint8_t *pOutBuffer,
+                                      uint32_t BlockIndex,
+                                      uint32_t DataCount,
+                                      uint32_t *ConvertedDataCount)
+{
+  uint32_t numberMCU;
+  uint32_t i,j, currentMCU, xRef,yRef;
+
+  uint32_t refline;
+  int32_t ycomp;
+
+  uint8_t *pOutAddr;
+  uint8_t *pLum;
+
+  numberMCU = DataCount / GRAY_444_BLOCK_SIZE;
+  currentMCU = BlockIndex;
+
+  while(currentMCU < (numberMCU + BlockIndex))
+  {
+    xRef = ((currentMCU *8) / JPEG_ConvertorParams.WidthExtend)*8;
+
+    yRef = ((currentMCU *8) % JPEG_ConvertorParams.WidthExtend);
+
+    refline = JPEG_ConvertorParams.ScaledWidth * xRef + (JPEG_BYTES_PER_PIXEL*yRef);
+
+    currentMCU++;
+
+    pLum = pInBuffer;
+
+    for(i= 0; i <  8; i++)
+    {
+      if(refline < JPEG_ConvertorParams.ImageSize_Bytes)
+      {
+        pOutAddr = pOutBuffer + refline;
+
+        for(j=0; j < 8; j++)
+        {
+          ycomp = (int32_t)(*(pLum + j));
+
+#if (JPEG_RGB_FORMAT == JPEG_ARGB8888)
+
+          *(__IO uint32_t *)pOutAddr = 0xFF000000 | (ycomp << 16) | (ycomp << 8) | ycomp;
+
+#elif (JPEG_RGB_FORMAT == JPEG_RGB888)
+
+          pOutAddr[0] = ycomp;
+          pOutAddr[1] = ycomp;
+          pOutAddr[2] = ycomp;
+
+#elif (JPEG_RGB_FORMAT == JPEG_RGB565)
+
+          *(__IO uint16_t *)pOutAddr = ((ycomp >> 3) << 11) | ((ycomp >> 2) << 5) | (ycomp >> 3);
+
+#endif /* JPEG_RGB_FORMAT */
+
+          pOutAddr += JPEG_BYTES_PER_PIXEL;
+        }
+        pLum += 8;
+
+        refline += JPEG_ConvertorParams.ScaledWidth;
+      }
+    }
+
+    pInBuffer +=  GRAY_444_BLOCK_SIZE;
+  }
+  return numberMCU;
+}
+//}}}
+//{{{
 HAL_StatusTypeDef JPEG_GetDecodeColorConvertFunc(JPEG_ConfTypeDef *pJpegInfo, JPEG_YCbCrToRGB_Convert_Function *pFunction, uint32_t *ImageNbMCUs)
 {
   uint32_t hMCU, vMCU;
   JPEG_ConvertorParams.ColorSpace = pJpegInfo->ColorSpace;
   JPEG_ConvertorParams.ImageWidth = pJpegInfo->ImageWidth;
   JPEG_ConvertorParams.ImageHeight = pJpegInfo->ImageHeight;
-  JPEG_ConvertorParams.ImageSize_Bytes = pJpegInfo->ImageWidth * pJpegInfo->ImageHeight * JPEG_BYTES_PER_PIXEL;
 
   JPEG_ConvertorParams.ChromaSubsampling = pJpegInfo->ChromaSubsampling;
   if(JPEG_ConvertorParams.ColorSpace == JPEG_YCBCR_COLORSPACE) {
@@ -586,19 +663,11 @@ HAL_StatusTypeDef JPEG_GetDecodeColorConvertFunc(JPEG_ConfTypeDef *pJpegInfo, JP
     JPEG_ConvertorParams.H_factor = 8;
     JPEG_ConvertorParams.V_factor  = 8;
   }
-  else if(JPEG_ConvertorParams.ColorSpace == JPEG_CMYK_COLORSPACE) {
-    *pFunction =  JPEG_MCU_YCCK_ARGB_ConvertBlocks;
-    JPEG_ConvertorParams.LineOffset = JPEG_ConvertorParams.ImageWidth % 8;
-    if(JPEG_ConvertorParams.LineOffset != 0)
-      JPEG_ConvertorParams.LineOffset = 8 - JPEG_ConvertorParams.LineOffset;
-    JPEG_ConvertorParams.H_factor = 8;
-    JPEG_ConvertorParams.V_factor  = 8;
-  }
   else
-    return HAL_ERROR; /* Color space Not supported*/
+    return HAL_ERROR; /* Color space Not supported, no YCCK converter */
 
   JPEG_ConvertorParams.WidthExtend = JPEG_ConvertorParams.ImageWidth + JPEG_ConvertorParams.LineOffset;
-  JPEG_ConvertorParams.ScaledWidth = JPEG_BYTES_PER_PIXEL * JPEG_ConvertorParams.ImageWidth;
+  JPEG_ConvertorParams.ScaledWidth = JPEG_BYTES_PER_PIXEL * JPEG_ConvertorParams.WidthExtend;
 
   hMCU = (JPEG_ConvertorParams.ImageWidth / JPEG_ConvertorParams.H_factor);
   if((JPEG_ConvertorParams.ImageWidth % JPEG_ConvertorParams.H_factor) != 0)
@@ -610,10 +679,27 @@ HAL_StatusTypeDef JPEG_GetDecodeColorConvertFunc(JPEG_ConfTypeDef *pJpegInfo, JP
   JPEG_ConvertorParams.MCU_Total_Nb = (hMCU * vMCU);
   *ImageNbMCUs = JPEG_ConvertorParams.MCU_Total_Nb;
 
+  /* mcu padded lines, every row an mcu writes is inside the buffer */
+  JPEG_ConvertorParams.HeightExtend = vMCU * JPEG_ConvertorParams.V_factor;
+  JPEG_ConvertorParams.ImageSize_Bytes = JPEG_ConvertorParams.ScaledWidth * JPEG_ConvertorParams.HeightExtend;
+  JPEG_ConvertorParams.BlockSize = (JPEG_ConvertorParams.ColorSpace == JPEG_GRAYSCALE_COLORSPACE) ? GRAY_444_BLOCK_SIZE :
+                                   (JPEG_ConvertorParams.ChromaSubsampling == JPEG_420_SUBSAMPLING) ? YCBCR_420_BLOCK_SIZE :
+                                   (JPEG_ConvertorParams.ChromaSubsampling == JPEG_422_SUBSAMPLING) ? YCBCR_422_BLOCK_SIZE :
+                                                                                                     YCBCR_444_BLOCK_SIZE;
+
   return HAL_OK;
   }
 //}}}
 
+//{{{
+void JPEG_GetDecodeOutputSize (uint32_t* pWidth, uint32_t* pHeight, uint32_t* pMcuBytes) {
+
+  *pWidth = JPEG_ConvertorParams.WidthExtend;
+  *pHeight = JPEG_ConvertorParams.HeightExtend;
+  *pMcuBytes = JPEG_ConvertorParams.BlockSize;
+  }
+//}}}
+
 //{{{
 void JPEG_InitPostProcColorTables(void) {
 
@@ -0,0 +1,41 @@
+// jpeg_utils.h - jpeg hw decoder mcu stream to rgb converters
+#pragma once
+//{{{  includes
+#ifdef HOST_BUILD
+  #include "../host/host.h"
+#else
+  #include "stm32h7xx_hal.h"
+#endif
+//}}}
+//{{{
+#ifdef __cplusplus
+ extern "C" {
+#endif
+//}}}
+
+// output format, rgb565 tiles for cLcd
+#define JPEG_ARGB8888  0
+#define JPEG_RGB888    1
+#define JPEG_RGB565    2
+
+#define JPEG_RGB_FORMAT  JPEG_RGB565
+#define JPEG_SWAP_RB     0
+
+// convert DataCount bytes of whole mcus, starting at mcu BlockIndex, into pOutBuffer, return mcus converted
+typedef uint32_t (*JPEG_YCbCrToRGB_Convert_Function) (uint8_t* pInBuffer, uint8_t* pOutBuffer,
+                                                      uint32_t BlockIndex, uint32_t DataCount,
+                                                      uint32_t* ConvertedDataCount);
+
+void JPEG_InitPostProcColorTables();
+HAL_StatusTypeDef JPEG_GetDecodeColorConvertFunc (JPEG_ConfTypeDef* pJpegInfo,
+                                                  JPEG_YCbCrToRGB_Convert_Function* pFunction,
+                                                  uint32_t* ImageNbMCUs);
+
+// output buffer size, width and height rounded up to whole mcus, width is the line pitch
+void JPEG_GetDecodeOutputSize (uint32_t* pWidth, uint32_t* pHeight, uint32_t* pMcuBytes);
+
+//{{{
+#ifdef __cplusplus
+}
+#endif
+//}}}
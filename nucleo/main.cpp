@@ -13,6 +13,8 @@
 #include "cLcd.h"
 #include "sd.h"
 #include "jpeg.h"
+#include "cThumbCache.h"
+#include "cDecodeAhead.h"
 #include "lsm303c.h"
 
 #include "../fatFs/ff.h"
@@ -21,7 +23,11 @@ using namespace std;
 //}}}
 
 #define SW_JPEG
-#define SW_SCALE 4
+#define SW_DITHER true
+//#define SW_MERGED
+#define BROWSE_THUMBS
+#define DECODE_AHEAD_POOL 4
+//#define JPEG_BENCH 4
 #define FMC_PERIOD  FMC_SDRAM_CLOCK_PERIOD_2
 
 const string kHello = "largeLcd " + string(__TIME__) + " " + string(__DATE__);
@@ -37,9 +43,12 @@ cRtc* rtc = nullptr;
 
 vector<string> mFileVec;
 int gCount = 0;
+bool gHwJpeg = false;
 
 __IO bool gShow = false;
 __IO cTile* showTile[2] = { nullptr, nullptr };
+cDecodeAhead::sSlot* showSlot[2] = { nullptr, nullptr };
+cDecodeAhead* gDecodeAhead = nullptr;
 
 cTraceVec mTraceVec;
 int16_t la[3] = { 0 };
@@ -139,7 +148,14 @@ void uiThread (void* arg) {
 
   int count = 0;
   while (true) {
-    if (lcd->isChanged() || (count == 1000)) {
+    if (count == 1000) {
+      // clock tick, only clock and time text damaged
+      lcd->invalidate (cRect (int16_t(centre.x - radius - 1), int16_t(centre.y - radius - 1),
+                              int16_t(centre.x + radius + 1), int16_t(centre.y + radius + 1)));
+      lcd->invalidate (cRect (565,550, 1024,600));
+      }
+
+    if (lcd->isChanged()) {
       count = 0;
       lcd->start();
       lcd->clear (kBlack);
@@ -215,9 +231,73 @@ void uiThread (void* arg) {
   }
 //}}}
 //{{{
+void show (cDecodeAhead* decodeAhead, cDecodeAhead::sSlot* slot, cTile* tile) {
+// appThread, tile onto the hidden side and flip, what was there let go, a slot back to the decoder,
+// a browse thumbnail or a preview deleted
+// - the browse pass has no decodeAhead and no slots, only thumbnails
+
+  bool hide = !gShow;
+  auto hideSlot = showSlot[hide];
+  auto hideTile = showTile[hide];
+  showSlot[hide] = slot;
+  showTile[hide] = tile;
+  gShow = hide;
+  lcd->change();
+  if (hideSlot)
+    decodeAhead->release (hideSlot);
+  else
+    delete hideTile;
+  }
+//}}}
+//{{{
+bool previewWanted (void* context) {
+// decoder task, progressive scan done, appThread is stalled on this slide
+  return ((cDecodeAhead*)context)->isWaiting();
+  }
+//}}}
+//{{{
+void previewDecoded (cTile* tile, int scan, void* context) {
+// decoder task, hand the scan's tile to appThread
+  ((cDecodeAhead*)context)->preview (tile);
+  }
+//}}}
+//{{{
+void showPreview (cTile* tile, void* context) {
+// appThread, stalled in get, the latest scan of the slide being decoded
+// - held for a frame, uiThread is off the side just hidden before the next show deletes it
+
+  show ((cDecodeAhead*)context, nullptr, tile);
+  lcd->setTitle ("preview " + dec (tile->mWidth) + "x" + dec (tile->mHeight));
+  vTaskDelay (40);
+  }
+//}}}
+//{{{
+cTile* decodeSlide (const string& fileName, void* context) {
+// decoder task, full size hw decode or sw decode scaled to fit the show area
+// - progressive is sw, the hw decoder can't, its scans previewed while appThread waits on it
+
+  cPoint size (lcd->getWidth() - 20, lcd->getHeight() - 44);
+  bool progressive = jpegProgressive (fileName);
+  if (gHwJpeg && !progressive)
+    return hwJpegDecode (fileName, 0, 0, true);
+  return progressive ? swJpegDecodeProgressive (fileName, size, SW_DITHER, previewWanted, previewDecoded, gDecodeAhead)
+                     : swJpegDecode (fileName, size, SW_DITHER);
+  }
+//}}}
+//{{{
+bool updateThumbs (void* context) {
+// decoder task idle, pool full, rebuild missing or stale thumbnails 20ms at a time, true while there are more
+  return !((cThumbCache*)context)->update (mFileVec, 20);
+  }
+//}}}
+//{{{
 void appThread (void* arg) {
 
-  bool hwJpeg = BSP_PB_GetState (BUTTON_KEY) == 0;
+  gHwJpeg = BSP_PB_GetState (BUTTON_KEY) == 0;
+#ifdef SW_MERGED
+  // 4:2:0 and 4:2:2 sw decodes at 5/8 to 8/8 upsample and convert in one pass, not fancy
+  jpegMergedEnable (true);
+#endif
 
   char sdPath[4];
   if (FATFS_LinkDriver (&SD_Driver, sdPath) != 0) {
@@ -241,26 +321,63 @@ void appThread (void* arg) {
 
     findFiles ("", ".jpg");
     printf ("%d piccies\n", mFileVec.size());
+
+#ifdef JPEG_BENCH
+    // corpus then the first JPEG_BENCH card files, results over RTT
+    jpegBench (vector<string> (mFileVec.begin(), mFileVec.begin() + (mFileVec.size() < JPEG_BENCH ? mFileVec.size() : JPEG_BENCH)));
+#endif
     lcd->setTitle (string(label) + " " + dec (mFileVec.size()) + " piccies");
 
+    cThumbCache thumbCache ("thumbs.bin", cPoint (160,120), gHwJpeg, SW_DITHER);
+    thumbCache.open();
+
+#ifdef BROWSE_THUMBS
+    //{{{  browse pass, cached thumbnails, else exif thumbnails or 1/8 decodes, added to the cache
     for (auto fileName : mFileVec) {
       gCount++;
-      FILINFO filInfo;
-      if (f_stat (fileName.c_str(), &filInfo))
-        printf ("APP fstat fail\n");
+      auto startTime = HAL_GetTick();
 
-      printf ("APP decode %s size:%d time:%d date:%d\n",
-              fileName.c_str(), int(filInfo.fsize), filInfo.ftime, filInfo.fdate);
+      FILINFO filInfo;
+      cTile* tile = nullptr;
+      if (!f_stat (fileName.c_str(), &filInfo)) {
+        tile = thumbCache.get (fileName, filInfo);
+        if (!tile) {
+          tile = thumbJpegDecode (fileName, cPoint (160,120), gHwJpeg, SW_DITHER);
+          if (tile)
+            thumbCache.add (fileName, filInfo, tile);
+          }
+        }
+      show (nullptr, nullptr, tile);
 
+      if (tile)
+        lcd->setTitle (fileName + " thumb " + dec (tile->mWidth) + "x" + dec (tile->mHeight) + " " +
+                       dec (HAL_GetTick() - startTime) + "ms");
+      }
+    gCount = 0;
+    //}}}
+#endif
+
+    //{{{  slideshow, decoder task decodes ahead into the pool, this thread shows
+    // - two slots held, one on show, one just off it while uiThread may still draw it, the rest decode ahead
+    // - the decoder task owns FatFs until the end marker, this thread makes no FatFs calls meanwhile
+    // - progressive slides previewed scan by scan while this thread stalls on them
+    cDecodeAhead decodeAhead (mFileVec, DECODE_AHEAD_POOL, decodeSlide, updateThumbs, &thumbCache);
+    decodeAhead.setPreview (showPreview, &decodeAhead);
+    gDecodeAhead = &decodeAhead;
+    decodeAhead.start (3);
+
+    while (auto slot = decodeAhead.get()) {
+      gCount++;
       auto startTime = HAL_GetTick();
-      delete showTile[gShow];
-      showTile[gShow] = hwJpeg ? hwJpegDecode (fileName) : swJpegDecode (fileName, SW_SCALE);
-      gShow = !gShow;
-
-      if (showTile[gShow]) {
-        printf ("APP decoded - show:%d - took %d\n", gShow, HAL_GetTick() - startTime);
-        lcd->setTitle (fileName + " " +
-                       dec (showTile[gShow]->mWidth) + "x" + dec (showTile[gShow]->mHeight) + " " +
+      show (&decodeAhead, slot, slot->mTile);
+
+      auto& filInfo = slot->mInfo;
+      printf ("APP show %s size:%d time:%d date:%d decode:%d wait:%d queue:%d\n",
+              slot->mFileName.c_str(), int(filInfo.fsize), filInfo.ftime, filInfo.fdate,
+              slot->mDecodeTime, HAL_GetTick() - startTime, decodeAhead.getQueueDepth());
+      if (slot->mTile)
+        lcd->setTitle (slot->mFileName + " " +
+                       dec (slot->mTile->mWidth) + "x" + dec (slot->mTile->mHeight) + " " +
                        dec ((int)(filInfo.fsize) / 1000) + "k " +
                        dec (filInfo.ftime >> 11, 2, '0') + ":" +
                        dec ((filInfo.ftime >> 5) & 0x3F, 2, '0') + ":" +
@@ -268,10 +385,20 @@ void appThread (void* arg) {
                        dec (filInfo.fdate & 0x1F) + "." +
                        dec ((filInfo.fdate >> 5) & 0xF) + "." +
                        dec ((filInfo.fdate >> 9) + 1980) + " " +
-                       dec (HAL_GetTick() - startTime) + "ms");
-        vTaskDelay (100);
-        }
+                       dec (slot->mDecodeTime) + "ms q" + dec (decodeAhead.getQueueDepth()));
+
+      vTaskDelay (100);
       }
+
+    printf ("APP decodeAhead pool:%d decoded:%d %dms maxQueue:%d full stalls:%d %dms empty stalls:%d %dms"
+            " previews:%d first shown %dms\n",
+            decodeAhead.getPoolSize(), decodeAhead.getNumDecoded(), decodeAhead.getDecodeTime(),
+            decodeAhead.getMaxQueueDepth(), decodeAhead.getFullStalls(), decodeAhead.getFullStallTime(),
+            decodeAhead.getEmptyStalls(), decodeAhead.getEmptyStallTime(),
+            decodeAhead.getPreviews(), decodeAhead.getPreviewStallTime());
+    gDecodeAhead = nullptr;
+    jpegArenaReport();
+    //}}}
     //char stats [250];
     //vTaskList (stats);
     //printf ("%s", stats);
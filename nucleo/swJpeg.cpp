@@ -0,0 +1,1389 @@
+// swJpeg.cpp - libjpeg decode from FatFs straight into sdRam tiles
+//{{{  includes
+#include "jpeg.h"
+
+#include "cLcd.h" // for cTile
+
+#include "../fatFs/ff.h"
+#include "cmsis_os.h"
+
+// jpeg_color_deconverter, rgb565 converter replaces color_convert
+#define JPEG_INTERNALS
+#include "jpeglib.h"
+#include "jerror.h"
+#include "jpegSimd.h"
+
+using namespace std;
+//}}}
+//{{{  const
+// source buffer, whole sectors, FatFs reads them by dma straight into it, one multi block read per fill
+// - fills stay on 32k file offsets, inside one cluster of a 32k or larger cluster card
+const uint32_t kSourceBufferSize = 0x8000;
+
+// most rows libjpeg asks for per jpeg_read_scanlines, rec_outbuf_height is 1 or 2 in practice
+const int kMaxOutRows = 4;
+
+// largest dct scale, 8/8, no upscaling in the idct, cLcd::size does that
+const int kMaxScaleNum = 8;
+
+// ycc to rgb 16.16 fixed point, the jdcolor constants, undithered rgb565 is the rgb888 decode truncated
+const int kScaleBits = 16;
+const int32_t kOneHalf = 1 << (kScaleBits-1);
+
+// the same constants for the table free merged path, FIX (1.40200), FIX (1.77200), FIX (0.71414), FIX (0.34414)
+const int32_t kCrR = 91881;
+const int32_t kCbB = 116130;
+const int32_t kCrG = 46802;
+const int32_t kCbG = 22554;
+
+// ordered dither thresholds, as cLcd grad
+const uint8_t kBayer4[4][4] = { { 0,8,2,10 }, { 12,4,14,6 }, { 3,11,1,9 }, { 15,7,13,5 } };
+
+// parallel decode, workers are heap allocated jpeg objects, the host heap stands in for the target's sram,
+// two bands per worker so one slow band doesn't leave the others idle
+const int kMaxDecodeThreads = 8;
+const int kBandsPerThread = 2;
+const uint16_t kWorkerStackDepth = 4096;
+const UBaseType_t kWorkerPriority = 3;
+//}}}
+
+bool mMergedEnabled = false;
+
+//{{{  fatFs source manager
+//{{{
+struct sFatFsSource {
+  jpeg_source_mgr mPub;
+  FIL* mFile;
+  FSIZE_t mEnd;
+  JOCTET* mBuffer;
+  bool mStartOfFile;
+
+  // roi restart jump, header handed over before the file, file RSTn renumbered from RST0
+  const JOCTET* mPrefix;
+  size_t mPrefixSize;
+  uint8_t mRstBase;
+  bool mPrevFF;
+  };
+//}}}
+
+//{{{
+void initSource (j_decompress_ptr cinfo) {
+
+  auto source = (sFatFsSource*)cinfo->src;
+  source->mStartOfFile = true;
+  }
+//}}}
+//{{{
+boolean fillInputBuffer (j_decompress_ptr cinfo) {
+// file offset stays aligned, every f_read is whole sectors dma'd into mBuffer
+// - a read from an unaligned offset stops at the next buffer boundary, later ones are aligned
+// - reads stop at mEnd, the end of an exif thumbnail stream inside the file
+
+  auto source = (sFatFsSource*)cinfo->src;
+  if (source->mPrefix) {
+    source->mPub.next_input_byte = source->mPrefix;
+    source->mPub.bytes_in_buffer = source->mPrefixSize;
+    source->mPrefix = nullptr;
+    source->mStartOfFile = false;
+    return TRUE;
+    }
+
+  FSIZE_t position = f_tell (source->mFile);
+  FSIZE_t remaining = source->mEnd > position ? source->mEnd - position : 0;
+  FSIZE_t toBoundary = kSourceBufferSize - (position & (kSourceBufferSize - 1));
+  remaining = remaining < toBoundary ? remaining : toBoundary;
+  UINT bytesRead = 0;
+  f_read (source->mFile, source->mBuffer, UINT(remaining), &bytesRead);
+
+#ifndef HOST_BUILD
+  // mBuffer is in the jmemArena sdRam arena, write through, drop the lines cached before the sdmmc dma
+  SCB_InvalidateDCache_by_Addr ((uint32_t*)source->mBuffer, kSourceBufferSize);
+#endif
+
+  if (source->mRstBase)
+    for (UINT i = 0; i < bytesRead; i++) {
+      // FF Dn is always a marker in entropy coded data, FF 00 is a stuffed byte, FF FF fill
+      if (source->mPrevFF && ((source->mBuffer[i] & 0xF8) == 0xD0))
+        source->mBuffer[i] = 0xD0 | ((source->mBuffer[i] - source->mRstBase) & 7);
+      source->mPrevFF = source->mBuffer[i] == 0xFF;
+      }
+
+  if (!bytesRead) {
+    if (source->mStartOfFile)
+      ERREXIT (cinfo, JERR_INPUT_EMPTY);
+
+    // truncated file, insert fake EOI like jdatasrc
+    WARNMS (cinfo, JWRN_JPEG_EOF);
+    source->mBuffer[0] = (JOCTET)0xFF;
+    source->mBuffer[1] = (JOCTET)JPEG_EOI;
+    bytesRead = 2;
+    }
+
+  source->mPub.next_input_byte = source->mBuffer;
+  source->mPub.bytes_in_buffer = bytesRead;
+  source->mStartOfFile = false;
+  return TRUE;
+  }
+//}}}
+//{{{
+void skipInputData (j_decompress_ptr cinfo, long numBytes) {
+// big APPn markers, exif and thumbnails, seek past them rather than read through
+// - seek to the buffer boundary below the target, keeps later fills aligned
+
+  auto source = (sFatFsSource*)cinfo->src;
+  if (numBytes <= 0)
+    return;
+
+  if ((size_t)numBytes <= source->mPub.bytes_in_buffer) {
+    source->mPub.next_input_byte += numBytes;
+    source->mPub.bytes_in_buffer -= numBytes;
+    return;
+    }
+
+  FSIZE_t offset = f_tell (source->mFile) + (numBytes - source->mPub.bytes_in_buffer);
+  FSIZE_t alignedOffset = offset & ~FSIZE_t(kSourceBufferSize - 1);
+  f_lseek (source->mFile, alignedOffset);
+  fillInputBuffer (cinfo);
+
+  size_t skip = size_t(offset - alignedOffset);
+  if (skip < source->mPub.bytes_in_buffer) {
+    source->mPub.next_input_byte += skip;
+    source->mPub.bytes_in_buffer -= skip;
+    }
+  else // past the end, next fill inserts EOI
+    source->mPub.bytes_in_buffer = 0;
+  }
+//}}}
+//{{{
+void termSource (j_decompress_ptr cinfo) {
+  }
+//}}}
+
+//{{{
+void jpegFatFsSrc (j_decompress_ptr cinfo, FIL* file, FSIZE_t end) {
+// jpeg_stdio_src for FatFs, buffer from the libjpeg large pool, jmemArena sdRam the SDMMC idma reaches, 32 byte aligned
+
+  auto source = (sFatFsSource*)(*cinfo->mem->alloc_small) ((j_common_ptr)cinfo, JPOOL_PERMANENT, sizeof (sFatFsSource));
+  source->mBuffer = (JOCTET*)(*cinfo->mem->alloc_large) ((j_common_ptr)cinfo, JPOOL_PERMANENT, kSourceBufferSize);
+  source->mFile = file;
+  source->mEnd = end;
+  source->mPrefix = nullptr;
+  source->mPrefixSize = 0;
+  source->mRstBase = 0;
+  source->mPrevFF = false;
+
+  source->mPub.init_source = initSource;
+  source->mPub.fill_input_buffer = fillInputBuffer;
+  source->mPub.skip_input_data = skipInputData;
+  source->mPub.resync_to_restart = jpeg_resync_to_restart;
+  source->mPub.term_source = termSource;
+  source->mPub.bytes_in_buffer = 0;
+  source->mPub.next_input_byte = nullptr;
+
+  cinfo->src = &source->mPub;
+  }
+//}}}
+//}}}
+
+//{{{  memory source manager
+//{{{
+struct sMemorySource {
+// the file in memory, optionally after a restart jump header, nothing written, the workers share the file
+  jpeg_source_mgr mPub;
+  const JOCTET* mPrefix;
+  size_t mPrefixSize;
+  const JOCTET* mData;
+  size_t mSize;
+  };
+//}}}
+
+//{{{
+void memoryInitSource (j_decompress_ptr cinfo) {
+  }
+//}}}
+//{{{
+boolean memoryFillInputBuffer (j_decompress_ptr cinfo) {
+// prefix, then the data, then a fake EOI like jdatasrc
+
+  static const JOCTET kEoi[2] = { (JOCTET)0xFF, (JOCTET)JPEG_EOI };
+
+  auto source = (sMemorySource*)cinfo->src;
+  if (source->mPrefix) {
+    source->mPub.next_input_byte = source->mPrefix;
+    source->mPub.bytes_in_buffer = source->mPrefixSize;
+    source->mPrefix = nullptr;
+    }
+  else if (source->mData) {
+    source->mPub.next_input_byte = source->mData;
+    source->mPub.bytes_in_buffer = source->mSize;
+    source->mData = nullptr;
+    }
+  else {
+    WARNMS (cinfo, JWRN_JPEG_EOF);
+    source->mPub.next_input_byte = kEoi;
+    source->mPub.bytes_in_buffer = 2;
+    }
+
+  return TRUE;
+  }
+//}}}
+//{{{
+void memorySkipInputData (j_decompress_ptr cinfo, long numBytes) {
+
+  auto source = (sMemorySource*)cinfo->src;
+  while (numBytes > (long)source->mPub.bytes_in_buffer) {
+    if (!source->mPrefix && !source->mData) {
+      // past the end, next fill inserts EOI
+      source->mPub.bytes_in_buffer = 0;
+      return;
+      }
+    numBytes -= (long)source->mPub.bytes_in_buffer;
+    memoryFillInputBuffer (cinfo);
+    }
+
+  if (numBytes > 0) {
+    source->mPub.next_input_byte += numBytes;
+    source->mPub.bytes_in_buffer -= numBytes;
+    }
+  }
+//}}}
+
+//{{{
+void jpegMemorySrc (j_decompress_ptr cinfo, const JOCTET* prefix, size_t prefixSize, const JOCTET* data, size_t size) {
+// jpeg_mem_src with a restart jump header handed over before the data
+
+  auto source = (sMemorySource*)(*cinfo->mem->alloc_small) ((j_common_ptr)cinfo, JPOOL_PERMANENT, sizeof (sMemorySource));
+  source->mPrefix = prefix;
+  source->mPrefixSize = prefixSize;
+  source->mData = data;
+  source->mSize = size;
+
+  source->mPub.init_source = memoryInitSource;
+  source->mPub.fill_input_buffer = memoryFillInputBuffer;
+  source->mPub.skip_input_data = memorySkipInputData;
+  source->mPub.resync_to_restart = jpeg_resync_to_restart;
+  source->mPub.term_source = termSource;
+  source->mPub.bytes_in_buffer = 0;
+  source->mPub.next_input_byte = nullptr;
+
+  cinfo->src = &source->mPub;
+  }
+//}}}
+//}}}
+
+//{{{  rgb565 colour converter
+//{{{
+struct sRgb565Convert {
+  // ycc tables, MAXJSAMPLE+1 each, not for merged upsampling
+  int32_t* mCrR;
+  int32_t* mCbB;
+  int32_t* mCrG;
+  int32_t* mCbG;
+
+  uint8_t* mPiccy;
+  uint32_t mPitch;
+  bool mDither;
+
+  // roi, output columns converted to the start of the tile row, rows above it skipped
+  JDIMENSION mFirstCol;
+  JDIMENSION mLastCol;
+  bool mSkip;
+  };
+//}}}
+
+//{{{
+int32_t fix (double value) {
+  return (int32_t)(value * (1 << kScaleBits) + 0.5);
+  }
+//}}}
+//{{{
+void rowDither (sRgb565Convert* convert, JSAMPROW row, uint8_t* dither5, uint8_t* dither6) {
+// offsets below one 565 step, (2t+1)/32 of a step, by tile row, so the pattern is fixed to the image
+
+  uint32_t y = (uint32_t)(row - convert->mPiccy) / convert->mPitch;
+  const uint8_t* bayer = kBayer4[y & 3];
+  for (int x = 0; x < 4; x++) {
+    dither5[x] = convert->mDither ? ((2 * bayer[x]) + 1) >> 2 : 0;
+    dither6[x] = convert->mDither ? ((2 * bayer[x]) + 1) >> 3 : 0;
+    }
+  }
+//}}}
+
+//{{{
+void yccRgb565Convert (j_decompress_ptr cinfo, JSAMPIMAGE inputBuf, JDIMENSION inputRow, JSAMPARRAY outputBuf, int numRows) {
+// jdcolor ycc_rgb_convert, packed to rgb565 in the tile row, range_limit clamps the dithered value too
+// - jpegSimd row kernel if there is one, same pixels
+
+  auto convert = (sRgb565Convert*)cinfo->client_data;
+  JSAMPLE* rangeLimit = cinfo->sample_range_limit;
+
+  if (convert->mSkip)
+    return;
+
+  tYccRgb565Row yccRgb565 = jpegKernels()->mYccRgb565;
+  uint8_t dither5[4];
+  uint8_t dither6[4];
+  while (--numRows >= 0) {
+    JSAMPROW yRow = inputBuf[0][inputRow];
+    JSAMPROW cbRow = inputBuf[1][inputRow];
+    JSAMPROW crRow = inputBuf[2][inputRow];
+    inputRow++;
+
+    rowDither (convert, *outputBuf, dither5, dither6);
+    auto dst = (uint16_t*)*outputBuf++;
+    if (yccRgb565) {
+      // kernel dither phase starts at its first pixel
+      JDIMENSION first = convert->mFirstCol;
+      uint8_t rowDither5[4];
+      uint8_t rowDither6[4];
+      for (int i = 0; i < 4; i++) {
+        rowDither5[i] = dither5[(first + i) & 3];
+        rowDither6[i] = dither6[(first + i) & 3];
+        }
+      yccRgb565 (yRow + first, cbRow + first, crRow + first, dst, convert->mLastCol - first, rowDither5, rowDither6);
+      continue;
+      }
+
+    for (JDIMENSION x = convert->mFirstCol; x < convert->mLastCol; x++) {
+      int y = yRow[x];
+      int cb = cbRow[x];
+      int cr = crRow[x];
+      int d5 = dither5[x & 3];
+      uint32_t r = rangeLimit[y + convert->mCrR[cr] + d5];
+      uint32_t g = rangeLimit[y + ((convert->mCbG[cb] + convert->mCrG[cr]) >> kScaleBits) + dither6[x & 3]];
+      uint32_t b = rangeLimit[y + convert->mCbB[cb] + d5];
+      *dst++ = ((r & 0xF8) << 8) | ((g & 0xFC) << 3) | (b >> 3);
+      }
+    }
+  }
+//}}}
+//{{{
+void rgbRgb565Convert (j_decompress_ptr cinfo, JSAMPIMAGE inputBuf, JDIMENSION inputRow, JSAMPARRAY outputBuf, int numRows) {
+// untransformed adobe rgb, components in r,g,b order
+
+  auto convert = (sRgb565Convert*)cinfo->client_data;
+  JSAMPLE* rangeLimit = cinfo->sample_range_limit;
+
+  if (convert->mSkip)
+    return;
+
+  uint8_t dither5[4];
+  uint8_t dither6[4];
+  while (--numRows >= 0) {
+    JSAMPROW rRow = inputBuf[0][inputRow];
+    JSAMPROW gRow = inputBuf[1][inputRow];
+    JSAMPROW bRow = inputBuf[2][inputRow];
+    inputRow++;
+
+    rowDither (convert, *outputBuf, dither5, dither6);
+    auto dst = (uint16_t*)*outputBuf++;
+    for (JDIMENSION x = convert->mFirstCol; x < convert->mLastCol; x++) {
+      int d5 = dither5[x & 3];
+      uint32_t r = rangeLimit[rRow[x] + d5];
+      uint32_t g = rangeLimit[gRow[x] + dither6[x & 3]];
+      uint32_t b = rangeLimit[bRow[x] + d5];
+      *dst++ = ((r & 0xF8) << 8) | ((g & 0xFC) << 3) | (b >> 3);
+      }
+    }
+  }
+//}}}
+//{{{
+void grayRgb565Convert (j_decompress_ptr cinfo, JSAMPIMAGE inputBuf, JDIMENSION inputRow, JSAMPARRAY outputBuf, int numRows) {
+
+  auto convert = (sRgb565Convert*)cinfo->client_data;
+  JSAMPLE* rangeLimit = cinfo->sample_range_limit;
+
+  if (convert->mSkip)
+    return;
+
+  uint8_t dither5[4];
+  uint8_t dither6[4];
+  while (--numRows >= 0) {
+    JSAMPROW yRow = inputBuf[0][inputRow++];
+
+    rowDither (convert, *outputBuf, dither5, dither6);
+    auto dst = (uint16_t*)*outputBuf++;
+    for (JDIMENSION x = convert->mFirstCol; x < convert->mLastCol; x++) {
+      uint32_t rb = rangeLimit[yRow[x] + dither5[x & 3]];
+      uint32_t g = rangeLimit[yRow[x] + dither6[x & 3]];
+      *dst++ = ((rb & 0xF8) << 8) | ((g & 0xFC) << 3) | (rb >> 3);
+      }
+    }
+  }
+//}}}
+
+//{{{  merged upsampling
+//{{{
+struct sMergedRgb565 {
+// jdmerge's upsampler, h2v1 and h2v2, upsample and colour convert in one, straight to rgb565
+// - a row group's second row waits, its input kept, when the caller has room for one row, no spare row
+  jpeg_upsampler mPub;
+  JDIMENSION mRowsToGo;
+  int mGroupRow;
+  };
+//}}}
+
+//{{{
+inline uint32_t clamp8 (int32_t value) {
+  return value < 0 ? 0 : value > MAXJSAMPLE ? MAXJSAMPLE : value;
+  }
+//}}}
+//{{{
+inline uint16_t packRgb565 (int32_t y, int32_t red, int32_t green, int32_t blue, int32_t d5, int32_t d6) {
+  return uint16_t(((clamp8 (y + red + d5) & 0xF8) << 8) | ((clamp8 (y + green + d6) & 0xFC) << 3) |
+                  (clamp8 (y + blue + d5) >> 3));
+  }
+//}}}
+//{{{
+inline void mergedChroma (int32_t cb, int32_t cr, int32_t& red, int32_t& green, int32_t& blue) {
+
+  cb -= CENTERJSAMPLE;
+  cr -= CENTERJSAMPLE;
+  red = ((kCrR * cr) + kOneHalf) >> kScaleBits;
+  green = ((-kCbG * cb) - (kCrG * cr) + kOneHalf) >> kScaleBits;
+  blue = ((kCbB * cb) + kOneHalf) >> kScaleBits;
+  }
+//}}}
+//{{{
+void mergedRow (sRgb565Convert* convert, JSAMPROW yRow0, JSAMPROW yRow1, JSAMPROW cbRow, JSAMPROW crRow,
+                JSAMPROW dstRow0, JSAMPROW dstRow1) {
+// one chroma row into one or two output rows, each chroma sample's terms once for its 2 or 4 pixels
+// - jdmerge's fixed point, multiplies rather than its tables, a compare clamp rather than range_limit,
+//   dither added before the clamp as yccRgb565Convert, so the same pixels as jdmerge's rgb888 dithered and packed
+// - odd first column, or odd last, a single pixel with its pair's chroma, the pairs between without a test
+
+  uint8_t dither5[2][4];
+  uint8_t dither6[2][4];
+  rowDither (convert, dstRow0, dither5[0], dither6[0]);
+  if (dstRow1)
+    rowDither (convert, dstRow1, dither5[1], dither6[1]);
+
+  auto dst0 = (uint16_t*)dstRow0;
+  auto dst1 = (uint16_t*)dstRow1;
+  JDIMENSION x = convert->mFirstCol;
+  JDIMENSION lastPair = convert->mLastCol & ~1;
+  int32_t red;
+  int32_t green;
+  int32_t blue;
+
+  if (x & 1) {
+    mergedChroma (cbRow[x >> 1], crRow[x >> 1], red, green, blue);
+    *dst0++ = packRgb565 (yRow0[x], red, green, blue, dither5[0][x & 3], dither6[0][x & 3]);
+    if (dst1)
+      *dst1++ = packRgb565 (yRow1[x], red, green, blue, dither5[1][x & 3], dither6[1][x & 3]);
+    x++;
+    }
+
+  for (; x < lastPair; x += 2) {
+    mergedChroma (cbRow[x >> 1], crRow[x >> 1], red, green, blue);
+    int i = x & 3;
+    dst0[0] = packRgb565 (yRow0[x], red, green, blue, dither5[0][i], dither6[0][i]);
+    dst0[1] = packRgb565 (yRow0[x+1], red, green, blue, dither5[0][i+1], dither6[0][i+1]);
+    dst0 += 2;
+    if (dst1) {
+      dst1[0] = packRgb565 (yRow1[x], red, green, blue, dither5[1][i], dither6[1][i]);
+      dst1[1] = packRgb565 (yRow1[x+1], red, green, blue, dither5[1][i+1], dither6[1][i+1]);
+      dst1 += 2;
+      }
+    }
+
+  if (x < convert->mLastCol) {
+    mergedChroma (cbRow[x >> 1], crRow[x >> 1], red, green, blue);
+    *dst0 = packRgb565 (yRow0[x], red, green, blue, dither5[0][x & 3], dither6[0][x & 3]);
+    if (dst1)
+      *dst1 = packRgb565 (yRow1[x], red, green, blue, dither5[1][x & 3], dither6[1][x & 3]);
+    }
+  }
+//}}}
+
+//{{{
+void mergedStartPass (j_decompress_ptr cinfo) {
+
+  auto merged = (sMergedRgb565*)cinfo->upsample;
+  merged->mRowsToGo = cinfo->output_height;
+  merged->mGroupRow = 0;
+  }
+//}}}
+//{{{
+void mergedUpsample (j_decompress_ptr cinfo, JSAMPIMAGE inputBuf, JDIMENSION* inRowGroupCtr,
+                     JDIMENSION inRowGroupsAvail, JSAMPARRAY outputBuf, JDIMENSION* outRowCtr, JDIMENSION outRowsAvail) {
+// a row group is max_v_samp_factor luma rows and their chroma row, as many of its rows as there is room for
+
+  auto merged = (sMergedRgb565*)cinfo->upsample;
+  auto convert = (sRgb565Convert*)cinfo->client_data;
+
+  int groupRows = cinfo->max_v_samp_factor;
+  JDIMENSION numRows = groupRows - merged->mGroupRow;
+  numRows = numRows > merged->mRowsToGo ? merged->mRowsToGo : numRows;
+  numRows = numRows > outRowsAvail - *outRowCtr ? outRowsAvail - *outRowCtr : numRows;
+
+  if (!convert->mSkip) {
+    JDIMENSION yRow = (*inRowGroupCtr * groupRows) + merged->mGroupRow;
+    bool pair = numRows > 1;
+    mergedRow (convert, inputBuf[0][yRow], pair ? inputBuf[0][yRow + 1] : nullptr,
+               inputBuf[1][*inRowGroupCtr], inputBuf[2][*inRowGroupCtr],
+               outputBuf[*outRowCtr], pair ? outputBuf[*outRowCtr + 1] : nullptr);
+    }
+
+  *outRowCtr += numRows;
+  merged->mRowsToGo -= numRows;
+  merged->mGroupRow += numRows;
+  if ((merged->mGroupRow == groupRows) || !merged->mRowsToGo) {
+    merged->mGroupRow = 0;
+    (*inRowGroupCtr)++;
+    }
+  }
+//}}}
+
+//{{{
+void mergedRgb565 (j_decompress_ptr cinfo) {
+// replace jdmerge's upsampler, its pass already started, so start ours
+// - no quantizer, the post controller passes through, its start_pass took the upsample method, take ours instead
+
+  auto merged = (sMergedRgb565*)(*cinfo->mem->alloc_small) ((j_common_ptr)cinfo, JPOOL_IMAGE, sizeof (sMergedRgb565));
+  merged->mPub.start_pass = mergedStartPass;
+  merged->mPub.upsample = mergedUpsample;
+  merged->mPub.need_context_rows = FALSE;
+  cinfo->upsample = &merged->mPub;
+  cinfo->post->post_process_data = mergedUpsample;
+  mergedStartPass (cinfo);
+  }
+//}}}
+
+//{{{
+bool jpegMergedEnable (bool enable) {
+// merged upsampling for the decodes that follow, returns the previous setting
+
+  bool enabled = mMergedEnabled;
+  mMergedEnabled = enable;
+  return enabled;
+  }
+//}}}
+//{{{
+bool jpegMerged (j_decompress_ptr cinfo) {
+// before jpeg_start_decompress, scale and out_color_space set, merged upsampling if enabled and jdmerge can,
+// use_merged_upsample's test
+// - 2h1v or 2h2v ycc, box filtered chroma, an 8x8 idct for it where fancy upsampling scales the chroma idct up
+//   to 16x8 or 16x16 at 8/8, 7/8 to 5/8 the same
+// - 4/8 and below the chroma idct is scaled up either way, nothing to merge, fancy stays on
+
+  if (!mMergedEnabled || (cinfo->jpeg_color_space != JCS_YCbCr) || (cinfo->num_components != 3) ||
+      (cinfo->out_color_space != JCS_RGB))
+    return false;
+
+  cinfo->do_fancy_upsampling = FALSE;
+  jpeg_calc_output_dimensions (cinfo);
+
+  auto comp = cinfo->comp_info;
+  bool merged = (comp[0].h_samp_factor == 2) && (comp[1].h_samp_factor == 1) && (comp[2].h_samp_factor == 1) &&
+                (comp[0].v_samp_factor <= 2) && (comp[1].v_samp_factor == 1) && (comp[2].v_samp_factor == 1) &&
+                !cinfo->CCIR601_sampling;
+  for (int ci = 0; ci < 3; ci++)
+    merged &= (comp[ci].DCT_h_scaled_size == cinfo->min_DCT_h_scaled_size) &&
+              (comp[ci].DCT_v_scaled_size == cinfo->min_DCT_v_scaled_size);
+
+  cinfo->do_fancy_upsampling = merged ? FALSE : TRUE;
+  return merged;
+  }
+//}}}
+//}}}
+//{{{
+bool jpegRgb565 (j_decompress_ptr cinfo, uint8_t* piccy, uint32_t pitch, bool dither) {
+// after jpeg_start_decompress, swap libjpeg's rgb888 color_convert for one writing rgb565 tile rows
+// - fancy upsampling unless jpegMerged turned it off, then jdmerge's upsampler is swapped instead
+// - no quantizer or post buffer, the upsampler hands the caller's rows straight to color_convert
+
+  auto convert = (sRgb565Convert*)(*cinfo->mem->alloc_small) ((j_common_ptr)cinfo, JPOOL_IMAGE, sizeof (sRgb565Convert));
+  convert->mPiccy = piccy;
+  convert->mPitch = pitch;
+  convert->mDither = dither;
+  convert->mFirstCol = 0;
+  convert->mLastCol = cinfo->output_width;
+  convert->mSkip = false;
+  cinfo->client_data = convert;
+
+  if (!cinfo->cconvert) {
+    // jpegMerged turned fancy upsampling off and libjpeg chose jdmerge, no colour converter, swap its upsampler
+    mergedRgb565 (cinfo);
+    return true;
+    }
+
+  switch (cinfo->jpeg_color_space) {
+    case JCS_YCbCr: {
+      auto tables = (int32_t*)(*cinfo->mem->alloc_small) ((j_common_ptr)cinfo, JPOOL_IMAGE,
+                                                           4 * (MAXJSAMPLE+1) * sizeof (int32_t));
+      convert->mCrR = tables;
+      convert->mCbB = tables + (MAXJSAMPLE+1);
+      convert->mCrG = tables + (2 * (MAXJSAMPLE+1));
+      convert->mCbG = tables + (3 * (MAXJSAMPLE+1));
+      for (int i = 0, x = -CENTERJSAMPLE; i <= MAXJSAMPLE; i++, x++) {
+        convert->mCrR[i] = (fix (1.40200) * x + kOneHalf) >> kScaleBits;
+        convert->mCbB[i] = (fix (1.77200) * x + kOneHalf) >> kScaleBits;
+        convert->mCrG[i] = -fix (0.71414) * x;
+        convert->mCbG[i] = -fix (0.34414) * x + kOneHalf;
+        }
+      cinfo->cconvert->color_convert = yccRgb565Convert;
+      return true;
+      }
+
+    case JCS_RGB:
+      cinfo->cconvert->color_convert = rgbRgb565Convert;
+      return true;
+
+    case JCS_GRAYSCALE:
+      cinfo->cconvert->color_convert = grayRgb565Convert;
+      return true;
+
+    default:
+      return false;
+    }
+  }
+//}}}
+//{{{
+void readRgb565 (j_decompress_ptr cinfo, uint8_t* piccy, uint32_t pitch) {
+// the output pass, rec_outbuf_height rows at a time, into the tile rows
+
+  JSAMPROW rows[kMaxOutRows];
+  while (cinfo->output_scanline < cinfo->output_height) {
+    int numRows = cinfo->output_height - cinfo->output_scanline;
+    numRows = numRows > cinfo->rec_outbuf_height ? cinfo->rec_outbuf_height : numRows;
+    numRows = numRows > kMaxOutRows ? kMaxOutRows : numRows;
+    for (int row = 0; row < numRows; row++)
+      rows[row] = piccy + ((cinfo->output_scanline + row) * pitch);
+    jpeg_read_scanlines (cinfo, rows, numRows);
+    }
+  }
+//}}}
+//}}}
+//{{{  roi idct
+//{{{
+struct sRoiIdct {
+  jpeg_inverse_dct mPub;
+  inverse_DCT_method_ptr mIdct[MAX_COMPONENTS];
+  JDIMENSION mFirstBlock[MAX_COMPONENTS];
+  JDIMENSION mLastBlock[MAX_COMPONENTS];
+  JDIMENSION mFirstRow;
+  };
+//}}}
+
+//{{{
+void roiIdct (j_decompress_ptr cinfo, jpeg_component_info* compptr, JCOEFPTR coefBlock,
+              JSAMPARRAY outputBuf, JDIMENSION outputCol) {
+// the block is entropy decoded, idct it only if the roi or its upsampling context uses it
+
+  auto roi = (sRoiIdct*)cinfo->idct;
+  int ci = compptr->component_index;
+  JDIMENSION block = outputCol / compptr->DCT_h_scaled_size;
+  if ((cinfo->output_iMCU_row >= roi->mFirstRow) && (block >= roi->mFirstBlock[ci]) && (block <= roi->mLastBlock[ci]))
+    (*roi->mIdct[ci]) (cinfo, compptr, coefBlock, outputBuf, outputCol);
+  }
+//}}}
+//{{{
+void jpegRoiIdct (j_decompress_ptr cinfo, JDIMENSION left, JDIMENSION right, JDIMENSION top) {
+// after jpeg_start_decompress, wrap the idct methods its start_pass chose, roi columns left..right, rows from top
+// - a block and an iMCU row of margin, fancy upsampling reads the neighbouring samples
+
+  auto roi = (sRoiIdct*)(*cinfo->mem->alloc_small) ((j_common_ptr)cinfo, JPOOL_IMAGE, sizeof (sRoiIdct));
+  roi->mPub = *cinfo->idct;
+
+  roi->mFirstRow = top / (cinfo->max_v_samp_factor * DCTSIZE);
+  roi->mFirstRow = roi->mFirstRow ? roi->mFirstRow - 1 : 0;
+
+  for (int ci = 0; ci < cinfo->num_components; ci++) {
+    auto compptr = &cinfo->comp_info[ci];
+    JDIMENSION first = (left * compptr->h_samp_factor) / (cinfo->max_h_samp_factor * DCTSIZE);
+    JDIMENSION last = ((right - 1) * compptr->h_samp_factor) / (cinfo->max_h_samp_factor * DCTSIZE);
+    roi->mFirstBlock[ci] = first ? first - 1 : 0;
+    roi->mLastBlock[ci] = last + 1;
+    roi->mIdct[ci] = cinfo->idct->inverse_DCT[ci];
+    roi->mPub.inverse_DCT[ci] = roiIdct;
+    }
+
+  cinfo->idct = &roi->mPub;
+  }
+//}}}
+//}}}
+//{{{
+int jpegScale (j_decompress_ptr cinfo, uint32_t width, uint32_t height, const cPoint& size) {
+// smallest scale_num/8 whose output covers width x height, the image or a roi, fitted inside size,
+// libjpeg's scaled idcts do the rest
+// - output is ceil (image * num / 8), as jpeg_calc_output_dimensions
+
+  uint32_t fitWidth = size.x;
+  uint32_t fitHeight = size.y;
+  if (width * fitHeight > height * fitWidth)
+    fitHeight = (height * fitWidth) / width;
+  else
+    fitWidth = (width * fitHeight) / height;
+
+  int num = 1;
+  while ((num < kMaxScaleNum) && ((((width * num) + 7) / 8 < fitWidth) || (((height * num) + 7) / 8 < fitHeight)))
+    num++;
+
+  cinfo->scale_num = num;
+  cinfo->scale_denom = 8;
+  return num;
+  }
+//}}}
+
+//{{{  parallel decode
+//{{{
+struct sJpegBand {
+// mcu rows mFirstRow..mLastRow, decoded from mStartRow, an interval of upsampling context above mFirstRow
+// - mOffset 0 is the whole file from its SOI, else a restart jump, as swJpegDecodeRoi
+  uint16_t mStartRow;
+  uint16_t mFirstRow;
+  uint16_t mLastRow;
+  uint8_t mRstNum;
+  uint32_t mOffset;
+  };
+//}}}
+//{{{
+struct sJpegParallel {
+  const sJpegIndex* mIndex;
+  const uint8_t* mFile;
+  uint32_t mFileSize;
+
+  int mScale;
+  bool mDither;
+  uint8_t* mPiccy;
+  uint32_t mPitch;
+  JDIMENSION mOutputHeight;
+
+  QueueHandle_t mBandQueue;
+  QueueHandle_t mDoneQueue;
+  };
+//}}}
+
+//{{{
+void decodeBand (sJpegParallel* parallel, const sJpegBand& band) {
+// own jpeg object, entropy state and source, writes only the tile rows of its band
+// - rows from mStartRow to mFirstRow are decoded for their context, not converted
+// - stops after mLastRow, destroy aborts the rest
+
+  auto index = parallel->mIndex;
+
+  struct jpeg_error_mgr jerr;
+  struct jpeg_decompress_struct cinfo;
+  cinfo.err = jpeg_std_error (&jerr);
+  jpeg_create_decompress (&cinfo);
+
+  if (band.mOffset) {
+    uint32_t height = index->mHeight - (band.mStartRow * index->mMcuHeight);
+    auto header = (JOCTET*)(*cinfo.mem->alloc_small) ((j_common_ptr)&cinfo, JPOOL_PERMANENT, index->mHeader.size());
+    memcpy (header, index->mHeader.data(), index->mHeader.size());
+    header[index->mSofHeight] = uint8_t(height >> 8);
+    header[index->mSofHeight + 1] = uint8_t(height);
+    jpegMemorySrc (&cinfo, header, index->mHeader.size(),
+                   parallel->mFile + band.mOffset, parallel->mFileSize - band.mOffset);
+    }
+  else
+    jpegMemorySrc (&cinfo, nullptr, 0, parallel->mFile, parallel->mFileSize);
+
+  jpeg_read_header (&cinfo, TRUE);
+  if (band.mOffset)
+    // the file's RSTn as they are, expected from the jump's, rather than renumbered in a shared buffer
+    cinfo.marker->next_restart_num = band.mRstNum;
+
+  cinfo.scale_num = parallel->mScale;
+  cinfo.scale_denom = 8;
+  cinfo.dct_method = JDCT_ISLOW;
+  cinfo.out_color_space = JCS_RGB;
+  jpegMerged (&cinfo);
+  jpeg_start_decompress (&cinfo);
+  jpegSimdIdct (&cinfo);
+  jpegRgb565 (&cinfo, parallel->mPiccy, parallel->mPitch, parallel->mDither);
+  auto convert = (sRgb565Convert*)cinfo.client_data;
+
+  // tile rows, an mcu row is mMcuHeight * scale / 8 output rows, whole at every scale
+  JDIMENSION skipRows = (band.mStartRow * index->mMcuHeight * parallel->mScale) / 8;
+  JDIMENSION firstRow = (band.mFirstRow * index->mMcuHeight * parallel->mScale) / 8;
+  JDIMENSION lastRow = ((band.mLastRow + 1) * index->mMcuHeight * parallel->mScale) / 8;
+  lastRow = lastRow < parallel->mOutputHeight ? lastRow : parallel->mOutputHeight;
+
+  JSAMPROW rows[kMaxOutRows];
+  while (cinfo.output_scanline + skipRows < lastRow) {
+    // batches stay above or inside the band
+    JDIMENSION row = cinfo.output_scanline + skipRows;
+    convert->mSkip = row < firstRow;
+    int numRows = (convert->mSkip ? firstRow : lastRow) - row;
+    numRows = numRows > cinfo.rec_outbuf_height ? cinfo.rec_outbuf_height : numRows;
+    numRows = numRows > kMaxOutRows ? kMaxOutRows : numRows;
+    for (int i = 0; i < numRows; i++)
+      rows[i] = parallel->mPiccy + (convert->mSkip ? 0 : (row + i) * parallel->mPitch);
+    jpeg_read_scanlines (&cinfo, rows, numRows);
+    }
+
+  jpeg_destroy_decompress (&cinfo);
+  }
+//}}}
+//{{{
+void decodeWorker (void* arg) {
+// takes bands until there are none left, then says so on the done queue
+
+  auto parallel = (sJpegParallel*)arg;
+
+  sJpegBand band;
+  while (xQueueReceive (parallel->mBandQueue, &band, 0))
+    decodeBand (parallel, band);
+
+  int done = 1;
+  xQueueSend (parallel->mDoneQueue, &done, portMAX_DELAY);
+  vTaskDelete (nullptr);
+  }
+//}}}
+//}}}
+
+// interface
+//{{{
+cTile* swJpegDecode (const string& fileName, const cPoint& size, bool dither, uint32_t offset, uint32_t length) {
+// decode at the dct scale covering size, rgb565 straight into the tile rows, no line buffer copy or repack
+// - length 0 is the whole file, else decode the length byte jpeg stream at offset in it
+
+  cTile* tile = nullptr;
+
+  FIL* file = (FIL*)pvPortMalloc (sizeof (FIL));
+  if (f_open (file, fileName.c_str(), FA_READ))
+    printf ("swJpegDecode %s open fail\n", fileName.c_str());
+  else {
+    printf ("swJpegDecode %s start decoding\n", fileName.c_str());
+    uint32_t startTime = HAL_GetTick();
+
+    struct jpeg_error_mgr jerr;
+    struct jpeg_decompress_struct mCinfo;
+    mCinfo.err = jpeg_std_error (&jerr);
+    jpeg_create_decompress (&mCinfo);
+
+    f_lseek (file, offset);
+    jpegFatFsSrc (&mCinfo, file, length ? offset + length : f_size (file));
+    jpeg_read_header (&mCinfo, TRUE);
+
+    if ((mCinfo.jpeg_color_space != JCS_YCbCr) && (mCinfo.jpeg_color_space != JCS_RGB) &&
+        (mCinfo.jpeg_color_space != JCS_GRAYSCALE))
+      printf ("swJpegDecode %s colour space %d unsupported\n", fileName.c_str(), mCinfo.jpeg_color_space);
+    else {
+      int scale = jpegScale (&mCinfo, mCinfo.image_width, mCinfo.image_height, size);
+      mCinfo.dct_method = JDCT_ISLOW;
+      mCinfo.out_color_space = JCS_RGB;
+      jpegMerged (&mCinfo);
+      jpeg_start_decompress (&mCinfo);
+      jpegSimdIdct (&mCinfo);
+
+      uint32_t pitch = mCinfo.output_width * 2;
+      auto rgb565Pic = (uint8_t*)sdRamAlloc (pitch * mCinfo.output_height, "swJpegPic565");
+      if (rgb565Pic) {
+        tile = new cTile (rgb565Pic, cTile::eRgb565, mCinfo.output_width, 0,0, mCinfo.output_width, mCinfo.output_height);
+        jpegRgb565 (&mCinfo, rgb565Pic, pitch, dither);
+
+        readRgb565 (&mCinfo, rgb565Pic, pitch);
+        jpeg_finish_decompress (&mCinfo);
+        printf ("swJpegDecode %dx%d scale %d/8 took %dms\n",
+                mCinfo.output_width, mCinfo.output_height, scale, HAL_GetTick() - startTime);
+        }
+      else
+        // finish would error on the unread scanlines, destroy aborts
+        printf ("swJpegDecode %s rgb565pic alloc fail\n", fileName.c_str());
+      }
+
+    jpeg_destroy_decompress (&mCinfo);
+    f_close (file);
+    }
+  vPortFree (file);
+
+  return tile;
+  }
+//}}}
+//{{{
+cTile* swJpegDecodeProgressive (const string& fileName, const cPoint& size, bool dither,
+                                tJpegPreviewWanted wanted, tJpegPreview preview, void* context) {
+// buffered image decode of a progressive file, completed scans shown as they arrive, as swJpegDecode otherwise
+// - each preview is an output pass, idct, upsample and rgb565 of the coefficients so far, into its own tile,
+//   handed to preview, smoothed by libjpeg's block smoothing while the ac bands are missing
+// - wanted is asked once a completed scan is followed by another, the first scan gets its pass, later ones only once
+//   the input since the last pass took as long as that pass took, preview work stays below the decode's own
+// - the last scan's pass is the final one, after EOI
+// - every coefficient is complete by then, no smoothing, the returned tile is swJpegDecode's pixels
+// - the coefficient buffer is the whole image, as any multi scan decode, 128 bytes a block, from jmemArena
+
+  cTile* tile = nullptr;
+
+  FIL* file = (FIL*)pvPortMalloc (sizeof (FIL));
+  if (f_open (file, fileName.c_str(), FA_READ)) {
+    printf ("swJpegDecodeProgressive %s open fail\n", fileName.c_str());
+    vPortFree (file);
+    return nullptr;
+    }
+
+  uint32_t startTime = HAL_GetTick();
+
+  struct jpeg_error_mgr jerr;
+  struct jpeg_decompress_struct mCinfo;
+  mCinfo.err = jpeg_std_error (&jerr);
+  jpeg_create_decompress (&mCinfo);
+  jpegFatFsSrc (&mCinfo, file, f_size (file));
+  jpeg_read_header (&mCinfo, TRUE);
+
+  bool progressive = jpeg_has_multiple_scans (&mCinfo) &&
+                     ((mCinfo.jpeg_color_space == JCS_YCbCr) || (mCinfo.jpeg_color_space == JCS_RGB) ||
+                      (mCinfo.jpeg_color_space == JCS_GRAYSCALE));
+  if (progressive) {
+    printf ("swJpegDecodeProgressive %s start decoding\n", fileName.c_str());
+    int scale = jpegScale (&mCinfo, mCinfo.image_width, mCinfo.image_height, size);
+    mCinfo.dct_method = JDCT_ISLOW;
+    mCinfo.out_color_space = JCS_RGB;
+    jpegMerged (&mCinfo);
+    mCinfo.buffered_image = TRUE;
+    jpeg_start_decompress (&mCinfo);
+
+    uint32_t pitch = mCinfo.output_width * 2;
+    jpegRgb565 (&mCinfo, nullptr, pitch, dither);
+    auto convert = (sRgb565Convert*)mCinfo.client_data;
+
+    int numPreviews = 0;
+    uint32_t firstPreviewTime = 0;
+    uint32_t passTime = 0;
+    uint32_t inputTime = HAL_GetTick();
+
+    int result;
+    do {
+      result = jpeg_consume_input (&mCinfo);
+      bool last = result == JPEG_REACHED_EOI;
+      // SOS of the next scan, the one before it is complete, output it without consuming the new one
+      if (last ||
+          ((result == JPEG_REACHED_SOS) && wanted && wanted (context) &&
+           (!numPreviews || (HAL_GetTick() - inputTime >= passTime)))) {
+        uint32_t passStart = HAL_GetTick();
+        auto rgb565Pic = (uint8_t*)sdRamAlloc (pitch * mCinfo.output_height, last ? "swJpegPic565" : "swJpegPreview565");
+        if (!rgb565Pic) {
+          // finish would error on the unread scanlines, destroy aborts
+          printf ("swJpegDecodeProgressive %s rgb565pic alloc fail\n", fileName.c_str());
+          break;
+          }
+
+        jpeg_start_output (&mCinfo, last ? mCinfo.input_scan_number : mCinfo.input_scan_number - 1);
+        // its idct start_pass chose the libjpeg routines again
+        jpegSimdIdct (&mCinfo);
+        convert->mPiccy = rgb565Pic;
+        readRgb565 (&mCinfo, rgb565Pic, pitch);
+        jpeg_finish_output (&mCinfo);
+
+        auto passTile = new cTile (rgb565Pic, cTile::eRgb565, mCinfo.output_width, 0,0,
+                                   mCinfo.output_width, mCinfo.output_height);
+        passTime = HAL_GetTick() - passStart;
+        if (last)
+          tile = passTile;
+        else {
+          firstPreviewTime = numPreviews++ ? firstPreviewTime : HAL_GetTick() - startTime;
+          preview (passTile, mCinfo.output_scan_number, context);
+          }
+        inputTime = HAL_GetTick();
+        }
+      } while ((result != JPEG_REACHED_EOI) && (result != JPEG_SUSPENDED));
+
+    if (tile) {
+      jpeg_finish_decompress (&mCinfo);
+      printf ("swJpegDecodeProgressive %dx%d scale %d/8 %d scans %d previews first %dms took %dms\n",
+              mCinfo.output_width, mCinfo.output_height, scale, mCinfo.input_scan_number,
+              numPreviews, firstPreviewTime, HAL_GetTick() - startTime);
+      }
+    }
+
+  jpeg_destroy_decompress (&mCinfo);
+  f_close (file);
+  vPortFree (file);
+
+  // sequential, nothing to refine
+  return progressive ? tile : swJpegDecode (fileName, size, dither);
+  }
+//}}}
+//{{{
+bool jpegIndex (const string& fileName, sJpegIndex& index) {
+// marker walk to SOS keeping the decode tables, then one pass over the entropy coded data for its RSTn markers
+// - huffman sequential, one scan interleaving every component, DRI, else no restarts, roi decodes run from the top
+// - a single component image only with 1x1 sampling, its iMCU row is then one mcu row
+
+  index = sJpegIndex();
+
+  FIL* file = (FIL*)pvPortMalloc (sizeof (FIL));
+  if (f_open (file, fileName.c_str(), FA_READ)) {
+    printf ("jpegIndex %s open fail\n", fileName.c_str());
+    vPortFree (file);
+    return false;
+    }
+
+  //{{{  marker walk, keep all but APPn, except adobe APP14, and COM
+  int numComponents = 0;
+  int maxH = 1;
+  int maxV = 1;
+  FSIZE_t scanStart = 0;
+
+  uint8_t marker[4];
+  FSIZE_t pos = 2;
+  if (readAt (file, 0, marker, 2) && (marker[0] == 0xFF) && (marker[1] == 0xD8)) {
+    index.mHeader.assign (marker, marker + 2);
+    while (!scanStart && readAt (file, pos, marker, 4)) {
+      if (marker[0] != 0xFF)
+        break;
+      if (marker[1] == 0xFF) {
+        // fill byte
+        pos++;
+        continue;
+        }
+
+      uint8_t type = marker[1];
+      uint32_t length = (marker[2] << 8) | marker[3];
+      if ((type == 0xD9) || ((type >= 0xD0) && (type <= 0xD7)) || (length < 2))
+        break;
+
+      if (!(((type & 0xF0) == 0xE0) && (type != 0xEE)) && (type != 0xFE)) {
+        size_t start = index.mHeader.size();
+        index.mHeader.resize (start + 2 + length);
+        if (!readAt (file, pos, &index.mHeader[start], 2 + length))
+          break;
+
+        const uint8_t* segment = &index.mHeader[start + 4];
+        if ((type == 0xC0) || (type == 0xC1)) {
+          numComponents = segment[5];
+          if (length < 8 + (3 * uint32_t(numComponents)))
+            break;
+          index.mSofHeight = uint32_t(start + 5);
+          index.mHeight = (segment[1] << 8) | segment[2];
+          index.mWidth = (segment[3] << 8) | segment[4];
+          for (int c = 0; c < numComponents; c++) {
+            int h = segment[7 + (c * 3)] >> 4;
+            int v = segment[7 + (c * 3)] & 0xF;
+            maxH = h > maxH ? h : maxH;
+            maxV = v > maxV ? v : maxV;
+            }
+          }
+        else if ((type >= 0xC2) && (type <= 0xCF) && (type != 0xC4) && (type != 0xC8) && (type != 0xCC))
+          // progressive, lossless, arithmetic
+          break;
+        else if ((type == 0xDD) && (length >= 4))
+          index.mRestartInterval = (segment[0] << 8) | segment[1];
+        else if (type == 0xDA) {
+          if (!numComponents || (segment[0] != numComponents))
+            // a scan per component, an interval is part of one component
+            break;
+          scanStart = pos + 2 + length;
+          }
+        }
+
+      pos += 2 + length;
+      }
+    }
+  //}}}
+
+  if (scanStart && index.mRestartInterval && ((numComponents > 1) || ((maxH == 1) && (maxV == 1)))) {
+    //{{{  RSTn pass, keep intervals starting an mcu row
+    uint32_t mcuWidth = maxH * DCTSIZE;
+    index.mMcuHeight = maxV * DCTSIZE;
+    index.mMcusPerRow = (index.mWidth + mcuWidth - 1) / mcuWidth;
+    uint32_t mcuRows = (index.mHeight + index.mMcuHeight - 1) / index.mMcuHeight;
+
+    auto buffer = (uint8_t*)pvPortMalloc (kSourceBufferSize);
+    uint32_t interval = 0;
+    bool prevFF = false;
+    bool done = false;
+    FSIZE_t offset = scanStart;
+    f_lseek (file, offset);
+    while (buffer && !done) {
+      // whole sectors from the first buffer boundary, as fillInputBuffer
+      UINT bytesRead = 0;
+      f_read (file, buffer, UINT(kSourceBufferSize - (offset & (kSourceBufferSize - 1))), &bytesRead);
+      if (!bytesRead)
+        break;
+
+      for (UINT i = 0; (i < bytesRead) && !done; i++) {
+        uint8_t value = buffer[i];
+        if (prevFF) {
+          if ((value & 0xF8) == 0xD0) {
+            if ((value & 7) != (interval & 7)) {
+              printf ("jpegIndex %s RST%d expected RST%d\n", fileName.c_str(), value & 7, interval & 7);
+              index.mRestarts.clear();
+              done = true;
+              }
+            interval++;
+            uint32_t mcu = interval * index.mRestartInterval;
+            if (!(mcu % index.mMcusPerRow) && (mcu / index.mMcusPerRow < mcuRows))
+              index.mRestarts.push_back ({ uint16_t(mcu / index.mMcusPerRow), uint8_t(interval & 7), uint32_t(offset + i + 1) });
+            }
+          else if ((value != 0x00) && (value != 0xFF))
+            // EOI, or the next marker
+            done = true;
+          }
+        prevFF = value == 0xFF;
+        }
+      offset += bytesRead;
+      }
+    vPortFree (buffer);
+    }
+    //}}}
+
+  f_close (file);
+  vPortFree (file);
+  return !index.mRestarts.empty();
+  }
+//}}}
+//{{{
+cTile* swJpegDecodeRoi (const string& fileName, const cRect& roi, const cPoint& size, bool dither, const sJpegIndex* index) {
+// roi in image pixels, at the dct scale covering size, rgb565 straight into the tile rows
+// - rows above the roi are entropy decoded only, no idct or colour conversion
+// - columns outside the roi, bar a block of upsampling context, are not idct'd or converted
+// - stops after the roi's last row, destroy aborts the rest
+// - with an index, the stream starts at the last restart interval beginning an mcu row above the roi,
+//   the index header with its SOF height cut down, then the file from that interval, its RSTn renumbered from RST0
+
+  cTile* tile = nullptr;
+
+  FIL* file = (FIL*)pvPortMalloc (sizeof (FIL));
+  if (f_open (file, fileName.c_str(), FA_READ))
+    printf ("swJpegDecodeRoi %s open fail\n", fileName.c_str());
+  else {
+    uint32_t startTime = HAL_GetTick();
+
+    struct jpeg_error_mgr jerr;
+    struct jpeg_decompress_struct mCinfo;
+    mCinfo.err = jpeg_std_error (&jerr);
+    jpeg_create_decompress (&mCinfo);
+    jpegFatFsSrc (&mCinfo, file, f_size (file));
+
+    //{{{  restart jump
+    uint32_t skipRows = 0;
+    const sJpegIndex::sRestart* jump = nullptr;
+    if (index && !index->mRestarts.empty() && (roi.top > 0)) {
+      // an mcu row of margin for the upsampling context
+      uint32_t roiRow = roi.top / index->mMcuHeight;
+      roiRow = roiRow ? roiRow - 1 : 0;
+      for (auto& restart : index->mRestarts) {
+        if (restart.mMcuRow > roiRow)
+          break;
+        jump = &restart;
+        }
+      }
+
+    if (jump) {
+      skipRows = jump->mMcuRow * index->mMcuHeight;
+      uint32_t height = index->mHeight - skipRows;
+
+      auto header = (JOCTET*)(*mCinfo.mem->alloc_small) ((j_common_ptr)&mCinfo, JPOOL_PERMANENT, index->mHeader.size());
+      memcpy (header, index->mHeader.data(), index->mHeader.size());
+      header[index->mSofHeight] = uint8_t(height >> 8);
+      header[index->mSofHeight + 1] = uint8_t(height);
+
+      auto source = (sFatFsSource*)mCinfo.src;
+      source->mPrefix = header;
+      source->mPrefixSize = index->mHeader.size();
+      source->mRstBase = jump->mRstNum;
+      f_lseek (file, jump->mOffset);
+      }
+    //}}}
+    jpeg_read_header (&mCinfo, TRUE);
+
+    // roi in the stream's pixels, clipped to it
+    uint32_t left = roi.left > 0 ? roi.left : 0;
+    uint32_t right = (uint32_t)roi.right < mCinfo.image_width ? roi.right : mCinfo.image_width;
+    uint32_t top = (uint32_t)roi.top > skipRows ? roi.top - skipRows : 0;
+    uint32_t bottom = (uint32_t)roi.bottom > skipRows ? roi.bottom - skipRows : 0;
+    bottom = bottom < mCinfo.image_height ? bottom : mCinfo.image_height;
+
+    if ((right <= left) || (bottom <= top))
+      printf ("swJpegDecodeRoi %s roi outside image\n", fileName.c_str());
+    else if ((mCinfo.jpeg_color_space != JCS_YCbCr) && (mCinfo.jpeg_color_space != JCS_RGB) &&
+             (mCinfo.jpeg_color_space != JCS_GRAYSCALE))
+      printf ("swJpegDecodeRoi %s colour space %d unsupported\n", fileName.c_str(), mCinfo.jpeg_color_space);
+    else {
+      int scale = jpegScale (&mCinfo, right - left, bottom - top, size);
+      mCinfo.dct_method = JDCT_ISLOW;
+      mCinfo.out_color_space = JCS_RGB;
+      jpegMerged (&mCinfo);
+      jpeg_start_decompress (&mCinfo);
+      jpegSimdIdct (&mCinfo);
+      jpegRoiIdct (&mCinfo, left, right, top);
+
+      // output pixels, rounded as jpeg_calc_output_dimensions
+      JDIMENSION outLeft = (left * scale) / 8;
+      JDIMENSION outRight = ((right * scale) + 7) / 8;
+      outRight = outRight < mCinfo.output_width ? outRight : mCinfo.output_width;
+      JDIMENSION outTop = (top * scale) / 8;
+      JDIMENSION outBottom = ((bottom * scale) + 7) / 8;
+      outBottom = outBottom < mCinfo.output_height ? outBottom : mCinfo.output_height;
+
+      uint32_t pitch = (outRight - outLeft) * 2;
+      auto rgb565Pic = (uint8_t*)sdRamAlloc (pitch * (outBottom - outTop), "swJpegRoi565");
+      if (rgb565Pic) {
+        tile = new cTile (rgb565Pic, cTile::eRgb565, outRight - outLeft, 0,0, outRight - outLeft, outBottom - outTop);
+        jpegRgb565 (&mCinfo, rgb565Pic, pitch, dither);
+        auto convert = (sRgb565Convert*)mCinfo.client_data;
+        convert->mFirstCol = outLeft;
+        convert->mLastCol = outRight;
+
+        JSAMPROW rows[kMaxOutRows];
+        while (mCinfo.output_scanline < outBottom) {
+          // batches stay above or inside the roi
+          convert->mSkip = mCinfo.output_scanline < outTop;
+          int numRows = (convert->mSkip ? outTop : outBottom) - mCinfo.output_scanline;
+          numRows = numRows > mCinfo.rec_outbuf_height ? mCinfo.rec_outbuf_height : numRows;
+          numRows = numRows > kMaxOutRows ? kMaxOutRows : numRows;
+          for (int row = 0; row < numRows; row++)
+            rows[row] = convert->mSkip ? rgb565Pic : rgb565Pic + ((mCinfo.output_scanline + row - outTop) * pitch);
+          jpeg_read_scanlines (&mCinfo, rows, numRows);
+          }
+
+        printf ("swJpegDecodeRoi %dx%d scale %d/8 from row %d took %dms\n",
+                outRight - outLeft, outBottom - outTop, scale, skipRows, HAL_GetTick() - startTime);
+        }
+      else
+        printf ("swJpegDecodeRoi %s rgb565pic alloc fail\n", fileName.c_str());
+      }
+
+    jpeg_destroy_decompress (&mCinfo);
+    f_close (file);
+    }
+  vPortFree (file);
+
+  return tile;
+  }
+//}}}
+//{{{
+cTile* swJpegDecodeParallel (const string& fileName, const cPoint& size, bool dither, int threads, const sJpegIndex* index) {
+// restart intervals decoded by worker tasks, each its own jpeg object, entropy state and tile rows, same pixels as swJpegDecode
+// - bands start at the jpegIndex restarts, intervals beginning an mcu row, roughly mcuRows / bands apart
+// - each band also decodes the interval above it for the upsampling context, its rows not converted
+// - the file is read once into sdRam, FatFs stays with the calling task, the workers read memory
+// - jmemArena has one owner, it is off while the workers run, they allocate from the heap
+// - no restarts, or one thread, is swJpegDecode
+
+  sJpegIndex fileIndex;
+  if (!index) {
+    jpegIndex (fileName, fileIndex);
+    index = &fileIndex;
+    }
+
+  threads = threads < kMaxDecodeThreads ? threads : kMaxDecodeThreads;
+  if ((threads <= 1) || index->mRestarts.empty())
+    return swJpegDecode (fileName, size, dither);
+
+  //{{{  bands
+  uint32_t mcuRows = (index->mHeight + index->mMcuHeight - 1) / index->mMcuHeight;
+  uint32_t numBands = threads * kBandsPerThread;
+
+  vector<sJpegBand> bands;
+  sJpegBand band = { 0, 0, 0, 0, 0 };
+  const sJpegIndex::sRestart* prev = nullptr;
+  for (auto& restart : index->mRestarts) {
+    if (restart.mMcuRow >= ((bands.size() + 1) * mcuRows) / numBands) {
+      band.mLastRow = restart.mMcuRow - 1;
+      bands.push_back (band);
+
+      // from the interval above, or the file from its SOI
+      band.mStartRow = prev ? prev->mMcuRow : 0;
+      band.mRstNum = prev ? prev->mRstNum : 0;
+      band.mOffset = prev ? prev->mOffset : 0;
+      band.mFirstRow = restart.mMcuRow;
+      }
+    prev = &restart;
+    }
+  band.mLastRow = mcuRows - 1;
+  bands.push_back (band);
+  //}}}
+  if (bands.size() < 2)
+    return swJpegDecode (fileName, size, dither);
+  threads = (size_t)threads < bands.size() ? threads : (int)bands.size();
+
+  //{{{  read file
+  uint8_t* fileBuf = nullptr;
+  uint32_t fileSize = 0;
+
+  FIL* file = (FIL*)pvPortMalloc (sizeof (FIL));
+  if (f_open (file, fileName.c_str(), FA_READ))
+    printf ("swJpegDecodeParallel %s open fail\n", fileName.c_str());
+  else {
+    fileSize = (uint32_t)f_size (file);
+    fileBuf = sdRamAlloc (fileSize, "swJpegFile");
+    UINT bytesRead = 0;
+    if (fileBuf && (f_read (file, fileBuf, fileSize, &bytesRead) || (bytesRead != fileSize))) {
+      printf ("swJpegDecodeParallel %s read fail\n", fileName.c_str());
+      sdRamFree (fileBuf);
+      fileBuf = nullptr;
+      }
+    f_close (file);
+    }
+  vPortFree (file);
+  //}}}
+  if (!fileBuf)
+    return nullptr;
+
+  printf ("swJpegDecodeParallel %s start decoding\n", fileName.c_str());
+  uint32_t startTime = HAL_GetTick();
+
+  cTile* tile = nullptr;
+  sJpegParallel parallel = { index, fileBuf, fileSize, 0, dither, nullptr, 0, 0, nullptr, nullptr };
+
+  //{{{  header, scale and output size
+  struct jpeg_error_mgr jerr;
+  struct jpeg_decompress_struct mCinfo;
+  mCinfo.err = jpeg_std_error (&jerr);
+  jpeg_create_decompress (&mCinfo);
+  jpegMemorySrc (&mCinfo, nullptr, 0, fileBuf, fileSize);
+  jpeg_read_header (&mCinfo, TRUE);
+
+  JDIMENSION outputWidth = 0;
+  if ((mCinfo.jpeg_color_space != JCS_YCbCr) && (mCinfo.jpeg_color_space != JCS_RGB) &&
+      (mCinfo.jpeg_color_space != JCS_GRAYSCALE))
+    printf ("swJpegDecodeParallel %s colour space %d unsupported\n", fileName.c_str(), mCinfo.jpeg_color_space);
+  else {
+    parallel.mScale = jpegScale (&mCinfo, mCinfo.image_width, mCinfo.image_height, size);
+    jpeg_calc_output_dimensions (&mCinfo);
+    outputWidth = mCinfo.output_width;
+    parallel.mOutputHeight = mCinfo.output_height;
+    }
+
+  jpeg_destroy_decompress (&mCinfo);
+  //}}}
+  if (outputWidth) {
+    parallel.mPitch = outputWidth * 2;
+    parallel.mPiccy = (uint8_t*)sdRamAlloc (parallel.mPitch * parallel.mOutputHeight, "swJpegPic565");
+    if (parallel.mPiccy) {
+      tile = new cTile (parallel.mPiccy, cTile::eRgb565, outputWidth, 0,0, outputWidth, parallel.mOutputHeight);
+
+      parallel.mBandQueue = xQueueCreate (bands.size(), sizeof (sJpegBand));
+      parallel.mDoneQueue = xQueueCreate (threads, sizeof (int));
+      for (size_t i = 0; i < bands.size(); i++)
+        xQueueSend (parallel.mBandQueue, &bands[i], 0);
+
+      // kernels chosen once before the workers share them
+      jpegKernels();
+      bool arenaEnabled = jpegArenaEnable (false);
+
+      int started = 0;
+      for (int i = 0; i < threads; i++)
+        if (xTaskCreate ((TaskFunction_t)decodeWorker, "jpegWorker", kWorkerStackDepth, &parallel, kWorkerPriority, nullptr) == pdPASS)
+          started++;
+        else
+          printf ("swJpegDecodeParallel worker task fail\n");
+
+      if (!started)
+        // no workers, decode the bands here
+        while (xQueueReceive (parallel.mBandQueue, &band, 0))
+          decodeBand (&parallel, band);
+
+      int done;
+      for (int i = 0; i < started; i++)
+        xQueueReceive (parallel.mDoneQueue, &done, portMAX_DELAY);
+
+      jpegArenaEnable (arenaEnabled);
+      vQueueDelete (parallel.mBandQueue);
+      vQueueDelete (parallel.mDoneQueue);
+
+      printf ("swJpegDecodeParallel %dx%d scale %d/8 %d bands %d threads took %dms\n",
+              outputWidth, parallel.mOutputHeight, parallel.mScale, (int)bands.size(), started, HAL_GetTick() - startTime);
+      }
+    else
+      printf ("swJpegDecodeParallel %s rgb565pic alloc fail\n", fileName.c_str());
+    }
+
+  sdRamFree (fileBuf);
+  return tile;
+  }
+//}}}